@@ -0,0 +1,256 @@
+/// \file claim_index.cpp
+/// Shared memory index of entries that one process produces and other processes then reuse.
+
+#include "claim_index.h"
+#include "defines.h"
+#include "procs.h"
+#include "timing.h"
+#include <fcntl.h>
+#include <limits.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
+
+namespace IPC{
+
+  claimIndex::claimIndex(){
+    hits = misses = 0;
+    wakeup = 0;
+    busyWakeup = 0;
+  }
+
+  claimIndex::~claimIndex(){close();}
+
+  /// Opens the index in the shared memory page with the given name and size, guarded by the given
+  /// semaphore. If create is true, the index is created if it does not exist yet.
+  /// Returns true if the index could be opened.
+  bool claimIndex::openIndex(const char *name, size_t len, const char *semName, bool create){
+    close();
+    page.init(name, len, false, false);
+    if (!page.mapped && !create){return false;}
+    sem.open(semName, O_CREAT | O_RDWR, ACCESSPERMS, 1);
+    if (!sem){
+      close();
+      return false;
+    }
+    if (!page.mapped){
+      IPC::semGuard G(&sem);
+      // Check again now that we hold the lock, someone else may have been faster
+      page.init(name, len, false, false);
+      if (!page.mapped){
+        page.init(name, len, true, false);
+        if (!page.mapped){
+          WARN_MSG("Could not create shared index %s", name);
+          return false;
+        }
+        memset(page.mapped, 0, CLAIMIDX_HEADER);
+        Util::RelAccX A(page.mapped + CLAIMIDX_HEADER, false);
+        A.addField("key", RAX_64UINT);
+        A.addField("pid", RAX_32UINT);
+        A.addField("status", RAX_UINT);
+        addFields(A);
+        A.setRCount((len - CLAIMIDX_HEADER - A.getOffset()) / A.getRSize());
+        A.setReady();
+        page.master = false;
+      }
+    }
+    wakeup = (volatile uint32_t *)page.mapped;
+    hits = (uint64_t *)(page.mapped + 8);
+    misses = (uint64_t *)(page.mapped + 16);
+    accX = Util::RelAccX(page.mapped + CLAIMIDX_HEADER);
+    keyField = accX.getFieldData("key");
+    pidField = accX.getFieldData("pid");
+    statusField = accX.getFieldData("status");
+    mapFields();
+    return true;
+  }
+
+  claimIndex::operator bool() const{return page.mapped;}
+
+  void claimIndex::close(){
+    hits = misses = 0;
+    wakeup = 0;
+    accX = Util::RelAccX();
+    page.close();
+    sem.close();
+  }
+
+  uint64_t claimIndex::getHits() const{return hits ? *hits : 0;}
+
+  uint64_t claimIndex::getMisses() const{return misses ? *misses : 0;}
+
+  /// Returns the amount of entries currently in the index, including those being produced.
+  size_t claimIndex::getCount() const{
+    if (!page.mapped){return 0;}
+    size_t ret = 0;
+    for (size_t i = accX.getDeleted(); i < accX.getEndPos(); ++i){
+      if (accX.getInt(statusField, i) != CLAIMIDX_NONE){++ret;}
+    }
+    return ret;
+  }
+
+  /// Returns a pointer to one of the CLAIMIDX_COUNTERS counters for use by the derived class.
+  uint64_t *claimIndex::counter(size_t num) const{return (uint64_t *)(page.mapped + 24 + num * 8);}
+
+  /// Returns true if the given published entry should no longer be used.
+  /// Entries never expire by default.
+  bool claimIndex::isExpired(size_t rec) const{return false;}
+
+  /// Called right before an entry is removed from the index, while holding the lock.
+  /// Does nothing by default.
+  void claimIndex::onRemove(size_t rec){}
+
+  /// Returns the record number of the newest live entry for the given key, or
+  /// INVALID_RECORD_INDEX if there is none. Must be called while holding the lock.
+  size_t claimIndex::find(uint64_t key) const{
+    for (size_t i = accX.getEndPos(); i > accX.getDeleted(); --i){
+      if (accX.getInt(keyField, i - 1) == key && accX.getInt(statusField, i - 1) != CLAIMIDX_NONE){
+        return i - 1;
+      }
+    }
+    return INVALID_RECORD_INDEX;
+  }
+
+  /// Returns the record number of the claim the calling process holds on the given key, or
+  /// INVALID_RECORD_INDEX if it holds none. Must be called while holding the lock.
+  size_t claimIndex::findClaim(uint64_t key) const{
+    size_t rec = find(key);
+    if (rec == INVALID_RECORD_INDEX || accX.getInt(statusField, rec) != CLAIMIDX_CLAIMED ||
+        accX.getInt(pidField, rec) != (uint64_t)getpid()){
+      return INVALID_RECORD_INDEX;
+    }
+    return rec;
+  }
+
+  /// Looks up the entry with the given key. Must be called while holding the lock.
+  /// Returns CLAIMIDX_READY (and sets rec) if it is available, CLAIMIDX_BUSY if another process is
+  /// producing it, or CLAIMIDX_CLAIMED (and sets rec) if it was not available and is now reserved
+  /// for the calling process to produce. The caller then fills in its own fields of rec, and later
+  /// marks it ready with setReady() or gives up on it with abandon().
+  uint8_t claimIndex::claimEntry(uint64_t key, size_t &rec){
+    rec = find(key);
+    if (rec != INVALID_RECORD_INDEX){
+      uint8_t status = accX.getInt(statusField, rec);
+      if (status == CLAIMIDX_READY && !isExpired(rec)){return CLAIMIDX_READY;}
+      if (status == CLAIMIDX_CLAIMED && Util::Procs::isRunning(accX.getInt(pidField, rec))){
+        busyWakeup = *wakeup;
+        return CLAIMIDX_BUSY;
+      }
+      // Expired, or whoever was producing this entry went away without finishing it
+      removeEntry(rec);
+    }
+    trimFront();
+    // Make room if the ring is full
+    if (accX.getEndPos() - accX.getDeleted() >= accX.getRCount()){
+      removeEntry(accX.getDeleted());
+      trimFront();
+    }
+    rec = accX.getEndPos();
+    accX.setInt(keyField, key, rec);
+    accX.setInt(pidField, getpid(), rec);
+    accX.setInt(statusField, CLAIMIDX_CLAIMED, rec);
+    accX.addRecords(1);
+    ++(*misses);
+    return CLAIMIDX_CLAIMED;
+  }
+
+  /// Marks an entry the calling process claimed as available to everyone, and wakes up the
+  /// processes waiting for it. Must be called while holding the lock.
+  void claimIndex::setReady(size_t rec){
+    accX.setInt(statusField, CLAIMIDX_READY, rec);
+    wakeAll();
+  }
+
+  /// Removes the given entry. Processes waiting for it are woken up, so one of them can claim it
+  /// instead. Must be called while holding the lock.
+  void claimIndex::removeEntry(size_t rec){
+    uint8_t status = accX.getInt(statusField, rec);
+    if (status == CLAIMIDX_NONE){return;}
+    onRemove(rec);
+    accX.setInt(statusField, CLAIMIDX_NONE, rec);
+    if (status == CLAIMIDX_CLAIMED){wakeAll();}
+  }
+
+  /// Drops removed and expired entries from the front of the ring, freeing up space for new ones.
+  /// Must be called while holding the lock.
+  void claimIndex::trimFront(){
+    while (accX.getDeleted() < accX.getEndPos()){
+      size_t rec = accX.getDeleted();
+      uint8_t status = accX.getInt(statusField, rec);
+      if (status == CLAIMIDX_READY && isExpired(rec)){
+        removeEntry(rec);
+        status = CLAIMIDX_NONE;
+      }
+      if (status != CLAIMIDX_NONE){break;}
+      accX.deleteRecords(1);
+    }
+  }
+
+  /// Releases the claim the calling process holds on the given key, without publishing it.
+  void claimIndex::abandon(uint64_t key){
+    if (!page.mapped){return;}
+    IPC::semGuard G(&sem);
+    size_t rec = findClaim(key);
+    if (rec == INVALID_RECORD_INDEX){return;}
+    removeEntry(rec);
+    trimFront();
+  }
+
+  /// Sleeps until a claim in the index ends, after a claim returned CLAIMIDX_BUSY.
+  /// Wakes up at least every CLAIMIDX_WAKE_CHECK ms, so claims of processes that went away are
+  /// noticed as well. Returns false without waiting once the bootMS() time until has passed.
+  bool claimIndex::await(uint64_t until){
+    uint64_t now = Util::bootMS();
+    if (!wakeup || now >= until){return false;}
+    uint64_t ms = until - now;
+    if (ms > CLAIMIDX_WAKE_CHECK){ms = CLAIMIDX_WAKE_CHECK;}
+#ifdef __linux__
+    struct timespec timeout;
+    timeout.tv_sec = ms / 1000;
+    timeout.tv_nsec = (ms % 1000) * 1000000;
+    syscall(SYS_futex, (uint32_t *)wakeup, FUTEX_WAIT, busyWakeup, &timeout, 0, 0);
+#else
+    // Without futexes, check for a change in short intervals
+    while (*wakeup == busyWakeup && ms){
+      uint64_t step = (ms < 10 ? ms : 10);
+      Util::sleep(step);
+      ms -= step;
+    }
+#endif
+    return true;
+  }
+
+  /// Wakes up all processes waiting in await(). Must be called while holding the lock.
+  void claimIndex::wakeAll(){
+    ++(*wakeup);
+#ifdef __linux__
+    syscall(SYS_futex, (uint32_t *)wakeup, FUTEX_WAKE, INT_MAX, 0, 0, 0);
+#endif
+  }
+
+  /// Counts a request that could not use the index, e.g. because waiting for another process took
+  /// too long.
+  void claimIndex::countMiss(){
+    if (!page.mapped){return;}
+    IPC::semGuard G(&sem);
+    ++(*misses);
+  }
+
+  /// Removes all entries as well as the index itself.
+  void claimIndex::clear(){
+    if (!page.mapped){return;}
+    {
+      IPC::semGuard G(&sem);
+      for (size_t i = accX.getDeleted(); i < accX.getEndPos(); ++i){removeEntry(i);}
+      page.master = true;
+    }
+    page.close();
+    sem.unlink();
+    close();
+  }
+
+}// namespace IPC
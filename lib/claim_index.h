@@ -0,0 +1,74 @@
+/// \file claim_index.h
+/// Shared memory index of entries that one process produces and other processes then reuse.
+
+#pragma once
+#include "shared_memory.h"
+#include "util.h"
+#include <string>
+
+#define CLAIMIDX_HEADER 64       ///< Bytes of counters before the index ring
+#define CLAIMIDX_COUNTERS 5      ///< Counters available to users of the index, see claimIndex::counter
+#define CLAIMIDX_WAKE_CHECK 500  ///< Max ms to wait for a wakeup before checking on the claiming process again
+
+// Entry states, also used as return values for claimIndex::claimEntry
+#define CLAIMIDX_NONE 0    ///< Entry was removed
+#define CLAIMIDX_BUSY 1    ///< Only returned by claimEntry: another process is producing the entry
+#define CLAIMIDX_READY 2   ///< Entry was published and can be used
+#define CLAIMIDX_CLAIMED 3 ///< Entry is being produced by the process in the pid field
+
+namespace IPC{
+
+  /// Index of entries with a 64-bit key. The first process to ask for a key claims it and
+  /// produces the entry, while other processes asking for the same key sleep until it is
+  /// published or abandoned, and then use it instead of producing it themselves.
+  ///
+  /// The index is a shared memory page. It starts with a wakeup word, the hit and miss counts and
+  /// CLAIMIDX_COUNTERS more counters, followed by a RelAccX ring buffer with a key, pid and status
+  /// field per entry, plus whatever fields the derived class adds. All changes are made while
+  /// holding the index semaphore. Waiting processes sleep on the wakeup word (a futex on Linux),
+  /// which is bumped every time a claim ends.
+  class claimIndex{
+  public:
+    claimIndex();
+    virtual ~claimIndex();
+    operator bool() const;
+    void close();
+    uint64_t getHits() const;
+    uint64_t getMisses() const;
+    size_t getCount() const;
+    void abandon(uint64_t key);
+    bool await(uint64_t until);
+    void countMiss();
+    void clear();
+
+  protected:
+    bool openIndex(const char *name, size_t len, const char *semName, bool create);
+    /// Adds the fields of the derived class to a newly created index.
+    virtual void addFields(Util::RelAccX &A) = 0;
+    /// Looks up the fields of the derived class, after the index was opened.
+    virtual void mapFields() = 0;
+    virtual bool isExpired(size_t rec) const;
+    virtual void onRemove(size_t rec);
+    uint64_t *counter(size_t num) const;
+    uint8_t claimEntry(uint64_t key, size_t &rec);
+    size_t findClaim(uint64_t key) const;
+    void setReady(size_t rec);
+    void removeEntry(size_t rec);
+    void trimFront();
+    IPC::sharedPage page;
+    IPC::semaphore sem;
+    Util::RelAccX accX;
+    uint64_t *hits;
+    uint64_t *misses;
+    Util::RelAccXFieldData keyField;
+    Util::RelAccXFieldData pidField;
+    Util::RelAccXFieldData statusField;
+
+  private:
+    size_t find(uint64_t key) const;
+    void wakeAll();
+    volatile uint32_t *wakeup;
+    uint32_t busyWakeup; ///< Value of the wakeup word when claimEntry last returned CLAIMIDX_BUSY
+  };
+
+}// namespace IPC
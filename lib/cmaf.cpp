@@ -127,8 +127,8 @@ namespace CMAF{
     header.write(moovBox.asBox(), moovBox.boxedSize());
 
     if (M.getVod()){
-      DTSC::Fragments fragments(M.fragments(track));
-      DTSC::Keys keys(M.keys(track));
+      DTSC::Fragments fragments(M.getFragments(track));
+      DTSC::Keys keys(M.getKeys(track));
       DTSC::Parts parts(M.parts(track));
 
       MP4::SIDX sidxBox;
@@ -173,8 +173,8 @@ namespace CMAF{
   size_t keyHeaderSize(const DTSC::Meta &M, size_t track, size_t fragment){
     uint64_t tmpRes = 8 + 16 + 32 + 20;
 
-    DTSC::Fragments fragments(M.fragments(track));
-    DTSC::Keys keys(M.keys(track));
+    DTSC::Fragments fragments(M.getFragments(track));
+    DTSC::Keys keys(M.getKeys(track));
     DTSC::Parts parts(M.parts(track));
 
     size_t firstKey = fragments.getFirstKey(fragment);
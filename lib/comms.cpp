@@ -313,7 +313,7 @@ namespace Comms{
 
   /// \brief Claims a spot on the connections page for the input/output which calls this function
   ///        Starts the MistSession binary for each session, which handles the statistics
-  ///         and the USER_NEW and USER_END triggers
+  ///         and the USER_NEW and USER_END triggers, or hands the session to the session manager if one is running
   /// \param streamName: Name of the stream the input is providing or an output is making available to viewers
   /// \param ip: IP address of the viewer which wants to access streamName. For inputs this value can be set to any value
   /// \param tkn: Session token given by the player or randomly generated
@@ -359,48 +359,52 @@ namespace Comms{
       if (!dataPage){
         std::string host;
         Socket::hostBytesToStr(ip.data(), ip.size(), host);
-        pid_t thisPid;
-        std::deque<std::string> args;
-        args.push_back(Util::getMyPath() + "MistSession");
-        args.push_back(sessionId);
-
-        // First bit defines whether to include stream name
-        if (sessMode & 0x08){
-          args.push_back("--streamname");
-          args.push_back(streamName);
-        }else{
-          setenv("SESSION_STREAM", streamName.c_str(), 1);
-        }
-        // Second bit defines whether to include viewer ip
-        if (sessMode & 0x04){
-          args.push_back("--ip");
-          args.push_back(host);
-        }else{
-          setenv("SESSION_IP", host.c_str(), 1);
-        }
-        // Third bit defines whether to include tkn
-        if (sessMode & 0x02){
-          args.push_back("--tkn");
-          args.push_back(tkn);
-        }else{
-          setenv("SESSION_TKN", tkn.c_str(), 1);
+        // Hand the session over to the session manager if one is running
+        SessionRequests sessReq;
+        if (!sessReq.request(sessionId, streamName, host, tkn, protocol, reqUrl)){
+          pid_t thisPid;
+          std::deque<std::string> args;
+          args.push_back(Util::getMyPath() + "MistSession");
+          args.push_back(sessionId);
+
+          // First bit defines whether to include stream name
+          if (sessMode & 0x08){
+            args.push_back("--streamname");
+            args.push_back(streamName);
+          }else{
+            setenv("SESSION_STREAM", streamName.c_str(), 1);
+          }
+          // Second bit defines whether to include viewer ip
+          if (sessMode & 0x04){
+            args.push_back("--ip");
+            args.push_back(host);
+          }else{
+            setenv("SESSION_IP", host.c_str(), 1);
+          }
+          // Third bit defines whether to include tkn
+          if (sessMode & 0x02){
+            args.push_back("--tkn");
+            args.push_back(tkn);
+          }else{
+            setenv("SESSION_TKN", tkn.c_str(), 1);
+          }
+          // Fourth bit defines whether to include protocol
+          if (sessMode & 0x01){
+            args.push_back("--protocol");
+            args.push_back(protocol);
+          }else{
+            setenv("SESSION_PROTOCOL", protocol.c_str(), 1);
+          }
+          setenv("SESSION_REQURL", reqUrl.c_str(), 1);
+          int err = fileno(stderr);
+          thisPid = Util::Procs::StartPiped(args, 0, 0, &err);
+          Util::Procs::forget(thisPid);
+          unsetenv("SESSION_STREAM");
+          unsetenv("SESSION_IP");
+          unsetenv("SESSION_TKN");
+          unsetenv("SESSION_PROTOCOL");
+          unsetenv("SESSION_REQURL");
         }
-        // Fourth bit defines whether to include protocol
-        if (sessMode & 0x01){
-          args.push_back("--protocol");
-          args.push_back(protocol);
-        }else{
-          setenv("SESSION_PROTOCOL", protocol.c_str(), 1);
-        }
-        setenv("SESSION_REQURL", reqUrl.c_str(), 1);
-        int err = fileno(stderr);
-        thisPid = Util::Procs::StartPiped(args, 0, 0, &err);
-        Util::Procs::forget(thisPid);
-        unsetenv("SESSION_STREAM");
-        unsetenv("SESSION_IP");
-        unsetenv("SESSION_TKN");
-        unsetenv("SESSION_PROTOCOL");
-        unsetenv("SESSION_REQURL");
       }
     }
     reload(sessionId, _master, reIssue);
@@ -638,4 +642,85 @@ namespace Comms{
     VERYHIGH_MSG("%s", debugMsg.c_str());
     return Secure::sha256(concat.c_str(), concat.length());
   }
+
+  SessionRequests::SessionRequests() : Comms(){}
+
+  void SessionRequests::reload(bool _master, bool reIssue){
+    if (!sem){sem.open(SEM_SESSREQ, O_CREAT | O_RDWR, ACCESSPERMS, 1);}
+    Comms::reload(COMMS_SESSREQ, COMMS_SESSREQ_INITSIZE, _master, reIssue);
+  }
+
+  /// \brief Queues a new session for the session manager
+  /// \return True if the request was queued. False if no session manager is running, the queue is
+  /// full or one of the values is too long to store without truncating the trigger payloads. In
+  /// that case the caller should start a MistSession process for the session itself.
+  bool SessionRequests::request(const std::string &_sessId, const std::string &_stream, const std::string &_host,
+                                const std::string &_tkn, const std::string &_protocol, const std::string &_reqUrl){
+    if (_sessId.size() >= 80 || _stream.size() >= 100 || _host.size() >= 64 || _tkn.size() >= 256 ||
+        _protocol.size() >= 64 || _reqUrl.size() >= 1024){
+      return false;
+    }
+    // Check for a running manager first, without waiting for its page to appear
+    dataPage.init(COMMS_SESSREQ, 0, false, false);
+    if (!dataPage){return false;}
+    dataAccX = Util::RelAccX(dataPage.mapped, false);
+    if (!dataAccX.isReady() || dataAccX.isExit()){
+      dataPage.close();
+      return false;
+    }
+    fieldAccess();
+    if (status.uint(0) == COMM_STATUS_INVALID || !Util::Procs::isRunning(pid.uint(0))){
+      dataPage.close();
+      return false;
+    }
+    reload(false, true);
+    if (!*this){return false;}
+    sessId.set(_sessId, index);
+    stream.set(_stream, index);
+    host.set(_host, index);
+    tkn.set(_tkn, index);
+    protocol.set(_protocol, index);
+    reqUrl.set(_reqUrl, index);
+    // Marking the record as disconnected hands it over to the manager
+    setStatus(COMM_STATUS_DISCONNECT | getStatus());
+    index = INVALID_RECORD_INDEX;
+    return true;
+  }
+
+  void SessionRequests::addFields(){
+    Comms::addFields();
+    dataAccX.addField("sessid", RAX_STRING, 80);
+    dataAccX.addField("stream", RAX_STRING, 100);
+    dataAccX.addField("host", RAX_STRING, 64);
+    dataAccX.addField("tkn", RAX_STRING, 256);
+    dataAccX.addField("protocol", RAX_STRING, 64);
+    dataAccX.addField("requrl", RAX_STRING, 1024);
+  }
+
+  void SessionRequests::nullFields(){
+    Comms::nullFields();
+    sessId.set("", index);
+    stream.set("", index);
+    host.set("", index);
+    tkn.set("", index);
+    protocol.set("", index);
+    reqUrl.set("", index);
+  }
+
+  void SessionRequests::fieldAccess(){
+    Comms::fieldAccess();
+    sessId = dataAccX.getFieldAccX("sessid");
+    stream = dataAccX.getFieldAccX("stream");
+    host = dataAccX.getFieldAccX("host");
+    tkn = dataAccX.getFieldAccX("tkn");
+    protocol = dataAccX.getFieldAccX("protocol");
+    reqUrl = dataAccX.getFieldAccX("requrl");
+  }
+
+  std::string SessionRequests::getSessId(size_t idx) const{return (master ? sessId.string(idx) : "");}
+  std::string SessionRequests::getStream(size_t idx) const{return (master ? stream.string(idx) : "");}
+  std::string SessionRequests::getHost(size_t idx) const{return (master ? host.string(idx) : "");}
+  std::string SessionRequests::getTkn(size_t idx) const{return (master ? tkn.string(idx) : "");}
+  std::string SessionRequests::getProtocol(size_t idx) const{return (master ? protocol.string(idx) : "");}
+  std::string SessionRequests::getReqUrl(size_t idx) const{return (master ? reqUrl.string(idx) : "");}
 }// namespace Comms
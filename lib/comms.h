@@ -54,6 +54,8 @@ namespace Comms{
     void finishAll();
     void setMaster(bool _master);
     const std::string &pageName() const{return dataPage.name;}
+    uint64_t getIndex() const{return index;}
+    void setIndex(uint64_t _index){index = _index;}
 
   protected:
     bool master;
@@ -216,4 +218,34 @@ namespace Comms{
       void setTags(std::string _sid);
       void setTags(std::string _sid, size_t idx);
   };
+
+  /// Queue of new sessions for the session manager (MistSession --manager) to start tracking.
+  /// The first record belongs to the manager itself and holds its PID. Every other record is
+  /// claimed by an output, filled in and then marked as disconnected, which is the signal for the
+  /// manager to pick it up.
+  class SessionRequests : public Comms{
+  public:
+    SessionRequests();
+    void reload(bool _master = false, bool reIssue = false);
+    bool request(const std::string &sessId, const std::string &streamName, const std::string &ip,
+                 const std::string &tkn, const std::string &protocol, const std::string &reqUrl);
+    virtual void addFields();
+    virtual void nullFields();
+    virtual void fieldAccess();
+
+    std::string getSessId(size_t idx) const;
+    std::string getStream(size_t idx) const;
+    std::string getHost(size_t idx) const;
+    std::string getTkn(size_t idx) const;
+    std::string getProtocol(size_t idx) const;
+    std::string getReqUrl(size_t idx) const;
+
+  protected:
+    Util::FieldAccX sessId;
+    Util::FieldAccX stream;
+    Util::FieldAccX host;
+    Util::FieldAccX tkn;
+    Util::FieldAccX protocol;
+    Util::FieldAccX reqUrl;
+  };
 }// namespace Comms
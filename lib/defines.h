@@ -174,8 +174,8 @@ static inline void show_stackframe(){}
 #define DEFAULT_PAGE_TIMEOUT 15
 
 /// \TODO These values are hardcoded for now, but the dtsc_sizing_test binary can calculate them accurately.
-#define META_META_OFFSET 151
-#define META_META_RECORDSIZE 613
+#define META_META_OFFSET 163
+#define META_META_RECORDSIZE 621
 
 #define META_TRACK_OFFSET 148
 #define META_TRACK_RECORDSIZE 1893
@@ -204,6 +204,9 @@ static inline void show_stackframe(){}
 #define COMMS_SESSIONS "MstSession%s"
 #define COMMS_SESSIONS_INITSIZE 8 * 1024 * 1024
 
+#define COMMS_SESSREQ "MstSReq"
+#define COMMS_SESSREQ_INITSIZE 512 * 1024
+
 #define CUSTOM_VARIABLES_INITSIZE 64 * 1024
 
 #define EXTWRITERS "MstExtWriters"
@@ -217,6 +220,7 @@ static inline void show_stackframe(){}
 // End new meta
 
 #define INPUT_USER_INTERVAL 250
+#define INPUT_BUFFER_WORKERS 4 // Max amount of worker processes buffering VoD pages in parallel
 
 #define SHM_STREAM_STATE "MstSTATE%s" //%s stream name
 #define SHM_STREAM_CONF "MstSCnf%s"   //%s stream name
@@ -233,11 +237,15 @@ static inline void show_stackframe(){}
 #define STRMSTAT_LEN 3
 
 #define SHM_TRIGGER "MstTRGR%s" //%s trigger name
+#define SHM_TRIGCACHE "MstTCch%s" //%s trigger name
+#define SHM_TRIGCACHE_LEN 2 * 1024 * 1024
+#define SEM_TRIGCACHE "/MstTCch%s" //%s trigger name
 #define SEM_LIVE "/MstLIVE%s"   //%s stream name
 #define SEM_INPUT "/MstInpt%s"  //%s stream name
 #define SEM_TRACKLIST "/MstTRKS%s"  //%s stream name
 #define SEM_SESSION "/MstSess%s"
 #define SEM_SESSCACHE "/MstSessCacheLock"
+#define SEM_SESSREQ "/MstSReq"
 #define SESS_TIMEOUT 600 // Session timeout in seconds
 #define SHM_CAPA "MstCapa"
 #define SHM_PROTO "MstProt"
@@ -259,6 +267,11 @@ static inline void show_stackframe(){}
 
 #define SHM_STREAM_ENCRYPT "MstCRYP%s" //%s stream name
 
+#define SHM_SEGCACHE "MstSCch%s" //%s stream name
+#define SHM_SEGCACHE_LEN 64 * 1024
+#define SHM_SEGCACHE_DATA "MstSCdt%s@%016" PRIx64 //%s stream name, %PRIx64 segment key
+#define SEM_SEGCACHE "/MstSCch%s" //%s stream name
+
 #define SIMUL_TRACKS 40
 
 #ifndef UDP_API_HOST
@@ -293,6 +306,8 @@ static inline void show_stackframe(){}
 #define COMM_STATUS_DISCONNECT 0x20
 #define COMM_STATUS_REQDISCONNECT 0x10
 #define COMM_STATUS_NOKILL 0x8
+#define COMM_STATUS_RETRIGGER 0x4 // Session manager only: re-run USER_NEW for this session
+#define COMM_STATUS_MANAGED 0x2   // Session is tracked by the session manager, not its own process
 #define COMM_STATUS_ACTIVE 0x1
 #define COMM_STATUS_INVALID 0x0
 #define SESS_BUNDLE_DEFAULT_VIEWER 14
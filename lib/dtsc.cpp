@@ -12,14 +12,24 @@
 #include <arpa/inet.h> //for htonl/ntohl
 #include <cstdlib>
 #include <cstring>
+#include <fcntl.h>
 #include <fstream>
 #include <iomanip>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/// Largest packet that is used in place in a socket receive buffer. The buffer has to hold the whole
+/// packet at once, larger ones are copied out as they arrive.
+#define DTSC_INPLACE_MAX (16 * 1024 * 1024)
 
 namespace DTSC{
   char Magic_Header[] = "DTSC";
   char Magic_Packet[] = "DTPD";
   char Magic_Packet2[] = "DTP2";
   char Magic_Command[] = "DTCM";
+  char Magic_RawHeader[] = "DTSH";
+  char Magic_Mux[] = "DTMX";
 
   /// If non-zero, this variable will override any live jitter value calculations with the set value
   uint64_t veryUglyJitterOverride = 0;
@@ -129,35 +139,60 @@ namespace DTSC{
     }
   }
 
+  /// Waits for a complete packet on the given connection and copies it out of the receive buffer.
   void Packet::reInit(Socket::Connection &src){
+    uint32_t inBuffer = reInitInPlace(src);
+    if (inBuffer){
+      reInit(data, dataLen);
+      src.Received().skip(inBuffer);
+    }
+  }
+
+  /// Waits for a complete packet on the given connection and references it where it is in the
+  /// receive buffer, without copying it. Returns the amount of bytes the packet occupies there: the
+  /// caller skips those once done with the packet, and must not receive on the connection before.
+  /// Packets too large to be buffered whole are copied out as they arrive instead, and zero is
+  /// returned. Zero is also returned on errors and timeouts, which leave the packet null.
+  uint32_t Packet::reInitInPlace(Socket::Connection &src){
     int sleepCount = 0;
     null();
     Util::ResizeablePointer ptr;
     while (src.connected()){
-      if (!ptr.rsize() && src.Received().available(8)){
-        if (src.Received().copy(2) != "DT"){
+      const char *hdr = ptr.rsize() ? 0 : src.Received().peek(8);
+      if (hdr){
+        if (memcmp(hdr, "DT", 2)){
           WARN_MSG("Invalid DTSC Packet header encountered (%s)",
-                   Encodings::Hex::encode(src.Received().copy(4)).c_str());
+                   Encodings::Hex::encode(std::string(hdr, 4)).c_str());
           break;
         }
-        ptr.allocate(Bit::btohl(src.Received().copy(8).data() + 4) + 8);
+        uint32_t len = Bit::btohl(hdr + 4) + 8;
+        if (len <= DTSC_INPLACE_MAX){
+          const char *whole = src.Received().peek(len);
+          if (whole){
+            reInit(whole, len, true);
+            return len;
+          }
+        }else{
+          ptr.allocate(len);
+        }
       }
       unsigned int readable = src.Received().bytes(ptr.rsize() - ptr.size());
       if (ptr.rsize() && readable){
         src.Received().remove(ptr, readable);
         if (ptr.size() == ptr.rsize()){
           reInit(ptr, ptr.size());
-          return;
+          return 0;
         }
       }
       if (!src.spool()){
         if (sleepCount++ > 750){
           WARN_MSG("Waiting for packet on connection timed out");
-          return;
+          return 0;
         }
         Util::sleep(20);
       }
     }
+    return 0;
   }
 
   ///\brief Initializes a packet with new data
@@ -186,6 +221,11 @@ namespace DTSC{
     if (len <= 0){len = ntohl(((int *)data_)[1]) + 8;}
     // clear any existing controlled contents
     if (master && noCopy){null();}
+    // forget any referenced contents, they are not ours to resize
+    if (!master && !noCopy){
+      data = NULL;
+      bufferLen = 0;
+    }
     // set control flag to !noCopy
     master = !noCopy;
     // either copy the data, or only the pointer, depending on flag
@@ -891,11 +931,46 @@ namespace DTSC{
     }
   }
 
+  /// Returns the interned track type for the given type string.
+  trackType typeFromString(const std::string &type){
+    if (type == "video"){return TYPE_VIDEO;}
+    if (type == "audio"){return TYPE_AUDIO;}
+    if (type == "meta"){return TYPE_META;}
+    return TYPE_UNKNOWN;
+  }
+
+  /// Codec strings that have an interned codec, see codecFromString.
+  /// A constant table, so it is ready before any code runs and safe to use from any thread.
+  static const struct{
+    const char *name;
+    trackCodec codec;
+  } codecNames[] ={
+      {"H264", CODEC_H264}, {"HEVC", CODEC_HEVC}, {"AV1", CODEC_AV1}, {"VP8", CODEC_VP8},
+      {"VP9", CODEC_VP9}, {"MPEG2", CODEC_MPEG2}, {"H263", CODEC_H263}, {"VP6", CODEC_VP6},
+      {"VP6Alpha", CODEC_VP6ALPHA}, {"ScreenVideo1", CODEC_SCREENVIDEO1},
+      {"ScreenVideo2", CODEC_SCREENVIDEO2}, {"JPEG", CODEC_JPEG}, {"theora", CODEC_THEORA},
+      {"AAC", CODEC_AAC}, {"MP3", CODEC_MP3}, {"MP2", CODEC_MP2}, {"AC3", CODEC_AC3},
+      {"EAC3", CODEC_EAC3}, {"opus", CODEC_OPUS}, {"vorbis", CODEC_VORBIS}, {"FLAC", CODEC_FLAC},
+      {"DTS", CODEC_DTS}, {"PCM", CODEC_PCM}, {"FLOAT", CODEC_FLOAT}, {"ALAW", CODEC_ALAW},
+      {"ULAW", CODEC_ULAW}, {"ADPCM", CODEC_ADPCM}, {"Speex", CODEC_SPEEX},
+      {"Nellymoser", CODEC_NELLYMOSER}, {"subtitle", CODEC_SUBTITLE}, {"JSON", CODEC_JSON},
+      {"ID3", CODEC_ID3}, {"rawts", CODEC_RAWTS}
+  };
+
+  /// Returns the interned codec for the given codec string, or CODEC_UNKNOWN if it has no entry.
+  trackCodec codecFromString(const std::string &codec){
+    for (size_t i = 0; i < sizeof(codecNames) / sizeof(codecNames[0]); ++i){
+      if (codec == codecNames[i].name){return codecNames[i].codec;}
+    }
+    return CODEC_UNKNOWN;
+  }
+
   /// Initialize metadata from referenced DTSC::Scan object in master mode.
   Meta::Meta(const std::string &_streamName, const DTSC::Scan &src){
     version = DTSH_VERSION;
     streamMemBuf = 0;
     isMemBuf = false;
+    idCacheGeneration = 0;
     isMaster = true;
     reInit(_streamName, src);
   }
@@ -907,6 +982,7 @@ namespace DTSC{
     version = DTSH_VERSION;
     streamMemBuf = 0;
     isMemBuf = false;
+    idCacheGeneration = 0;
     isMaster = master;
     reInit(_streamName, master, autoBackOff);
   }
@@ -916,6 +992,7 @@ namespace DTSC{
     version = DTSH_VERSION;
     streamMemBuf = 0;
     isMemBuf = false;
+    idCacheGeneration = 0;
     isMaster = true;
     reInit(_streamName, fileName);
   }
@@ -943,26 +1020,170 @@ namespace DTSC{
   }
 
   /// Calls clear(), then initializes from given DTSH file in master mode.
-  /// Internally calls reInit(const std::string&, const DTSC::Scan&).
+  /// The file is memory mapped and loaded through reInit(const std::string&, const char*, size_t).
   /// If stream name is set, uses shared memory backing.
   /// If stream name is empty, uses non-shared memory backing.
   void Meta::reInit(const std::string &_streamName, const std::string &fileName){
     clear();
 
     ///\todo Implement absence of keysizes here instead of input::parseHeader
-    std::ifstream inFile(fileName.c_str());
-    if (!inFile.is_open()){return;}
-    inFile.seekg(0, std::ios_base::end);
-    size_t fileSize = inFile.tellg();
-    inFile.seekg(0, std::ios_base::beg);
+    int fd = ::open(fileName.c_str(), O_RDONLY);
+    if (fd == -1){return;}
+    struct stat st;
+    if (fstat(fd, &st) || !st.st_size){
+      ::close(fd);
+      return;
+    }
+    // Mapped privately, so nothing we do to the data can end up in the file
+    char *mapped = (char *)mmap(0, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (mapped == MAP_FAILED){
+      FAIL_MSG("Could not map header file %s: %s", fileName.c_str(), strerror(errno));
+      return;
+    }
+    reInit(_streamName, mapped, st.st_size);
+    munmap(mapped, st.st_size);
+  }
+
+  /// Returns the given size rounded up to a multiple of 8 bytes, the alignment of all sections of
+  /// a raw DTSH file.
+  static inline size_t rawPad(size_t len){return (len + 7) & ~(size_t)7;}
+
+  /// Returns the size of the Util::RelAccX structure at the start of the given data, or zero if
+  /// that is not a complete and ready structure of at most avail bytes.
+  /// Reads the structure header directly, as described in util.h, because Util::RelAccX itself
+  /// trusts its field descriptions to be complete.
+  static size_t rawSectionSize(const char *ptr, size_t avail){
+    if (avail < 36 || !(ptr[0] & 1)){return 0;}
+    uint16_t offset = *(const uint16_t *)(ptr + 26);
+    uint64_t size = offset + (uint64_t)(*(const uint32_t *)(ptr + 2)) * (*(const uint32_t *)(ptr + 6));
+    if ((uint8_t)ptr[1] < 36 || offset < (uint8_t)ptr[1] || size > avail){return 0;}
+    return size;
+  }
+
+  /// Loads a section of a raw DTSH file into the given freshly initialized structure of the same
+  /// record count. When the fields are laid out the same, as they are unless the layout changed
+  /// since the file was written, this is a single copy. Otherwise records are copied field by field.
+  static void loadRawSection(Util::RelAccX &dst, char *dstPtr, const char *src, size_t len){
+    Util::RelAccX rax((char *)src, false);
+    uint8_t fieldOffset = src[1];
+    if (rax.getOffset() == dst.getOffset() && rax.getRSize() == dst.getRSize() &&
+        rax.getRCount() == dst.getRCount() && fieldOffset == (uint8_t)dstPtr[1] &&
+        !memcmp(src + fieldOffset, dstPtr + fieldOffset, rax.getOffset() - fieldOffset)){
+      // Everything but the status byte: the destination is ready already
+      memcpy(dstPtr + 1, src + 1, len - 1);
+      return;
+    }
+    dst.flowFrom(rax);
+  }
 
-    char *scanBuf = (char *)malloc(fileSize);
-    inFile.read(scanBuf, fileSize);
+  /// Calls clear(), then initializes from a DTSH file held in memory, in master mode.
+  /// Raw (version 5+) files are loaded section by section with a single copy each, anything else
+  /// is parsed as a DTSC header through reInit(const std::string&, const DTSC::Scan&).
+  /// If stream name is set, uses shared memory backing.
+  /// If stream name is empty, uses non-shared memory backing.
+  void Meta::reInit(const std::string &_streamName, const char *data, size_t len){
+    if (len < 8 || memcmp(data, Magic_RawHeader, 4)){
+      DTSC::Packet pkt(data, len, true);
+      reInit(_streamName, pkt.getScan());
+      return;
+    }
+    clear();
+    uint32_t fileVersion = *(const uint32_t *)(data + 4);
+    if (fileVersion != DTSH_VERSION){
+      WARN_MSG("Cannot load raw DTSH version %" PRIu32 ", expected version %d", fileVersion, DTSH_VERSION);
+      return;
+    }
+    size_t pos = 8;
+    size_t strmLen = rawSectionSize(data + pos, len - pos);
+    if (!strmLen){
+      FAIL_MSG("Raw DTSH data is incomplete: no stream section");
+      return;
+    }
+    Util::RelAccX strm((char *)data + pos, false);
+    pos += rawPad(strmLen);
+
+    size_t tNum = strm.getInt("tracks");
+    if (_streamName == ""){
+      sBufMem(tNum);
+    }else{
+      sBufShm(_streamName, tNum, true);
+    }
+    streamInit(tNum);
+
+    setVod(strm.getInt("vod"));
+    setLive(strm.getInt("live"));
+    setUUID(strm.getPointer("uuid") ? strm.getPointer("uuid") : "");
+    version = fileVersion;
+    if (strm.getPointer("localvars") && *strm.getPointer("localvars")){
+      inputLocalVars = JSON::fromString(strm.getPointer("localvars"));
+    }
+
+    for (size_t i = 0; i < tNum; i++){
+      // Each track consists of its own fields, followed by the fragments, keys and parts
+      const char *sect[4];
+      size_t sectLen[4];
+      for (size_t j = 0; j < 4; ++j){
+        sect[j] = data + pos;
+        sectLen[j] = rawSectionSize(sect[j], pos < len ? len - pos : 0);
+        if (!sectLen[j]){
+          FAIL_MSG("Raw DTSH data is incomplete: track %zu of %zu is missing or damaged", i + 1, tNum);
+          clear();
+          return;
+        }
+        pos += rawPad(sectLen[j]);
+      }
+      Util::RelAccX trak((char *)sect[0], false);
+      Util::RelAccX fragments((char *)sect[1], false);
+      Util::RelAccX keys((char *)sect[2], false);
+      Util::RelAccX parts((char *)sect[3], false);
+      size_t tIdx = addTrack(fragments.getRCount(), keys.getRCount(), parts.getRCount());
+
+      std::string type = trak.getPointer("type") ? trak.getPointer("type") : "";
+      setType(tIdx, type);
+      setCodec(tIdx, trak.getPointer("codec") ? trak.getPointer("codec") : "");
+      setLang(tIdx, trak.getPointer("lang") ? trak.getPointer("lang") : "");
+      if (trak.getPointer("init")){
+        const char *init = trak.getPointer("init");
+        setInit(tIdx, init + 2, std::min((uint32_t)Bit::btohs(init), trak.getSize("init") - 2));
+      }
+      setID(tIdx, trak.getInt("id"));
+      setFirstms(tIdx, trak.getInt("firstms"));
+      setLastms(tIdx, trak.getInt("lastms"));
+      setBps(tIdx, trak.getInt("bps"));
+      setMaxBps(tIdx, trak.getInt("maxbps"));
+      setMissedFragments(tIdx, trak.getInt("missedFrags"));
+      setSourceTrack(tIdx, INVALID_TRACK_ID);
+      if (type == "video"){
+        setWidth(tIdx, trak.getInt("width"));
+        setHeight(tIdx, trak.getInt("height"));
+        setFpks(tIdx, trak.getInt("fpks"));
+      }else if (type == "audio"){
+        setRate(tIdx, trak.getInt("rate"));
+        setChannels(tIdx, trak.getInt("channels"));
+        setSize(tIdx, trak.getInt("size"));
+      }
+
+      Track &s = tracks[tIdx];
+      loadRawSection(s.fragments, s.track.getPointer("fragments"), sect[1], sectLen[1]);
+      loadRawSection(s.keys, s.track.getPointer("keys"), sect[2], sectLen[2]);
+      loadRawSection(s.parts, s.track.getPointer("parts"), sect[3], sectLen[3]);
+    }
 
-    inFile.close();
-    DTSC::Packet pkt(scanBuf, fileSize, true);
-    reInit(_streamName, pkt.getScan());
-    free(scanBuf);
+    // Unix Time at zero point of a stream
+    if (strm.getInt("unixzero")){
+      setBootMsOffset(strm.getInt("unixzero") - Util::unixMS() + Util::bootMS());
+    }else{
+      int64_t lastMs = 0;
+      for (std::map<size_t, Track>::iterator it = tracks.begin(); it != tracks.end(); it++){
+        if (it->second.track.getInt(it->second.trackLastmsField) > lastMs){
+          lastMs = it->second.track.getInt(it->second.trackLastmsField);
+        }
+      }
+      setBootMsOffset(Util::bootMS() - lastMs);
+    }
+    stream.setReady();
+    trackList.setReady();
   }
 
   /// Calls clear(), then initializes from the given DTSC:Scan object in master mode.
@@ -1179,6 +1400,7 @@ namespace DTSC{
       stream.addField("bootmsoffset", RAX_64INT);
       stream.addField("utcoffset", RAX_64INT);
       stream.addField("minfragduration", RAX_64UINT);
+      stream.addField("generation", RAX_64UINT);
       stream.setRCount(1);
       stream.addRecords(1);
 
@@ -1214,6 +1436,7 @@ namespace DTSC{
     streamBootMsOffsetField = stream.getFieldData("bootmsoffset");
     streamUTCOffsetField = stream.getFieldData("utcoffset");
     streamMinimumFragmentDurationField = stream.getFieldData("minfragduration");
+    streamGenerationField = stream.getFieldData("generation");
 
     trackValidField = trackList.getFieldData("valid");
     trackIdField = trackList.getFieldData("id");
@@ -1294,6 +1517,7 @@ namespace DTSC{
       stream.setInt("bootmsoffset", origStream.getInt("bootmsoffset"));
       stream.setInt("utcoffset", origStream.getInt("utcoffset"));
       stream.setInt("minfragduration", origStream.getInt("minfragduration"));
+      stream.setInt("generation", origStream.getInt("generation") + 1);
       // Copy tracks
       Util::RelAccX origTracks(origStream.getPointer("tracks"), false);
       if (origTracks.isReady()){trackList.flowFrom(origTracks);}
@@ -1363,6 +1587,14 @@ namespace DTSC{
       t.fragmentKeysField = t.fragments.getFieldData("keys");
       t.fragmentFirstKeyField = t.fragments.getFieldData("firstkey");
       t.fragmentSizeField = t.fragments.getFieldData("size");
+
+      t.pageFirstKeyField = t.pages.getFieldData("firstkey");
+      t.pageKeyCountField = t.pages.getFieldData("keycount");
+      t.pagePartsField = t.pages.getFieldData("parts");
+      t.pageSizeField = t.pages.getFieldData("size");
+      t.pageAvailField = t.pages.getFieldData("avail");
+      t.pageFirstTimeField = t.pages.getFieldData("firsttime");
+      t.pageLastKeyTimeField = t.pages.getFieldData("lastkeytime");
     }
   }
 
@@ -1459,6 +1691,14 @@ namespace DTSC{
         t.fragmentFirstKeyField = t.fragments.getFieldData("firstkey");
         t.fragmentSizeField = t.fragments.getFieldData("size");
 
+        t.pageFirstKeyField = t.pages.getFieldData("firstkey");
+        t.pageKeyCountField = t.pages.getFieldData("keycount");
+        t.pagePartsField = t.pages.getFieldData("parts");
+        t.pageSizeField = t.pages.getFieldData("size");
+        t.pageAvailField = t.pages.getFieldData("avail");
+        t.pageFirstTimeField = t.pages.getFieldData("firsttime");
+        t.pageLastKeyTimeField = t.pages.getFieldData("lastkeytime");
+
       }
     }
     return ret;
@@ -1952,6 +2192,14 @@ namespace DTSC{
     t.pages.addField("lastkeytime", RAX_64UINT);
     t.pages.setRCount(pageCount);
     t.pages.setReady();
+
+    t.pageFirstKeyField = t.pages.getFieldData("firstkey");
+    t.pageKeyCountField = t.pages.getFieldData("keycount");
+    t.pagePartsField = t.pages.getFieldData("parts");
+    t.pageSizeField = t.pages.getFieldData("size");
+    t.pageAvailField = t.pages.getFieldData("avail");
+    t.pageFirstTimeField = t.pages.getFieldData("firsttime");
+    t.pageLastKeyTimeField = t.pages.getFieldData("lastkeytime");
   }
 
   /// Sets the given track's init data.
@@ -2063,19 +2311,64 @@ namespace DTSC{
     trackList.setString(trackTypeField, type, trackIdx);
     DTSC::Track &t = tracks.at(trackIdx);
     t.track.setString(t.trackTypeField, type);
+    bumpGeneration();
   }
   std::string Meta::getType(size_t trackIdx) const{
     return trackList.getPointer(trackTypeField, trackIdx);
   }
+  /// Returns the interned type of the given track, without copying the type string.
+  trackType Meta::getTypeId(size_t trackIdx) const{
+    checkIdCache(trackIdx);
+    uint8_t &id = typeIds[trackIdx];
+    if (id == 0xFF){id = typeFromString(trackList.getPointer(trackTypeField, trackIdx));}
+    return (trackType)id;
+  }
 
   void Meta::setCodec(size_t trackIdx, const std::string &codec){
     trackList.setString(trackCodecField, codec, trackIdx);
     DTSC::Track &t = tracks.at(trackIdx);
     t.track.setString(t.trackCodecField, codec);
+    bumpGeneration();
   }
   std::string Meta::getCodec(size_t trackIdx) const{
     return trackList.getPointer(trackCodecField, trackIdx);
   }
+  /// Returns the interned codec of the given track, without copying the codec string.
+  trackCodec Meta::getCodecId(size_t trackIdx) const{
+    checkIdCache(trackIdx);
+    uint8_t &id = codecIds[trackIdx];
+    if (id == 0xFF){id = codecFromString(trackList.getPointer(trackCodecField, trackIdx));}
+    return (trackCodec)id;
+  }
+
+  /// Returns the metadata generation counter. It changes whenever tracks are added, removed or
+  /// (in)validated, change their type or codec, or receive their first key, which makes it usable
+  /// to detect changes that may affect track selection without polling.
+  /// While the metadata is being replaced, returns a value no generation will ever have.
+  uint64_t Meta::getGeneration() const{
+    if (!stream.isReady() || stream.isReload()){return 0xFFFFFFFFFFFFFFFFull;}
+    return stream.getInt(streamGenerationField);
+  }
+
+  /// Increases the metadata generation counter, see getGeneration().
+  void Meta::bumpGeneration(){
+    stream.setInt(streamGenerationField, stream.getInt(streamGenerationField) + 1);
+  }
+
+  /// Makes sure the interned type and codec cache has room for the given track and is valid for
+  /// the current metadata generation, clearing it if not.
+  void Meta::checkIdCache(size_t trackIdx) const{
+    uint64_t gen = getGeneration();
+    if (gen != idCacheGeneration){
+      typeIds.assign(typeIds.size(), 0xFF);
+      codecIds.assign(codecIds.size(), 0xFF);
+      idCacheGeneration = gen;
+    }
+    if (trackIdx >= typeIds.size()){
+      typeIds.resize(trackIdx + 1, 0xFF);
+      codecIds.resize(trackIdx + 1, 0xFF);
+    }
+  }
 
   void Meta::setLang(size_t trackIdx, const std::string &lang){
     DTSC::Track &t = tracks.at(trackIdx);
@@ -2322,6 +2615,7 @@ namespace DTSC{
   void Meta::validateTrack(size_t trackIdx, uint8_t validType){
     markUpdated(trackIdx);
     trackList.setInt(trackValidField, validType, trackIdx);
+    bumpGeneration();
   }
 
   void Meta::removeEmptyTracks(){
@@ -2337,10 +2631,10 @@ namespace DTSC{
     if (!getValidTracks().count(trackIdx)){return;}
     Track &t = tracks[trackIdx];
     for (uint64_t i = t.pages.getDeleted(); i < t.pages.getEndPos(); i++){
-      if (t.pages.getInt("avail", i) == 0){continue;}
+      if (t.pageAvailField.get(t.pages, i) == 0){continue;}
       char thisPageName[NAME_BUFFER_SIZE];
       snprintf(thisPageName, NAME_BUFFER_SIZE, SHM_TRACK_DATA, streamName.c_str(), trackIdx,
-               (uint32_t)t.pages.getInt("firstkey", i));
+               t.pageFirstKeyField.get(t.pages, i));
       IPC::sharedPage p(thisPageName, 20971520);
       p.master = true;
     }
@@ -2349,6 +2643,7 @@ namespace DTSC{
     tracks.erase(trackIdx);
 
     trackList.setInt(trackValidField, 0, trackIdx);
+    bumpGeneration();
   }
 
   /// Removes the first key from the memory structure and caches.
@@ -2378,11 +2673,11 @@ namespace DTSC{
       t.fragments.deleteRecords(1);
       setMissedFragments(trackIdx, getMissedFragments(trackIdx) + 1);
     }
-    if (t.pages.getPresent() > 1 && t.pages.getInt("firstkey", t.pages.getDeleted() + 1) < t.keys.getDeleted()){
+    if (t.pages.getPresent() > 1 && t.pageFirstKeyField.get(t.pages, t.pages.getDeleted() + 1) < t.keys.getDeleted()){
       // Initialize the correct page, make it master so it gets cleaned up when leaving scope.
       char thisPageName[NAME_BUFFER_SIZE];
       snprintf(thisPageName, NAME_BUFFER_SIZE, SHM_TRACK_DATA, streamName.c_str(), trackIdx,
-               (uint32_t)t.pages.getInt("firstkey", t.pages.getDeleted()));
+               t.pageFirstKeyField.get(t.pages, t.pages.getDeleted()));
       IPC::sharedPage p(thisPageName, 20971520);
       p.master = true;
 
@@ -2539,7 +2834,7 @@ namespace DTSC{
 
     uint64_t newKeyNum = t.keys.getEndPos();
     if (isKeyframe || newKeyNum == 0 ||
-        (getType(tNumber) != "video" && packTime >= AUDIO_KEY_INTERVAL &&
+        (getTypeId(tNumber) != TYPE_VIDEO && packTime >= AUDIO_KEY_INTERVAL &&
          packTime - t.keys.getInt(t.keyTimeField, newKeyNum - 1) >= AUDIO_KEY_INTERVAL)){
       if ((newKeyNum - t.keys.getDeleted()) >= t.keys.getRCount()){
         resizeTrack(tNumber, t.fragments.getRCount(), t.keys.getRCount() * 2, t.parts.getRCount(), t.pages.getRCount(), "not enough keys");
@@ -2563,6 +2858,8 @@ namespace DTSC{
       }
       t.keys.addRecords(1);
       t.track.setInt(t.trackFirstmsField, t.keys.getInt(t.keyTimeField, t.keys.getDeleted()));
+      // A track receiving its first key may now be selectable
+      if (!newKeyNum){bumpGeneration();}
 
       uint64_t newFragNum = t.fragments.getEndPos();
       if (newFragNum == 0 ||
@@ -2666,6 +2963,9 @@ namespace DTSC{
   Util::RelAccX &Meta::keys(size_t idx){return tracks.at(idx).keys;}
   const Util::RelAccX &Meta::keys(size_t idx) const{return tracks.at(idx).keys;}
   const Util::RelAccX &Meta::fragments(size_t idx) const{return tracks.at(idx).fragments;}
+  Keys Meta::getKeys(size_t idx){return Keys(tracks.at(idx));}
+  Keys Meta::getKeys(size_t idx) const{return Keys(tracks.at(idx));}
+  Fragments Meta::getFragments(size_t idx) const{return Fragments(tracks.at(idx));}
   const Util::RelAccX &Meta::pages(size_t idx) const{return tracks.at(idx).pages;}
   Util::RelAccX &Meta::pages(size_t idx){return tracks.at(idx).pages;}
 
@@ -2899,11 +3199,127 @@ namespace DTSC{
     if (!Util::externalWriter(uri, outFd, false)){return;}
     Socket::Connection outFile(outFd, -1);
     if (outFile){
-      send(outFile, false, getValidTracks(), false);
+      sendRaw(outFile, getValidTracks());
       outFile.close();
     }
   }
 
+  /// Writes the Util::RelAccX structure at the given pointer to a raw DTSH file, shrunk to the
+  /// records it holds. Records keep their numbers: record N is written at position N % present,
+  /// where a structure of that size keeps it, so the section can be used as-is when loading.
+  static void sendRawSection(Socket::Connection &conn, const char *ptr){
+    Util::RelAccX rax((char *)ptr, false);
+    uint32_t present = rax.getPresent();
+    uint64_t recsLen = (uint64_t)present * rax.getRSize();
+    std::string hdr(ptr, rax.getOffset());
+    hdr[0] = 1; // Ready, never exit or reload
+    memcpy(&hdr[2], &present, 4);
+    conn.SendNow(hdr);
+    const char *recs = ptr + rax.getOffset();
+    if (!rax.getDeleted()){
+      // Nothing was removed yet, so the records already are where they need to be
+      conn.SendNow(recs, recsLen);
+    }else if (present){
+      Util::ResizeablePointer buf;
+      buf.allocate(recsLen);
+      for (uint64_t n = rax.getDeleted(); n < rax.getDeleted() + present; ++n){
+        memcpy((char *)buf + (n % present) * rax.getRSize(), recs + (n % rax.getRCount()) * rax.getRSize(), rax.getRSize());
+      }
+      conn.SendNow(buf, recsLen);
+    }
+    size_t len = hdr.size() + recsLen;
+    if (rawPad(len) != len){conn.SendNow("\000\000\000\000\000\000\000", rawPad(len) - len);}
+  }
+
+  /// Sends the current Meta object through a socket in raw DTSH format:
+  ///   4 bytes "DTSH" magic
+  ///   4 bytes version (DTSH_VERSION), host byte order
+  ///   Stream section: vod, live, unixzero, track count, uuid and local input variables
+  ///   Per track: a section with the track fields, then the fragments, keys and parts sections
+  /// Every section is a single record Util::RelAccX structure, or for fragments, keys and parts the
+  /// exact in-memory structure shrunk to the records present, padded to a multiple of 8 bytes.
+  /// Like the in-memory structures, all of it is in host byte order.
+  void Meta::sendRaw(Socket::Connection &conn, std::set<size_t> selectedTracks) const{
+    std::string lVars;
+    if (inputLocalVars.size()){lVars = inputLocalVars.toString();}
+    std::string uuid = getUUID();
+
+    conn.SendNow(Magic_RawHeader, 4);
+    uint32_t fileVersion = DTSH_VERSION;
+    conn.SendNow((const char *)&fileVersion, 4);
+
+    Util::ResizeablePointer buf;
+    buf.allocate(256 + uuid.size() + lVars.size());
+    memset(buf, 0, buf.rsize());
+    Util::RelAccX strm(buf, false);
+    strm.addField("vod", RAX_UINT);
+    strm.addField("live", RAX_UINT);
+    strm.addField("unixzero", RAX_64UINT);
+    strm.addField("tracks", RAX_32UINT);
+    strm.addField("uuid", RAX_STRING, uuid.size() + 1);
+    strm.addField("localvars", RAX_STRING, lVars.size() + 1);
+    strm.setRCount(1);
+    strm.setReady();
+    strm.addRecords(1);
+    strm.setInt("vod", getVod());
+    strm.setInt("live", getLive());
+    if (getLive()){strm.setInt("unixzero", Util::unixMS() - Util::bootMS() + getBootMsOffset());}
+    strm.setInt("tracks", selectedTracks.size());
+    strm.setString("uuid", uuid);
+    strm.setString("localvars", lVars);
+    conn.SendNow(buf, rawPad(strm.getOffset() + strm.getRSize()));
+
+    for (std::set<size_t>::const_iterator it = selectedTracks.begin(); it != selectedTracks.end(); it++){
+      const Track &t = tracks.at(*it);
+      const char *init = t.track.getPointer(t.trackInitField);
+      uint32_t initLen = 2 + Bit::btohs(init);
+
+      buf.allocate(512 + initLen);
+      memset(buf, 0, buf.rsize());
+      Util::RelAccX trak(buf, false);
+      trak.addField("id", RAX_32UINT);
+      trak.addField("type", RAX_STRING, 8);
+      trak.addField("codec", RAX_STRING, 8);
+      trak.addField("firstms", RAX_64UINT);
+      trak.addField("lastms", RAX_64UINT);
+      trak.addField("bps", RAX_32UINT);
+      trak.addField("maxbps", RAX_32UINT);
+      trak.addField("lang", RAX_STRING, 4);
+      trak.addField("init", RAX_RAW, initLen);
+      trak.addField("rate", RAX_16UINT);
+      trak.addField("size", RAX_16UINT);
+      trak.addField("channels", RAX_16UINT);
+      trak.addField("width", RAX_32UINT);
+      trak.addField("height", RAX_32UINT);
+      trak.addField("fpks", RAX_16UINT);
+      trak.addField("missedFrags", RAX_32UINT);
+      trak.setRCount(1);
+      trak.setReady();
+      trak.addRecords(1);
+      trak.setInt("id", getID(*it));
+      trak.setString("type", getType(*it));
+      trak.setString("codec", getCodec(*it));
+      trak.setInt("firstms", getFirstms(*it));
+      trak.setInt("lastms", getLastms(*it));
+      trak.setInt("bps", getBps(*it));
+      trak.setInt("maxbps", getMaxBps(*it));
+      trak.setString("lang", getLang(*it));
+      memcpy(trak.getPointer("init"), init, initLen);
+      trak.setInt("rate", getRate(*it));
+      trak.setInt("size", getSize(*it));
+      trak.setInt("channels", getChannels(*it));
+      trak.setInt("width", getWidth(*it));
+      trak.setInt("height", getHeight(*it));
+      trak.setInt("fpks", getFpks(*it));
+      trak.setInt("missedFrags", getMissedFragments(*it));
+      conn.SendNow(buf, rawPad(trak.getOffset() + trak.getRSize()));
+
+      sendRawSection(conn, t.track.getPointer("fragments"));
+      sendRawSection(conn, t.track.getPointer("keys"));
+      sendRawSection(conn, t.track.getPointer("parts"));
+    }
+  }
+
   /// Sends the current Meta object through a socket in DTSH format
   void Meta::send(Socket::Connection &conn, bool skipDynamic, std::set<size_t> selectedTracks, bool reID) const{
     std::string lVars;
@@ -2919,7 +3335,7 @@ namespace DTSC{
     if (getVod()){conn.SendNow("\000\003vod\001\000\000\000\000\000\000\000\001", 14);}
     if (getLive()){conn.SendNow("\000\004live\001\000\000\000\000\000\000\000\001", 15);}
     conn.SendNow("\000\007version\001", 10);
-    conn.SendNow(c64(DTSH_VERSION), 8);
+    conn.SendNow(c64(DTSH_PACKED_VERSION), 8);
     if (getLive()){
       conn.SendNow("\000\010unixzero\001", 11);
       conn.SendNow(c64(Util::unixMS() - Util::bootMS() + getBootMsOffset()), 8);
@@ -3090,7 +3506,7 @@ namespace DTSC{
     if (!trackList.getPresent()){return 0;}
     uint32_t trackIdx = (idx == INVALID_TRACK_ID ? mainTrack() : idx);
     if (!tM.count(trackIdx)){return 0;}
-    DTSC::Fragments fragments(tracks.at(trackIdx).fragments);
+    DTSC::Fragments fragments(tracks.at(trackIdx));
     uint64_t firstFragment = fragments.getFirstValid();
     uint64_t endFragment = fragments.getEndValid();
     uint32_t ret = 0;
@@ -3103,8 +3519,8 @@ namespace DTSC{
 
   bool Meta::tracksAlign(size_t idx1, size_t idx2) const{
     if (!tM.count(idx1) || !tM.count(idx2)){return false;}
-    DTSC::Fragments frag1(tracks.at(idx1).fragments);
-    DTSC::Fragments frag2(tracks.at(idx2).fragments);
+    DTSC::Fragments frag1(tracks.at(idx1));
+    DTSC::Fragments frag2(tracks.at(idx2));
     if (frag1.getFirstValid() >= frag2.getFirstValid()){
       size_t firstValid = frag1.getFirstValid();
       size_t firstTime = getTimeForFragmentIndex(idx1, firstValid);
@@ -3140,16 +3556,23 @@ namespace DTSC{
   }
 
   /// Gets indice of the fragment containing timestamp, or last fragment if nowhere.
+  /// Fragment end times are monotonic within the ring, so this is a binary search.
   uint32_t Meta::getFragmentIndexForTime(uint32_t idx, uint64_t timestamp) const{
-    DTSC::Fragments fragments(tracks.at(idx).fragments);
-    DTSC::Keys keys(tracks.at(idx).keys);
+    DTSC::Fragments fragments(tracks.at(idx));
+    DTSC::Keys keys(tracks.at(idx));
     uint32_t firstFragment = fragments.getFirstValid();
     uint32_t endFragment = fragments.getEndValid();
-    for (size_t i = firstFragment; i < endFragment; i++){
-      uint32_t keyNumber = fragments.getFirstKey(i);
-      uint32_t duration = fragments.getDuration(i);
-      if (timestamp < keys.getTime(keyNumber) + duration){return i;}
+    // Find the first fragment that ends after the timestamp
+    size_t lo = firstFragment, hi = endFragment;
+    while (lo < hi){
+      size_t mid = lo + (hi - lo) / 2;
+      if (timestamp < keys.getTime(fragments.getFirstKey(mid)) + fragments.getDuration(mid)){
+        hi = mid;
+      }else{
+        lo = mid + 1;
+      }
     }
+    if (lo < endFragment){return lo;}
     if (endFragment > firstFragment){
       if (timestamp < getLastms(idx)){return endFragment - 1;}
     }
@@ -3158,26 +3581,32 @@ namespace DTSC{
 
   /// Returns the timestamp for the given key index in the given track index
   uint64_t Meta::getTimeForKeyIndex(uint32_t idx, uint32_t keyIdx) const{
-    DTSC::Keys keys(tracks.at(idx).keys);
+    DTSC::Keys keys(tracks.at(idx));
     return keys.getTime(keyIdx);
   }
 
   /// Returns indice of the key containing timestamp, or last key if nowhere.
+  /// Key end times are monotonic within the ring, so this is a binary search.
   uint32_t Meta::getKeyIndexForTime(uint32_t idx, uint64_t timestamp) const{
-    DTSC::Keys keys(tracks.at(idx).keys);
-    uint32_t firstKey = keys.getFirstValid();
-    uint32_t endKey = keys.getEndValid();
-
-    for (size_t i = firstKey; i < endKey; i++){
-      if (keys.getTime(i) + keys.getDuration(i) > timestamp){return i;}
+    DTSC::Keys keys(tracks.at(idx));
+    size_t lo = keys.getFirstValid();
+    size_t hi = keys.getEndValid();
+    // Find the first key that ends after the timestamp
+    while (lo < hi){
+      size_t mid = lo + (hi - lo) / 2;
+      if (keys.getTime(mid) + keys.getDuration(mid) > timestamp){
+        hi = mid;
+      }else{
+        lo = mid + 1;
+      }
     }
-    return endKey;
+    return lo;
   }
 
   /// Returns the tiestamp for the given fragment index in the given track index.
   uint64_t Meta::getTimeForFragmentIndex(uint32_t idx, uint32_t fragmentIdx) const{
-    DTSC::Fragments fragments(tracks.at(idx).fragments);
-    DTSC::Keys keys(tracks.at(idx).keys);
+    DTSC::Fragments fragments(tracks.at(idx));
+    DTSC::Keys keys(tracks.at(idx));
     return keys.getTime(fragments.getFirstKey(fragmentIdx));
   }
 
@@ -3191,7 +3620,7 @@ namespace DTSC{
 
     uint32_t res = 0;
     uint32_t keyIdx = getKeyIndexForTime(idx, timestamp);
-    DTSC::Keys Keys(keys(idx));
+    DTSC::Keys Keys(getKeys(idx));
     DTSC::Parts Parts(parts(idx));
     uint64_t currentTime = Keys.getTime(keyIdx);
     res = Keys.getFirstPart(keyIdx);
@@ -3211,87 +3640,139 @@ namespace DTSC{
   /// index is invalid or if the timestamp cannot be found.
   uint64_t Meta::getPartTime(uint32_t partIndex, size_t idx) const{
     if (idx == INVALID_TRACK_ID){return 0;}
-    DTSC::Keys Keys(keys(idx));
+    DTSC::Keys Keys(getKeys(idx));
     DTSC::Parts Parts(parts(idx));
-    size_t kId = 0;
-    for (kId = 0; kId < Keys.getEndValid(); ++kId){
-      size_t keyPartId = Keys.getFirstPart(kId);
-      if (keyPartId+Keys.getParts(kId) > partIndex){
-        //It's inside this key. Step through.
-        uint64_t res = Keys.getTime(kId);
-        while (keyPartId < partIndex){
-          res += Parts.getDuration(keyPartId);
-          ++keyPartId;
-        }
-        return res;
+    // Binary search for the first key that ends after the requested part
+    size_t lo = Keys.getFirstValid();
+    size_t hi = Keys.getEndValid();
+    while (lo < hi){
+      size_t mid = lo + (hi - lo) / 2;
+      if (Keys.getFirstPart(mid) + Keys.getParts(mid) > partIndex){
+        hi = mid;
+      }else{
+        lo = mid + 1;
       }
     }
-    return 0;
+    if (lo >= Keys.getEndValid()){return 0;}
+    //It's inside this key. Step through.
+    size_t keyPartId = Keys.getFirstPart(lo);
+    uint64_t res = Keys.getTime(lo);
+    while (keyPartId < partIndex){
+      res += Parts.getDuration(keyPartId);
+      ++keyPartId;
+    }
+    return res;
+  }
+
+  /// Returns the index in the pages ring of the last page with a value for the given field that is
+  /// less than or equal to the given value, regardless of availability.
+  /// Returns the ring end position if there is no such page.
+  /// Both the firstkey and firsttime fields are monotonic within the ring, so this is a binary search.
+  template <typename T>
+  static uint64_t lastPageAtOrBefore(const Util::RelAccX &pages, const Util::RelAccXTypedField<T> &field, uint64_t val){
+    uint64_t lo = pages.getStartPos();
+    uint64_t hi = pages.getEndPos();
+    uint64_t endPos = hi;
+    while (lo < hi){
+      uint64_t mid = lo + (hi - lo) / 2;
+      if (field.get(pages, mid) > val){
+        hi = mid;
+      }else{
+        lo = mid + 1;
+      }
+    }
+    if (lo == pages.getStartPos()){return endPos;}
+    return lo - 1;
+  }
+
+  /// Returns the index of the closest available page at or before the given page index,
+  /// or the ring start position if none are available.
+  static uint64_t lastAvailablePage(const Track &t, uint64_t i){
+    uint64_t startPos = t.pages.getStartPos();
+    if (i >= t.pages.getEndPos()){return startPos;}
+    while (i > startPos && t.pageAvailField.get(t.pages, i) == 0){--i;}
+    return i;
   }
 
   /// Given the current page, check if the next page is available. Returns true if it is.
   bool Meta::nextPageAvailable(uint32_t idx, size_t currentPage) const{
-    const Util::RelAccX &pages = tracks.at(idx).pages;
-    for (size_t i = pages.getStartPos(); i + 1 < pages.getEndPos(); ++i){
-      if (pages.getInt("firstkey", i) == currentPage){return pages.getInt("avail", i + 1);}
-    }
-    return false;
+    const Track &t = tracks.at(idx);
+    uint64_t i = lastPageAtOrBefore(t.pages, t.pageFirstKeyField, currentPage);
+    if (i + 1 >= t.pages.getEndPos() || t.pageFirstKeyField.get(t.pages, i) != currentPage){return false;}
+    return t.pageAvailField.get(t.pages, i + 1);
   }
 
   /// Given a timestamp, returns the page number that timestamp can be found on.
   /// If the timestamp is not available, returns the closest page number that is.
   size_t Meta::getPageNumberForTime(uint32_t idx, uint64_t time) const{
-    const Util::RelAccX &pages = tracks.at(idx).pages;
-    Util::RelAccXFieldData avail = pages.getFieldData("avail");
-    Util::RelAccXFieldData firsttime = pages.getFieldData("firsttime");
-    uint32_t res = pages.getStartPos();
-    uint64_t endPos = pages.getEndPos();
-    for (uint64_t i = res; i < endPos; ++i){
-      if (pages.getInt(avail, i) == 0){continue;}
-      if (pages.getInt(firsttime, i) > time){break;}
-      res = i;
-    }
-    DONTEVEN_MSG("Page number for time %" PRIu64 " on track %" PRIu32 " can be found on page %" PRIu64, time, idx, pages.getInt("firstkey", res));
-    return pages.getInt("firstkey", res);
+    const Track &t = tracks.at(idx);
+    uint64_t res = lastAvailablePage(t, lastPageAtOrBefore(t.pages, t.pageFirstTimeField, time));
+    DONTEVEN_MSG("Page number for time %" PRIu64 " on track %" PRIu32 " can be found on page %" PRIu32, time, idx, t.pageFirstKeyField.get(t.pages, res));
+    return t.pageFirstKeyField.get(t.pages, res);
   }
 
   /// Given a key, returns the page number it can be found on.
   /// If the key is not available, returns the closest page that is.
   size_t Meta::getPageNumberForKey(uint32_t idx, uint64_t keyNum) const{
-    const Util::RelAccX &pages = tracks.at(idx).pages;
-    size_t res = pages.getStartPos();
-    for (size_t i = pages.getStartPos(); i < pages.getEndPos(); ++i){
-      if (pages.getInt("avail", i) == 0){continue;}
-      if (pages.getInt("firstkey", i) > keyNum){break;}
-      res = i;
+    const Track &t = tracks.at(idx);
+    uint64_t res = lastAvailablePage(t, lastPageAtOrBefore(t.pages, t.pageFirstKeyField, keyNum));
+    return t.pageFirstKeyField.get(t.pages, res);
+  }
+
+  /// Given a key, returns the page number it can be found on.
+  /// Returns INVALID_KEY_NUM if no page holds the key or that page is not available.
+  size_t Meta::getAvailablePageForKey(uint32_t idx, uint64_t keyNum) const{
+    const Track &t = tracks.at(idx);
+    uint64_t i = lastPageAtOrBefore(t.pages, t.pageFirstKeyField, keyNum);
+    if (i >= t.pages.getEndPos() || i < t.pages.getDeleted()){return INVALID_KEY_NUM;}
+    uint64_t pageNum = t.pageFirstKeyField.get(t.pages, i);
+    if (keyNum > pageNum + t.pageKeyCountField.get(t.pages, i) - 1){return INVALID_KEY_NUM;}
+    return t.pageAvailField.get(t.pages, i) ? pageNum : INVALID_KEY_NUM;
+  }
+
+  /// Returns the highest page number in the page list of the given track.
+  size_t Meta::getHighestPageNumber(uint32_t idx) const{
+    const Track &t = tracks.at(idx);
+    uint64_t highest = 0;
+    for (uint64_t i = t.pages.getDeleted(); i < t.pages.getEndPos(); i++){
+      uint64_t pageNum = t.pageFirstKeyField.get(t.pages, i);
+      if (pageNum > highest){highest = pageNum;}
     }
-    return pages.getInt("firstkey", res);
+    return highest;
   }
 
   /// Returns the key number containing a given time.
   /// Or, closest key if given time is not available.
   /// Or, INVALID_KEY_NUM if no keys are available at all.
   /// If the time is in the gap before a key, returns that next key instead.
+  /// Key times are monotonic within the ring, so this is a binary search.
   size_t Meta::getKeyNumForTime(uint32_t idx, uint64_t time) const{
     const Track &trk = tracks.at(idx);
     const Util::RelAccX &keys = trk.keys;
     const Util::RelAccX &parts = trk.parts;
     if (!keys.getEndPos()){return INVALID_KEY_NUM;}
-    size_t res = keys.getStartPos();
-    for (size_t i = res; i < keys.getEndPos(); i++){
-      if (keys.getInt(trk.keyTimeField, i) > time){
-        //It's possible we overshot our timestamp, but the previous key does not contain it.
-        //This happens when seeking to a timestamp past the last part of the previous key, but
-        //before the first part of the next key.
-        //In this case, we should _not_ return the previous key, but the current key.
-        //That prevents getting stuck at the end of the page, waiting for a part to show up that never will.
-        if (keys.getInt(trk.keyFirstPartField, i) > parts.getStartPos()){
-          uint64_t dur = parts.getInt(trk.partDurationField, keys.getInt(trk.keyFirstPartField, i)-1);
-          if (keys.getInt(trk.keyTimeField, i) - dur < time){res = i;}
-        }
-        continue;
+    // Find the first key that starts after the given time
+    size_t lo = keys.getStartPos();
+    size_t hi = keys.getEndPos();
+    while (lo < hi){
+      size_t mid = lo + (hi - lo) / 2;
+      if (trk.keyTimeField.get(keys, mid) > time){
+        hi = mid;
+      }else{
+        lo = mid + 1;
+      }
+    }
+    size_t res = (lo > keys.getStartPos()) ? lo - 1 : keys.getStartPos();
+    if (lo < keys.getEndPos()){
+      //It's possible we overshot our timestamp, but the previous key does not contain it.
+      //This happens when seeking to a timestamp past the last part of the previous key, but
+      //before the first part of the next key.
+      //In this case, we should _not_ return the previous key, but the current key.
+      //That prevents getting stuck at the end of the page, waiting for a part to show up that never will.
+      if (keys.getInt(trk.keyFirstPartField, lo) > parts.getStartPos()){
+        uint64_t dur = parts.getInt(trk.partDurationField, keys.getInt(trk.keyFirstPartField, lo)-1);
+        if (keys.getInt(trk.keyTimeField, lo) - dur < time){res = lo;}
       }
-      res = i;
     }
     DONTEVEN_MSG("Key number for time %" PRIu64 " on track %" PRIu32 " is %zu", time, idx, res);
     return res;
@@ -3324,7 +3805,7 @@ namespace DTSC{
       uint32_t longest_prt = 0;
       uint32_t shrtest_cnt = 0xFFFFFFFFul;
       uint32_t longest_cnt = 0;
-      DTSC::Keys Mkeys(keys(i));
+      DTSC::Keys Mkeys(getKeys(i));
       uint32_t firstKey = Mkeys.getFirstValid();
       uint32_t endKey = Mkeys.getEndValid();
       for (uint32_t k = firstKey; k+1 < endKey; k++){
@@ -3435,8 +3916,8 @@ namespace DTSC{
     uint32_t keyIdx1 = getKeyIndexForTime(idx1,firstms);
     uint32_t keyIdx2 = getKeyIndexForTime(idx2,firstms);
 
-    DTSC::Keys keys1(tracks.at(idx1).keys);
-    DTSC::Keys keys2(tracks.at(idx2).keys);
+    DTSC::Keys keys1(tracks.at(idx1));
+    DTSC::Keys keys2(tracks.at(idx2));
 
     while(true) {
       if (lastms < keys1.getTime(keyIdx1) || lastms < keys2.getTime(keyIdx2)) {return true;}
@@ -3460,48 +3941,82 @@ namespace DTSC{
   uint64_t Parts::getDuration(size_t idx) const{return parts.getInt(durationField, idx);}
   int64_t Parts::getOffset(size_t idx) const{return parts.getInt(offsetField, idx);}
 
-  Keys::Keys(Util::RelAccX &_keys) : isConst(false), keys(_keys), cKeys(_keys){
-    firstPartField = cKeys.getFieldData("firstpart");
-    bposField = cKeys.getFieldData("bpos");
-    durationField = cKeys.getFieldData("duration");
-    numberField = cKeys.getFieldData("number");
-    partsField = cKeys.getFieldData("parts");
-    timeField = cKeys.getFieldData("time");
-    sizeField = cKeys.getFieldData("size");
-  }
-
-  Keys::Keys(const Util::RelAccX &_keys) : isConst(true), keys(empty), cKeys(_keys){
-    firstPartField = cKeys.getFieldData("firstpart");
-    bposField = cKeys.getFieldData("bpos");
-    durationField = cKeys.getFieldData("duration");
-    numberField = cKeys.getFieldData("number");
-    partsField = cKeys.getFieldData("parts");
-    timeField = cKeys.getFieldData("time");
-    sizeField = cKeys.getFieldData("size");
-  }
-
-  size_t Keys::getFirstValid() const{return cKeys.getDeleted();}
-  size_t Keys::getEndValid() const{return cKeys.getEndPos();}
+  Keys::Keys(Util::RelAccX &_keys) : isConst(false), keys(&_keys), cKeys(&_keys){
+    firstPartField = cKeys->getFieldData("firstpart");
+    bposField = cKeys->getFieldData("bpos");
+    durationField = cKeys->getFieldData("duration");
+    numberField = cKeys->getFieldData("number");
+    partsField = cKeys->getFieldData("parts");
+    timeField = cKeys->getFieldData("time");
+    sizeField = cKeys->getFieldData("size");
+  }
+
+  Keys::Keys(const Util::RelAccX &_keys) : isConst(true), keys(0), cKeys(&_keys){
+    firstPartField = cKeys->getFieldData("firstpart");
+    bposField = cKeys->getFieldData("bpos");
+    durationField = cKeys->getFieldData("duration");
+    numberField = cKeys->getFieldData("number");
+    partsField = cKeys->getFieldData("parts");
+    timeField = cKeys->getFieldData("time");
+    sizeField = cKeys->getFieldData("size");
+  }
+
+  /// Uses the key field handles the track already resolved, instead of looking them up by name.
+  Keys::Keys(Track &_track) : isConst(false), keys(&_track.keys), cKeys(&_track.keys){
+    firstPartField = _track.keyFirstPartField;
+    bposField = _track.keyBposField;
+    durationField = _track.keyDurationField;
+    numberField = _track.keyNumberField;
+    partsField = _track.keyPartsField;
+    timeField = _track.keyTimeField;
+    sizeField = _track.keySizeField;
+  }
+
+  /// Uses the key field handles the track already resolved, instead of looking them up by name.
+  Keys::Keys(const Track &_track) : isConst(true), keys(0), cKeys(&_track.keys){
+    firstPartField = _track.keyFirstPartField;
+    bposField = _track.keyBposField;
+    durationField = _track.keyDurationField;
+    numberField = _track.keyNumberField;
+    partsField = _track.keyPartsField;
+    timeField = _track.keyTimeField;
+    sizeField = _track.keySizeField;
+  }
+
+  size_t Keys::getFirstValid() const{return cKeys->getDeleted();}
+  size_t Keys::getEndValid() const{return cKeys->getEndPos();}
   size_t Keys::getValidCount() const{return getEndValid() - getFirstValid();}
 
-  size_t Keys::getFirstPart(size_t idx) const{return cKeys.getInt(firstPartField, idx);}
-  size_t Keys::getBpos(size_t idx) const{return cKeys.getInt(bposField, idx);}
-  uint64_t Keys::getDuration(size_t idx) const{return cKeys.getInt(durationField, idx);}
-  size_t Keys::getNumber(size_t idx) const{return cKeys.getInt(numberField, idx);}
-  size_t Keys::getParts(size_t idx) const{return cKeys.getInt(partsField, idx);}
-  uint64_t Keys::getTime(size_t idx) const{return cKeys.getInt(timeField, idx);}
+  size_t Keys::getFirstPart(size_t idx) const{return firstPartField.get(*cKeys, idx);}
+  size_t Keys::getBpos(size_t idx) const{return bposField.get(*cKeys, idx);}
+  uint64_t Keys::getDuration(size_t idx) const{return durationField.get(*cKeys, idx);}
+  size_t Keys::getNumber(size_t idx) const{return numberField.get(*cKeys, idx);}
+  size_t Keys::getParts(size_t idx) const{return partsField.get(*cKeys, idx);}
+  uint64_t Keys::getTime(size_t idx) const{return timeField.get(*cKeys, idx);}
   void Keys::setSize(size_t idx, size_t _size){
     if (isConst){return;}
-    keys.setInt(sizeField, _size, idx);
+    keys->setInt(sizeField, _size, idx);
   }
-  size_t Keys::getSize(size_t idx) const{return cKeys.getInt(sizeField, idx);}
+  size_t Keys::getSize(size_t idx) const{return sizeField.get(*cKeys, idx);}
 
-  Fragments::Fragments(const Util::RelAccX &_fragments) : fragments(_fragments){}
+  Fragments::Fragments(const Util::RelAccX &_fragments) : fragments(_fragments){
+    durationField = fragments.getFieldData("duration");
+    keysField = fragments.getFieldData("keys");
+    firstKeyField = fragments.getFieldData("firstkey");
+    sizeField = fragments.getFieldData("size");
+  }
+  /// Uses the fragment field handles the track already resolved, instead of looking them up by name.
+  Fragments::Fragments(const Track &_track) : fragments(_track.fragments){
+    durationField = _track.fragmentDurationField;
+    keysField = _track.fragmentKeysField;
+    firstKeyField = _track.fragmentFirstKeyField;
+    sizeField = _track.fragmentSizeField;
+  }
   size_t Fragments::getFirstValid() const{return fragments.getDeleted();}
   size_t Fragments::getEndValid() const{return fragments.getEndPos();}
   size_t Fragments::getValidCount() const{return getEndValid() - getFirstValid();}
-  uint64_t Fragments::getDuration(size_t idx) const{return fragments.getInt("duration", idx);}
-  size_t Fragments::getKeycount(size_t idx) const{return fragments.getInt("keys", idx);}
-  size_t Fragments::getFirstKey(size_t idx) const{return fragments.getInt("firstkey", idx);}
-  size_t Fragments::getSize(size_t idx) const{return fragments.getInt("size", idx);}
+  uint64_t Fragments::getDuration(size_t idx) const{return durationField.get(fragments, idx);}
+  size_t Fragments::getKeycount(size_t idx) const{return keysField.get(fragments, idx);}
+  size_t Fragments::getFirstKey(size_t idx) const{return firstKeyField.get(fragments, idx);}
+  size_t Fragments::getSize(size_t idx) const{return sizeField.get(fragments, idx);}
 }// namespace DTSC
@@ -32,7 +32,10 @@
 //  Version 0-2: Undocumented changes
 //  Version 3: switched to bigMeta-style by default, Parts layout switched from 3/2/4 to 3/3/3 bytes
 //  Version 4: renamed bps to maxbps (peak bit rate) and added new value bps (average bit rate)
-#define DTSH_VERSION 4
+//  Version 5: raw format, sections laid out like the in-memory Util::RelAccX structures
+#define DTSH_VERSION 5
+// Headers sent over DTSC connections still use the version 4 packed format
+#define DTSH_PACKED_VERSION 4
 
 namespace DTSC{
 
@@ -54,9 +57,56 @@ namespace DTSC{
   extern char Magic_Packet[];  ///< The magic bytes for a DTSC packet
   extern char Magic_Packet2[]; ///< The magic bytes for a DTSC packet version 2
   extern char Magic_Command[]; ///< The magic bytes for a DTCM packet
+  extern char Magic_RawHeader[]; ///< The magic bytes for a raw (version 5+) DTSH file
+  extern char Magic_Mux[];       ///< The magic bytes for a multiplexed DTSC frame
 
   enum packType{DTSC_INVALID, DTSC_HEAD, DTSC_V1, DTSC_V2, DTCM};
 
+  ///\brief Interned track types, as returned by Meta::getTypeId.
+  enum trackType{TYPE_UNKNOWN, TYPE_VIDEO, TYPE_AUDIO, TYPE_META};
+
+  ///\brief Interned track codecs, as returned by Meta::getCodecId.
+  /// Codecs without an entry of their own are CODEC_UNKNOWN; compare getCodec() for those.
+  enum trackCodec{
+    CODEC_UNKNOWN,
+    CODEC_H264,
+    CODEC_HEVC,
+    CODEC_AV1,
+    CODEC_VP8,
+    CODEC_VP9,
+    CODEC_MPEG2,
+    CODEC_H263,
+    CODEC_VP6,
+    CODEC_VP6ALPHA,
+    CODEC_SCREENVIDEO1,
+    CODEC_SCREENVIDEO2,
+    CODEC_JPEG,
+    CODEC_THEORA,
+    CODEC_AAC,
+    CODEC_MP3,
+    CODEC_MP2,
+    CODEC_AC3,
+    CODEC_EAC3,
+    CODEC_OPUS,
+    CODEC_VORBIS,
+    CODEC_FLAC,
+    CODEC_DTS,
+    CODEC_PCM,
+    CODEC_FLOAT,
+    CODEC_ALAW,
+    CODEC_ULAW,
+    CODEC_ADPCM,
+    CODEC_SPEEX,
+    CODEC_NELLYMOSER,
+    CODEC_SUBTITLE,
+    CODEC_JSON,
+    CODEC_ID3,
+    CODEC_RAWTS
+  };
+
+  trackType typeFromString(const std::string &type);
+  trackCodec codecFromString(const std::string &codec);
+
   /// This class allows scanning through raw binary format DTSC data.
   /// It can be used as an iterator or as a direct accessor.
   class Scan{
@@ -104,6 +154,7 @@ namespace DTSC{
     operator bool() const;
     packType getVersion() const;
     void reInit(Socket::Connection &src);
+    uint32_t reInitInPlace(Socket::Connection &src);
     void reInit(const char *data_, unsigned int len, bool noCopy = false);
     void genericFill(uint64_t packTime, int64_t packOffset, uint32_t packTrack, const char *packData,
                      size_t packDataSize, uint64_t packBytePos, bool isKeyframe);
@@ -175,10 +226,14 @@ namespace DTSC{
     Util::RelAccXFieldData offsetField;
   };
 
+  class Track;
+
   class Keys{
   public:
     Keys(Util::RelAccX &_keys);
     Keys(const Util::RelAccX &_keys);
+    Keys(Track &_track);
+    Keys(const Track &_track);
     size_t getFirstValid() const;
     size_t getEndValid() const;
     size_t getValidCount() const;
@@ -193,23 +248,23 @@ namespace DTSC{
 
   private:
     bool isConst;
-    Util::RelAccX empty;
 
-    Util::RelAccX &keys;
-    const Util::RelAccX &cKeys;
+    Util::RelAccX *keys;
+    const Util::RelAccX *cKeys;
 
-    Util::RelAccXFieldData firstPartField;
-    Util::RelAccXFieldData bposField;
-    Util::RelAccXFieldData durationField;
-    Util::RelAccXFieldData numberField;
-    Util::RelAccXFieldData partsField;
-    Util::RelAccXFieldData timeField;
-    Util::RelAccXFieldData sizeField;
+    Util::RelAccXTypedField<uint64_t> firstPartField;
+    Util::RelAccXTypedField<uint64_t> bposField;
+    Util::RelAccXTypedField<uint32_t> durationField;
+    Util::RelAccXTypedField<uint32_t> numberField;
+    Util::RelAccXTypedField<uint32_t> partsField;
+    Util::RelAccXTypedField<uint64_t> timeField;
+    Util::RelAccXTypedField<uint32_t> sizeField;
   };
 
   class Fragments{
   public:
     Fragments(const Util::RelAccX &_fragments);
+    Fragments(const Track &_track);
     size_t getFirstValid() const;
     size_t getEndValid() const;
     size_t getValidCount() const;
@@ -220,6 +275,10 @@ namespace DTSC{
 
   private:
     const Util::RelAccX &fragments;
+    Util::RelAccXTypedField<uint32_t> durationField;
+    Util::RelAccXTypedField<uint16_t> keysField;
+    Util::RelAccXTypedField<uint32_t> firstKeyField;
+    Util::RelAccXTypedField<uint32_t> sizeField;
   };
 
   class Track{
@@ -254,18 +313,26 @@ namespace DTSC{
     Util::RelAccXFieldData partDurationField;
     Util::RelAccXFieldData partOffsetField;
 
-    Util::RelAccXFieldData keyFirstPartField;
-    Util::RelAccXFieldData keyBposField;
-    Util::RelAccXFieldData keyDurationField;
-    Util::RelAccXFieldData keyNumberField;
-    Util::RelAccXFieldData keyPartsField;
-    Util::RelAccXFieldData keyTimeField;
-    Util::RelAccXFieldData keySizeField;
-
-    Util::RelAccXFieldData fragmentDurationField;
-    Util::RelAccXFieldData fragmentKeysField;
-    Util::RelAccXFieldData fragmentFirstKeyField;
-    Util::RelAccXFieldData fragmentSizeField;
+    Util::RelAccXTypedField<uint64_t> keyFirstPartField;
+    Util::RelAccXTypedField<uint64_t> keyBposField;
+    Util::RelAccXTypedField<uint32_t> keyDurationField;
+    Util::RelAccXTypedField<uint32_t> keyNumberField;
+    Util::RelAccXTypedField<uint32_t> keyPartsField;
+    Util::RelAccXTypedField<uint64_t> keyTimeField;
+    Util::RelAccXTypedField<uint32_t> keySizeField;
+
+    Util::RelAccXTypedField<uint32_t> fragmentDurationField;
+    Util::RelAccXTypedField<uint16_t> fragmentKeysField;
+    Util::RelAccXTypedField<uint32_t> fragmentFirstKeyField;
+    Util::RelAccXTypedField<uint32_t> fragmentSizeField;
+
+    Util::RelAccXTypedField<uint32_t> pageFirstKeyField;
+    Util::RelAccXTypedField<uint32_t> pageKeyCountField;
+    Util::RelAccXTypedField<uint32_t> pagePartsField;
+    Util::RelAccXTypedField<uint32_t> pageSizeField;
+    Util::RelAccXTypedField<uint32_t> pageAvailField;
+    Util::RelAccXTypedField<uint64_t> pageFirstTimeField;
+    Util::RelAccXTypedField<uint64_t> pageLastKeyTimeField;
 
     Util::RelAccXFieldData extraJSON;
   };
@@ -292,6 +359,7 @@ namespace DTSC{
     ~Meta();
     void reInit(const std::string &_streamName, bool master = true, bool autoBackOff = true);
     void reInit(const std::string &_streamName, const std::string &fileName);
+    void reInit(const std::string &_streamName, const char *data, size_t len);
     void reInit(const std::string &_streamName, const DTSC::Scan &src);
     void addTrackFrom(const DTSC::Scan &src);
 
@@ -364,9 +432,13 @@ namespace DTSC{
 
     void setType(size_t trackIdx, const std::string &type);
     std::string getType(size_t trackIdx) const;
+    trackType getTypeId(size_t trackIdx) const;
 
     void setCodec(size_t trackIdx, const std::string &codec);
     std::string getCodec(size_t trackIdx) const;
+    trackCodec getCodecId(size_t trackIdx) const;
+
+    uint64_t getGeneration() const;
 
     void setLang(size_t trackIdx, const std::string &lang);
     std::string getLang(size_t trackIdx) const;
@@ -474,6 +546,8 @@ namespace DTSC{
     bool nextPageAvailable(uint32_t idx, size_t currentPage) const;
     size_t getPageNumberForTime(uint32_t idx, uint64_t time) const;
     size_t getPageNumberForKey(uint32_t idx, uint64_t keynumber) const;
+    size_t getAvailablePageForKey(uint32_t idx, uint64_t keyNum) const;
+    size_t getHighestPageNumber(uint32_t idx) const;
     size_t getKeyNumForTime(uint32_t idx, uint64_t time) const;
     bool keyTimingsMatch(size_t idx1, size_t idx2) const;
 
@@ -481,6 +555,9 @@ namespace DTSC{
     Util::RelAccX &keys(size_t idx);
     const Util::RelAccX &keys(size_t idx) const;
     const Util::RelAccX &fragments(size_t idx) const;
+    Keys getKeys(size_t idx);
+    Keys getKeys(size_t idx) const;
+    Fragments getFragments(size_t idx) const;
     Util::RelAccX &pages(size_t idx);
     const Util::RelAccX &pages(size_t idx) const;
 
@@ -490,6 +567,7 @@ namespace DTSC{
 
     uint64_t getSendLen(bool skipDynamic = false, std::set<size_t> selectedTracks = std::set<size_t>()) const;
     void toFile(const std::string &uri) const;
+    void sendRaw(Socket::Connection &conn, std::set<size_t> selectedTracks) const;
     void send(Socket::Connection &conn, bool skypDynamic = false,
               std::set<size_t> selectedTracks = std::set<size_t>(), bool reID = false) const;
     void toJSON(JSON::Value &res, bool skipDynamic = true, bool tracksOnly = false) const;
@@ -508,6 +586,8 @@ namespace DTSC{
     void streamInit(size_t trackCount = DEFAULT_TRACK_COUNT);
     void updateFieldDataReferences();
     void resizeTrackList(size_t newTrackCount);
+    void bumpGeneration();
+    void checkIdCache(size_t trackIdx) const;
 
     std::string streamName;
 
@@ -535,6 +615,12 @@ namespace DTSC{
     Util::RelAccXFieldData streamBootMsOffsetField;
     Util::RelAccXFieldData streamUTCOffsetField;
     Util::RelAccXFieldData streamMinimumFragmentDurationField;
+    Util::RelAccXFieldData streamGenerationField;
+
+    // Per-process cache of interned track types and codecs, valid for idCacheGeneration
+    mutable std::vector<uint8_t> typeIds;
+    mutable std::vector<uint8_t> codecIds;
+    mutable uint64_t idCacheGeneration;
 
     Util::RelAccXFieldData trackValidField;
     Util::RelAccXFieldData trackIdField;
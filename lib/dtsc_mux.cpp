@@ -0,0 +1,411 @@
+/// \file dtsc_mux.cpp
+/// Multiplexing of many DTSC connections over a single link between two servers.
+
+#include "dtsc_mux.h"
+#include "bitfields.h"
+#include "defines.h"
+#include "dtsc.h"
+#include "stream.h"
+#include "timing.h"
+#include <poll.h>
+#include <string.h>
+
+namespace DTSC{
+
+  /// Returns the path of the Unix socket on which the process sharing a multiplexed connection to
+  /// the given origin accepts local connections.
+  std::string muxSocket(const std::string &host, uint16_t port){
+    return Util::getTmpFolder() + "MstDTSCMux_" + host + "_" + JSON::Value((uint64_t)port).asString();
+  }
+
+  /// Starts a multiplexed session over the given link.
+  /// The link is used non-blocking from now on; any data already received on it is part of the
+  /// session. Only the end that connected the link should open channels.
+  Mux::Mux(Socket::Connection &_link) : link(_link){
+    nextChannel = 1;
+    lastRecv = lastPing = Util::bootSecs();
+    link.Received().splitter.clear();
+    link.setBlocking(false);
+    loop.add(link.getSocket(), &link);
+  }
+
+  /// Closes all channels. The link itself is left as it is.
+  Mux::~Mux(){
+    while (chans.size()){closeChannel(chans.begin()->first, false);}
+    while (closed.size()){
+      delete closed.front();
+      closed.pop_front();
+    }
+    loop.remove(link.getSocket());
+  }
+
+  /// Returns true while the link is connected.
+  Mux::operator bool() const{return link;}
+
+  /// Returns the amount of open channels.
+  size_t Mux::channels() const{return chans.size();}
+
+  /// Sends data over the link without blocking, queueing what cannot be sent right away.
+  /// The queue is sent by pump(); channels stop sending while it is large.
+  void Mux::send(const char *data, size_t len){
+    if (!linkOut.size()){
+      unsigned int w = link.iwrite(data, len);
+      data += w;
+      len -= w;
+    }
+    if (len){linkOut.append(data, len);}
+  }
+
+  /// Sends a DTCM command over the link.
+  void Mux::sendCmd(const JSON::Value &cmd){
+    std::string packed = cmd.toPacked();
+    char hdr[8];
+    memcpy(hdr, Magic_Command, 4);
+    Bit::htobl(hdr + 4, packed.size());
+    send(hdr, 8);
+    send(packed.data(), packed.size());
+  }
+
+  /// Opens a new channel carrying the given local connection, which the session takes over.
+  /// Returns the channel number.
+  uint32_t Mux::open(Socket::Connection &local){
+    uint32_t channel = nextChannel++;
+    newChannel(channel);
+    JSON::Value cmd;
+    cmd["cmd"] = "mux_open";
+    cmd["channel"] = channel;
+    sendCmd(cmd);
+    attach(channel, local);
+    return channel;
+  }
+
+  /// Returns a channel the other end opened, that needs a local connection through attach().
+  /// Returns zero if there is no such channel.
+  uint32_t Mux::accept(){
+    while (opened.size()){
+      uint32_t channel = opened.front();
+      opened.pop_front();
+      // Skips channels that were closed again before being accepted
+      if (chans.count(channel)){return channel;}
+    }
+    return 0;
+  }
+
+  /// Connects a channel to the given local connection, which the session takes over.
+  /// Any data already received on the channel is written to it right away, and data the
+  /// connection already read is sent from pump(). Attaching a disconnected connection closes the
+  /// channel.
+  void Mux::attach(uint32_t channel, Socket::Connection &local){
+    if (!local){
+      closeChannel(channel, true);
+      return;
+    }
+    std::map<uint32_t, muxChannel *>::iterator it = chans.find(channel);
+    if (it == chans.end() || it->second->fd != -1){
+      WARN_MSG("Cannot attach connection to channel %" PRIu32 ": not waiting for one", channel);
+      local.close();
+      return;
+    }
+    muxChannel &c = *it->second;
+    c.local = local;
+    local.drop();
+    c.local.Received().splitter.clear();
+    c.local.setBlocking(false);
+    c.fd = c.local.getSocket();
+    setWatched(c, true);
+    // Data the connection already read will not be signalled by the event loop
+    if (c.local.Received().size()){backlog.insert(channel);}
+    if (flushing.count(channel)){flush(c);}
+    if (!c.local){closeChannel(channel, true);}
+  }
+
+  /// Also wakes up pump() when the given file descriptor becomes readable, for example to accept
+  /// new local connections without delay.
+  void Mux::watch(int fd){loop.add(fd, this);}
+
+  /// Forgets about all channels and the link without shutting any of them down.
+  /// Meant for use in forked child processes, so the parent can keep using them.
+  void Mux::drop(){
+    for (std::map<uint32_t, muxChannel *>::iterator it = chans.begin(); it != chans.end(); ++it){
+      if (it->second->watched){loop.remove(it->second->fd);}
+      it->second->local.drop();
+      delete it->second;
+    }
+    chans.clear();
+    opened.clear();
+    flushing.clear();
+    backlog.clear();
+    while (closed.size()){
+      delete closed.front();
+      closed.pop_front();
+    }
+    loop.remove(link.getSocket());
+  }
+
+  muxChannel *Mux::newChannel(uint32_t channel){
+    muxChannel *c = new muxChannel;
+    c->id = channel;
+    c->fd = -1;
+    c->credit = DTSC_MUX_WINDOW;
+    c->delivered = 0;
+    c->watched = false;
+    c->closing = false;
+    chans[channel] = c;
+    return c;
+  }
+
+  /// Closes a channel and its local connection, telling the other end if notify is true.
+  void Mux::closeChannel(uint32_t channel, bool notify){
+    std::map<uint32_t, muxChannel *>::iterator it = chans.find(channel);
+    if (it == chans.end()){return;}
+    muxChannel *c = it->second;
+    if (c->watched){loop.remove(c->fd);}
+    c->local.close();
+    closed.push_back(c);
+    chans.erase(it);
+    flushing.erase(channel);
+    backlog.erase(channel);
+    if (notify && link){
+      JSON::Value cmd;
+      cmd["cmd"] = "mux_close";
+      cmd["channel"] = channel;
+      sendCmd(cmd);
+    }
+  }
+
+  /// Starts or stops waiting for data on the local connection of a channel.
+  /// Channels without credit are not waited for, leaving their data in the socket so the local
+  /// sender slows down instead.
+  void Mux::setWatched(muxChannel &c, bool watched){
+    if (c.watched == watched || c.fd == -1){return;}
+    if (watched){
+      c.watched = loop.add(c.fd, &c);
+    }else{
+      loop.remove(c.fd);
+      c.watched = false;
+    }
+  }
+
+  /// Tells the other end it may send more data on a channel, once a good part of its window has
+  /// been written to the local connection.
+  void Mux::grant(muxChannel &c){
+    if (c.delivered < DTSC_MUX_WINDOW / 4 || !link){return;}
+    JSON::Value cmd;
+    cmd["cmd"] = "mux_credit";
+    cmd["channel"] = c.id;
+    cmd["bytes"] = c.delivered;
+    sendCmd(cmd);
+    c.delivered = 0;
+  }
+
+  /// Writes data received on a channel to its local connection, keeping what cannot be written
+  /// right away until the local connection is ready for it.
+  void Mux::deliver(muxChannel &c, const char *data, size_t len){
+    if (!c.pending.size() && c.fd != -1){
+      unsigned int w = c.local.iwrite(data, len);
+      c.delivered += w;
+      data += w;
+      len -= w;
+    }
+    if (len){
+      c.pending.append(data, len);
+      flushing.insert(c.id);
+    }
+    grant(c);
+  }
+
+  /// Writes as much pending data of a channel to its local connection as possible.
+  /// Returns true if anything was written.
+  bool Mux::flush(muxChannel &c){
+    if (c.fd == -1){return false;}
+    unsigned int w = c.pending.size() ? c.local.iwrite(c.pending, c.pending.size()) : 0;
+    c.pending.shift(w);
+    c.delivered += w;
+    if (!c.pending.size()){flushing.erase(c.id);}
+    grant(c);
+    return w;
+  }
+
+  /// Sends all data waiting on the local connection of a channel over the link, for as long as the
+  /// channel has credit left. Closes the channel once its local connection closed and all of its
+  /// data was sent. Channels left with data read from their local connection that did not fit on
+  /// a congested link are remembered, as the event loop will not signal that data again.
+  /// Returns true if anything was sent.
+  bool Mux::readLocal(muxChannel &c){
+    if (c.fd == -1){return false;}
+    bool moved = false;
+    Socket::Buffer &buf = c.local.Received();
+    while (c.credit > 0 && linkOut.size() < DTSC_MUX_FRAME){
+      if (!buf.size()){
+        if (c.local){c.local.spool();}
+        if (!buf.size()){break;}
+      }
+      uint32_t len = buf.bytes(DTSC_MUX_FRAME);
+      char hdr[12];
+      memcpy(hdr, Magic_Mux, 4);
+      Bit::htobl(hdr + 4, len + 4);
+      Bit::htobl(hdr + 8, c.id);
+      send(hdr, 12);
+      send(buf.peek(len), len);
+      buf.skip(len);
+      c.credit -= len;
+      moved = true;
+    }
+    if (c.credit <= 0){setWatched(c, false);}
+    if (c.credit > 0 && buf.size()){
+      backlog.insert(c.id);
+    }else{
+      backlog.erase(c.id);
+    }
+    if (!c.local && !buf.size()){closeChannel(c.id, true);}
+    return moved;
+  }
+
+  /// Handles all complete frames and commands received over the link.
+  /// Returns true if anything was handled.
+  bool Mux::readLink(){
+    bool moved = false;
+    while (link){
+      const char *hdr = link.Received().peek(8);
+      if (!hdr){break;}
+      bool isMux = !memcmp(hdr, Magic_Mux, 4);
+      uint32_t len = Bit::btohl(hdr + 4);
+      // Frames are never larger than the sending end makes them, so anything else is not waited for
+      if ((!isMux && (memcmp(hdr, Magic_Command, 4) || len > DTSC_MUX_CMD_MAX)) ||
+          (isMux && (len < 4 || len > DTSC_MUX_FRAME + 4))){
+        FAIL_MSG("Invalid data received over multiplexed link; closing it");
+        link.close();
+        break;
+      }
+      const char *frame = link.Received().peek(8 + len);
+      if (!frame){break;}
+      moved = true;
+      lastRecv = Util::bootSecs();
+      if (isMux){
+        // Data for unknown channels was sent before the other end saw us close the channel
+        std::map<uint32_t, muxChannel *>::iterator it = chans.find(Bit::btohl(frame + 8));
+        if (it != chans.end()){
+          deliver(*it->second, frame + 12, len - 4);
+          if (it->second->fd != -1 && !it->second->local){closeChannel(it->first, true);}
+        }
+        link.Received().skip(8 + len);
+        continue;
+      }
+      Scan cmd((char *)frame + 8, len);
+      std::string name = cmd.getMember("cmd").asString();
+      uint32_t channel = cmd.getMember("channel").asInt();
+      std::map<uint32_t, muxChannel *>::iterator it = chans.find(channel);
+      if (name == "mux_open"){
+        if (!channel || it != chans.end()){
+          WARN_MSG("Ignoring request to open channel %" PRIu32 ": already open", channel);
+        }else{
+          newChannel(channel);
+          opened.push_back(channel);
+        }
+      }else if (name == "mux_close"){
+        if (it != chans.end()){
+          it->second->closing = true;
+          if (!it->second->pending.size()){closeChannel(channel, false);}
+        }
+      }else if (name == "mux_credit"){
+        if (it != chans.end()){
+          muxChannel &c = *it->second;
+          c.credit += cmd.getMember("bytes").asInt();
+          if (c.credit > 0){
+            setWatched(c, true);
+            readLocal(c);
+          }
+        }
+      }else if (name == "ping"){
+        JSON::Value rep;
+        rep["cmd"] = "ok";
+        rep["msg"] = "Pong!";
+        sendCmd(rep);
+      }else if (name == "error"){
+        FAIL_MSG("Multiplexed link error: %s", cmd.getMember("msg").asString().c_str());
+        link.close();
+      }else if (name != "ok"){
+        WARN_MSG("Unhandled DTCM command on multiplexed link: '%s'", name.c_str());
+      }
+      link.Received().skip(8 + len);
+    }
+    return moved;
+  }
+
+  /// Moves data between the link and all channels, waiting up to timeout milliseconds for any to
+  /// arrive. Also keeps the link alive, and closes it if the other end stopped responding.
+  /// Returns true if any data was moved, or a watched file descriptor became readable.
+  bool Mux::pump(uint64_t timeout){
+    if (!link){return false;}
+    bool moved = readLink();
+    // Keeps trying to write pending data, as the event loop only signals readability
+    for (std::set<uint32_t>::iterator it = flushing.begin(); it != flushing.end();){
+      muxChannel &c = *chans[*(it++)];
+      if (flush(c)){moved = true;}
+      if (c.fd != -1 && !c.local){
+        closeChannel(c.id, true);
+      }else if (c.closing && !c.pending.size()){
+        closeChannel(c.id, false);
+      }
+    }
+    if (linkOut.size()){
+      unsigned int w = link.iwrite(linkOut, linkOut.size());
+      linkOut.shift(w);
+      if (w){moved = true;}
+    }
+    // Continues sending buffered data of channels that were cut short by a congested link
+    std::set<uint32_t>::iterator it = backlog.begin();
+    while (it != backlog.end() && linkOut.size() < DTSC_MUX_FRAME){
+      muxChannel &c = *chans[*(it++)];
+      if (readLocal(c)){moved = true;}
+    }
+    if (moved){timeout = 0;}
+    if ((flushing.size() || linkOut.size()) && timeout > 10){timeout = 10;}
+
+    std::deque<void *> ready;
+    if (linkOut.size() >= DTSC_MUX_FRAME){
+      // The link is congested, so channels cannot send anyway: only wait for the link to become
+      // writable, while still receiving from it so the other end never blocks on us.
+      struct pollfd p;
+      p.fd = link.getSocket();
+      p.events = POLLIN | POLLOUT;
+      p.revents = 0;
+      if (poll(&p, 1, timeout) > 0 && (p.revents & (POLLIN | POLLHUP | POLLERR))){ready.push_back(&link);}
+    }else{
+      loop.await(ready, timeout);
+    }
+    for (std::deque<void *>::iterator it = ready.begin(); it != ready.end(); ++it){
+      if (*it == this){
+        moved = true;
+        continue;
+      }
+      if (*it == &link){
+        link.spool();
+        if (readLink()){moved = true;}
+        continue;
+      }
+      // Local connection of a channel; it may have been closed by an earlier event in this batch
+      muxChannel *c = (muxChannel *)*it;
+      std::map<uint32_t, muxChannel *>::iterator ch = chans.find(c->id);
+      if (ch == chans.end() || ch->second != c){continue;}
+      if (readLocal(*c)){moved = true;}
+    }
+    while (closed.size()){
+      delete closed.front();
+      closed.pop_front();
+    }
+
+    uint64_t now = Util::bootSecs();
+    if (now - lastRecv > 30){
+      WARN_MSG("Multiplexed link timed out; closing it");
+      link.close();
+    }else if (now - lastRecv >= 5 && now - lastPing >= 5){
+      JSON::Value cmd;
+      cmd["cmd"] = "ping";
+      sendCmd(cmd);
+      lastPing = now;
+    }
+    return moved;
+  }
+
+}// namespace DTSC
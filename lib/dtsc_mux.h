@@ -0,0 +1,85 @@
+/// \file dtsc_mux.h
+/// Multiplexing of many DTSC connections over a single link between two servers.
+
+#pragma once
+#include "ev.h"
+#include "json.h"
+#include "socket.h"
+#include <deque>
+#include <map>
+#include <set>
+#include <stdint.h>
+
+/// Amount of bytes a channel may send before the receiving end has to grant more.
+#define DTSC_MUX_WINDOW (4 * 1024 * 1024)
+/// Largest amount of bytes sent in a single multiplexed frame.
+#define DTSC_MUX_FRAME (256 * 1024)
+/// Largest DTCM command accepted over a multiplexed link; the commands used on it are all tiny.
+#define DTSC_MUX_CMD_MAX (64 * 1024)
+
+namespace DTSC{
+
+  std::string muxSocket(const std::string &host, uint16_t port);
+
+  /// State of a single channel of a multiplexed session.
+  struct muxChannel{
+    uint32_t id;                     ///< Channel number
+    Socket::Connection local;        ///< Local end of the channel, disconnected until attached
+    int fd;                          ///< Socket of local as attached, or -1 if not attached yet
+    int64_t credit;                  ///< Bytes we may still send to the other end
+    uint64_t delivered;              ///< Bytes written to local since the last credit grant
+    Util::ResizeablePointer pending; ///< Received bytes not yet written to local
+    bool watched;                    ///< True if local is registered with the event loop
+    bool closing;                    ///< True if the other end closed the channel
+  };
+
+  /// Carries many DTSC connections over one link, so that an edge pulling many streams from the
+  /// same origin needs only a single connection to it.
+  /// Every channel is a plain byte stream between a local connection on either end, so the regular
+  /// DTSC protocol runs unchanged over it. Channel data travels in DTMX frames:
+  /// "DTMX", 4 bytes length, 4 bytes channel number, then the data itself.
+  /// Channels are managed through DTCM commands on the link itself: mux_open and mux_close open and
+  /// close channels, and mux_credit grants the other end permission to send more data on a channel.
+  /// Each channel may have DTSC_MUX_WINDOW bytes in flight, so a slow channel never holds up the
+  /// others.
+  /// This saves connections and connection setup, not processes: every channel is still served by
+  /// its own DTSC output on the origin and read by its own DTSC input on the edge, each with their
+  /// own DTSC::Meta. The mux processes only pass bytes along and never parse the streams.
+  class Mux{
+  public:
+    Mux(Socket::Connection &link);
+    ~Mux();
+    operator bool() const;
+    uint32_t open(Socket::Connection &local);
+    uint32_t accept();
+    void attach(uint32_t channel, Socket::Connection &local);
+    void watch(int fd);
+    bool pump(uint64_t timeout);
+    size_t channels() const;
+    void drop();
+    void sendCmd(const JSON::Value &cmd);
+
+  private:
+    Socket::Connection &link;
+    std::map<uint32_t, muxChannel *> chans;
+    std::deque<uint32_t> opened; ///< Channels opened by the other end that are not attached yet
+    std::set<uint32_t> flushing; ///< Channels with pending data for their local end
+    std::set<uint32_t> backlog;  ///< Channels with buffered local data that did not fit on the link
+    std::deque<muxChannel *> closed; ///< Closed channels, deleted at the end of pump()
+    Event::Loop loop;
+    uint32_t nextChannel;
+    uint64_t lastRecv; ///< bootSecs() of the last data received over the link
+    uint64_t lastPing; ///< bootSecs() of the last ping sent over the link
+    Util::ResizeablePointer linkOut; ///< Data waiting to be sent over the link
+    void send(const char *data, size_t len);
+    muxChannel *newChannel(uint32_t channel);
+    void closeChannel(uint32_t channel, bool notify);
+    void setWatched(muxChannel &c, bool watched);
+    bool readLink();
+    bool readLocal(muxChannel &c);
+    void deliver(muxChannel &c, const char *data, size_t len);
+    bool flush(muxChannel &c);
+    void grant(muxChannel &c);
+  };
+
+}// namespace DTSC
@@ -0,0 +1,112 @@
+/// \file ev.cpp
+/// Event loop helper for waiting on readability of many file descriptors at once.
+
+#include "ev.h"
+#include "defines.h"
+#include <errno.h>
+#include <poll.h>
+#include <string.h>
+#include <unistd.h>
+#include <vector>
+#ifdef __linux__
+#include <sys/epoll.h>
+#endif
+
+namespace Event{
+
+  Loop::Loop(){
+#ifdef __linux__
+    epollFd = epoll_create(64);
+    if (epollFd == -1){FAIL_MSG("Could not create epoll instance: %s", strerror(errno));}
+#else
+    epollFd = 0;
+#endif
+  }
+
+  Loop::~Loop(){
+#ifdef __linux__
+    if (epollFd != -1){close(epollFd);}
+#endif
+  }
+
+  /// Returns true if the loop can be used.
+  Loop::operator bool() const{return epollFd != -1;}
+
+  /// Starts watching the given file descriptor for readability.
+  /// Returns false if the file descriptor could not be added.
+  bool Loop::add(int fd, void *arg){
+    if (fd < 0){return false;}
+#ifdef __linux__
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN | EPOLLRDHUP;
+    ev.data.fd = fd;
+    int op = fds.count(fd) ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+    if (epoll_ctl(epollFd, op, fd, &ev) == -1){
+      WARN_MSG("Could not add file descriptor %d to epoll: %s", fd, strerror(errno));
+      return false;
+    }
+#endif
+    fds[fd] = arg;
+    return true;
+  }
+
+  /// Stops watching the given file descriptor.
+  /// Must be called before the file descriptor is closed.
+  void Loop::remove(int fd){
+    if (!fds.count(fd)){return;}
+#ifdef __linux__
+    struct epoll_event ev;
+    epoll_ctl(epollFd, EPOLL_CTL_DEL, fd, &ev);
+#endif
+    fds.erase(fd);
+  }
+
+  /// Returns the amount of file descriptors currently being watched.
+  size_t Loop::size() const{return fds.size();}
+
+  /// Waits up to timeout milliseconds for any watched file descriptor to become readable.
+  /// The arguments of all readable file descriptors are appended to ready.
+  /// Returns the amount of arguments appended.
+  size_t Loop::await(std::deque<void *> &ready, uint64_t timeout){
+#ifdef __linux__
+    struct epoll_event evs[64];
+    int r = epoll_wait(epollFd, evs, 64, timeout);
+    if (r < 0){
+      if (errno != EINTR){WARN_MSG("Error waiting for events: %s", strerror(errno));}
+      return 0;
+    }
+    size_t ret = 0;
+    for (int i = 0; i < r; ++i){
+      std::map<int, void *>::iterator it = fds.find(evs[i].data.fd);
+      if (it == fds.end()){continue;}
+      ready.push_back(it->second);
+      ++ret;
+    }
+    return ret;
+#else
+    std::vector<struct pollfd> pfds;
+    pfds.reserve(fds.size());
+    for (std::map<int, void *>::iterator it = fds.begin(); it != fds.end(); ++it){
+      struct pollfd p;
+      p.fd = it->first;
+      p.events = POLLIN;
+      p.revents = 0;
+      pfds.push_back(p);
+    }
+    int r = poll(pfds.size() ? &pfds[0] : 0, pfds.size(), timeout);
+    if (r < 0){
+      if (errno != EINTR){WARN_MSG("Error waiting for events: %s", strerror(errno));}
+      return 0;
+    }
+    size_t ret = 0;
+    for (size_t i = 0; i < pfds.size(); ++i){
+      if (!pfds[i].revents){continue;}
+      ready.push_back(fds[pfds[i].fd]);
+      ++ret;
+    }
+    return ret;
+#endif
+  }
+
+}// namespace Event
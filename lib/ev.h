@@ -0,0 +1,31 @@
+/// \file ev.h
+/// Event loop helper for waiting on readability of many file descriptors at once.
+
+#pragma once
+#include <deque>
+#include <map>
+#include <stddef.h>
+#include <stdint.h>
+
+namespace Event{
+
+  /// Waits for any of a set of file descriptors to become readable.
+  /// Uses epoll where available, and falls back to poll() elsewhere.
+  /// Every file descriptor is registered with an opaque argument, which is handed back when the
+  /// file descriptor is readable (or closed/errored).
+  class Loop{
+  public:
+    Loop();
+    ~Loop();
+    operator bool() const;
+    bool add(int fd, void *arg);
+    void remove(int fd);
+    size_t size() const;
+    size_t await(std::deque<void *> &ready, uint64_t timeout);
+
+  private:
+    int epollFd;
+    std::map<int, void *> fds;
+  };
+
+}// namespace Event
@@ -335,16 +335,16 @@ bool FLV::Tag::DTSCLoader(DTSC::Packet &packData, const DTSC::Meta &M, size_t id
     WARN_MSG("packet with invalid track id found!");
     return false;
   }
-  std::string type = M.getType(idx);
-  std::string codec = M.getCodec(idx);
-  if (type == "video"){
+  DTSC::trackType type = M.getTypeId(idx);
+  DTSC::trackCodec codec = M.getCodecId(idx);
+  if (type == DTSC::TYPE_VIDEO){
     char *tmpData = 0;
     size_t tmpLen = 0;
     packData.getString("data", tmpData, tmpLen);
     len = tmpLen + 16;
-    if (codec == "H264"){len += 4;}
+    if (codec == DTSC::CODEC_H264){len += 4;}
     if (!checkBufferSize()){return false;}
-    if (codec == "H264"){
+    if (codec == DTSC::CODEC_H264){
       memcpy(data + 16, tmpData, len - 20);
       data[12] = 1;
       offset(packData.getInt("offset"));
@@ -352,13 +352,13 @@ bool FLV::Tag::DTSCLoader(DTSC::Packet &packData, const DTSC::Meta &M, size_t id
       memcpy(data + 12, tmpData, len - 16);
     }
     data[11] = 0;
-    if (codec == "H264"){data[11] |= 7;}
-    if (codec == "ScreenVideo2"){data[11] |= 6;}
-    if (codec == "VP6Alpha"){data[11] |= 5;}
-    if (codec == "VP6"){data[11] |= 4;}
-    if (codec == "ScreenVideo1"){data[11] |= 3;}
-    if (codec == "H263"){data[11] |= 2;}
-    if (codec == "JPEG"){data[11] |= 1;}
+    if (codec == DTSC::CODEC_H264){data[11] |= 7;}
+    if (codec == DTSC::CODEC_SCREENVIDEO2){data[11] |= 6;}
+    if (codec == DTSC::CODEC_VP6ALPHA){data[11] |= 5;}
+    if (codec == DTSC::CODEC_VP6){data[11] |= 4;}
+    if (codec == DTSC::CODEC_SCREENVIDEO1){data[11] |= 3;}
+    if (codec == DTSC::CODEC_H263){data[11] |= 2;}
+    if (codec == DTSC::CODEC_JPEG){data[11] |= 1;}
     if (packData.getFlag("keyframe")){
       data[11] |= 0x10;
     }else{
@@ -366,14 +366,14 @@ bool FLV::Tag::DTSCLoader(DTSC::Packet &packData, const DTSC::Meta &M, size_t id
     }
     if (packData.getFlag("disposableframe")){data[11] |= 0x30;}
   }
-  if (type == "audio"){
+  if (type == DTSC::TYPE_AUDIO){
     char *tmpData = 0;
     size_t tmpLen = 0;
     packData.getString("data", tmpData, tmpLen);
     len = tmpLen + 16;
-    if (codec == "AAC"){len++;}
+    if (codec == DTSC::CODEC_AAC){len++;}
     if (!checkBufferSize()){return false;}
-    if (codec == "AAC"){
+    if (codec == DTSC::CODEC_AAC){
       memcpy(data + 13, tmpData, len - 17);
       data[12] = 1; // raw AAC data, not sequence header
     }else{
@@ -381,17 +381,17 @@ bool FLV::Tag::DTSCLoader(DTSC::Packet &packData, const DTSC::Meta &M, size_t id
     }
     unsigned int datarate = M.getRate(idx);
     data[11] = 0;
-    if (codec == "AAC"){data[11] |= 0xA0;}
-    if (codec == "MP3"){
+    if (codec == DTSC::CODEC_AAC){data[11] |= 0xA0;}
+    if (codec == DTSC::CODEC_MP3){
       if (datarate == 8000){
         data[11] |= 0xE0;
       }else{
         data[11] |= 0x20;
       }
     }
-    if (codec == "ADPCM"){data[11] |= 0x10;}
-    if (codec == "PCM"){data[11] |= 0x30;}
-    if (codec == "Nellymoser"){
+    if (codec == DTSC::CODEC_ADPCM){data[11] |= 0x10;}
+    if (codec == DTSC::CODEC_PCM){data[11] |= 0x30;}
+    if (codec == DTSC::CODEC_NELLYMOSER){
       if (datarate == 8000){
         data[11] |= 0x50;
       }else if (datarate == 16000){
@@ -400,9 +400,9 @@ bool FLV::Tag::DTSCLoader(DTSC::Packet &packData, const DTSC::Meta &M, size_t id
         data[11] |= 0x60;
       }
     }
-    if (codec == "ALAW"){data[11] |= 0x70;}
-    if (codec == "ULAW"){data[11] |= 0x80;}
-    if (codec == "Speex"){data[11] |= 0xB0;}
+    if (codec == DTSC::CODEC_ALAW){data[11] |= 0x70;}
+    if (codec == DTSC::CODEC_ULAW){data[11] |= 0x80;}
+    if (codec == DTSC::CODEC_SPEEX){data[11] |= 0xB0;}
     if (datarate >= 44100){
       data[11] |= 0x0C;
     }else if (datarate >= 22050){
@@ -415,9 +415,9 @@ bool FLV::Tag::DTSCLoader(DTSC::Packet &packData, const DTSC::Meta &M, size_t id
   }
   if (!len){return false;}
   setLen();
-  if (type == "video"){data[0] = 0x09;}
-  if (type == "audio"){data[0] = 0x08;}
-  if (type == "meta"){data[0] = 0x12;}
+  if (type == DTSC::TYPE_VIDEO){data[0] = 0x09;}
+  if (type == DTSC::TYPE_AUDIO){data[0] = 0x08;}
+  if (type == DTSC::TYPE_META){data[0] = 0x12;}
   data[1] = ((len - 15) >> 16) & 0xFF;
   data[2] = ((len - 15) >> 8) & 0xFF;
   data[3] = (len - 15) & 0xFF;
@@ -16,15 +16,10 @@ namespace h264{
     uint8_t nalType = (data[0] & 0x1F);
     if (nalType == 0x05){return true;}
     if (nalType != 0x01){return false;}
+    // The slice type is always within the first few bytes of the slice header
+    char header[11];
     Utils::bitstream bs;
-    for (size_t i = 1; i < 10 && i < len; ++i){
-      if (i + 2 < len && (memcmp(data + i, "\000\000\003", 3) == 0)){// Emulation prevention bytes
-        bs.append(data + i, 2);
-        i += 2;
-      }else{
-        bs.append(data + i, 1);
-      }
-    }
+    if (len > 1){bs.append(header, nalu::removeEmulationPrevention(data + 1, len - 1 < 11 ? len - 1 : 11, header));}
     bs.getExpGolomb(); // Discard first_mb_in_slice
     uint64_t sliceType = bs.getUExpGolomb();
     // Slice types:
@@ -77,16 +72,7 @@ namespace h264{
 
   bool sequenceParameterSet::validate() const{
     Utils::bitstream bs;
-    for (size_t i = 1; i < dataLen; i++){
-      if (i + 2 < dataLen && (memcmp(data + i, "\000\000\003", 3) == 0)){// Emulation prevention bytes
-        // Yes, we increase i here
-        bs.append(data + i, 2);
-        i += 2;
-      }else{
-        // No we don't increase i here
-        bs.append(data + i, 1);
-      }
-    }
+    if (dataLen > 1){nalu::removeEmulationPrevention(data + 1, dataLen - 1, bs);}
     if (bs.size() < 24){return false;}//static size data
     char profileIdc = bs.get(8);
     bs.skip(16);
@@ -177,16 +163,7 @@ namespace h264{
 
     // Fill the bitstream
     Utils::bitstream bs;
-    for (size_t i = 1; i < dataLen; i++){
-      if (i + 2 < dataLen && (memcmp(data + i, "\000\000\003", 3) == 0)){// Emulation prevention bytes
-        // Yes, we increase i here
-        bs.append(data + i, 2);
-        i += 2;
-      }else{
-        // No we don't increase i here
-        bs.append(data + i, 1);
-      }
-    }
+    if (dataLen > 1){nalu::removeEmulationPrevention(data + 1, dataLen - 1, bs);}
 
     char profileIdc = bs.get(8);
     result.profile = profileIdc;
@@ -378,16 +355,7 @@ namespace h264{
 
     // Fill the bitstream
     Utils::bitstream bs;
-    for (size_t i = 1; i < len; i++){
-      if (i + 2 < len && (memcmp(data + i, "\000\000\003", 3) == 0)){// Emulation prevention bytes
-        // Yes, we increase i here
-        bs.append(data + i, 2);
-        i += 2;
-      }else{
-        // No we don't increase i here
-        bs.append(data + i, 1);
-      }
-    }
+    if (len > 1){nalu::removeEmulationPrevention(data + 1, len - 1, bs);}
     profileIdc = bs.get(8);
     constraintSet0Flag = bs.get(1);
     constraintSet1Flag = bs.get(1);
@@ -717,14 +685,8 @@ namespace h264{
     bw.append(1, 1);
     std::string tmp = bw.str();
     std::string res;
-    for (int i = 0; i < tmp.size(); i++){
-      if (res.size() > 2 && res[res.size() - 1] == 0x00 && res[res.size() - 2] == 0x00){
-        if (tmp[i] == 0x00 || tmp[i] == 0x01 || tmp[i] == 0x02 || tmp[i] == 0x03){
-          res += (char)0x03;
-        }
-      }
-      res += tmp[i];
-    }
+    res.resize(tmp.size() + tmp.size() / 2 + 1);
+    res.resize(nalu::addEmulationPrevention(tmp.data(), tmp.size(), &res[0]));
     return res;
   }
 
@@ -750,16 +712,7 @@ namespace h264{
 
   bool ppsValidate(const char *data, size_t len){
     Utils::bitstream bs;
-    for (size_t i = 1; i < len; i++){
-      if (i + 2 < len && (memcmp(data + i, "\000\000\003", 3) == 0)){// Emulation prevention bytes
-        // Yes, we increase i here
-        bs.append(data + i, 2);
-        i += 2;
-      }else{
-        // No we don't increase i here
-        bs.append(data + i, 1);
-      }
-    }
+    if (len > 1){nalu::removeEmulationPrevention(data + 1, len - 1, bs);}
     bs.getUExpGolomb();
     bs.getUExpGolomb();
     bs.get(2);
@@ -789,16 +742,7 @@ namespace h264{
   ppsUnit::ppsUnit(const char *data, size_t len, uint8_t chromaFormatIdc) : nalUnit(data, len){
     picScalingMatrixPresentFlags = NULL;
     Utils::bitstream bs;
-    for (size_t i = 1; i < len; i++){
-      if (i + 2 < len && (memcmp(data + i, "\000\000\003", 3) == 0)){// Emulation prevention bytes
-        // Yes, we increase i here
-        bs.append(data + i, 2);
-        i += 2;
-      }else{
-        // No we don't increase i here
-        bs.append(data + i, 1);
-      }
-    }
+    if (len > 1){nalu::removeEmulationPrevention(data + 1, len - 1, bs);}
     picParameterSetId = bs.getUExpGolomb();
     seqParameterSetId = bs.getUExpGolomb();
     entropyCodingModeFlag = bs.get(1);
@@ -961,29 +905,14 @@ namespace h264{
 
     std::string tmp = bw.str();
     std::string res;
-    for (int i = 0; i < tmp.size(); i++){
-      if (res.size() > 2 && res[res.size() - 1] == 0x00 && res[res.size() - 2] == 0x00){
-        if (tmp[i] == 0x00 || tmp[i] == 0x01 || tmp[i] == 0x02 || tmp[i] == 0x03){
-          res += (char)0x03;
-        }
-      }
-      res += tmp[i];
-    }
+    res.resize(tmp.size() + tmp.size() / 2 + 1);
+    res.resize(nalu::addEmulationPrevention(tmp.data(), tmp.size(), &res[0]));
     return res;
   }
 
   codedSliceUnit::codedSliceUnit(const char *data, size_t len) : nalUnit(data, len){
     Utils::bitstream bs;
-    for (size_t i = 1; i < len; i++){
-      if (i + 2 < len && (memcmp(data + i, "\000\000\003", 3) == 0)){// Emulation prevention bytes
-        // Yes, we increase i here
-        bs.append(data + i, 2);
-        i += 2;
-      }else{
-        // No we don't increase i here
-        bs.append(data + i, 1);
-      }
-    }
+    if (len > 1){nalu::removeEmulationPrevention(data + 1, len - 1, bs);}
     firstMbInSlice = bs.getUExpGolomb();
     sliceType = bs.getUExpGolomb();
     picParameterSetId = bs.getUExpGolomb();
@@ -1035,16 +964,7 @@ namespace h264{
   seiUnit::seiUnit(const char *data, size_t len) : nalUnit(data, len){
     Utils::bitstream bs;
     payloadOffset = 1;
-    for (size_t i = 1; i < len; i++){
-      if (i + 2 < len && (memcmp(data + i, "\000\000\003", 3) == 0)){// Emulation prevention bytes
-        // Yes, we increase i here
-        bs.append(data + i, 2);
-        i += 2;
-      }else{
-        // No we don't increase i here
-        bs.append(data + i, 1);
-      }
-    }
+    if (len > 1){nalu::removeEmulationPrevention(data + 1, len - 1, bs);}
     uint8_t tmp = bs.get(8);
     ++payloadOffset;
     payloadType = 0;
@@ -1159,11 +1079,11 @@ namespace h264{
         char *data = (char *)malloc(1024 * 1024 * sizeof(char)); // allocate 1MB in size
         size_t len = fread(data, 1, 1024 * 1024, in);
         if (len){
-          std::string str(data, len);
-          size_t nextPos = str.find("\000\000\001", 0, 3);
+          const char *next = nalu::scanAnnexB(data, len);
+          size_t nextPos = next ? next - data : std::string::npos;
           if (nextPos == std::string::npos && feof(in)){nextPos = len;}
           if (nextPos != std::string::npos){
-            if (str[nextPos - 1] == 0x00){nextPos--;}
+            if (nextPos && data[nextPos - 1] == 0x00){nextPos--;}
             switch (data[0] & 0x1F){
             case 1:
             case 5:
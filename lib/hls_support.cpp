@@ -170,6 +170,38 @@ namespace HLS{
     }
   }
 
+  /// Describes everything the media manifest depends on, given fragment data as set by
+  /// populateFragmentData. Manifests rendered while the description stays the same are identical,
+  /// so it serves as cache key and ETag: it changes once per new fragment or partial fragment.
+  std::string mediaManifestState(const DTSC::Meta &M, const FragmentData &fragData,
+                                 const TrackData &trackData, const HlsSpecData &hlsSpecData,
+                                 const DTSC::Fragments &fragments, const DTSC::Keys &keys){
+    std::stringstream r;
+    r << "HLS_" << trackData.requestTrackId << "_" << trackData.timingTrackId << trackData.mediaFormat;
+    r << "_" << trackData.isLive << trackData.noLLHLS << "_" << calcManifestVersion(hlsSpecData.hlsSkip);
+    r << "_" << trackData.targetDurationMax << "_" << M.getGeneration();
+    r << "_" << trackData.systemBoot + trackData.bootMsOffset;
+    if (!trackData.isLive){r << "_" << M.getFirstms(trackData.timingTrackId);}
+    r << "/" << fragData.firstFrag << "_" << fragData.currentFrag << "_" << fragData.lastFrag;
+    // While live streams have less than two fragments, the one at the live edge is listed too
+    if (trackData.isLive && fragData.lastFrag < 2){r << "_" << fragData.lastMs;}
+    if (trackData.isLive && !trackData.noLLHLS && serverSupport.tags && serverSupport.parts &&
+        fragData.lastFrag > fragData.currentFrag){
+      // Partial fragments depend on the live edge: how many the last fragment has so far, and
+      // from which fragment on they are listed (see addPartialFragmentTags)
+      uint64_t i = fragData.lastFrag - 1;
+      r << "_" << (fragData.lastMs - keys.getTime(fragments.getFirstKey(i))) / partDurationMaxMs;
+      while (i > fragData.currentFrag &&
+             (fragData.lastFrag - (i - 1) < 5 || fragData.lastMs - keys.getTime(fragments.getFirstKey(i - 1)) <=
+                                                    3 * trackData.targetDurationMax * 1000)){
+        --i;
+      }
+      r << "_" << i;
+    }
+    r << "/" << trackData.encryptMethod << "/" << trackData.sessionId << "/" << trackData.urlPrefix;
+    return r.str();
+  }
+
   /// Encryption logic to LLHLS playlist
   void hlsManifestMediaEncriptionTags(const DTSC::Meta &M, std::stringstream &result,
                                       const size_t timingTid){
@@ -420,7 +452,7 @@ namespace HLS{
   void addAltRenditionReports(std::stringstream &result, const DTSC::Meta &M,
                               const std::map<size_t, Comms::Users> &userSelect,
                               const FragmentData &fragData, const TrackData &trackData){
-    DTSC::Fragments fragments(M.fragments(trackData.timingTrackId));
+    DTSC::Fragments fragments(M.getFragments(trackData.timingTrackId));
     std::ldiv_t altPart =
         std::ldiv(fragments.getDuration(fragData.currentFrag - 2), partDurationMaxMs);
     std::map<size_t, Comms::Users>::const_iterator it = userSelect.end();
@@ -704,8 +736,8 @@ namespace HLS{
   /// Get the first fragment number to be printed in the playlist
   u_int64_t getInitFragment(const DTSC::Meta &M, const MasterData &masterData){
     if (M.getLive()){
-      DTSC::Fragments fragments(M.fragments(masterData.mainTrack));
-      DTSC::Keys keys(M.keys(masterData.mainTrack));
+      DTSC::Fragments fragments(M.getFragments(masterData.mainTrack));
+      DTSC::Keys keys(M.getKeys(masterData.mainTrack));
       u_int64_t iFrag = std::max(fragments.getEndValid() -
                                      (masterData.noLLHLS ? 10 : getLiveLengthLimit(masterData)),
                                  fragments.getFirstValid());
@@ -753,7 +785,7 @@ namespace HLS{
   /// returns 0 for a hinted part which never got created
   uint64_t getPartTargetTime(const DTSC::Meta &M, const uint32_t idx, const uint32_t mTrack,
                              const uint64_t startTime, const uint64_t msn, const uint32_t part){
-    DTSC::Fragments fragments(M.fragments(mTrack));
+    DTSC::Fragments fragments(M.getFragments(mTrack));
 
     // Estimate the target end time for a given part
     // 50 ms is margin of safety to accommodate inconsistencies
@@ -68,6 +68,10 @@ namespace HLS{
 
   size_t getTimingTrackId(const DTSC::Meta &M, const std::string &mTrack, const size_t mSelTrack);
 
+  std::string mediaManifestState(const DTSC::Meta &M, const FragmentData &fragData,
+                                 const TrackData &trackData, const HlsSpecData &hlsSpecData,
+                                 const DTSC::Fragments &fragments, const DTSC::Keys &keys);
+
   void addStartingMetaTags(std::stringstream &result, FragmentData &fragData,
                            const TrackData &trackData, const HlsSpecData &hlsSpecData);
 
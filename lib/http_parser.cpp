@@ -10,7 +10,9 @@
 #include "util.h"
 #include "json.h"
 #include <iomanip>
+#include <errno.h>
 #include <strings.h>
+#include <unistd.h>
 
 /// This constructor creates an empty HTTP::Parser, ready for use for either reading or writing.
 /// All this constructor does is call HTTP::Parser::Clean().
@@ -26,15 +28,21 @@ HTTP::Parser::Parser(){
 /// Completely re-initializes the HTTP::Parser, leaving it ready for either reading or writing
 /// usage.
 void HTTP::Parser::Clean(){
-  CleanPreserveHeaders();
   headers.clear();
+  head.clear();
+  parsedCount = 0;
+  CleanPreserveHeaders();
 }
 
 /// Completely re-initializes the HTTP::Parser, leaving it ready for either reading or writing
 /// usage.
 void HTTP::Parser::CleanPreserveHeaders(){
+  // Parsed headers point into the head, so keep copies of them before letting go of it
+  flattenHeaders();
+  head.clear();
   seenHeaders = false;
   seenReq = false;
+  isResponse = false;
   possiblyComplete = false;
   getChunks = false;
   sendingChunks = false;
@@ -147,6 +155,7 @@ void HTTP::Parser::setCORSHeaders(){
 /// \return A string containing a valid HTTP 1.0 or 1.1 request, ready for sending.
 std::string &HTTP::Parser::BuildRequest(){
   /// \todo Include POST variable handling for vars?
+  flattenHeaders();
   std::map<std::string, std::string>::iterator it;
   if (protocol.size() < 5 || protocol[4] != '/'){protocol = "HTTP/1.0";}
   if (!(method == "POST" && GetHeader("Content-Type") == "application/x-www-form-urlencoded") && vars.size() && url.find('?') == std::string::npos){
@@ -173,6 +182,7 @@ void HTTP::Parser::SendRequest(Socket::Connection &conn, const std::string &reqb
 void HTTP::Parser::sendRequest(Socket::Connection &conn, const void *reqbody,
                                const size_t reqbodyLen, bool allAtOnce){
   /// \todo Include GET/POST variable parsing?
+  flattenHeaders();
   if (allAtOnce){
     /// \TODO Make this less duplicated / more pretty.
 
@@ -221,6 +231,7 @@ void HTTP::Parser::sendRequest(Socket::Connection &conn, const void *reqbody,
 /// \return A string containing a valid HTTP 1.0 or 1.1 response, ready for sending.
 std::string &HTTP::Parser::BuildResponse(std::string code, std::string message){
   /// \todo Include GET/POST variable parsing?
+  flattenHeaders();
   std::map<std::string, std::string>::iterator it;
   if (protocol.size() < 5 || protocol[4] != '/'){protocol = "HTTP/1.0";}
   builder = protocol + " " + code + " " + message + "\r\n";
@@ -253,6 +264,7 @@ std::string &HTTP::Parser::BuildResponse(){
 /// message. Usually you want "OK". \param conn The Socket::Connection to send the response over.
 void HTTP::Parser::SendResponse(std::string code, std::string message, Socket::Connection &conn){
   /// \todo Include GET/POST variable parsing?
+  flattenHeaders();
   std::map<std::string, std::string>::iterator it;
   if (protocol.size() < 5 || protocol[4] != '/'){protocol = "HTTP/1.0";}
   builder = protocol + " " + code + " " + message + "\r\n";
@@ -281,6 +293,7 @@ void HTTP::Parser::StartResponse(std::string code, std::string message, const HT
   bool willSendChunks =
       (!bufferAllChunks && request.protocol == "HTTP/1.1" && request.GetHeader("Connection") != "close");
   CleanPreserveHeaders();
+  flattenHeaders();
   sendingChunks = willSendChunks;
   protocol = prot;
   if (sendingChunks){
@@ -432,9 +445,32 @@ std::string HTTP::Parser::getUrl() const{
   }
 }
 
+/// Returns the index of the last parsed header named i (case-insensitive), or -1 if there is none.
+int HTTP::Parser::findParsedHeader(const char *i, size_t len) const{
+  for (int n = parsedCount - 1; n >= 0; --n){
+    if (parsed[n].nameLen == len && !strncasecmp(head.data() + parsed[n].name, i, len)){return n;}
+  }
+  return -1;
+}
+
+/// Moves all headers in the parsed header table over to the headers set through SetHeader, which
+/// take precedence. Used before building a message from this parser.
+void HTTP::Parser::flattenHeaders(){
+  for (int n = parsedCount - 1; n >= 0; --n){
+    std::string name(head, parsed[n].name, parsed[n].nameLen);
+    if (!headers.count(name)){headers[name].assign(head, parsed[n].val, parsed[n].valLen);}
+  }
+  parsedCount = 0;
+}
+
 /// Returns header i, if set.
 const std::string &HTTP::Parser::GetHeader(const std::string &i) const{
   if (headers.count(i)){return headers.at(i);}
+  int n = findParsedHeader(i.data(), i.size());
+  if (n != -1){
+    parsedVals[n].assign(head, parsed[n].val, parsed[n].valLen);
+    return parsedVals[n];
+  }
   for (std::map<std::string, std::string>::const_iterator it = headers.begin(); it != headers.end(); ++it){
     if (it->first.length() != i.length()){continue;}
     if (strncasecmp(it->first.c_str(), i.c_str(), i.length()) == 0){return it->second;}
@@ -444,9 +480,32 @@ const std::string &HTTP::Parser::GetHeader(const std::string &i) const{
   return empty;
 }
 
+/// Points val to the value of header i without copying it, if set.
+/// The value stays valid until the next call to Read or Clean.
+bool HTTP::Parser::getHeaderView(const char *i, const char *&val, size_t &len) const{
+  std::map<std::string, std::string>::const_iterator it = headers.find(i);
+  if (it != headers.end()){
+    val = it->second.data();
+    len = it->second.size();
+    return true;
+  }
+  int n = findParsedHeader(i, strlen(i));
+  if (n != -1){
+    val = head.data() + parsed[n].val;
+    len = parsed[n].valLen;
+    return true;
+  }
+  if (!hasHeader(i)){return false;}
+  const std::string &v = GetHeader(i);
+  val = v.data();
+  len = v.size();
+  return true;
+}
+
 /// Returns header i, if set.
 bool HTTP::Parser::hasHeader(const std::string &i) const{
   if (headers.count(i)){return true;}
+  if (findParsedHeader(i.data(), i.size()) != -1){return true;}
   for (std::map<std::string, std::string>::const_iterator it = headers.begin(); it != headers.end(); ++it){
     if (it->first.length() != i.length()){continue;}
     if (strncasecmp(it->first.c_str(), i.c_str(), i.length()) == 0){return true;}
@@ -488,6 +547,12 @@ void HTTP::Parser::SetHeader(std::string i, std::string v){
 
 void HTTP::Parser::clearHeader(const std::string &i){
   headers.erase(i);
+  size_t kept = 0;
+  for (size_t n = 0; n < parsedCount; ++n){
+    if (parsed[n].nameLen == i.size() && !memcmp(head.data() + parsed[n].name, i.data(), i.size())){continue;}
+    parsed[kept++] = parsed[n];
+  }
+  parsedCount = kept;
 }
 
 /// Sets header i to integer value v.
@@ -511,29 +576,35 @@ void HTTP::Parser::SetVar(std::string i, std::string v){
 /// returned. If not, as much as can be interpreted is removed and false returned. \param conn The
 /// socket to read from. \return True if a whole request or response was read, false otherwise.
 bool HTTP::Parser::Read(Socket::Connection &conn, Util::DataCallback &cb, Util::DataCallback &error_cb){
+  Socket::Buffer &buf = conn.Received();
   // In this case, we might have a broken connection and need to check if we're done
-  if (!conn.Received().size()){
-    return (parse(conn.Received().get(), cb, error_cb) && (!possiblyComplete || !conn || !JSON::Value(url).asInt()));
-  }
-  while (conn.Received().size()){
-    // Make sure the received data ends in a newline (\n).
-    while ((!seenHeaders || (getChunks && !doingChunk)) && conn.Received().get().size() &&
-           *(conn.Received().get().rbegin()) != '\n'){
-      if (conn.Received().size() > 1){
-        // make a copy of the first part
-        std::string tmp = conn.Received().get();
-        // clear the first part, wiping it from the partlist
-        conn.Received().get().clear();
-        conn.Received().size();
-        // take the now first (was second) part, insert the stored part in front of it
-        conn.Received().get().insert(0, tmp);
-      }else{
-        return false;
+  if (!buf.size()){
+    return (parse(buf.get(), cb, error_cb) && (!possiblyComplete || !conn || !JSON::Value(url).asInt()));
+  }
+  while (buf.size()){
+    if (!seenHeaders){
+      // Parse the lines of the head in place, straight from the receive buffer
+      unsigned int avail = buf.bytes(0xFFFFFFFFu);
+      buf.skip(parseHead(buf.peek(avail), avail));
+      if (!seenHeaders){return false;}
+      // Even without any data left, the message may be complete now
+      if (parseBody(buf.get(), cb, error_cb) && (!possiblyComplete || !conn || !JSON::Value(url).asInt())){
+        return true;
       }
+      continue;
+    }
+    if (getChunks && !doingChunk){
+      // Only hand over chunk size lines once they are complete
+      unsigned int avail = buf.bytes(0xFFFFFFFFu);
+      const char *data = buf.peek(avail);
+      const char *nl = (const char *)memchr(data, '\n', avail);
+      if (!nl){return false;}
+      std::string line = buf.remove(nl + 1 - data);
+      if (parse(line, cb, error_cb)){return true;}
+      continue;
     }
-
     // return true if a parse succeeds, and is not a request
-    if (parse(conn.Received().get(), cb, error_cb) && (!possiblyComplete || !conn || !JSON::Value(url).asInt())){
+    if (parse(buf.get(), cb, error_cb) && (!possiblyComplete || !conn || !JSON::Value(url).asInt())){
       return true;
     }
   }
@@ -555,253 +626,271 @@ uint8_t HTTP::Parser::getPercentage() const{
   return ((body.length() * 100) / length);
 }
 
+/// Handles a single line of a message head, stored in head from start onwards.
+/// The line holds no line ending; anything from the first carriage return onwards is ignored.
+/// Header names and values are not copied, but kept as positions in head.
+void HTTP::Parser::parseHeadLine(size_t start){
+  const char *line = head.data() + start;
+  size_t len = head.size() - start;
+  const char *cr = (const char *)memchr(line, '\r', len);
+  if (cr){len = cr - line;}
+  if (!seenReq){
+    const char *f = (const char *)memchr(line, ' ', len);
+    if (!f){return;}
+    const char *rest = f + 1;
+    const char *g = (const char *)memchr(rest, ' ', line + len - rest);
+    if (!g){return;}
+    seenReq = true;
+    if (len >= 4 && !memcmp(line, "HTTP", 4)){
+      protocol.assign(line, f - line);
+      url.assign(rest, g - rest);
+      method.assign(g + 1, line + len - g - 1);
+    }else{
+      method.assign(line, f - line);
+      url.assign(rest, g - rest);
+      protocol.assign(g + 1, line + len - g - 1);
+    }
+    size_t q = url.find('?');
+    if (q != std::string::npos){
+      parseVars(url.substr(q + 1), vars); // parse GET variables
+      url.erase(q);
+    }
+    if (url.find_first_of("%+") != std::string::npos){url = Encodings::URL::decode(url);}
+    // Responses (and other protocols' equivalents) have a status code where requests have a URL
+    isResponse = (url.size() && url[0] >= '0' && url[0] <= '9');
+    return;
+  }
+  if (!len){
+    seenHeaders = true;
+    return;
+  }
+  const char *colon = (const char *)memchr(line, ':', len);
+  if (!colon){return;}
+  const char *nameEnd = colon, *val = colon + 1, *valEnd = line + len;
+  while (line < nameEnd && (*line == ' ' || *line == '\t')){++line;}
+  while (nameEnd > line && (nameEnd[-1] == ' ' || nameEnd[-1] == '\t')){--nameEnd;}
+  while (val < valEnd && (*val == ' ' || *val == '\t')){++val;}
+  while (valEnd > val && (valEnd[-1] == ' ' || valEnd[-1] == '\t')){--valEnd;}
+  if (parsedCount >= HTTP_MAX_HEADERS){
+    SetHeader(std::string(line, nameEnd - line), std::string(val, valEnd - val));
+    return;
+  }
+  headerPos &h = parsed[parsedCount++];
+  h.name = line - head.data();
+  h.nameLen = nameEnd - line;
+  h.val = val - head.data();
+  h.valLen = valEnd - val;
+}
+
+/// Parses as many complete lines of a message head as there are in data.
+/// Once the empty line ending the head is found, the headers describing the body are looked up.
+/// Returns the amount of bytes used, always up to and including the last line ending parsed.
+size_t HTTP::Parser::parseHead(const char *data, size_t len){
+  size_t pos = 0;
+  while (!seenHeaders && pos < len){
+    const char *f = (const char *)memchr(data + pos, '\n', len - pos);
+    if (!f){break;}
+    // Anything before the request line was not part of a message
+    if (!seenReq && !parsedCount){head.clear();}
+    size_t lineStart = head.size();
+    head.append(data + pos, f - data - pos);
+    pos = f - data + 1;
+    parseHeadLine(lineStart);
+  }
+  if (!seenHeaders){return pos;}
+  body.clear();
+  knownLength = false;
+  const char *val;
+  size_t valLen;
+  if (getHeaderView("Content-Length", val, valLen) && valLen){
+    length = atoi(GetHeader("Content-Length").c_str());
+    knownLength = true;
+  }
+  if (getHeaderView("Transfer-Encoding", val, valLen) && valLen == 7 && !memcmp(val, "chunked", 7)){
+    getChunks = true;
+    doingChunk = 0;
+  }
+
+  // If a cookie is found in the HTTP req, set it as a environment variable
+  // in order to redirect it with triggers
+  if (!getenv("MIST_TRIGGER")){
+    static const char *hdrs[] ={"Livepeer-Access-Key", "Livepeer-Jwt", "Tx-Stream-Id", "X-Forwarded-For", "X-Forwarded-Proto",
+                                 "X-Tlive-Spanid", "Host", "Referer", "Origin", "User-Agent"};
+    std::string cookie;
+    if (hasHeader("Cookie")){cookie = GetHeader("Cookie");}
+    for (size_t i = 0; i < sizeof(hdrs) / sizeof(hdrs[0]); ++i){
+      if (getHeaderView(hdrs[i], val, valLen)){
+        if (cookie.size()){cookie += "; ";}
+        cookie += hdrs[i];
+        cookie += "=" + Encodings::URL::encode(std::string(val, valLen));
+      }
+    }
+    if (cookie.size()){
+      setenv("Cookie", cookie.c_str(), 1);
+    }else{
+      unsetenv("Cookie");
+    }
+  }
+  return pos;
+}
+
 /// Attempt to read a whole HTTP response or request from a data buffer.
 /// If succesful, fills its own fields with the proper data and removes the response/request
-/// from the data buffer.
+/// from the data buffer. Requests without a Content-Length or chunked body have no body, so any
+/// pipelined requests after them are left in the buffer for the next call.
 /// \param HTTPbuffer The data buffer to read from.
 /// \return True on success, false otherwise.
 bool HTTP::Parser::parse(std::string &HTTPbuffer, Util::DataCallback &cb, Util::DataCallback &error_cb){
-  size_t f;
-  std::string tmpA, tmpB, tmpC;
-  /// \todo Make this not resize HTTPbuffer in parts, but read all at once and then remove the
-  /// entire request, like doxygen claims it does?
-  while (!HTTPbuffer.empty()){
-    if (!seenHeaders){
-      f = HTTPbuffer.find('\n');
-      if (f == std::string::npos) return false;
-      tmpA = HTTPbuffer.substr(0, f);
-      if (f + 1 == HTTPbuffer.size()){
-        HTTPbuffer.clear();
-      }else{
-        HTTPbuffer.erase(0, f + 1);
-      }
-      while (tmpA.find('\r') != std::string::npos){tmpA.erase(tmpA.find('\r'));}
-      if (!seenReq){
-        seenReq = true;
-        f = tmpA.find(' ');
-        if (f != std::string::npos){
-          if (tmpA.substr(0, 4) == "HTTP"){
-            protocol = tmpA.substr(0, f);
-            tmpA.erase(0, f + 1);
-            f = tmpA.find(' ');
-            if (f != std::string::npos){
-              url = tmpA.substr(0, f);
-              tmpA.erase(0, f + 1);
-              method = tmpA;
-              if (url.find('?') != std::string::npos){
-                parseVars(url.substr(url.find('?') + 1), vars); // parse GET variables
-                url.erase(url.find('?'));
-              }
-              url = Encodings::URL::decode(url);
-            }else{
-              seenReq = false;
-            }
-          }else{
-            method = tmpA.substr(0, f);
-            tmpA.erase(0, f + 1);
-            f = tmpA.find(' ');
-            if (f != std::string::npos){
-              url = tmpA.substr(0, f);
-              tmpA.erase(0, f + 1);
-              protocol = tmpA;
-              if (url.find('?') != std::string::npos){
-                parseVars(url.substr(url.find('?') + 1), vars); // parse GET variables
-                url.erase(url.find('?'));
-              }
-              url = Encodings::URL::decode(url);
-            }else{
-              seenReq = false;
-            }
-          }
-        }else{
-          seenReq = false;
-        }
-      }else{
-        if (tmpA.size() == 0){
-          seenHeaders = true;
-          body.clear();
-          knownLength = false;
-          if (GetHeader("Content-Length") != ""){
-            length = atoi(GetHeader("Content-Length").c_str());
-            if (!bodyCallback && (&cb == &Util::defaultDataCallback) && body.capacity() < length){
-              body.reserve(length);
-            }
-            knownLength = true;
-          }
-          if (GetHeader("Transfer-Encoding") == "chunked"){
-            getChunks = true;
-            doingChunk = 0;
-          }
+  if (!seenHeaders){
+    size_t pos = parseHead(HTTPbuffer.data(), HTTPbuffer.size());
+    if (pos == HTTPbuffer.size()){
+      HTTPbuffer.clear();
+    }else if (pos){
+      HTTPbuffer.erase(0, pos);
+    }
+    if (!seenHeaders){return false;}
+  }else if (HTTPbuffer.empty()){
+    return possiblyComplete; // empty input
+  }
+  return parseBody(HTTPbuffer, cb, error_cb);
+}
 
-          // If a cookie is found in the HTTP req, set it as a environment variable
-          // in order to redirect it with triggers
-          if (!getenv("MIST_TRIGGER")){
-            std::string cookie;
-            if (hasHeader("Cookie")){cookie = GetHeader("Cookie");}
-            std::deque<std::string> hdrs;
-            hdrs.push_back("Livepeer-Access-Key");
-            hdrs.push_back("Livepeer-Jwt");
-            hdrs.push_back("Tx-Stream-Id");
-            hdrs.push_back("X-Forwarded-For");
-            hdrs.push_back("X-Forwarded-Proto");
-            hdrs.push_back("X-Tlive-Spanid");
-            hdrs.push_back("Host");
-            hdrs.push_back("Referer");
-            hdrs.push_back("Origin");
-            hdrs.push_back("User-Agent");
-            while (hdrs.size()){
-              if (hasHeader(hdrs.front())){
-                if (cookie.size()){cookie += "; ";}
-                cookie += hdrs.front() + std::string("=") + Encodings::URL::encode(GetHeader(hdrs.front()));
-              }
-              hdrs.pop_front();
-            }
-            if (cookie.size()){
-              setenv("Cookie", cookie.c_str(), 1);
-            }else{
-              unsetenv("Cookie");
-            }
-          }
-        }else{
-          f = tmpA.find(':');
-          if (f == std::string::npos) continue;
-          tmpB = tmpA.substr(0, f);
-          tmpC = tmpA.substr(f + 1);
-          SetHeader(tmpB, tmpC);
-        }
-      }
+/// Reads (part of) the body of a message whose head was already parsed from a data buffer,
+/// removing what was used from the buffer.
+/// \return True if the message is complete, false otherwise.
+bool HTTP::Parser::parseBody(std::string &HTTPbuffer, Util::DataCallback &cb, Util::DataCallback &error_cb){
+  if (headerOnly){return true;}
+  //Check if we have a response code that may never have a body
+  unsigned int code = 200;
+  if (url.size() && url[0] >= '0' && url[0] <= '9'){
+    code = atoi(url.data());
+    if ((code >= 100 && code < 200) || code == 204 || code == 304){return true;}
+  }
+  if (knownLength && !getChunks){
+    if (!bodyCallback && (&cb == &Util::defaultDataCallback) && body.capacity() < length){
+      body.reserve(length);
     }
-    if (seenHeaders){
-      if (headerOnly){return true;}
-      //Check if we have a response code that may never have a body
-      unsigned int code = 200;
-      if (url.size() && url[0] >= '0' && url[0] <= '9'){
-        code = atoi(url.data());
-        if ((code >= 100 && code < 200) || code == 204 || code == 304){return true;}
+    unsigned int toappend = length - body.length();
+
+    // limit the amount of bytes that will be appended to the amount there
+    // is available
+    if (toappend > HTTPbuffer.size()){toappend = HTTPbuffer.size();}
+
+    if (toappend > 0){
+      bool shouldAppend = true;
+      // check if pointer callback function is set and run callback. remove partial data from buffer
+      if (bodyCallback){
+        bodyCallback(HTTPbuffer.data(), toappend);
+        length -= toappend;
+        shouldAppend = false;
       }
-      if (knownLength && !getChunks){
-        unsigned int toappend = length - body.length();
-
-        // limit the amount of bytes that will be appended to the amount there
-        // is available
-        if (toappend > HTTPbuffer.size()){toappend = HTTPbuffer.size();}
-
-        if (toappend > 0){
-          bool shouldAppend = true;
-          // check if pointer callback function is set and run callback. remove partial data from buffer
-          if (bodyCallback){
-            bodyCallback(HTTPbuffer.data(), toappend);
-            length -= toappend;
-            shouldAppend = false;
-          }
 
-          // If reference error callback is set and response code >= 300, give that callback priority
-          if (shouldAppend && code >= 300 && &error_cb != &Util::defaultDataCallback){
-            error_cb.dataCallback(HTTPbuffer.data(), toappend);
-            length -= toappend;
-            shouldAppend = false;
-          }
+      // If reference error callback is set and response code >= 300, give that callback priority
+      if (shouldAppend && code >= 300 && &error_cb != &Util::defaultDataCallback){
+        error_cb.dataCallback(HTTPbuffer.data(), toappend);
+        length -= toappend;
+        shouldAppend = false;
+      }
 
-          // check if reference callback function is set and run callback. remove partial data from buffer
-          if (shouldAppend && &cb != &Util::defaultDataCallback){
-            cb.dataCallback(HTTPbuffer.data(), toappend);
-            length -= toappend;
-            shouldAppend = false;
-          }
+      // check if reference callback function is set and run callback. remove partial data from buffer
+      if (shouldAppend && &cb != &Util::defaultDataCallback){
+        cb.dataCallback(HTTPbuffer.data(), toappend);
+        length -= toappend;
+        shouldAppend = false;
+      }
 
-          if (shouldAppend){body.append(HTTPbuffer, 0, toappend);}
-          HTTPbuffer.erase(0, toappend);
-          currentLength += toappend;
-        }
-        if (length == body.length()){
-          // parse POST body if the content type is URLEncoded
-          if (method == "POST" && GetHeader("Content-Type") == "application/x-www-form-urlencoded"){parseVars(body, vars);}
-          return true;
-        }else{
-          return false;
+      if (shouldAppend){body.append(HTTPbuffer, 0, toappend);}
+      HTTPbuffer.erase(0, toappend);
+      currentLength += toappend;
+    }
+    if (length == body.length()){
+      // parse POST body if the content type is URLEncoded
+      if (method == "POST" && GetHeader("Content-Type") == "application/x-www-form-urlencoded"){parseVars(body, vars);}
+      return true;
+    }else{
+      return false;
+    }
+  }else{
+    if (getChunks){
+      currentLength += HTTPbuffer.size();
+      if (doingChunk){
+        unsigned int toappend = HTTPbuffer.size();
+        if (toappend > doingChunk){toappend = doingChunk;}
+
+        bool shouldAppend = true;
+        if (bodyCallback){
+          bodyCallback(HTTPbuffer.data(), toappend);
+          shouldAppend = false;
         }
-      }else{
-        if (getChunks){
-          currentLength += HTTPbuffer.size();
-          if (doingChunk){
-            unsigned int toappend = HTTPbuffer.size();
-            if (toappend > doingChunk){toappend = doingChunk;}
-
-            bool shouldAppend = true;
-            if (bodyCallback){
-              bodyCallback(HTTPbuffer.data(), toappend);
-              shouldAppend = false;
-            }
 
-            // If reference error callback is set and response code >= 300, give that callback priority
-            if (shouldAppend && code >= 300 && &error_cb != &Util::defaultDataCallback){
-              error_cb.dataCallback(HTTPbuffer.data(), toappend);
-              shouldAppend = false;
-            }
+        // If reference error callback is set and response code >= 300, give that callback priority
+        if (shouldAppend && code >= 300 && &error_cb != &Util::defaultDataCallback){
+          error_cb.dataCallback(HTTPbuffer.data(), toappend);
+          shouldAppend = false;
+        }
 
-            if (shouldAppend && &cb != &Util::defaultDataCallback){
-              cb.dataCallback(HTTPbuffer.data(), toappend);
-              shouldAppend = false;
-            }
+        if (shouldAppend && &cb != &Util::defaultDataCallback){
+          cb.dataCallback(HTTPbuffer.data(), toappend);
+          shouldAppend = false;
+        }
 
-            if (shouldAppend){body.append(HTTPbuffer, 0, toappend);}
-            HTTPbuffer.erase(0, toappend);
-            doingChunk -= toappend;
-          }else{
-            f = HTTPbuffer.find('\n');
-            if (f == std::string::npos){return false;}
-            tmpA = HTTPbuffer.substr(0, f);
-            while (tmpA.find('\r') != std::string::npos){tmpA.erase(tmpA.find('\r'));}
-            unsigned int chunkLen = 0;
-            if (!tmpA.empty()){
-              for (unsigned int i = 0; i < tmpA.size(); ++i){
-                chunkLen = (chunkLen << 4) | Encodings::Hex::ord(tmpA[i]);
-              }
-              if (chunkLen == 0){
-                getChunks = false;
-                return true;
-              }
-              doingChunk = chunkLen;
-            }
-            if (f + 1 == HTTPbuffer.size()){
-              HTTPbuffer.clear();
-            }else{
-              HTTPbuffer.erase(0, f + 1);
-            }
+        if (shouldAppend){body.append(HTTPbuffer, 0, toappend);}
+        HTTPbuffer.erase(0, toappend);
+        doingChunk -= toappend;
+      }else{
+        size_t f = HTTPbuffer.find('\n');
+        if (f == std::string::npos){return false;}
+        size_t lineLen = HTTPbuffer.find('\r');
+        if (lineLen > f){lineLen = f;}
+        unsigned int chunkLen = 0;
+        if (lineLen){
+          for (unsigned int i = 0; i < lineLen; ++i){
+            chunkLen = (chunkLen << 4) | Encodings::Hex::ord(HTTPbuffer[i]);
           }
-          return false;
-        }else{
-          if (protocol.substr(0, 4) == "RTSP" || method.substr(0, 4) == "RTSP"){return true;}
-          unsigned int toappend = HTTPbuffer.size();
-          bool shouldAppend = true;
-          if (bodyCallback){
-            bodyCallback(HTTPbuffer.data(), toappend);
-            shouldAppend = false;
+          if (chunkLen == 0){
+            getChunks = false;
+            return true;
           }
+          doingChunk = chunkLen;
+        }
+        if (f + 1 == HTTPbuffer.size()){
+          HTTPbuffer.clear();
+        }else{
+          HTTPbuffer.erase(0, f + 1);
+        }
+      }
+      return false;
+    }else{
+      if (protocol.substr(0, 4) == "RTSP" || method.substr(0, 4) == "RTSP"){return true;}
+      // Requests without a length or chunked encoding have no body
+      if (!isResponse){return true;}
+      unsigned int toappend = HTTPbuffer.size();
+      bool shouldAppend = true;
+      if (bodyCallback){
+        bodyCallback(HTTPbuffer.data(), toappend);
+        shouldAppend = false;
+      }
 
-          // If reference error callback is set and response code >= 300, give that callback priority
-          if (shouldAppend && code >= 300 && &error_cb != &Util::defaultDataCallback){
-            error_cb.dataCallback(HTTPbuffer.data(), toappend);
-            shouldAppend = false;
-          }
+      // If reference error callback is set and response code >= 300, give that callback priority
+      if (shouldAppend && code >= 300 && &error_cb != &Util::defaultDataCallback){
+        error_cb.dataCallback(HTTPbuffer.data(), toappend);
+        shouldAppend = false;
+      }
 
-          if (shouldAppend && &cb != &Util::defaultDataCallback){
-            cb.dataCallback(HTTPbuffer.data(), toappend);
-            shouldAppend = false;
-          }
+      if (shouldAppend && &cb != &Util::defaultDataCallback){
+        cb.dataCallback(HTTPbuffer.data(), toappend);
+        shouldAppend = false;
+      }
 
-          if (shouldAppend){body.append(HTTPbuffer, 0, toappend);}
-          HTTPbuffer.erase(0, toappend);
+      if (shouldAppend){body.append(HTTPbuffer, 0, toappend);}
+      HTTPbuffer.erase(0, toappend);
 
-          // return true if there is no body, otherwise we only stop when the connection is dropped
-          possiblyComplete = true;
-          return true;
-        }
-      }
+      // return true if there is no body, otherwise we only stop when the connection is dropped
+      possiblyComplete = true;
+      return true;
     }
   }
-  return possiblyComplete; // empty input
-}// HTTPReader::parse
+}// HTTPReader::parseBody
 
 /// HTTP variable parser to std::map<std::string, std::string> structure.
 /// Reads variables from data, decodes and stores them to storage.
@@ -843,12 +932,27 @@ void HTTP::Parser::Chunkify(const std::string &bodypart, Socket::Connection &con
   Chunkify(bodypart.c_str(), bodypart.size(), conn);
 }
 
+/// Writes the size line that starts a chunk of the given size in chunked transfer encoding,
+/// the size in hexadecimal followed by \r\n, into buf. Returns the length written, at most 18.
+static size_t chunkSizeLine(char *buf, uint64_t size){
+  static const char hexa[] = "0123456789abcdef";
+  char digits[16];
+  size_t count = 0;
+  do{
+    digits[count++] = hexa[size & 0xf];
+    size >>= 4;
+  }while (size);
+  for (size_t i = 0; i < count; ++i){buf[i] = digits[count - 1 - i];}
+  buf[count] = '\r';
+  buf[count + 1] = '\n';
+  return count + 2;
+}
+
 /// Sends a string in chunked format if protocol is HTTP/1.1, sends as-is otherwise.
 /// \param data The data to send.
 /// \param size The size of the data to send.
 /// \param conn The connection to use for sending.
 void HTTP::Parser::Chunkify(const char *data, unsigned int size, Socket::Connection &conn){
-  static char hexa[] = "0123456789abcdef";
   if (bufferChunks){
     if (size){
       body.append(data, size);
@@ -862,18 +966,16 @@ void HTTP::Parser::Chunkify(const char *data, unsigned int size, Socket::Connect
   if (sendingChunks){
     // prepend the chunk size and \r\n
     if (!size){conn.SendNow("0\r\n\r\n", 5);}
-    size_t offset = 8;
-    unsigned int t_size = size;
-    char len[] = "\000\000\000\000\000\000\0000\r\n";
-    while (t_size && offset < 9){
-      len[--offset] = hexa[t_size & 0xf];
-      t_size >>= 4;
-    }
-    conn.SendNow(len + offset, 10 - offset);
-    // send the chunk itself
-    conn.SendNow(data, size);
-    // append \r\n
-    conn.SendNow("\r\n", 2);
+    char len[18];
+    // send the chunk size, the chunk itself and \r\n in one go
+    struct iovec iov[3];
+    iov[0].iov_base = len;
+    iov[0].iov_len = chunkSizeLine(len, size);
+    iov[1].iov_base = (void *)data;
+    iov[1].iov_len = size;
+    iov[2].iov_base = (void *)"\r\n";
+    iov[2].iov_len = 2;
+    conn.SendNow(iov, 3);
   }else{
     // just send the chunk itself
     conn.SendNow(data, size);
@@ -884,3 +986,32 @@ void HTTP::Parser::Chunkify(const char *data, unsigned int size, Socket::Connect
     }
   }
 }
+
+/// Like Chunkify, but sends size bytes of the given file starting at offset as the body part.
+/// When not buffering, the file data is sent straight from the file without being copied through
+/// userspace where possible. Empty parts are ignored: use Chunkify to end the response.
+/// Returns false if the file could not be read completely.
+bool HTTP::Parser::ChunkifyFile(int fd, uint64_t offset, size_t size, Socket::Connection &conn){
+  if (!size){return true;}
+  if (bufferChunks){
+    size_t start = body.size();
+    body.resize(start + size);
+    size_t done = 0;
+    while (done < size){
+      ssize_t r = pread(fd, (char *)body.data() + start + done, size - done, offset + done);
+      if (r < 0 && errno == EINTR){continue;}
+      if (r < 1){
+        body.resize(start + done);
+        return false;
+      }
+      done += r;
+    }
+    return true;
+  }
+  if (!sendingChunks){return conn.SendFile(fd, offset, size);}
+  char len[18];
+  conn.SendNow(len, chunkSizeLine(len, size));
+  bool ret = conn.SendFile(fd, offset, size);
+  conn.SendNow("\r\n", 2);
+  return ret;
+}
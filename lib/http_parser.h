@@ -9,6 +9,10 @@
 #include <stdlib.h>
 #include <string>
 
+/// Amount of parsed headers kept in the fixed-size header table of a HTTP::Parser.
+/// Any headers beyond this are stored like headers set through SetHeader.
+#define HTTP_MAX_HEADERS 64
+
 /// Holds all HTTP processing related code.
 namespace HTTP{
 
@@ -23,6 +27,7 @@ namespace HTTP{
     bool Read(Socket::Connection &conn, Util::DataCallback &cb = Util::defaultDataCallback, Util::DataCallback &error_cb = Util::defaultDataCallback);
     bool Read(std::string &strbuf);
     const std::string &GetHeader(const std::string &i) const;
+    bool getHeaderView(const char *i, const char *&val, size_t &len) const;
     bool hasHeader(const std::string &i) const;
     void clearHeader(const std::string &i);
     uint8_t getPercentage() const;
@@ -47,6 +52,7 @@ namespace HTTP{
     void StartResponse(Parser &request, Socket::Connection &conn, bool bufferAllChunks = false);
     void Chunkify(const std::string &bodypart, Socket::Connection &conn);
     void Chunkify(const char *data, unsigned int size, Socket::Connection &conn);
+    bool ChunkifyFile(int fd, uint64_t offset, size_t size, Socket::Connection &conn);
     void Proxy(Socket::Connection &from, Socket::Connection &to);
     void Clean();
     void CleanPreserveHeaders();
@@ -66,15 +72,29 @@ namespace HTTP{
     void (*bodyCallback)(const char *, size_t);
 
   private:
+    /// Location of a parsed header name and value inside the message head.
+    struct headerPos{
+      uint32_t name, nameLen, val, valLen;
+    };
     std::string cnonce;
     bool seenHeaders;
     bool seenReq;
+    bool isResponse;
     bool getChunks;
     bool possiblyComplete;
     unsigned int doingChunk;
     bool parse(std::string &HTTPbuffer, Util::DataCallback &cb = Util::defaultDataCallback, Util::DataCallback &error_cb = Util::defaultDataCallback);
+    size_t parseHead(const char *data, size_t len);
+    bool parseBody(std::string &HTTPbuffer, Util::DataCallback &cb, Util::DataCallback &error_cb);
+    void parseHeadLine(size_t start);
+    int findParsedHeader(const char *i, size_t len) const;
+    void flattenHeaders();
     std::string builder;
     std::string read_buffer;
+    std::string head; ///< Raw lines of the parsed message head, the header table points into it
+    headerPos parsed[HTTP_MAX_HEADERS];
+    size_t parsedCount;
+    mutable std::string parsedVals[HTTP_MAX_HEADERS];
     std::map<std::string, std::string> headers;
     std::map<std::string, std::string> vars;
     void Trim(std::string &s);
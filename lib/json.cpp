@@ -7,6 +7,7 @@
 #include <fstream>
 #include <sstream>
 #include <stdint.h> //for uint64_t
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h> //for memcpy
 
@@ -251,75 +252,171 @@ stopParsing:
   return out;
 }
 
-static std::string UTF16(uint32_t c){
+/// Reads a string up to the given separator from a buffer into out, advancing p past the separator.
+/// Handles escapes the same way as the std::istream version above; runs of characters that need no
+/// handling are copied in one go.
+static void read_string(char separator, const char *&p, const char *end, std::string &out){
+  uint32_t fullChar = 0;
+  while (p < end){
+    if (!fullChar){
+      const char *run = p;
+      while (p < end && *p != separator && *p != '\\'){++p;}
+      if (p != run){out.append(run, p - run);}
+      if (p >= end){break;}
+    }
+    char c = *(p++);
+    if (c == '\\'){
+      if (p >= end){break;}
+      c = *(p++);
+      if (fullChar && c != 'u'){
+        out += UTF8(fullChar >> 16);
+        fullChar = 0;
+      }
+      switch (c){
+      case 'b': out += '\b'; break;
+      case '\\': out += '\\'; break;
+      case 'f': out += '\f'; break;
+      case 'n': out += '\n'; break;
+      case 'r': out += '\r'; break;
+      case 't': out += '\t'; break;
+      case 'x':
+        if (end - p < 2){
+          p = end;
+          break;
+        }
+        out.append(1, (c2hex(p[1]) + (c2hex(p[0]) << 4)));
+        p += 2;
+        break;
+      case 'u':{
+        for (size_t i = 0; i < 4; ++i){
+          if (p + i >= end){
+            p = end;
+            goto stopParsing;
+          }
+          if (p[i] == separator){
+            p += i + 1;
+            goto stopParsing;
+          }
+        }
+        uint32_t tmpChar = (c2hex(p[3]) + (c2hex(p[2]) << 4) + (c2hex(p[1]) << 8) + (c2hex(p[0]) << 12));
+        p += 4;
+        if (fullChar && (tmpChar < 0xDC00 || tmpChar > 0xDFFF)){
+          // not a low surrogate - handle high surrogate separately!
+          out += UTF8(fullChar >> 16);
+          fullChar = 0;
+        }
+        fullChar |= tmpChar;
+        if (fullChar >= 0xD800 && fullChar <= 0xDBFF){
+          // possibly high surrogate! Read next characters before handling...
+          fullChar <<= 16; // save as high surrogate
+        }else{
+          out += UTF8(fullChar);
+          fullChar = 0;
+        }
+        break;
+      }
+      default: out.append(1, c); break;
+      }
+    }else{
+      if (fullChar){
+        out += UTF8(fullChar >> 16);
+        fullChar = 0;
+      }
+      if (c == separator){return;}
+      out.append(1, c);
+    }
+  }
+stopParsing:
+  if (fullChar){out += UTF8(fullChar >> 16);}
+}
+
+/// Appends raw bytes to a JSON output buffer, growing it geometrically so that writing a large
+/// document does not reallocate for every value.
+static inline void writeRaw(Util::ResizeablePointer &out, const char *data, size_t len){
+  if (out.size() + len > out.rsize()){
+    size_t want = out.rsize() * 2;
+    if (want < out.size() + len){want = out.size() + len;}
+    if (want < 4096){want = 4096;}
+    out.allocate(want);
+  }
+  out.append(data, len);
+}
+
+/// Appends a single character as a UTF-16 escape, as a surrogate pair if needed.
+static void writeUTF16(Util::ResizeablePointer &out, uint32_t c){
   if (c > 0xFFFF){
     c -= 0x010000;
-    return UTF16(0xD800 + ((c >> 10) & 0x3FF)) + UTF16(0xDC00 + (c & 0x3FF));
+    writeUTF16(out, 0xD800 + ((c >> 10) & 0x3FF));
+    writeUTF16(out, 0xDC00 + (c & 0x3FF));
+    return;
   }
-  std::string ret = "\\u";
-  ret += hex2c((c >> 12) & 0xf);
-  ret += hex2c((c >> 8) & 0xf);
-  ret += hex2c((c >> 4) & 0xf);
-  ret += hex2c(c & 0xf);
-  return ret;
+  char esc[6] ={'\\', 'u', hex2c((c >> 12) & 0xf), hex2c((c >> 8) & 0xf), hex2c((c >> 4) & 0xf), hex2c(c & 0xf)};
+  writeRaw(out, esc, 6);
 }
 
-std::string JSON::string_escape(const std::string &val){
-  std::string out = "\"";
-  for (size_t i = 0; i < val.size(); ++i){
-    const char &c = val.data()[i];
+/// Appends a JSON-string-escaped, quoted copy of the given data to a JSON output buffer.
+static void writeEscaped(Util::ResizeablePointer &out, const char *val, size_t len){
+  writeRaw(out, "\"", 1);
+  size_t run = 0; // start of the current run of characters that need no escaping
+  for (size_t i = 0; i < len; ++i){
+    const char &c = val[i];
+    if (c >= 32 && c <= 126 && c != '"' && c != '\\'){continue;}
+    if (i > run){writeRaw(out, val + run, i - run);}
     switch (c){
-    case '"': out += "\\\""; break;
-    case '\\': out += "\\\\"; break;
-    case '\n': out += "\\n"; break;
-    case '\b': out += "\\b"; break;
-    case '\f': out += "\\f"; break;
-    case '\r': out += "\\r"; break;
-    case '\t': out += "\\t"; break;
-    default:
-      if (c < 32 || c > 126){
-        // we assume our data is UTF-8 encoded internally.
-        // JavaScript expects UTF-16, so if we recognize a valid UTF-8 sequence, we turn it into
-        // UTF-16 for JavaScript. Anything else is escaped as a single character UTF-16 escape.
-        if ((c & 0xC0) == 0xC0){
-          // possible UTF-8 sequence
-          // check for 2-byte sequence
-          if (((c & 0xE0) == 0XC0) && (i + 1 < val.size()) && ((val.data()[i + 1] & 0xC0) == 0x80)){
-            // valid 2-byte sequence
-            out += UTF16(((c & 0x1F) << 6) | (val.data()[i + 1] & 0x3F));
-            i += 1;
-            break;
-          }
-          // check for 3-byte sequence
-          if (((c & 0xF0) == 0XE0) && (i + 2 < val.size()) &&
-              ((val.data()[i + 1] & 0xC0) == 0x80) && ((val.data()[i + 2] & 0xC0) == 0x80)){
-            // valid 3-byte sequence
-            out += UTF16(((c & 0x1F) << 12) | ((val.data()[i + 1] & 0x3F) << 6) | (val.data()[i + 2] & 0x3F));
-            i += 2;
-            break;
-          }
-          // check for 4-byte sequence
-          if (((c & 0xF8) == 0XF0) && (i + 3 < val.size()) && ((val.data()[i + 1] & 0xC0) == 0x80) &&
-              ((val.data()[i + 2] & 0xC0) == 0x80) && ((val.data()[i + 3] & 0xC0) == 0x80)){
-            // valid 4-byte sequence
-            out += UTF16(((c & 0x1F) << 18) | ((val.data()[i + 1] & 0x3F) << 12) |
-                         ((val.data()[i + 2] & 0x3F) << 6) | (val.data()[i + 3] & 0x3F));
-            i += 3;
-            break;
-          }
+    case '"': writeRaw(out, "\\\"", 2); break;
+    case '\\': writeRaw(out, "\\\\", 2); break;
+    case '\n': writeRaw(out, "\\n", 2); break;
+    case '\b': writeRaw(out, "\\b", 2); break;
+    case '\f': writeRaw(out, "\\f", 2); break;
+    case '\r': writeRaw(out, "\\r", 2); break;
+    case '\t': writeRaw(out, "\\t", 2); break;
+    default:{
+      // we assume our data is UTF-8 encoded internally.
+      // JavaScript expects UTF-16, so if we recognize a valid UTF-8 sequence, we turn it into
+      // UTF-16 for JavaScript. Anything else is escaped as a single character UTF-16 escape.
+      if ((c & 0xC0) == 0xC0){
+        // possible UTF-8 sequence
+        // check for 2-byte sequence
+        if (((c & 0xE0) == 0XC0) && (i + 1 < len) && ((val[i + 1] & 0xC0) == 0x80)){
+          // valid 2-byte sequence
+          writeUTF16(out, ((c & 0x1F) << 6) | (val[i + 1] & 0x3F));
+          i += 1;
+          break;
+        }
+        // check for 3-byte sequence
+        if (((c & 0xF0) == 0XE0) && (i + 2 < len) && ((val[i + 1] & 0xC0) == 0x80) &&
+            ((val[i + 2] & 0xC0) == 0x80)){
+          // valid 3-byte sequence
+          writeUTF16(out, ((c & 0x1F) << 12) | ((val[i + 1] & 0x3F) << 6) | (val[i + 2] & 0x3F));
+          i += 2;
+          break;
+        }
+        // check for 4-byte sequence
+        if (((c & 0xF8) == 0XF0) && (i + 3 < len) && ((val[i + 1] & 0xC0) == 0x80) &&
+            ((val[i + 2] & 0xC0) == 0x80) && ((val[i + 3] & 0xC0) == 0x80)){
+          // valid 4-byte sequence
+          writeUTF16(out, ((c & 0x1F) << 18) | ((val[i + 1] & 0x3F) << 12) |
+                              ((val[i + 2] & 0x3F) << 6) | (val[i + 3] & 0x3F));
+          i += 3;
+          break;
         }
-        // Anything else, we encode as a single UTF-16 character.
-        out += "\\u00";
-        out += hex2c((val.data()[i] >> 4) & 0xf);
-        out += hex2c(val.data()[i] & 0xf);
-      }else{
-        out += val.data()[i];
       }
+      // Anything else, we encode as a single UTF-16 character.
+      char esc[6] ={'\\', 'u', '0', '0', hex2c((c >> 4) & 0xf), hex2c(c & 0xf)};
+      writeRaw(out, esc, 6);
       break;
     }
+    }
+    run = i + 1;
   }
-  out += "\"";
-  return out;
+  if (len > run){writeRaw(out, val + run, len - run);}
+  writeRaw(out, "\"", 1);
+}
+
+std::string JSON::string_escape(const std::string &val){
+  Util::ResizeablePointer out;
+  writeEscaped(out, val.data(), val.size());
+  return std::string((const char *)out, out.size());
 }
 
 /// Skips an std::istream forward until any of the following characters is seen: ,]}
@@ -463,6 +560,144 @@ JSON::Value::Value(std::istream &fromstream){
   if (negative){intVal *= -1;}
 }
 
+/// Skips a buffer forward until any of the following characters is seen: ,]}
+static void skipToEnd(const char *&p, const char *end){
+  while (p < end && *p != ',' && *p != ']' && *p != '}'){++p;}
+}
+
+/// Sets this JSON::Value to the value that starts at p, advancing p past it.
+/// Accepts the same (lenient) syntax as the std::istream constructor, but parses straight from
+/// memory and builds object members and array elements in place instead of copying them over from
+/// temporaries. Doubles are read with strtod, so they keep their full precision and may use an
+/// exponent.
+void JSON::Value::parse(const char *&p, const char *end){
+  null();
+  bool reading_object = false;
+  bool reading_array = false;
+  bool negative = false;
+  bool stop = false;
+  while (!stop && p < end){
+    char c = *p;
+    switch (c){
+    case '{':
+      reading_object = true;
+      ++p;
+      myType = OBJECT;
+      break;
+    case '[':{
+      reading_array = true;
+      ++p;
+      Value &first = append();
+      first.parse(p, end);
+      if (first.myType == EMPTY){
+        delete arrVal.back();
+        arrVal.pop_back();
+      }
+      break;
+    }
+    case '\'':
+    case '"':
+      ++p;
+      if (!reading_object){
+        myType = STRING;
+        read_string(c, p, end, strVal);
+        stop = true;
+      }else{
+        std::string key;
+        read_string(c, p, end, key);
+        Value *&member = objVal[key];
+        if (!member){member = new JSON::Value();}
+        member->parse(p, end);
+      }
+      break;
+    case '-':
+      ++p;
+      negative = true;
+      break;
+    case '0':
+    case '1':
+    case '2':
+    case '3':
+    case '4':
+    case '5':
+    case '6':
+    case '7':
+    case '8':
+    case '9':
+    case '.':{
+      const char *num = p;
+      bool isDouble = false;
+      while (p < end && ((*p >= '0' && *p <= '9') || *p == '.' || *p == 'e' || *p == 'E' ||
+                         ((*p == '-' || *p == '+') && (p[-1] == 'e' || p[-1] == 'E')))){
+        if (*p == '.' || *p == 'e' || *p == 'E'){isDouble = true;}
+        ++p;
+      }
+      if (myType == INTEGER || myType == DOUBLE){break;}
+      if (!isDouble){
+        myType = INTEGER;
+        for (; num < p; ++num){intVal = intVal * 10 + (*num - '0');}
+        break;
+      }
+      // strtod needs a terminated string
+      char tmp[64];
+      std::string longNum;
+      const char *numStr = tmp;
+      if ((size_t)(p - num) < sizeof(tmp)){
+        memcpy(tmp, num, p - num);
+        tmp[p - num] = 0;
+      }else{
+        longNum.assign(num, p - num);
+        numStr = longNum.c_str();
+      }
+      myType = DOUBLE;
+      dblVal = strtod(numStr, 0);
+      if (negative){dblVal = -dblVal;}
+      break;
+    }
+    case ',':
+      if (!reading_object && !reading_array){
+        stop = true;
+        break;
+      }
+      ++p;
+      if (reading_array){append().parse(p, end);}
+      break;
+    case '}':
+      if (reading_object){++p;}
+      stop = true;
+      break;
+    case ']':
+      if (reading_array){++p;}
+      stop = true;
+      break;
+    case 't':
+    case 'T':
+      skipToEnd(p, end);
+      myType = BOOL;
+      intVal = 1;
+      stop = true;
+      break;
+    case 'f':
+    case 'F':
+      skipToEnd(p, end);
+      myType = BOOL;
+      intVal = 0;
+      stop = true;
+      break;
+    case 'n':
+    case 'N':
+      skipToEnd(p, end);
+      myType = EMPTY;
+      stop = true;
+      break;
+    default:
+      ++p; // ignore this character
+      break;
+    }
+  }
+  if (negative){intVal *= -1;}
+}
+
 /// Sets this JSON::Value to the given string.
 JSON::Value::Value(const std::string &val){
   myType = STRING;
@@ -1083,61 +1318,61 @@ std::string &JSON::Value::toNetPacked(){
 /// Converts this JSON::Value to valid JSON notation and returns it.
 /// Makes absolutely no attempts to pretty-print anything. :-)
 std::string JSON::Value::toString() const{
+  Util::ResizeablePointer out;
+  toString(out);
+  return std::string((const char *)out, out.size());
+}
+
+/// Appends this JSON::Value in valid JSON notation to the given buffer.
+/// Writes the whole document into the one buffer, without building any temporary strings.
+void JSON::Value::toString(Util::ResizeablePointer &out) const{
   switch (myType){
   case INTEGER:{
-    std::stringstream st;
-    st << intVal;
-    return st.str();
+    char num[32];
+    writeRaw(out, num, snprintf(num, sizeof(num), "%lld", intVal));
     break;
   }
   case DOUBLE:{
-    std::stringstream st;
-    st.precision(10);
-    st << std::fixed << dblVal;
-    return st.str();
+    // Large enough for any double in fixed notation
+    char num[512];
+    writeRaw(out, num, snprintf(num, sizeof(num), "%.10f", dblVal));
     break;
   }
   case BOOL:{
     if (intVal != 0){
-      return "true";
+      writeRaw(out, "true", 4);
     }else{
-      return "false";
+      writeRaw(out, "false", 5);
     }
     break;
   }
   case STRING:{
-    return JSON::string_escape(strVal);
+    writeEscaped(out, strVal.data(), strVal.size());
     break;
   }
   case ARRAY:{
-    std::string tmp = "[";
-    if (arrVal.size() > 0){
-      jsonForEachConst(*this, i){
-        tmp += i->toString();
-        if (i.num() + 1 != arrVal.size()){tmp += ",";}
-      }
+    writeRaw(out, "[", 1);
+    for (std::vector<Value *>::const_iterator it = arrVal.begin(); it != arrVal.end(); ++it){
+      if (it != arrVal.begin()){writeRaw(out, ",", 1);}
+      (*it)->toString(out);
     }
-    tmp += "]";
-    return tmp;
+    writeRaw(out, "]", 1);
     break;
   }
   case OBJECT:{
-    std::string tmp2 = "{";
-    if (objVal.size() > 0){
-      jsonForEachConst(*this, i){
-        tmp2 += JSON::string_escape(i.key()) + ":";
-        tmp2 += i->toString();
-        if (i.num() + 1 != objVal.size()){tmp2 += ",";}
-      }
+    writeRaw(out, "{", 1);
+    for (std::map<std::string, Value *>::const_iterator it = objVal.begin(); it != objVal.end(); ++it){
+      if (it != objVal.begin()){writeRaw(out, ",", 1);}
+      writeEscaped(out, it->first.data(), it->first.size());
+      writeRaw(out, ":", 1);
+      it->second->toString(out);
     }
-    tmp2 += "}";
-    return tmp2;
+    writeRaw(out, "}", 1);
     break;
   }
   case EMPTY:
-  default: return "null";
+  default: writeRaw(out, "null", 4);
   }
-  return "null"; // should never get here...
 }
 
 /// Converts this JSON::Value to valid JSON notation and returns it.
@@ -1244,7 +1479,7 @@ void JSON::Value::prepend(const JSON::Value &rhs){
     null();
     myType = ARRAY;
   }
-  arrVal.push_front(new JSON::Value(rhs));
+  arrVal.insert(arrVal.begin(), new JSON::Value(rhs));
 }
 
 /// For array and object JSON::Value objects, reduces them
@@ -1254,9 +1489,10 @@ void JSON::Value::prepend(const JSON::Value &rhs){
 /// do anything if the size is already lower or equal to the
 /// given size.
 void JSON::Value::shrink(unsigned int size){
-  while (arrVal.size() > size){
-    delete arrVal.front();
-    arrVal.pop_front();
+  if (arrVal.size() > size){
+    size_t excess = arrVal.size() - size;
+    for (size_t i = 0; i < excess; ++i){delete arrVal[i];}
+    arrVal.erase(arrVal.begin(), arrVal.begin() + excess);
   }
   while (objVal.size() > size){
     delete objVal.begin()->second;
@@ -1273,7 +1509,7 @@ void JSON::Value::removeMember(const std::string &name){
   }
 }
 
-void JSON::Value::removeMember(const std::deque<Value *>::iterator &it){
+void JSON::Value::removeMember(const std::vector<Value *>::iterator &it){
   delete (*it);
   arrVal.erase(it);
 }
@@ -1343,24 +1579,33 @@ unsigned int JSON::Value::size() const{
   return objVal.size() + arrVal.size();
 }
 
-/// Converts a std::string to a JSON::Value.
+/// Converts a buffer holding JSON data to a JSON::Value.
 JSON::Value JSON::fromString(const char *data, uint32_t data_len){
-  std::string str(data, data_len);
-  return JSON::fromString(str);
+  JSON::Value ret;
+  ret.parse(data, data + data_len);
+  return ret;
 }
 
 /// Converts a std::string to a JSON::Value.
 JSON::Value JSON::fromString(const std::string &json){
-  std::istringstream is(json);
-  return JSON::Value(is);
+  return JSON::fromString(json.data(), json.size());
 }
 
 /// Converts a file to a JSON::Value.
 JSON::Value JSON::fromFile(const std::string &filename){
-  std::ifstream File;
-  File.open(filename.c_str());
-  JSON::Value ret(File);
-  File.close();
+  JSON::Value ret;
+  FILE *F = fopen(filename.c_str(), "r");
+  if (!F){return ret;}
+  Util::ResizeablePointer data;
+  size_t r = 0;
+  do{
+    data.append(0, r);
+    if (!data.allocate(data.size() + 64 * 1024)){break;}
+    r = fread((char *)data + data.size(), 1, data.rsize() - data.size(), F);
+  }while (r);
+  fclose(F);
+  const char *p = data;
+  ret.parse(p, p + data.size());
   return ret;
 }
 
@@ -1,6 +1,7 @@
 /// \file json.h Holds all JSON-related headers.
 #pragma once
 #include "socket.h"
+#include "util.h"
 #include <deque>
 #include <istream>
 #include <map>
@@ -31,7 +32,7 @@ namespace JSON{
     std::string strVal;
     double dblVal;
     double dblDivider;
-    std::deque<Value *> arrVal;
+    std::vector<Value *> arrVal;
     std::map<std::string, Value *> objVal;
 
   public:
@@ -84,19 +85,21 @@ namespace JSON{
     const Value &operator[](const char *i) const;
     const Value &operator[](uint32_t i) const;
     // handy functions and others
+    void parse(const char *&p, const char *end);
     std::string toPacked() const;
     void sendTo(Socket::Connection &socket) const;
     uint64_t packedSize() const;
     void netPrepare();
     std::string &toNetPacked();
     std::string toString() const;
+    void toString(Util::ResizeablePointer &out) const;
     std::string toPrettyString(size_t indent = 0, bool omitBinaryStrings = true) const;
     void append(const Value &rhs);
     Value & append();
     void prepend(const Value &rhs);
     void shrink(uint32_t size);
     void removeMember(const std::string &name);
-    void removeMember(const std::deque<Value *>::iterator &it);
+    void removeMember(const std::vector<Value *>::iterator &it);
     void removeMember(const std::map<std::string, Value *>::iterator &it);
     void removeNullMembers();
     bool isMember(const std::string &name) const;
@@ -137,7 +140,7 @@ namespace JSON{
     ValueType myType;
     Value *r;
     uint32_t i;
-    std::deque<Value *>::iterator aIt;
+    std::vector<Value *>::iterator aIt;
     std::map<std::string, Value *>::iterator oIt;
   };
   class ConstIter{
@@ -153,7 +156,7 @@ namespace JSON{
     ValueType myType;
     const Value *r;
     uint32_t i;
-    std::deque<Value *>::const_iterator aIt;
+    std::vector<Value *>::const_iterator aIt;
     std::map<std::string, Value *>::const_iterator oIt;
   };
 #define jsonForEach(val, i) for (JSON::Iter i(val); i; ++i)
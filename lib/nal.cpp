@@ -10,7 +10,146 @@
 #include "defines.h"
 #include "nal.h"
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__clang__) || __GNUC__ >= 5)
+#define NAL_AVX2 1
+#include <immintrin.h>
+#else
+#define NAL_AVX2 0
+#endif
+#if defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
 namespace nalu{
+  /// Returns a pointer to the first 0x0000XX sequence in data where XX lies within the
+  /// [minByte, maxByte] range, or null if there is none. Plain C++ version, also used for the tails
+  /// of the vectorized versions below.
+  static const char *findScalar(const char *data, size_t dataLen, uint8_t minByte, uint8_t maxByte){
+    if (dataLen < 3){return 0;}
+    const uint8_t *offset = (const uint8_t *)data;
+    const uint8_t *maxData = offset + dataLen - 2;
+    while (offset < maxData){
+      uint8_t third = offset[2];
+      if (third && (third < minByte || third > maxByte)){
+        // The third byte is neither zero nor a match, so we need to skip at least 3 bytes forward
+        offset += 3;
+        continue;
+      }
+      if (!offset[0] && !offset[1] && third >= minByte){return (const char *)offset;}
+      // A zero third byte may be the start of a sequence, a non-zero one cannot
+      offset += third ? 3 : 1;
+    }
+    return 0;
+  }
+
+#if defined(__SSE2__)
+  /// SSE2 version of findScalar, checking 16 positions per iteration.
+  static const char *findSSE2(const char *data, size_t dataLen, uint8_t minByte, uint8_t maxByte){
+    const char *offset = data;
+    const char *dataEnd = data + dataLen;
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i lo = _mm_set1_epi8(minByte);
+    const __m128i hi = _mm_set1_epi8(maxByte);
+    while (dataEnd - offset >= 18){
+      __m128i first = _mm_loadu_si128((const __m128i *)offset);
+      __m128i second = _mm_loadu_si128((const __m128i *)(offset + 1));
+      __m128i third = _mm_loadu_si128((const __m128i *)(offset + 2));
+      __m128i zeroes = _mm_cmpeq_epi8(_mm_or_si128(first, second), zero);
+      __m128i inRange = _mm_and_si128(_mm_cmpeq_epi8(_mm_max_epu8(third, lo), third),
+                                      _mm_cmpeq_epi8(_mm_min_epu8(third, hi), third));
+      unsigned int mask = _mm_movemask_epi8(_mm_and_si128(zeroes, inRange));
+      if (mask){return offset + __builtin_ctz(mask);}
+      offset += 16;
+    }
+    return findScalar(offset, dataEnd - offset, minByte, maxByte);
+  }
+#endif
+
+#if NAL_AVX2
+  /// AVX2 version of findScalar, checking 32 positions per iteration.
+  __attribute__((target("avx2"))) static const char *findAVX2(const char *data, size_t dataLen,
+                                                               uint8_t minByte, uint8_t maxByte){
+    const char *offset = data;
+    const char *dataEnd = data + dataLen;
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i lo = _mm256_set1_epi8(minByte);
+    const __m256i hi = _mm256_set1_epi8(maxByte);
+    while (dataEnd - offset >= 34){
+      __m256i first = _mm256_loadu_si256((const __m256i *)offset);
+      __m256i second = _mm256_loadu_si256((const __m256i *)(offset + 1));
+      __m256i third = _mm256_loadu_si256((const __m256i *)(offset + 2));
+      __m256i zeroes = _mm256_cmpeq_epi8(_mm256_or_si256(first, second), zero);
+      __m256i inRange = _mm256_and_si256(_mm256_cmpeq_epi8(_mm256_max_epu8(third, lo), third),
+                                         _mm256_cmpeq_epi8(_mm256_min_epu8(third, hi), third));
+      unsigned int mask = _mm256_movemask_epi8(_mm256_and_si256(zeroes, inRange));
+      if (mask){return offset + __builtin_ctz(mask);}
+      offset += 32;
+    }
+    return findScalar(offset, dataEnd - offset, minByte, maxByte);
+  }
+#endif
+
+#if defined(__aarch64__)
+  /// NEON version of findScalar, checking 16 positions per iteration.
+  static const char *findNEON(const char *data, size_t dataLen, uint8_t minByte, uint8_t maxByte){
+    const char *offset = data;
+    const char *dataEnd = data + dataLen;
+    const uint8x16_t zero = vdupq_n_u8(0);
+    const uint8x16_t lo = vdupq_n_u8(minByte);
+    const uint8x16_t hi = vdupq_n_u8(maxByte);
+    while (dataEnd - offset >= 18){
+      uint8x16_t first = vld1q_u8((const uint8_t *)offset);
+      uint8x16_t second = vld1q_u8((const uint8_t *)(offset + 1));
+      uint8x16_t third = vld1q_u8((const uint8_t *)(offset + 2));
+      uint8x16_t zeroes = vceqq_u8(vorrq_u8(first, second), zero);
+      uint8x16_t inRange = vandq_u8(vcgeq_u8(third, lo), vcleq_u8(third, hi));
+      // There is a match in these 16 positions; let the scalar version pinpoint the first one
+      if (vmaxvq_u8(vandq_u8(zeroes, inRange))){return findScalar(offset, 18, minByte, maxByte);}
+      offset += 16;
+    }
+    return findScalar(offset, dataEnd - offset, minByte, maxByte);
+  }
+#endif
+
+  typedef const char *(*findFunc)(const char *, size_t, uint8_t, uint8_t);
+  static findFunc findKernel = 0;
+  static const char *findKernelName = "none";
+
+  /// Selects the fastest search implementation supported by this CPU, or the plain C++ one.
+  void useSIMD(bool enabled){
+    findKernel = findScalar;
+    findKernelName = "scalar";
+    if (!enabled){return;}
+#if defined(__SSE2__)
+    findKernel = findSSE2;
+    findKernelName = "SSE2";
+#endif
+#if NAL_AVX2
+    if (__builtin_cpu_supports("avx2")){
+      findKernel = findAVX2;
+      findKernelName = "AVX2";
+    }
+#endif
+#if defined(__aarch64__)
+    findKernel = findNEON;
+    findKernelName = "NEON";
+#endif
+  }
+
+  /// Returns the name of the search implementation in use.
+  const char *simdName(){
+    if (!findKernel){useSIMD(true);}
+    return findKernelName;
+  }
+
+  static inline const char *findPattern(const char *data, size_t dataLen, uint8_t minByte, uint8_t maxByte){
+    if (!findKernel){useSIMD(true);}
+    return findKernel(data, dataLen, minByte, maxByte);
+  }
+
   std::deque<int> parseNalSizes(DTSC::Packet &pack){
     std::deque<int> result;
     char *data;
@@ -25,26 +164,59 @@ namespace nalu{
     return result;
   }
 
+  /// Removes all emulation prevention bytes from data, returning the result as a new string.
   std::string removeEmulationPrevention(const std::string &data){
-    std::string result;
-    result.resize(data.size());
-    result[0] = data[0];
-    result[1] = data[1];
-    size_t dataPtr = 2;
-    size_t dataLen = data.size();
-    size_t resPtr = 2;
-    while (dataPtr + 2 < dataLen){
-      if (!data[dataPtr] && !data[dataPtr + 1] && data[dataPtr + 2] == 3){// We have found an emulation prevention
-        result[resPtr++] = data[dataPtr++];
-        result[resPtr++] = data[dataPtr++];
-        dataPtr++; // Skip the emulation prevention byte
-      }else{
-        result[resPtr++] = data[dataPtr++];
-      }
+    std::string result(data);
+    if (result.size()){result.resize(removeEmulationPrevention(&result[0], result.size()));}
+    return result;
+  }
+
+  /// Removes all emulation prevention bytes (0x03 in 0x000003 sequences) from data, writing the
+  /// result to the caller-provided buffer, which must be at least dataLen bytes large.
+  /// The result buffer may be the same as data. Returns the size of the result.
+  size_t removeEmulationPrevention(const char *data, size_t dataLen, char *result){
+    size_t in = 0;
+    size_t out = 0;
+    while (in < dataLen){
+      const char *epb = findPattern(data + in, dataLen - in, 3, 3);
+      // Copy up to and including the two zero bytes, then skip the emulation prevention byte
+      size_t chunk = epb ? (epb - data) - in + 2 : dataLen - in;
+      if (result + out != data + in){memmove(result + out, data + in, chunk);}
+      out += chunk;
+      in += chunk + (epb ? 1 : 0);
     }
+    return out;
+  }
+
+  /// Removes all emulation prevention bytes from data in place, returning the new size.
+  size_t removeEmulationPrevention(char *data, size_t dataLen){
+    return removeEmulationPrevention(data, dataLen, data);
+  }
 
-    while (dataPtr < dataLen){result[resPtr++] = data[dataPtr++];}
-    return result.substr(0, resPtr);
+  /// Removes all emulation prevention bytes from data and appends the result to the bitstream.
+  void removeEmulationPrevention(const char *data, size_t dataLen, Utils::bitstream &bs){
+    Util::ResizeablePointer buf;
+    if (!dataLen || !buf.allocate(dataLen)){return;}
+    bs.append(buf, removeEmulationPrevention(data, dataLen, buf));
+  }
+
+  /// Inserts emulation prevention bytes into data wherever two zero bytes are followed by a byte
+  /// in the 0x00-0x03 range, as well as after a trailing zero byte. The result is written to the
+  /// caller-provided buffer, which must not overlap data and must be at least dataLen + dataLen / 2
+  /// + 1 bytes large. Returns the size of the result.
+  size_t addEmulationPrevention(const char *data, size_t dataLen, char *result){
+    size_t in = 0;
+    size_t out = 0;
+    while (in < dataLen){
+      const char *match = findPattern(data + in, dataLen - in, 0, 3);
+      size_t chunk = match ? (match - data) - in + 2 : dataLen - in;
+      memcpy(result + out, data + in, chunk);
+      out += chunk;
+      in += chunk;
+      if (match){result[out++] = 0x03;}
+    }
+    if (out && !result[out - 1]){result[out++] = 0x03;}
+    return out;
   }
 
   unsigned long toAnnexB(const char *data, unsigned long dataSize, char *&result){
@@ -72,58 +244,31 @@ namespace nalu{
   }
 
   /// Scan data for Annex B start code. Returns pointer to it when found, null otherwise.
-  const char *scanAnnexB(const char *data, uint32_t dataSize){
-    char *offset = (char *)data;
-    const char *maxData = data + dataSize - 2;
-    while (offset < maxData){
-      if (offset[2] > 1){
-        // We have no zero in the third byte, so we need to skip at least 3 bytes forward
-        offset += 3;
-        continue;
-      }
-      if (!offset[2]){
-        // We COULD skip forward 1 or 2 bytes depending on contents of the second byte
-        // offset += (offset[1]?2:1);
-        //... but skipping a single byte (removing the 'if') is actually faster (benchmarked).
-        ++offset;
-        continue;
-      }
-      if (!offset[0] && !offset[1]){return offset;}
-      // We have no zero in the third byte, so we need to skip at least 3 bytes forward
-      offset += 3;
-    }
-    return 0;
-  }
+  const char *scanAnnexB(const char *data, uint32_t dataSize){return findPattern(data, dataSize, 1, 1);}
 
+  /// Converts Annex B formatted data to 4-byte length prefixed NAL units in the caller-provided
+  /// result buffer. Every 3-byte start code grows by one byte into a length, while 4-byte start
+  /// codes keep their size, so the buffer must be at least dataSize + dataSize / 3 bytes large.
+  /// Returns the size of the result.
   unsigned long fromAnnexB(const char *data, unsigned long dataSize, char *&result){
-    const char *lastCheck = data + dataSize - 3;
     if (!result){
       FAIL_MSG("No output buffer given to FromAnnexB");
       return 0;
     }
-    int offset = 0;
-    int newOffset = 0;
-    while (offset < dataSize){
-      const char *begin = data + offset;
-      while (begin < lastCheck && !(!begin[0] && !begin[1] && begin[2] == 0x01)){
-        begin++;
-        if (begin < lastCheck && begin[0]){begin++;}
-      }
-      begin += 3; // Initialize begin after the first 0x000001 pattern.
-      if (begin > data + dataSize){
-        offset = dataSize;
-        continue;
-      }
-      const char *end = (const char *)memmem(begin, dataSize - (begin - data), "\000\000\001", 3);
-      if (!end){end = data + dataSize;}
-      // Check for 4-byte lead in's. Yes, we access -1 here
-      if (end > begin && (end - data) != dataSize && end[-1] == 0x00){end--;}
+    const char *dataEnd = data + dataSize;
+    const char *begin = scanAnnexB(data, dataSize);
+    unsigned long newOffset = 0;
+    while (begin){
+      begin += 3; // Start after the 0x000001 pattern
+      const char *next = scanAnnexB(begin, dataEnd - begin);
+      const char *end = next ? next : dataEnd;
+      // Check for 4-byte lead in's
+      if (next && end > begin && end[-1] == 0x00){end--;}
       unsigned int nalSize = end - begin;
       Bit::htobl(result + newOffset, nalSize);
       memcpy(result + newOffset + 4, begin, nalSize);
-
       newOffset += 4 + nalSize;
-      offset = end - data;
+      begin = next;
     }
     return newOffset;
   }
@@ -4,6 +4,10 @@
 #include <deque>
 #include <string>
 
+namespace Utils{
+  class bitstream;
+}
+
 namespace nalu{
   struct nalData{
     uint8_t nalType;
@@ -12,9 +16,16 @@ namespace nalu{
 
   std::deque<int> parseNalSizes(DTSC::Packet &pack);
   std::string removeEmulationPrevention(const std::string &data);
+  size_t removeEmulationPrevention(const char *data, size_t dataLen, char *result);
+  size_t removeEmulationPrevention(char *data, size_t dataLen);
+  void removeEmulationPrevention(const char *data, size_t dataLen, Utils::bitstream &bs);
+  size_t addEmulationPrevention(const char *data, size_t dataLen, char *result);
 
   unsigned long toAnnexB(const char *data, unsigned long dataSize, char *&result);
   unsigned long fromAnnexB(const char *data, unsigned long dataSize, char *&result);
   const char *scanAnnexB(const char *data, uint32_t dataSize);
   const char *nalEndPosition(const char *data, uint32_t dataSize);
+
+  const char *simdName();
+  void useSIMD(bool enabled);
 }// namespace nalu
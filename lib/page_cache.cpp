@@ -0,0 +1,261 @@
+/// \file page_cache.cpp
+/// On-disk cache of buffered VoD data pages, kept across input restarts.
+
+#include "page_cache.h"
+#include "auth.h"
+#include "bitfields.h"
+#include "defines.h"
+#include <algorithm>
+#include <ctype.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <map>
+#include <sstream>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utime.h>
+#include <vector>
+
+namespace PageCache{
+
+  /// Returns the amount of complete DTSC packets in a buffered page, or zero if the data does not
+  /// consist of whole packets only.
+  size_t countPackets(const char *data, uint64_t len){
+    size_t count = 0;
+    uint64_t pos = 0;
+    while (pos < len){
+      if (len - pos < 8 || memcmp(data + pos, "DTP2", 4)){return 0;}
+      uint64_t pktLen = 8 + (uint64_t)Bit::btohl(data + pos + 4);
+      if (pktLen > len - pos){return 0;}
+      pos += pktLen;
+      ++count;
+    }
+    return count;
+  }
+
+  /// A single cached page file, used while trimming the cache.
+  struct entry{
+    time_t mtime;
+    uint64_t size;
+    std::string path;
+  };
+
+  inline bool operator<(const entry &a, const entry &b){return a.mtime < b.mtime;}
+
+  /// Returns true if the given name is that of a source directory, a 32 digit hexadecimal md5 hash.
+  static bool isSourceDir(const char *name){
+    size_t i = 0;
+    for (; name[i]; ++i){
+      if (i >= 32 || !isxdigit(name[i])){return false;}
+    }
+    return i == 32;
+  }
+
+  /// Returns true if the given name is that of a page file, a track and page number separated by an
+  /// underscore.
+  static bool isPageName(const char *name){
+    const char *p = name;
+    if (!isdigit(*p)){return false;}
+    while (isdigit(*p)){++p;}
+    if (*p != '_' || !isdigit(*++p)){return false;}
+    while (isdigit(*p)){++p;}
+    return !*p;
+  }
+
+  Store::Store(){
+    maxBytes = 0;
+    knownBytes = 0;
+    untrimmed = 0;
+  }
+
+  /// Opens the page store for the given source file in the given cache directory, creating the
+  /// directories as needed. Only local files can be cached.
+  /// The layout describes how the source is divided into pages; pages are only reused by stores
+  /// opened with the same layout.
+  /// Returns true if pages can be loaded from and stored in the cache.
+  bool Store::open(const std::string &cacheDir, const std::string &source, const std::string &layout,
+                   uint64_t _maxBytes){
+    root.clear();
+    dir.clear();
+    maxBytes = _maxBytes;
+    if (!cacheDir.size() || !maxBytes){return false;}
+    char fullPath[PATH_MAX];
+    struct stat st;
+    if (!realpath(source.c_str(), fullPath) || stat(fullPath, &st) || !S_ISREG(st.st_mode)){
+      INFO_MSG("Not caching pages of %s: not a local file", source.c_str());
+      return false;
+    }
+    std::stringstream key;
+    key << fullPath << "\n" << st.st_size << "\n" << st.st_mtime << "\n" << Secure::md5(layout);
+    root = cacheDir;
+    dir = cacheDir + "/" + Secure::md5(key.str());
+    if (!makeDir()){
+      WARN_MSG("Could not create page cache directory %s: %s", dir.c_str(), strerror(errno));
+      root.clear();
+      dir.clear();
+      return false;
+    }
+    HIGH_MSG("Caching pages of %s in %s", fullPath, dir.c_str());
+    trim();
+    return true;
+  }
+
+  Store::operator bool() const{return dir.size();}
+
+  /// Creates the cache directory and the directory of this source, including its marker file.
+  /// Returns false if any of them could not be created.
+  bool Store::makeDir(){
+    if ((mkdir(root.c_str(), 0755) && errno != EEXIST) || (mkdir(dir.c_str(), 0755) && errno != EEXIST)){
+      return false;
+    }
+    int fd = ::open((dir + "/" PAGECACHE_MARKER).c_str(), O_WRONLY | O_CREAT, 0644);
+    if (fd == -1){return false;}
+    ::close(fd);
+    return true;
+  }
+
+  /// Returns the file name a page is cached under.
+  std::string Store::pagePath(size_t track, uint32_t pageNumber) const{
+    std::stringstream p;
+    p << dir << "/" << track << "_" << pageNumber;
+    return p.str();
+  }
+
+  /// Reads a cached page into dest, setting len to its size.
+  /// Returns false if the page is not cached or does not fit in destSize bytes.
+  bool Store::load(size_t track, uint32_t pageNumber, char *dest, uint64_t destSize, uint64_t &len){
+    if (!*this){return false;}
+    std::string path = pagePath(track, pageNumber);
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd == -1){return false;}
+    struct stat st;
+    if (fstat(fd, &st) || !st.st_size || (uint64_t)st.st_size > destSize){
+      ::close(fd);
+      remove(track, pageNumber);
+      return false;
+    }
+    len = 0;
+    while (len < (uint64_t)st.st_size){
+      ssize_t r = read(fd, dest + len, st.st_size - len);
+      if (r <= 0){
+        if (r == -1 && errno == EINTR){continue;}
+        break;
+      }
+      len += r;
+    }
+    ::close(fd);
+    if (len != (uint64_t)st.st_size){return false;}
+    // Mark the page as recently used
+    utime(path.c_str(), 0);
+    return true;
+  }
+
+  /// Writes a completely buffered page to the cache, then trims the cache to its maximum size if
+  /// needed (see Store).
+  /// The page is written under a temporary name first, so a page is either complete or missing.
+  bool Store::store(size_t track, uint32_t pageNumber, const char *data, uint64_t len){
+    if (!*this || !len || len > maxBytes){return false;}
+    std::string path = pagePath(track, pageNumber);
+    std::stringstream tmp;
+    tmp << path << ".tmp" << getpid();
+    int fd = ::open(tmp.str().c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd == -1 && errno == ENOENT){
+      // Another process evicted the last page of this source and removed its directory
+      makeDir();
+      fd = ::open(tmp.str().c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    }
+    if (fd == -1){
+      WARN_MSG("Could not write cached page %s: %s", tmp.str().c_str(), strerror(errno));
+      return false;
+    }
+    uint64_t written = 0;
+    while (written < len){
+      ssize_t r = write(fd, data + written, len - written);
+      if (r <= 0){
+        if (r == -1 && errno == EINTR){continue;}
+        break;
+      }
+      written += r;
+    }
+    ::close(fd);
+    if (written != len || rename(tmp.str().c_str(), path.c_str())){
+      WARN_MSG("Could not write cached page %s: %s", path.c_str(), strerror(errno));
+      unlink(tmp.str().c_str());
+      return false;
+    }
+    knownBytes += len;
+    if (knownBytes > maxBytes || ++untrimmed >= PAGECACHE_TRIM_INTERVAL){trim();}
+    return true;
+  }
+
+  /// Removes a page from the cache, for example because it turned out to be invalid.
+  void Store::remove(size_t track, uint32_t pageNumber){
+    if (!*this){return;}
+    unlink(pagePath(track, pageNumber).c_str());
+  }
+
+  /// Removes the least recently used pages of all sources in the cache directory until it is no
+  /// larger than the maximum size. Only page files in source directories with a marker file are
+  /// counted and removed.
+  /// Returns the size of all cached pages afterwards.
+  uint64_t Store::trim(){
+    if (!*this){return 0;}
+    untrimmed = 0;
+    knownBytes = 0;
+    std::vector<entry> entries;
+    std::map<std::string, size_t> pageCount;
+    uint64_t total = 0;
+    DIR *r = opendir(root.c_str());
+    if (!r){return 0;}
+    struct dirent *rp;
+    while ((rp = readdir(r))){
+      if (!isSourceDir(rp->d_name)){continue;}
+      std::string srcDir = root + "/" + rp->d_name;
+      if (access((srcDir + "/" PAGECACHE_MARKER).c_str(), F_OK)){continue;}
+      DIR *d = opendir(srcDir.c_str());
+      if (!d){continue;}
+      struct dirent *dp;
+      while ((dp = readdir(d))){
+        // Skips the marker, pages that are still being written and anything else
+        if (!isPageName(dp->d_name)){continue;}
+        entry e;
+        e.path = srcDir + "/" + dp->d_name;
+        struct stat st;
+        if (stat(e.path.c_str(), &st) || !S_ISREG(st.st_mode)){continue;}
+        e.mtime = st.st_mtime;
+        e.size = st.st_size;
+        total += e.size;
+        entries.push_back(e);
+        ++pageCount[srcDir];
+      }
+      closedir(d);
+    }
+    closedir(r);
+    if (total > maxBytes){
+      std::sort(entries.begin(), entries.end());
+      for (std::vector<entry>::iterator it = entries.begin(); it != entries.end() && total > maxBytes; ++it){
+        if (unlink(it->path.c_str())){continue;}
+        total -= it->size;
+        HIGH_MSG("Evicted cached page %s", it->path.c_str());
+        // Removes the directory of the source once its last page is gone
+        std::string srcDir = it->path.substr(0, it->path.rfind('/'));
+        if (--pageCount[srcDir] || srcDir == dir){continue;}
+        std::string marker = srcDir + "/" PAGECACHE_MARKER;
+        unlink(marker.c_str());
+        if (rmdir(srcDir.c_str())){
+          // Not empty after all, so it is still in use: keep it marked
+          int fd = ::open(marker.c_str(), O_WRONLY | O_CREAT, 0644);
+          if (fd != -1){::close(fd);}
+        }
+      }
+    }
+    knownBytes = total;
+    return total;
+  }
+
+}// namespace PageCache
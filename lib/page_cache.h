@@ -0,0 +1,47 @@
+/// \file page_cache.h
+/// On-disk cache of buffered VoD data pages, kept across input restarts.
+
+#pragma once
+#include <stdint.h>
+#include <string>
+
+#define PAGECACHE_TRIM_INTERVAL 16 ///< Stores after which the cache is trimmed even if below its size
+#define PAGECACHE_MARKER ".mistpages" ///< File marking a directory as created by a Store
+
+namespace PageCache{
+
+  size_t countPackets(const char *data, uint64_t len);
+
+  /// Store of buffered data pages for a single source file.
+  /// Pages of a source live in their own directory below the cache directory, named after a hash
+  /// of the source path, size and modification time and of its page layout, so pages of a changed
+  /// source or of a differently paged stream header are never used.
+  /// Trimming only ever removes page files from directories holding the PAGECACHE_MARKER file, so
+  /// anything else that happens to be in the cache directory is left alone.
+  /// All sources share the size limit of the cache directory: once it is exceeded, the least
+  /// recently used pages are removed first. Loading a page counts as using it.
+  /// Every store keeps track of the cache size as of its last trim plus what it stored since, and
+  /// only trims when that exceeds the limit, or after PAGECACHE_TRIM_INTERVAL stores to account
+  /// for pages stored by other processes.
+  class Store{
+  public:
+    Store();
+    bool open(const std::string &cacheDir, const std::string &source, const std::string &layout,
+              uint64_t maxBytes);
+    operator bool() const;
+    bool load(size_t track, uint32_t pageNumber, char *dest, uint64_t destSize, uint64_t &len);
+    bool store(size_t track, uint32_t pageNumber, const char *data, uint64_t len);
+    void remove(size_t track, uint32_t pageNumber);
+    uint64_t trim();
+    std::string pagePath(size_t track, uint32_t pageNumber) const;
+
+  private:
+    bool makeDir();
+    std::string root;
+    std::string dir;
+    uint64_t maxBytes;
+    uint64_t knownBytes; ///< Cache size as of the last trim, plus the size of pages stored since
+    size_t untrimmed;    ///< Pages stored since the last trim
+  };
+
+}// namespace PageCache
@@ -29,6 +29,8 @@ bool Util::Procs::handler_set = false;
 bool Util::Procs::thread_handler = false;
 tthread::mutex Util::Procs::plistMutex;
 tthread::thread *Util::Procs::reaper_thread = 0;
+tthread::condition_variable *Util::Procs::reaperCond = 0;
+pid_t Util::Procs::forkParent = 0;
 
 /// How many seconds to wait when shutting down child processes. Defaults to 10
 int Util::Procs::kill_timeout = 10;
@@ -74,6 +76,7 @@ void Util::Procs::exit_handler(){
     tthread::lock_guard<tthread::mutex> guard(plistMutex);
     listcopy = plist;
     thread_handler = false;
+    if (reaperCond){reaperCond->notify_all();}
   }
   if (reaper_thread){
     reaper_thread->join();
@@ -152,26 +155,26 @@ void Util::Procs::exit_handler(){
   FAIL_MSG("Giving up with %d children left.", (int)listcopy.size());
 }
 
-// Joins the reaper thread, if any, before a fork
+/// Locks the process list before a fork, so the child never inherits it in a half-changed state.
+/// The reaper thread keeps running; it only touches the process list while holding the lock.
+/// Must always be followed by fork_complete, in both the parent and the child.
 void Util::Procs::fork_prepare(){
-  tthread::lock_guard<tthread::mutex> guard(plistMutex);
-  if (handler_set){
-    thread_handler = false;
-    if (reaper_thread){
-      reaper_thread->join();
-      delete reaper_thread;
-      reaper_thread = 0;
-    }
-  }
+  plistMutex.lock();
+  forkParent = getpid();
 }
 
-/// Restarts reaper thread if it was joined
-void Util::Procs::fork_complete(){
-  tthread::lock_guard<tthread::mutex> guard(plistMutex);
-  if (handler_set){
-    thread_handler = true;
-    reaper_thread = new tthread::thread(grim_reaper, 0);
+/// Unlocks the process list after a fork.
+/// In the child, the reaper thread of the parent does not exist. The child forgets about it and
+/// starts its own, unless startReaper is false.
+void Util::Procs::fork_complete(bool startReaper){
+  if (getpid() != forkParent && handler_set){
+    // The old thread and condition variable belong to the parent and can't be cleaned up here
+    reaper_thread = 0;
+    reaperCond = new tthread::condition_variable();
+    thread_handler = startReaper;
+    if (startReaper){reaper_thread = new tthread::thread(grim_reaper, 0);}
   }
+  plistMutex.unlock();
 }
 
 /// Sets up exit and childsig handlers.
@@ -181,6 +184,7 @@ void Util::Procs::setHandler(){
   tthread::lock_guard<tthread::mutex> guard(plistMutex);
   if (!handler_set){
     thread_handler = true;
+    reaperCond = new tthread::condition_variable();
     reaper_thread = new tthread::thread(grim_reaper, 0);
     struct sigaction new_action;
     new_action.sa_handler = childsig_handler;
@@ -193,40 +197,36 @@ void Util::Procs::setHandler(){
 }
 
 /// Thread that loops until thread_handler is false.
-/// Reaps available children and then sleeps for a second.
+/// Reaps available children and then waits half a second, or until woken up through reaperCond.
 /// Not done in signal handler so we can use a mutex to prevent race conditions.
 void Util::Procs::grim_reaper(void *n){
   VERYHIGH_MSG("Grim reaper start");
+  tthread::lock_guard<tthread::mutex> guard(plistMutex);
   while (thread_handler){
-    {
-      if (plistMutex.try_lock()){
-        int status;
-        pid_t ret = -1;
-        while (ret != 0){
-          ret = waitpid(-1, &status, WNOHANG);
-          if (ret <= 0){// ignore, would block otherwise
-            if (ret == 0 || errno != EINTR){break;}
-            continue;
-          }
-          int exitcode;
-          if (WIFEXITED(status)){
-            exitcode = WEXITSTATUS(status);
-          }else if (WIFSIGNALED(status)){
-            exitcode = -WTERMSIG(status);
-          }else{// not possible
-            break;
-          }
-          if (plist.count(ret)){
-            HIGH_MSG("Process %d fully terminated with code %d", ret, exitcode);
-            plist.erase(ret);
-          }else{
-            HIGH_MSG("Child process %d exited with code %d", ret, exitcode);
-          }
-        }
-        plistMutex.unlock();
+    int status;
+    pid_t ret = -1;
+    while (ret != 0){
+      ret = waitpid(-1, &status, WNOHANG);
+      if (ret <= 0){// ignore, would block otherwise
+        if (ret == 0 || errno != EINTR){break;}
+        continue;
+      }
+      int exitcode;
+      if (WIFEXITED(status)){
+        exitcode = WEXITSTATUS(status);
+      }else if (WIFSIGNALED(status)){
+        exitcode = -WTERMSIG(status);
+      }else{// not possible
+        break;
+      }
+      if (plist.count(ret)){
+        HIGH_MSG("Process %d fully terminated with code %d", ret, exitcode);
+        plist.erase(ret);
+      }else{
+        HIGH_MSG("Child process %d exited with code %d", ret, exitcode);
       }
     }
-    Util::sleep(500);
+    if (thread_handler){reaperCond->wait_for(plistMutex, 500);}
   }
   VERYHIGH_MSG("Grim reaper stop");
 }
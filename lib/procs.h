@@ -19,6 +19,8 @@ namespace Util{
     static tthread::mutex plistMutex;
     static std::set<pid_t> plist; ///< Holds active process list.
     static bool thread_handler;   ///< True while thread handler should be running.
+    static tthread::condition_variable *reaperCond; ///< Wakes up the reaper thread, signalled with plistMutex held.
+    static pid_t forkParent;      ///< PID of the process that last called fork_prepare.
     static void childsig_handler(int signum);
     static void exit_handler();
     static char *const *dequeToArgv(std::deque<std::string> &argDeq);
@@ -28,7 +30,7 @@ namespace Util{
     static tthread::thread *reaper_thread;
     static bool handler_set; ///< If true, the sigchld handler has been setup.
     static void fork_prepare();
-    static void fork_complete();
+    static void fork_complete(bool startReaper = true);
     static void setHandler();
     static std::string getOutputOf(char *const *argv, uint64_t maxWait = 0);
     static std::string getOutputOf(std::deque<std::string> &argDeq, uint64_t maxWait = 0);
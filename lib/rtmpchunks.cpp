@@ -21,10 +21,10 @@ size_t RTMPStream::snd_cnt = 0;
 
 timeval RTMPStream::lastrec;
 
-/// Holds the last sent chunk for every msg_id.
-std::map<unsigned int, RTMPStream::Chunk> RTMPStream::lastsend;
-/// Holds the last received chunk for every msg_id.
-std::map<unsigned int, RTMPStream::Chunk> RTMPStream::lastrecv;
+/// Holds the last sent chunk for every cs_id.
+RTMPStream::ChunkStreams RTMPStream::lastsend;
+/// Holds the last received chunk for every cs_id.
+RTMPStream::ChunkStreams RTMPStream::lastrecv;
 
 #define P1024                                                                                      \
   "FFFFFFFFFFFFFFFFC90FDAA22168C234C4C6628B80DC1CD129024E088A67CC74020BBEA63B139B22514A08798E3404" \
@@ -73,20 +73,69 @@ bool ValidateClientScheme(uint8_t *pBuffer, uint8_t scheme){
 /// \returns A std::string ready to be sent.
 std::string &RTMPStream::Chunk::Pack(){
   static std::string output;
+  static ChunkWriter writer;
+  writer.pack(cs_id, msg_type_id, msg_stream_id, timestamp, data.data(), len);
   output.clear();
+  output.reserve(writer.size);
+  for (size_t i = 0; i < writer.count; ++i){
+    output.append((const char *)writer.vec[i].iov_base, writer.vec[i].iov_len);
+  }
+  Chunk &prev = lastsend[cs_id];
+  ts_delta = prev.ts_delta;
+  ts_header = prev.ts_header;
+  len_left = len;
+  return output;
+}// SendChunk
+
+/// Writes the basic header of a chunk: the chunk type and chunk stream ID.
+/// Returns the amount of bytes written, at most 3.
+static size_t writeChunkId(char *p, unsigned char chtype, unsigned int cs_id){
+  if (cs_id <= 63){
+    p[0] = chtype | cs_id;
+    return 1;
+  }
+  if (cs_id <= 255 + 64){
+    p[0] = chtype;
+    p[1] = cs_id - 64;
+    return 2;
+  }
+  p[0] = chtype | 1;
+  p[1] = (cs_id - 64) % 256;
+  p[2] = (cs_id - 64) / 256;
+  return 3;
+}
+
+RTMPStream::ChunkWriter::ChunkWriter(){
+  vec = 0;
+  count = 0;
+  size = 0;
+}
+
+/// Packs a message into chunks, without a payload prefix.
+size_t RTMPStream::ChunkWriter::pack(unsigned int cs_id, unsigned char msg_type_id,
+                                     unsigned int msg_stream_id, uint64_t timestamp,
+                                     const char *data, size_t len){
+  return pack(cs_id, msg_type_id, msg_stream_id, timestamp, 0, 0, data, len);
+}
+
+/// Packs a message into chunks. The payload consists of prefix followed by data, which allows
+/// sending a small header (such as the FLV tag data header) in front of media data as-is.
+/// Chooses the smallest chunk header the previous message on this chunk stream allows.
+/// Returns the size of the packed message in bytes.
+size_t RTMPStream::ChunkWriter::pack(unsigned int cs_id, unsigned char msg_type_id,
+                                     unsigned int msg_stream_id, uint64_t timestamp,
+                                     const char *prefix, size_t prefixLen, const char *data, size_t len){
+  size_t total = prefixLen + len;
   bool allow_short = lastsend.count(cs_id);
-  RTMPStream::Chunk prev = lastsend[cs_id];
-  uint64_t tmpi;
+  Chunk &prev = lastsend[cs_id];
   unsigned char chtype = 0x00;
-  if (allow_short && (prev.cs_id == cs_id)){
+  if (allow_short){
     if (msg_stream_id == prev.msg_stream_id){
       chtype = 0x40; // do not send msg_stream_id
-      if (len == prev.len){
-        if (msg_type_id == prev.msg_type_id){
-          chtype = 0x80; // do not send len and msg_type_id
-          if (timestamp - prev.timestamp == prev.ts_delta){
-            chtype = 0xC0; // do not send timestamp
-          }
+      if (total == prev.len && msg_type_id == prev.msg_type_id){
+        chtype = 0x80; // do not send len and msg_type_id
+        if (timestamp - prev.timestamp == prev.ts_delta){
+          chtype = 0xC0; // do not send timestamp
         }
       }
     }
@@ -94,99 +143,153 @@ std::string &RTMPStream::Chunk::Pack(){
     // channel
     if (timestamp < prev.timestamp){chtype = 0x00;}
   }
-  if (cs_id <= 63){
-    output += (unsigned char)(chtype | cs_id);
-  }else{
-    if (cs_id <= 255 + 64){
-      output += (unsigned char)(chtype | 0);
-      output += (unsigned char)(cs_id - 64);
-    }else{
-      output += (unsigned char)(chtype | 1);
-      output += (unsigned char)((cs_id - 64) % 256);
-      output += (unsigned char)((cs_id - 64) / 256);
-    }
+
+  // The first header takes at most 18 bytes, continuation headers 7; every chunk needs a header
+  // and at most two payload slices, as a chunk may span the end of the prefix.
+  size_t chunks = total ? (total + chunk_snd_max - 1) / chunk_snd_max : 1;
+  if (!headers.allocate(18 + chunks * 7) || !vecs.allocate(chunks * 3 * sizeof(struct iovec))){
+    FAIL_MSG("Could not allocate memory for %zu RTMP chunks", chunks);
+    count = 0;
+    size = 0;
+    return 0;
   }
-  uint64_t ntime = 0;
+  char *h = headers;
+  vec = (struct iovec *)(char *)vecs;
+  count = 0;
+
+  // Basic and message header
+  size_t hLen = writeChunkId(h, chtype, cs_id);
+  uint64_t delta = prev.ts_delta;
+  uint64_t tsField = prev.ts_header;
   if (chtype != 0xC0){
-    // timestamp or timestamp diff
-    if (chtype == 0x00){
-      tmpi = timestamp;
-    }else{
-      tmpi = timestamp - prev.timestamp;
-    }
-    ts_delta = tmpi;
-    if (tmpi >= 0x00ffffff){
-      ntime = tmpi;
-      tmpi = 0x00ffffff;
-    }
-    ts_header = tmpi;
-    output += (unsigned char)((tmpi >> 16) & 0xff);
-    output += (unsigned char)((tmpi >> 8) & 0xff);
-    output += (unsigned char)(tmpi & 0xff);
+    delta = (chtype == 0x00) ? timestamp : timestamp - prev.timestamp;
+    tsField = (delta >= 0x00ffffff) ? 0x00ffffff : delta;
+    h[hLen++] = (tsField >> 16) & 0xff;
+    h[hLen++] = (tsField >> 8) & 0xff;
+    h[hLen++] = tsField & 0xff;
     if (chtype != 0x80){
-      // len
-      tmpi = len;
-      output += (unsigned char)((tmpi >> 16) & 0xff);
-      output += (unsigned char)((tmpi >> 8) & 0xff);
-      output += (unsigned char)(tmpi & 0xff);
-      // msg type id
-      output += (unsigned char)msg_type_id;
+      h[hLen++] = (total >> 16) & 0xff;
+      h[hLen++] = (total >> 8) & 0xff;
+      h[hLen++] = total & 0xff;
+      h[hLen++] = msg_type_id;
       if (chtype != 0x40){
-        // msg stream id
-        output += (unsigned char)(msg_stream_id % 256);
-        output += (unsigned char)(msg_stream_id / 256);
-        output += (unsigned char)(msg_stream_id / (256 * 256));
-        output += (unsigned char)(msg_stream_id / (256 * 256 * 256));
+        // msg stream id, little endian
+        h[hLen++] = msg_stream_id & 0xff;
+        h[hLen++] = (msg_stream_id >> 8) & 0xff;
+        h[hLen++] = (msg_stream_id >> 16) & 0xff;
+        h[hLen++] = (msg_stream_id >> 24) & 0xff;
       }
     }
-  }else{
-    ts_header = prev.ts_header;
-    if (ts_header == 0xffffff){ntime = timestamp;}
   }
-  // support for 0x00ffffff timestamps
-  if (ntime){
-    output += (unsigned char)((ntime >> 24) & 0xff);
-    output += (unsigned char)((ntime >> 16) & 0xff);
-    output += (unsigned char)((ntime >> 8) & 0xff);
-    output += (unsigned char)(ntime & 0xff);
+  // support for 0x00ffffff timestamps; repeated in every continuation header
+  bool extended = (tsField == 0x00ffffff);
+  char ext[4];
+  if (extended){
+    ext[0] = (delta >> 24) & 0xff;
+    ext[1] = (delta >> 16) & 0xff;
+    ext[2] = (delta >> 8) & 0xff;
+    ext[3] = delta & 0xff;
+    memcpy(h + hLen, ext, 4);
+    hLen += 4;
   }
-  len_left = 0;
-  while (len_left < len){
-    tmpi = len - len_left;
-    if (tmpi > RTMPStream::chunk_snd_max){tmpi = RTMPStream::chunk_snd_max;}
-    output.append(data, len_left, tmpi);
-    len_left += tmpi;
-    if (len_left < len){
-      if (cs_id <= 63){
-        output += (unsigned char)(0xC0 + cs_id);
-      }else{
-        if (cs_id <= 255 + 64){
-          output += (unsigned char)(0xC0);
-          output += (unsigned char)(cs_id - 64);
-        }else{
-          output += (unsigned char)(0xC1);
-          output += (unsigned char)((cs_id - 64) % 256);
-          output += (unsigned char)((cs_id - 64) / 256);
-        }
-      }
-      if (ntime){
-        output += (unsigned char)((ntime >> 24) & 0xff);
-        output += (unsigned char)((ntime >> 16) & 0xff);
-        output += (unsigned char)((ntime >> 8) & 0xff);
-        output += (unsigned char)(ntime & 0xff);
+  vec[count].iov_base = h;
+  vec[count].iov_len = hLen;
+  ++count;
+  h += hLen;
+  size = hLen;
+
+  size_t pos = 0;
+  while (pos < total){
+    size_t end = pos + chunk_snd_max;
+    if (end > total){end = total;}
+    if (pos < prefixLen){
+      size_t n = (end < prefixLen ? end : prefixLen) - pos;
+      vec[count].iov_base = (void *)(prefix + pos);
+      vec[count].iov_len = n;
+      ++count;
+    }
+    if (end > prefixLen){
+      size_t from = (pos > prefixLen ? pos : prefixLen) - prefixLen;
+      vec[count].iov_base = (void *)(data + from);
+      vec[count].iov_len = end - prefixLen - from;
+      ++count;
+    }
+    size += end - pos;
+    pos = end;
+    if (pos < total){
+      // Continuation chunk: type 3 header, plus the extended timestamp if there is one
+      hLen = writeChunkId(h, 0xC0, cs_id);
+      if (extended){
+        memcpy(h + hLen, ext, 4);
+        hLen += 4;
       }
+      vec[count].iov_base = h;
+      vec[count].iov_len = hLen;
+      ++count;
+      h += hLen;
+      size += hLen;
     }
   }
-  lastsend[cs_id] = *this;
-  RTMPStream::snd_cnt += output.size();
-  return output;
-}// SendChunk
+
+  prev.cs_id = cs_id;
+  prev.timestamp = timestamp;
+  prev.ts_delta = delta;
+  prev.ts_header = tsField;
+  prev.len = total;
+  prev.real_len = total;
+  prev.len_left = 0;
+  prev.msg_type_id = msg_type_id;
+  prev.msg_stream_id = msg_stream_id;
+  RTMPStream::snd_cnt += size;
+  return size;
+}
+
+RTMPStream::ChunkStreams::ChunkStreams(){}
+
+RTMPStream::ChunkStreams::~ChunkStreams(){
+  clear();
+}
+
+/// Returns 1 if the given chunk stream was used since the last clear(), 0 otherwise.
+size_t RTMPStream::ChunkStreams::count(unsigned int cs_id) const{
+  return (cs_id < streams.size() && streams[cs_id]) ? 1 : 0;
+}
+
+/// Returns the last chunk of the given chunk stream, creating an empty one if there is none.
+/// Chunk stream IDs can not exceed 65599, larger IDs share the state of ID 0, which is unused.
+RTMPStream::Chunk &RTMPStream::ChunkStreams::operator[](unsigned int cs_id){
+  if (cs_id >= RTMP_CHUNK_STREAMS){cs_id = 0;}
+  if (cs_id >= streams.size()){streams.resize(cs_id + 1, 0);}
+  if (!streams[cs_id]){
+    streams[cs_id] = new Chunk();
+  }
+  return *streams[cs_id];
+}
+
+/// Forgets the state of the given chunk stream.
+void RTMPStream::ChunkStreams::erase(unsigned int cs_id){
+  if (cs_id >= streams.size() || !streams[cs_id]){return;}
+  delete streams[cs_id];
+  streams[cs_id] = 0;
+}
+
+/// Forgets the state of all chunk streams.
+void RTMPStream::ChunkStreams::clear(){
+  for (unsigned int i = 0; i < streams.size(); ++i){
+    if (streams[i]){
+      delete streams[i];
+      streams[i] = 0;
+    }
+  }
+}
 
 /// Default constructor, creates an empty chunk with all values initialized to zero.
 RTMPStream::Chunk::Chunk(){
   headertype = 0;
   cs_id = 0;
   timestamp = 0;
+  ts_delta = 0;
+  ts_header = 0;
   len = 0;
   real_len = 0;
   len_left = 0;
@@ -323,6 +426,20 @@ std::string &RTMPStream::SendUSR(unsigned char type, unsigned int data, unsigned
   return ch.Pack();
 }// SendUSR
 
+/// Copies all header fields of this chunk into the given chunk, but not the payload.
+void RTMPStream::Chunk::storeHeader(Chunk &target) const{
+  target.headertype = headertype;
+  target.cs_id = cs_id;
+  target.timestamp = timestamp;
+  target.ts_delta = ts_delta;
+  target.ts_header = ts_header;
+  target.len = len;
+  target.real_len = real_len;
+  target.len_left = len_left;
+  target.msg_type_id = msg_type_id;
+  target.msg_stream_id = msg_stream_id;
+}
+
 /// Parses the argument Socket::Buffer into the current chunk.
 /// Tries to read a whole chunk, removing data from the Buffer as it reads.
 /// If a single packet contains a partial chunk, it will remove the packet and
@@ -335,7 +452,7 @@ bool RTMPStream::Chunk::Parse(Socket::Buffer &buffer){
   gettimeofday(&RTMPStream::lastrec, 0);
   unsigned int i = 0;
   if (!buffer.available(3)){return false;}// we want at least 3 bytes
-  std::string indata = buffer.copy(3);
+  const char *indata = buffer.peek(3);
 
   unsigned char chunktype = indata[i++];
   // read the chunkstream ID properly
@@ -349,7 +466,7 @@ bool RTMPStream::Chunk::Parse(Socket::Buffer &buffer){
   }
 
   bool allow_short = lastrecv.count(cs_id);
-  RTMPStream::Chunk prev = lastrecv[cs_id];
+  RTMPStream::Chunk &prev = lastrecv[cs_id];
 
   // process the rest of the header, for each chunk type
   headertype = chunktype & 0xC0;
@@ -362,7 +479,7 @@ bool RTMPStream::Chunk::Parse(Socket::Buffer &buffer){
       DONTEVEN_MSG("Cannot read whole header");
       return false;
     }// can't read whole header
-    indata = buffer.copy(i + 11);
+    indata = buffer.peek(i + 11);
     timestamp = indata[i++] * 256 * 256;
     timestamp += indata[i++] * 256;
     timestamp += indata[i++];
@@ -383,7 +500,7 @@ bool RTMPStream::Chunk::Parse(Socket::Buffer &buffer){
       DONTEVEN_MSG("Cannot read whole header");
       return false;
     }// can't read whole header
-    indata = buffer.copy(i + 7);
+    indata = buffer.peek(i + 7);
     if (!allow_short){WARN_MSG("Warning: Header type 0x40 with no valid previous chunk!");}
     timestamp = indata[i++] * 256 * 256;
     timestamp += indata[i++] * 256;
@@ -405,7 +522,7 @@ bool RTMPStream::Chunk::Parse(Socket::Buffer &buffer){
       DONTEVEN_MSG("Cannot read whole header");
       return false;
     }// can't read whole header
-    indata = buffer.copy(i + 3);
+    indata = buffer.peek(i + 3);
     if (!allow_short){WARN_MSG("Warning: Header type 0x80 with no valid previous chunk!");}
     timestamp = indata[i++] * 256 * 256;
     timestamp += indata[i++] * 256;
@@ -452,7 +569,7 @@ bool RTMPStream::Chunk::Parse(Socket::Buffer &buffer){
       DONTEVEN_MSG("Cannot read timestamp");
       return false;
     }// can't read timestamp
-    indata = buffer.copy(i + 4);
+    indata = buffer.peek(i + 4);
     timestamp = indata[i++] * 256 * 256 * 256;
     timestamp += indata[i++] * 256 * 256;
     timestamp += indata[i++] * 256;
@@ -467,13 +584,18 @@ bool RTMPStream::Chunk::Parse(Socket::Buffer &buffer){
       DONTEVEN_MSG("Cannot read all data yet");
       return false;
     }// can't read all data (yet)
-    buffer.remove(i);                                      // remove the header
+    indata = buffer.peek(i + real_len);
     if (prev.len_left > 0){
-      data = prev.data + buffer.remove(real_len); // append the data and remove from buffer
+      // continue the partial message kept with this chunk stream
+      data.swap(prev.data);
+      data.append(indata + i, real_len);
     }else{
-      data = buffer.remove(real_len); // append the data and remove from buffer
+      data.assign(indata + i, real_len);
     }
-    lastrecv[cs_id] = *this;
+    buffer.skip(i + real_len); // remove the header and data from the buffer
+    storeHeader(prev);
+    // keep a partial message with its chunk stream, other chunk streams may interleave with it
+    if (len_left){prev.data.swap(data);}
     RTMPStream::rec_cnt += i + real_len;
     if (RTMPStream::rec_cnt >= 0xf0000000){
       INFO_MSG("Resetting receive window due to impending rollover");
@@ -486,10 +608,9 @@ bool RTMPStream::Chunk::Parse(Socket::Buffer &buffer){
       return Parse(buffer);
     }
   }else{
-    buffer.remove(i); // remove the header
-    data = "";
-    indata = indata.substr(i + real_len);
-    lastrecv[cs_id] = *this;
+    buffer.skip(i); // remove the header
+    data.clear();
+    storeHeader(prev);
     RTMPStream::rec_cnt += i + real_len;
     return true;
   }
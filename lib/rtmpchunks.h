@@ -3,12 +3,17 @@
 
 #pragma once
 #include "socket.h"
+#include "util.h"
 #include <arpa/inet.h>
 #include <map>
 #include <stdlib.h>
 #include <string.h>
 #include <string>
 #include <sys/time.h>
+#include <sys/uio.h>
+#include <vector>
+
+#define RTMP_CHUNK_STREAMS 65600 ///< Amount of chunk stream IDs; the three byte form goes up to 65599
 
 #ifndef FILLER_DATA
 #define FILLER_DATA                                                                                \
@@ -64,11 +69,52 @@ namespace RTMPStream{
     Chunk();
     bool Parse(Socket::Buffer &data);
     std::string &Pack();
+    void storeHeader(Chunk &target) const;
   };
   // RTMPStream::Chunk
 
-  extern std::map<unsigned int, Chunk> lastsend;
-  extern std::map<unsigned int, Chunk> lastrecv;
+  /// State of all chunk streams in one direction, in a table indexed by chunk stream ID.
+  /// A Chunk is allocated the first time a chunk stream is used and kept until clear(), so looking
+  /// up a chunk stream never searches and only allocates once per chunk stream. The table itself
+  /// only grows as far as the highest chunk stream ID used.
+  class ChunkStreams{
+  public:
+    ChunkStreams();
+    ~ChunkStreams();
+    size_t count(unsigned int cs_id) const;
+    Chunk &operator[](unsigned int cs_id);
+    void erase(unsigned int cs_id);
+    void clear();
+
+  private:
+    ChunkStreams(const ChunkStreams &);
+    ChunkStreams &operator=(const ChunkStreams &);
+    std::vector<Chunk *> streams; ///< Table of chunk streams, only as large as the highest ID used
+  };
+
+  extern ChunkStreams lastsend;
+  extern ChunkStreams lastrecv;
+
+  /// Splits messages into RTMP chunks without copying their payload.
+  /// All chunk headers are written into a buffer that is kept between messages, and vec lists
+  /// those headers alternated with the matching slices of the payload, ready to be sent with a
+  /// single vectored Socket::Connection::SendNow call. The payload must stay valid until then.
+  /// Uses and updates the lastsend state, and counts the message in snd_cnt.
+  class ChunkWriter{
+  public:
+    ChunkWriter();
+    size_t pack(unsigned int cs_id, unsigned char msg_type_id, unsigned int msg_stream_id,
+                uint64_t timestamp, const char *data, size_t len);
+    size_t pack(unsigned int cs_id, unsigned char msg_type_id, unsigned int msg_stream_id,
+                uint64_t timestamp, const char *prefix, size_t prefixLen, const char *data, size_t len);
+    struct iovec *vec; ///< Chunk headers and payload slices of the last packed message
+    size_t count;      ///< Amount of entries in vec
+    size_t size;       ///< Total size of the last packed message, in bytes
+
+  private:
+    Util::ResizeablePointer headers; ///< Storage for the chunk headers
+    Util::ResizeablePointer vecs;    ///< Storage for vec
+  };
 
   std::string &SendChunk(unsigned int cs_id, unsigned char msg_type_id, unsigned int msg_stream_id,
                          std::string data);
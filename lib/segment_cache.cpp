@@ -0,0 +1,220 @@
+/// \file segment_cache.cpp
+/// Shared memory cache for HTTP media segments that are identical for every viewer.
+
+#include "segment_cache.h"
+#include "checksum.h"
+#include "defines.h"
+#include "dtsc.h"
+#include "timing.h"
+#include <string.h>
+#include <unistd.h>
+
+namespace SegmentCache{
+
+  /// Turns a segment description into the 64-bit key it is cached under.
+  uint64_t hashKey(const std::string &key){
+    return ((uint64_t)checksum::crc32(0, key.data(), key.size()) << 32) |
+           checksum::crc32c(0, key.data(), key.size());
+  }
+
+  /// Opens the segment cache index of the given stream.
+  /// If create is true, the index is created if it does not exist yet.
+  /// Returns true if the index could be opened.
+  bool Index::open(const std::string &_streamName, bool create){
+    streamName = _streamName;
+    char name[NAME_BUFFER_SIZE];
+    snprintf(name, NAME_BUFFER_SIZE, SHM_SEGCACHE, streamName.c_str());
+    char semName[NAME_BUFFER_SIZE];
+    snprintf(semName, NAME_BUFFER_SIZE, SEM_SEGCACHE, streamName.c_str());
+    return openIndex(name, SHM_SEGCACHE_LEN, semName, create);
+  }
+
+  void Index::addFields(Util::RelAccX &A){
+    A.addField("track", RAX_32UINT);
+    A.addField("time", RAX_64UINT);
+    A.addField("size", RAX_64UINT);
+  }
+
+  void Index::mapFields(){
+    trackField = accX.getFieldData("track");
+    timeField = accX.getFieldData("time");
+    sizeField = accX.getFieldData("size");
+  }
+
+  uint64_t Index::getEvictions() const{return page.mapped ? *counter(0) : 0;}
+
+  /// Returns the total size in bytes of all segments currently in the cache.
+  uint64_t Index::getStored() const{return page.mapped ? *counter(1) : 0;}
+
+  /// Returns the shared memory page name the segment with the given key is stored in.
+  std::string Index::pageName(uint64_t key) const{
+    char name[NAME_BUFFER_SIZE];
+    snprintf(name, NAME_BUFFER_SIZE, SHM_SEGCACHE_DATA, streamName.c_str(), key);
+    return name;
+  }
+
+  /// Deletes the page of a cached segment that is being removed from the index.
+  void Index::onRemove(size_t rec){
+    if (accX.getInt(statusField, rec) != CLAIMIDX_READY){return;}
+    uint64_t len = accX.getInt(sizeField, rec);
+    IPC::sharedPage segPage(pageName(accX.getInt(keyField, rec)), len, false, false);
+    if (segPage.mapped){segPage.master = true;}
+    uint64_t &stored = *counter(1);
+    stored -= (stored > len ? len : stored);
+    ++(*counter(0));
+  }
+
+  /// Looks up the segment with the given key.
+  /// Returns CLAIMIDX_READY (and sets len) if it is available, CLAIMIDX_BUSY if another process
+  /// is producing it, or CLAIMIDX_CLAIMED if it was not available and is now reserved for the
+  /// calling process to produce.
+  uint8_t Index::claim(uint64_t key, size_t track, uint64_t time, uint64_t &len){
+    if (!page.mapped){return CLAIMIDX_NONE;}
+    IPC::semGuard G(&sem);
+    size_t rec;
+    uint8_t res = claimEntry(key, rec);
+    if (res == CLAIMIDX_READY){len = accX.getInt(sizeField, rec);}
+    if (res == CLAIMIDX_CLAIMED){
+      accX.setInt(trackField, track, rec);
+      accX.setInt(timeField, time, rec);
+      accX.setInt(sizeField, 0, rec);
+    }
+    return res;
+  }
+
+  /// Marks a segment this process claimed as available, now that its page was written.
+  /// Older segments are evicted as needed to keep the total below maxBytes.
+  /// Returns false if the segment could not be added; the caller should remove its page.
+  bool Index::publish(uint64_t key, uint64_t len, uint64_t maxBytes){
+    if (!page.mapped){return false;}
+    IPC::semGuard G(&sem);
+    size_t rec = findClaim(key);
+    if (rec == INVALID_RECORD_INDEX){return false;}
+    uint64_t &stored = *counter(1);
+    for (size_t i = accX.getDeleted(); i < accX.getEndPos() && stored + len > maxBytes; ++i){
+      if (i != rec && accX.getInt(statusField, i) == CLAIMIDX_READY){removeEntry(i);}
+    }
+    if (stored + len > maxBytes){
+      removeEntry(rec);
+      trimFront();
+      return false;
+    }
+    accX.setInt(sizeField, len, rec);
+    stored += len;
+    setReady(rec);
+    trimFront();
+    return true;
+  }
+
+  /// Counts a request that was served from the cache (hit) or had to be served without it.
+  void Index::count(bool hit){
+    if (!page.mapped){return;}
+    IPC::semGuard G(&sem);
+    ++(*(hit ? hits : misses));
+  }
+
+  /// Removes all segments that belong to data no longer in the buffer of the given stream:
+  /// either because their track went away or because their start is no longer buffered.
+  void Index::evictStale(const DTSC::Meta &M){
+    if (!page.mapped){return;}
+    std::set<size_t> validTracks = M.getValidTracks();
+    IPC::semGuard G(&sem);
+    for (size_t i = accX.getDeleted(); i < accX.getEndPos(); ++i){
+      if (accX.getInt(statusField, i) == CLAIMIDX_NONE){continue;}
+      size_t track = accX.getInt(trackField, i);
+      if (!validTracks.count(track) || accX.getInt(timeField, i) < M.getFirstms(track)){removeEntry(i);}
+    }
+    trimFront();
+  }
+
+  Segment::Segment(){
+    key = 0;
+    maxBytes = 0;
+    producing = false;
+  }
+
+  Segment::~Segment(){release();}
+
+  /// Attempts to retrieve a segment from the cache of the given stream.
+  /// The key must describe the segment contents completely; track and time are those of the
+  /// fragment the segment starts in, and used to evict it once that fragment leaves the buffer.
+  /// Returns true if the segment is available from data()/size(), false if the caller should
+  /// produce it.
+  bool Segment::get(const std::string &streamName, const std::string &keyStr, size_t track,
+                    uint64_t time, uint64_t _maxBytes){
+    release();
+    maxBytes = _maxBytes;
+    key = hashKey(keyStr);
+    if (!idx.open(streamName, true)){return false;}
+    uint64_t waitUntil = Util::bootMS() + SEGCACHE_WAIT;
+    while (true){
+      uint64_t len = 0;
+      uint8_t res = idx.claim(key, track, time, len);
+      if (res == CLAIMIDX_READY){
+        page.init(idx.pageName(key), len, false, false);
+        if (page.mapped){
+          idx.count(true);
+          HIGH_MSG("Segment %016" PRIx64 " (%" PRIu64 " bytes) served from cache", key, len);
+          return true;
+        }
+        // The page was evicted right after our lookup
+        idx.count(false);
+        return false;
+      }
+      if (res == CLAIMIDX_CLAIMED){
+        producing = true;
+        buffer.truncate(0);
+        return false;
+      }
+      if (res != CLAIMIDX_BUSY || !idx.await(waitUntil)){
+        idx.count(false);
+        return false;
+      }
+    }
+  }
+
+  /// Returns true if the caller is expected to pass the segment it produces through append().
+  bool Segment::isProducing() const{return producing;}
+
+  const char *Segment::data() const{return page.mapped;}
+
+  size_t Segment::size() const{return page.mapped ? page.len : 0;}
+
+  void Segment::append(const char *ptr, size_t len){
+    if (producing && !buffer.append(ptr, len)){release();}
+  }
+
+  void Segment::append(const std::string &str){append(str.data(), str.size());}
+
+  /// Stores the segment passed through append() in the cache, for other viewers to use.
+  void Segment::finish(){
+    if (!producing){return;}
+    producing = false;
+    if (!buffer.size()){
+      idx.abandon(key);
+      return;
+    }
+    std::string name = idx.pageName(key);
+    IPC::sharedPage segPage(name, buffer.size(), true, false);
+    if (!segPage.mapped){
+      idx.abandon(key);
+      return;
+    }
+    memcpy(segPage.mapped, buffer, buffer.size());
+    if (idx.publish(key, buffer.size(), maxBytes)){
+      segPage.master = false;
+      HIGH_MSG("Segment %016" PRIx64 " (%zu bytes) stored in cache", key, buffer.size());
+    }
+    buffer.truncate(0);
+  }
+
+  /// Unmaps the segment, or gives up on producing it so others can produce it instead.
+  void Segment::release(){
+    page.close();
+    if (!producing){return;}
+    producing = false;
+    idx.abandon(key);
+    buffer.truncate(0);
+  }
+
+}// namespace SegmentCache
@@ -0,0 +1,74 @@
+/// \file segment_cache.h
+/// Shared memory cache for HTTP media segments that are identical for every viewer.
+
+#pragma once
+#include "claim_index.h"
+#include "shared_memory.h"
+#include "util.h"
+#include <string>
+
+#define SEGCACHE_WAIT 5000 ///< Max ms to wait for another process to finish producing a segment
+
+namespace DTSC{
+  class Meta;
+}
+
+namespace SegmentCache{
+
+  uint64_t hashKey(const std::string &key);
+
+  /// Per-stream index of cached segments, keyed on hashKey() of the segment description.
+  /// Every entry records the track and start time of the segment, so it can be evicted once that
+  /// part of the stream leaves the buffer, and its size. The segments themselves are kept in
+  /// separate pages, which are removed along with their entries.
+  class Index : public IPC::claimIndex{
+  public:
+    bool open(const std::string &streamName, bool create);
+    uint64_t getEvictions() const;
+    uint64_t getStored() const;
+    uint8_t claim(uint64_t key, size_t track, uint64_t time, uint64_t &len);
+    bool publish(uint64_t key, uint64_t len, uint64_t maxBytes);
+    void count(bool hit);
+    void evictStale(const DTSC::Meta &M);
+    std::string pageName(uint64_t key) const;
+
+  protected:
+    virtual void addFields(Util::RelAccX &A);
+    virtual void mapFields();
+    virtual void onRemove(size_t rec);
+
+  private:
+    std::string streamName;
+    Util::RelAccXFieldData trackField;
+    Util::RelAccXFieldData timeField;
+    Util::RelAccXFieldData sizeField;
+  };
+
+  /// A single segment, either mapped from the cache or being produced into it.
+  /// Call get() first; if it returns true the segment can be sent from data()/size().
+  /// Otherwise the caller generates the segment itself, passing all of it through append() if
+  /// isProducing() is true, followed by finish() once the segment is complete. Segments that are
+  /// not finished are released on destruction, so other viewers go back to producing them.
+  class Segment{
+  public:
+    Segment();
+    ~Segment();
+    bool get(const std::string &streamName, const std::string &key, size_t track, uint64_t time, uint64_t maxBytes);
+    bool isProducing() const;
+    const char *data() const;
+    size_t size() const;
+    void append(const char *ptr, size_t len);
+    void append(const std::string &str);
+    void finish();
+    void release();
+
+  private:
+    Index idx;
+    uint64_t key;
+    uint64_t maxBytes;
+    bool producing;
+    Util::ResizeablePointer buffer;
+    IPC::sharedPage page;
+  };
+
+}// namespace SegmentCache
@@ -14,6 +14,14 @@
 #include <sstream>
 #include <sys/socket.h>
 #include <sys/stat.h>
+#include <sys/uio.h>
+#ifdef __linux__
+#include <netinet/udp.h>
+#include <sys/sendfile.h>
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103
+#endif
+#endif
 
 #define BUFFER_BLOCKSIZE 4096 // set buffer blocksize to 4KiB
 
@@ -333,200 +341,230 @@ std::string uint2string(unsigned int i){
 }
 
 Socket::Buffer::Buffer(){
+  buf = 0;
+  bufSize = 0;
+  start = 0;
+  end = 0;
   splitter = "\n";
 }
 
-/// Returns the amount of elements in the internal std::deque of std::string objects.
-/// The back is popped as long as it is empty, first - this way this function is
-/// guaranteed to return 0 if the buffer is empty.
+Socket::Buffer::Buffer(const Buffer &rhs){
+  buf = 0;
+  bufSize = 0;
+  start = 0;
+  end = 0;
+  *this = rhs;
+}
+
+Socket::Buffer &Socket::Buffer::operator=(const Buffer &rhs){
+  if (this == &rhs){return *this;}
+  clear();
+  splitter = rhs.splitter;
+  part = rhs.part;
+  if (rhs.end > rhs.start){append(rhs.buf + rhs.start, rhs.end - rhs.start);}
+  return *this;
+}
+
+Socket::Buffer::~Buffer(){
+  free(buf);
+}
+
+/// Moves the remainder of the part handed out by get() back in front of the unread data, so all
+/// unread data is contiguous again.
+void Socket::Buffer::unget(){
+  if (!part.size()){return;}
+  insert(part.data(), part.size());
+  part.clear();
+}
+
+/// Inserts data in front of the unread data in buf, moving the unread data if there is not
+/// enough room in front of it.
+void Socket::Buffer::insert(const char *newdata, size_t newdatasize){
+  if (!newdatasize){return;}
+  if (start < newdatasize){
+    size_t len = end - start;
+    if (len + newdatasize > bufSize){
+      size_t newSize = bufSize * 2;
+      if (newSize < len + newdatasize){newSize = len + newdatasize;}
+      char *newBuf = (char *)realloc(buf, newSize);
+      if (!newBuf){
+        FAIL_MSG("Could not allocate %zu bytes of receive buffer", newSize);
+        return;
+      }
+      buf = newBuf;
+      bufSize = newSize;
+    }
+    memmove(buf + newdatasize, buf + start, len);
+    start = newdatasize;
+    end = newdatasize + len;
+  }
+  start -= newdatasize;
+  memcpy(buf + start, newdata, newdatasize);
+}
+
+/// Returns the amount of parts in the buffer: zero if it is empty, one if all data is in the part
+/// returned by get(), more than one otherwise.
+/// If the part returned by get() was emptied, the next part is loaded first.
 unsigned int Socket::Buffer::size(){
-  while (data.size() > 0 && data.back().empty()){data.pop_back();}
-  return data.size();
+  if (!part.size() && end > start){get();}
+  return (part.size() ? 1 : 0) + (end > start ? 1 : 0);
 }
 
 /// Returns either the amount of total bytes available in the buffer or max, whichever is smaller.
 unsigned int Socket::Buffer::bytes(unsigned int max){
-  unsigned int i = 0;
-  for (std::deque<std::string>::iterator it = data.begin(); it != data.end(); ++it){
-    i += (*it).size();
-    if (i >= max){return max;}
-  }
-  return i;
+  size_t i = part.size() + end - start;
+  return i < max ? i : max;
 }
 
 /// Returns how many bytes to read until the next splitter, or 0 if none found.
 unsigned int Socket::Buffer::bytesToSplit(){
-  unsigned int i = 0;
-  for (std::deque<std::string>::reverse_iterator it = data.rbegin(); it != data.rend(); ++it){
-    i += (*it).size();
-    if ((*it).size() >= splitter.size() && (*it).substr((*it).size() - splitter.size()) == splitter){
-      return i;
-    }
-  }
-  return 0;
+  unget();
+  if (!splitter.size()){return 0;}
+  const char *found = (const char *)memmem(buf + start, end - start, splitter.data(), splitter.size());
+  if (!found){return 0;}
+  return found - (buf + start) + splitter.size();
 }
 
-/// Appends this string to the internal std::deque of std::string objects.
-/// It is automatically split every BUFFER_BLOCKSIZE bytes and when the splitter string is
-/// encountered.
+/// Appends this string to the buffer.
 void Socket::Buffer::append(const std::string &newdata){
   append(newdata.data(), newdata.size());
 }
 
-/// Helper function that does a short-circuiting string compare
-inline bool string_compare(const char *a, const char *b, const size_t len){
-  for (size_t i = 0; i < len; ++i){
-    if (a[i] != b[i]){return false;}
-  }
-  return true;
-}
-
-/// Appends this data block to the internal std::deque of std::string objects.
-/// It is automatically split every BUFFER_BLOCKSIZE bytes and when the splitter string is
-/// encountered.
+/// Appends this data block to the buffer.
 void Socket::Buffer::append(const char *newdata, const unsigned int newdatasize){
-  uint32_t i = 0;
-  while (i < newdatasize){
-    uint32_t j = 0;
-    if (!splitter.size()){
-      if (newdatasize - i > BUFFER_BLOCKSIZE){
-        j = BUFFER_BLOCKSIZE;
-      }else{
-        j = newdatasize - i;
-      }
-    }else{
-      while (j + i < newdatasize && j < BUFFER_BLOCKSIZE){
-        j++;
-        if (j >= splitter.size()){
-          if (string_compare(newdata + i + j - splitter.size(), splitter.data(), splitter.size())){
-            break;
-          }
-        }
-      }
-    }
-    if (j){
-      data.push_front("");
-      data.front().assign(newdata + i, (size_t)j);
-      i += j;
-    }else{
-      FAIL_MSG("Appended an empty string to buffer: aborting!");
-      break;
+  char *dest = appendSpace(newdatasize);
+  if (!dest){return;}
+  memcpy(dest, newdata, newdatasize);
+  end += newdatasize;
+}
+
+/// Returns a pointer to room for at least count bytes after the unread data, so they can be
+/// written into the buffer directly. Call appended() afterwards with the amount actually written.
+/// Moves the unread data back to the start of the block or grows the block as needed.
+/// Returns a null pointer if the memory could not be allocated.
+char *Socket::Buffer::appendSpace(unsigned int count){
+  if (end + count <= bufSize){return buf + end;}
+  size_t len = end - start;
+  if (len + count > bufSize / 2){
+    size_t newSize = bufSize ? bufSize * 2 : BUFFER_BLOCKSIZE * 4;
+    while (newSize < len + count){newSize *= 2;}
+    char *newBuf = (char *)realloc(buf, newSize);
+    if (!newBuf){
+      FAIL_MSG("Could not allocate %zu bytes of receive buffer", newSize);
+      return 0;
     }
+    buf = newBuf;
+    bufSize = newSize;
   }
-  if (data.size() > 5000){
-    WARN_MSG("Warning: After %d new bytes, buffer has %d parts containing over %u bytes!",
-             newdatasize, (int)data.size(), bytes(9000));
+  if (start){
+    memmove(buf, buf + start, len);
+    start = 0;
+    end = len;
   }
+  return buf + end;
+}
+
+/// Marks count bytes written to the pointer returned by appendSpace() as unread data.
+void Socket::Buffer::appended(unsigned int count){
+  end += count;
+  if (end > bufSize){end = bufSize;}
 }
 
-/// Prepends this data block to the internal std::deque of std::string objects.
-/// It is _not_ automatically split every BUFFER_BLOCKSIZE bytes.
+/// Prepends this data block to the buffer.
 void Socket::Buffer::prepend(const std::string &newdata){
-  data.push_back(newdata);
+  prepend(newdata.data(), newdata.size());
 }
 
-/// Prepends this data block to the internal std::deque of std::string objects.
-/// It is _not_ automatically split every BUFFER_BLOCKSIZE bytes.
+/// Prepends this data block to the buffer.
 void Socket::Buffer::prepend(const char *newdata, const unsigned int newdatasize){
-  data.push_back(std::string(newdata, (size_t)newdatasize));
+  unget();
+  insert(newdata, newdatasize);
 }
 
 /// Returns true if at least count bytes are available in this buffer.
 bool Socket::Buffer::available(unsigned int count){
-  size();
-  unsigned int i = 0;
-  for (std::deque<std::string>::iterator it = data.begin(); it != data.end(); ++it){
-    i += (*it).size();
-    if (i >= count){return true;}
-  }
-  return false;
+  return part.size() + end - start >= count;
 }
 
 /// Returns true if at least count bytes are available in this buffer.
 bool Socket::Buffer::available(unsigned int count) const{
-  unsigned int i = 0;
-  for (std::deque<std::string>::const_iterator it = data.begin(); it != data.end(); ++it){
-    i += (*it).size();
-    if (i >= count){return true;}
+  return part.size() + end - start >= count;
+}
+
+/// Returns a pointer to the first count bytes in the buffer, without copying or removing them.
+/// The pointer is valid until the buffer is next changed.
+/// Returns a null pointer if not all count bytes are available.
+const char *Socket::Buffer::peek(unsigned int count){
+  unget();
+  if (end - start < count){return 0;}
+  return buf + start;
+}
+
+/// Removes count bytes from the buffer without copying them anywhere.
+/// Removes all data if less than count bytes are available.
+void Socket::Buffer::skip(unsigned int count){
+  unget();
+  if (end - start <= count){
+    start = end = 0;
+    // Don't hold on to large blocks once the data that needed them is gone
+    if (bufSize > BUFFER_BLOCKSIZE * 256){
+      free(buf);
+      buf = 0;
+      bufSize = 0;
+    }
+    return;
   }
-  return false;
+  start += count;
 }
 
 /// Removes count bytes from the buffer, returning them by value.
 /// Returns an empty string if not all count bytes are available.
 std::string Socket::Buffer::remove(unsigned int count){
-  size();
-  if (!available(count)){return "";}
-  unsigned int i = 0;
-  std::string ret;
-  ret.reserve(count);
-  for (std::deque<std::string>::reverse_iterator it = data.rbegin(); it != data.rend(); ++it){
-    if (i + (*it).size() < count){
-      ret.append(*it);
-      i += (*it).size();
-      (*it).clear();
-    }else{
-      ret.append(*it, 0, count - i);
-      (*it).erase(0, count - i);
-      break;
-    }
-  }
+  const char *data = peek(count);
+  if (!data){return "";}
+  std::string ret(data, count);
+  skip(count);
   return ret;
 }
 
 /// Removes count bytes from the buffer, appending them to the given ptr.
 /// Does nothing if not all count bytes are available.
 void Socket::Buffer::remove(Util::ResizeablePointer & ptr, unsigned int count){
-  size();
-  if (!available(count)){return;}
-  unsigned int i = 0;
-  for (std::deque<std::string>::reverse_iterator it = data.rbegin(); it != data.rend(); ++it){
-    if (i + (*it).size() < count){
-      ptr.append(*it);
-      i += (*it).size();
-      (*it).clear();
-    }else{
-      ptr.append(it->data(), count - i);
-      (*it).erase(0, count - i);
-      break;
-    }
-  }
+  const char *data = peek(count);
+  if (!data){return;}
+  ptr.append(data, count);
+  skip(count);
 }
 
 /// Copies count bytes from the buffer, returning them by value.
 /// Returns an empty string if not all count bytes are available.
 std::string Socket::Buffer::copy(unsigned int count){
-  size();
-  if (!available(count)){return "";}
-  unsigned int i = 0;
-  std::string ret;
-  ret.reserve(count);
-  for (std::deque<std::string>::reverse_iterator it = data.rbegin(); it != data.rend(); ++it){
-    if (i + (*it).size() < count){
-      ret.append(*it);
-      i += (*it).size();
-    }else{
-      ret.append(*it, 0, count - i);
-      break;
-    }
-  }
-  return ret;
+  const char *data = peek(count);
+  if (!data){return "";}
+  return std::string(data, count);
 }
 
-/// Gets a reference to the back of the internal std::deque of std::string objects.
+/// Gets a reference to the first part of the buffer: the data up to and including the splitter,
+/// or at most BUFFER_BLOCKSIZE bytes if no splitter is found or set.
+/// Data erased from the returned string is removed from the buffer.
 std::string &Socket::Buffer::get(){
-  size();
-  static std::string empty;
-  if (data.size() > 0){
-    return data.back();
-  }else{
-    return empty;
+  if (part.size() || end == start){return part;}
+  size_t len = end - start;
+  if (len > BUFFER_BLOCKSIZE){len = BUFFER_BLOCKSIZE;}
+  if (splitter.size()){
+    const char *found = (const char *)memmem(buf + start, len, splitter.data(), splitter.size());
+    if (found){len = found - (buf + start) + splitter.size();}
   }
+  part.assign(buf + start, len);
+  start += len;
+  if (start == end){start = end = 0;}
+  return part;
 }
 
 /// Completely empties the buffer
 void Socket::Buffer::clear(){
-  data.clear();
+  part.clear();
+  start = end = 0;
 }
 
 void Socket::Connection::setBoundAddr(){
@@ -598,6 +636,10 @@ void Socket::Connection::clear(){
   Error = false;
   Blocking = false;
   skipCount = 0;
+  readSize = BUFFER_BLOCKSIZE;
+  corkDepth = 0;
+  corkMax = 0;
+  corkBuf.truncate(0);
   logUp = -1;
   logDown = -1;
 #ifdef SSL
@@ -703,6 +745,12 @@ bool Socket::Connection::isBlocking(){
 /// This function calls shutdown, thus making the socket unusable in all other
 /// processes as well. Do not use on shared sockets that are still in use.
 void Socket::Connection::close(){
+  if (corkDepth){
+    // Send any queued data first, unless that is what failed
+    corkDepth = 0;
+    if (corkBuf.size() && !Error && connected()){sendVec(0, 0);}
+    corkBuf.truncate(0);
+  }
   if (sSend != -1){shutdown(sSend, SHUT_RDWR);}
   drop();
 }// Socket::Connection::close
@@ -1009,7 +1057,7 @@ uint64_t Socket::Connection::dataDown(){
 /// Returns true if new data was received, false otherwise.
 bool Socket::Connection::spool(bool strictMode){
   /// \todo Provide better mechanism to prevent overbuffering.
-  if (!strictMode && downbuffer.size() > 10000){
+  if (!strictMode && downbuffer.available(10000 * BUFFER_BLOCKSIZE)){
     return true;
   }else{
     return iread(downbuffer);
@@ -1035,6 +1083,113 @@ const Socket::Buffer &Socket::Connection::Received() const{
 /// Will not buffer anything but always send right away. Blocks.
 /// Any data that could not be send will block until it can be send or the connection is severed.
 void Socket::Connection::SendNow(const char *data, size_t len){
+  if (corkDepth){
+    if (corkBuf.size() + len <= corkMax){
+      corkBuf.append(data, len);
+      return;
+    }
+    struct iovec iov;
+    iov.iov_base = (void *)data;
+    iov.iov_len = len;
+    sendVec(&iov, 1);
+    return;
+  }
+  sendUncorked(data, len);
+}
+
+/// Sends all given buffers as if they were a single SendNow call.
+/// Where possible this is done with a single writev call, instead of one call per buffer.
+void Socket::Connection::SendNow(const struct iovec *iov, size_t count){
+  if (corkDepth){
+    size_t total = corkBuf.size();
+    for (size_t i = 0; i < count; ++i){total += iov[i].iov_len;}
+    if (total <= corkMax){
+      for (size_t i = 0; i < count; ++i){corkBuf.append((const char *)iov[i].iov_base, iov[i].iov_len);}
+      return;
+    }
+  }
+  sendVec(iov, count);
+}
+
+/// Starts queueing all data passed to SendNow, instead of sending it right away.
+/// The queue is sent once uncork() was called as often as cork(), or as soon as more than
+/// maxBytes would be queued, merging as many buffers as possible into a single system call.
+/// Only SendNow and SendFile are aware of the queue: do not use iwrite directly while corked.
+void Socket::Connection::cork(size_t maxBytes){
+  if (!corkDepth || maxBytes < corkMax){corkMax = maxBytes;}
+  ++corkDepth;
+}
+
+/// Undoes a single cork() call, sending all queued data if it was the last one.
+void Socket::Connection::uncork(){
+  if (!corkDepth){return;}
+  if (--corkDepth){return;}
+  if (corkBuf.size()){sendVec(0, 0);}
+}
+
+/// Returns true if SendNow data is currently being queued.
+bool Socket::Connection::isCorked() const{
+  return corkDepth;
+}
+
+/// Sends the queued data (if any) followed by the given buffers. Blocks like SendNow.
+/// Uses writev for plain connections, and falls back to sending every buffer separately otherwise.
+void Socket::Connection::sendVec(const struct iovec *iov, size_t count){
+  bool direct = (!skipCount && logUp == -1);
+#ifdef SSL
+  if (sslConnected){direct = false;}
+#endif
+  if (!direct){
+    if (corkBuf.size()){sendUncorked(corkBuf, corkBuf.size());}
+    corkBuf.truncate(0);
+    for (size_t i = 0; i < count; ++i){sendUncorked((const char *)iov[i].iov_base, iov[i].iov_len);}
+    return;
+  }
+  bool bing = isBlocking();
+  if (!bing){setBlocking(true);}
+  // Sends up to 64 buffers per writev call, the queued data first
+  struct iovec vec[64];
+  size_t next = 0;
+  bool first = true;
+  while ((first || next < count) && connected()){
+    size_t cnt = 0;
+    if (first && corkBuf.size()){
+      vec[cnt].iov_base = (void *)(char *)corkBuf;
+      vec[cnt].iov_len = corkBuf.size();
+      ++cnt;
+    }
+    first = false;
+    for (; next < count && cnt < 64; ++next){
+      if (iov[next].iov_len){vec[cnt++] = iov[next];}
+    }
+    size_t idx = 0;
+    while (idx < cnt && connected()){
+      ssize_t r = writev(sSend, vec + idx, cnt - idx);
+      if (r < 0){
+        if (errno == EINTR || errno == EWOULDBLOCK){continue;}
+        Error = true;
+        lastErr = strerror(errno);
+        INSANE_MSG("Could not writev data! Error: %s", lastErr.c_str());
+        close();
+        break;
+      }
+      up += r;
+      while (idx < cnt && (size_t)r >= vec[idx].iov_len){
+        r -= vec[idx].iov_len;
+        ++idx;
+      }
+      if (r){
+        vec[idx].iov_base = (char *)vec[idx].iov_base + r;
+        vec[idx].iov_len -= r;
+      }
+    }
+  }
+  corkBuf.truncate(0);
+  if (!bing){setBlocking(false);}
+}
+
+/// Sends the given data right away, regardless of corking. Blocks.
+void Socket::Connection::sendUncorked(const char *data, size_t len){
   bool bing = isBlocking();
   if (!bing){setBlocking(true);}
   unsigned int i = iwrite(data, std::min((long unsigned int)len, SOCKETSIZE));
@@ -1069,6 +1224,58 @@ void Socket::Connection::SendNow(const std::string &data){
   SendNow(data.data(), data.size());
 }
 
+/// Sends len bytes of the given file, starting at offset, right away. Blocks like SendNow.
+/// Uses sendfile() where possible, so the data never passes through userspace; falls back to
+/// reading the file and sending it normally for encrypted or logged connections, or when the
+/// file or connection does not support it.
+/// Returns false if the file could not be read completely.
+bool Socket::Connection::SendFile(int fd, uint64_t offset, size_t len){
+  if (corkBuf.size()){sendVec(0, 0);}
+  bool zeroCopy = (!skipCount && logUp == -1);
+#ifdef SSL
+  if (sslConnected){zeroCopy = false;}
+#endif
+  bool bing = isBlocking();
+  if (!bing){setBlocking(true);}
+#ifdef __linux__
+  while (zeroCopy && len && connected()){
+    off_t off = offset;
+    ssize_t r = sendfile(sSend, fd, &off, std::min(len, (size_t)(16 * 1024 * 1024)));
+    if (r < 0){
+      if (errno == EINTR || errno == EAGAIN){continue;}
+      if (errno == EINVAL || errno == ENOSYS){
+        zeroCopy = false;
+        break;
+      }
+      Error = true;
+      lastErr = strerror(errno);
+      INSANE_MSG("Could not sendfile data! Error: %s", lastErr.c_str());
+      close();
+      break;
+    }
+    if (!r){break;}// Reached end of file
+    up += r;
+    offset += r;
+    len -= r;
+  }
+  if (zeroCopy){
+    if (!bing){setBlocking(false);}
+    return !len || !connected();
+  }
+#endif
+  char buf[32 * 1024];
+  while (len && connected()){
+    ssize_t r = pread(fd, buf, std::min(len, sizeof(buf)), offset);
+    if (r < 0 && errno == EINTR){continue;}
+    if (r < 1){break;}
+    SendNow(buf, r);
+    offset += r;
+    len -= r;
+  }
+  if (!bing){setBlocking(false);}
+  return !len || !connected();
+}
+
 void Socket::Connection::skipBytes(uint32_t byteCount){
   INFO_MSG("Skipping first %" PRIu32 " bytes going to socket", byteCount);
   skipCount = byteCount;
@@ -1220,16 +1427,25 @@ int Socket::Connection::iread(void *buffer, int len, int flags){
   return r;
 }// Socket::Connection::iread
 
+/// Sets how many bytes at most spool() and friends read into the receive buffer at once.
+/// Defaults to 4KiB; connections that receive large amounts of data benefit from more, as that
+/// takes fewer system calls.
+void Socket::Connection::setReadSize(size_t bytes){
+  readSize = bytes ? bytes : BUFFER_BLOCKSIZE;
+}
+
 /// Read call that is compatible with Socket::Buffer.
 /// Data is read using iread (which is nonblocking if the Socket::Connection itself is),
-/// then appended to end of buffer.
+/// directly into the free space at the end of the buffer.
 /// \param buffer Socket::Buffer to append data to.
 /// \param flags Flags to use in the recv call. Ignored on fake sockets.
 /// \return True if new data arrived, false otherwise.
 bool Socket::Connection::iread(Buffer &buffer, int flags){
-  char cbuffer[BUFFER_BLOCKSIZE];
-  int num = iread(cbuffer, BUFFER_BLOCKSIZE, flags);
+  char *cbuffer = buffer.appendSpace(readSize);
+  if (!cbuffer){return false;}
+  int num = iread(cbuffer, readSize, flags);
   if (num < 1){return false;}
+  buffer.appended(num);
   if (logDown != -1){
     size_t written = 0;
     while (written < num && logDown != -1){
@@ -1242,7 +1458,6 @@ bool Socket::Connection::iread(Buffer &buffer, int flags){
       written += ret;
     }
   }
-  buffer.append(cbuffer, num);
   return true;
 }// iread
 
@@ -1332,6 +1547,7 @@ Socket::Connection::Connection(const Connection &rhs){
   up = rhs.up;
   down = rhs.down;
   downbuffer = rhs.downbuffer;
+  readSize = rhs.readSize;
 #ifdef SSL
   if (!rhs.sslConnected){
 #endif
@@ -1366,6 +1582,7 @@ Socket::Connection &Socket::Connection::operator=(const Socket::Connection &rhs)
   up = rhs.up;
   down = rhs.down;
   downbuffer = rhs.downbuffer;
+  readSize = rhs.readSize;
 #ifdef SSL
   if (!rhs.sslConnected){
 #endif
@@ -1392,6 +1609,16 @@ bool Socket::Connection::isLocal(){
   return Socket::isLocal(remotehost);
 }
 
+/// Corks the given connection until this object is destroyed.
+Socket::CorkGuard::CorkGuard(Connection &conn, size_t maxBytes) : myConn(conn){
+  myConn.cork(maxBytes);
+}
+
+/// Uncorks the connection, sending any queued data.
+Socket::CorkGuard::~CorkGuard(){
+  myConn.uncork();
+}
+
 /// Create a new base Server. The socket is never connected, and a placeholder for later
 /// connections.
 Socket::Server::Server(){
@@ -1675,6 +1902,7 @@ Socket::UDPConnection::UDPConnection(bool nonblock){
   down = 0;
   destAddr = 0;
   destAddr_size = 0;
+  initBatches();
 #ifdef __CYGWIN__
   data.allocate(SOCKETSIZE);
 #else
@@ -1682,6 +1910,17 @@ Socket::UDPConnection::UDPConnection(bool nonblock){
 #endif
 }// Socket::UDPConnection UDP Contructor
 
+/// Resets the batched receive and send state.
+void Socket::UDPConnection::initBatches(){
+  recvSlot = 0;
+  recvCount = 0;
+  recvNext = 0;
+  sendCount = 0;
+  corkDepth = 0;
+  segmentOffload = false;
+  sendBuf.truncate(0);
+}
+
 ///Checks if the UDP receive buffer is at least 1 mbyte, attempts to increase and warns user through log message on failure.
 void Socket::UDPConnection::checkRecvBuf(){
   if (sock == -1){return;}
@@ -1749,11 +1988,18 @@ Socket::UDPConnection::UDPConnection(const UDPConnection &o){
     destAddr = 0;
     destAddr_size = 0;
   }
+  initBatches();
   data.allocate(2048);
 }
 
 /// Close the UDP socket
 void Socket::UDPConnection::close(){
+  if (corkDepth){
+    corkDepth = 0;
+    sendQueued();
+  }
+  recvCount = 0;
+  recvNext = 0;
   if (sock != -1){
     errno = EINTR;
     while (::close(sock) != 0 && errno == EINTR){}
@@ -1932,8 +2178,120 @@ void Socket::UDPConnection::SendNow(const char *sdata){
 /// Sends a UDP datagram using the buffer sdata of length len.
 /// Does not do anything if len < 1.
 /// Prints an DLVL_FAIL level debug message if sending failed.
+/// While corked, the datagram is queued instead, to be sent along with the others in the queue.
 void Socket::UDPConnection::SendNow(const char *sdata, size_t len){
   if (len < 1){return;}
+  if (corkDepth){
+    sendBuf.append(sdata, len);
+    sendLens[sendCount++] = len;
+    if (sendCount == UDP_BATCH){sendQueued();}
+    return;
+  }
+  sendDatagram(sdata, len);
+}
+
+/// Starts queueing datagrams passed to SendNow, instead of sending them right away.
+/// The queue is sent once uncork() was called as often as cork(), or when UDP_BATCH datagrams
+/// are queued, using as few system calls as possible.
+void Socket::UDPConnection::cork(){
+  ++corkDepth;
+}
+
+/// Undoes a single cork() call, sending all queued datagrams if it was the last one.
+void Socket::UDPConnection::uncork(){
+  if (!corkDepth){return;}
+  if (!--corkDepth){sendQueued();}
+}
+
+/// Enables or disables UDP generic segmentation offload for queued datagrams.
+/// When enabled, queues of equally sized datagrams (only the last may be smaller) are handed to
+/// the kernel as a single buffer that is split into datagrams as late as possible.
+/// Automatically disabled again if the kernel or network interface does not support it.
+void Socket::UDPConnection::setSegmentOffload(bool enable){
+  segmentOffload = enable;
+}
+
+/// Sends all queued datagrams.
+/// On Linux this is done with a single sendmsg call using UDP GSO when possible and enabled, and
+/// with sendmmsg otherwise. Other platforms send every datagram separately.
+void Socket::UDPConnection::sendQueued(){
+  if (!sendCount){return;}
+#ifdef __linux__
+  if (segmentOffload && sendCount > 1 && sendBuf.size() <= 65000){
+    bool equalSize = true;
+    for (size_t i = 1; i < sendCount && equalSize; ++i){
+      if (sendLens[i] > sendLens[0] || (sendLens[i] != sendLens[0] && i + 1 < sendCount)){equalSize = false;}
+    }
+    if (equalSize){
+      struct iovec iov;
+      iov.iov_base = (char *)sendBuf;
+      iov.iov_len = sendBuf.size();
+      char ctrl[CMSG_SPACE(sizeof(uint16_t))];
+      memset(ctrl, 0, sizeof(ctrl));
+      struct msghdr msg;
+      memset(&msg, 0, sizeof(msg));
+      msg.msg_name = destAddr;
+      msg.msg_namelen = destAddr_size;
+      msg.msg_iov = &iov;
+      msg.msg_iovlen = 1;
+      msg.msg_control = ctrl;
+      msg.msg_controllen = sizeof(ctrl);
+      struct cmsghdr *cm = CMSG_FIRSTHDR(&msg);
+      cm->cmsg_level = SOL_UDP;
+      cm->cmsg_type = UDP_SEGMENT;
+      cm->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+      uint16_t segSize = sendLens[0];
+      memcpy(CMSG_DATA(cm), &segSize, sizeof(segSize));
+      int r = sendmsg(sock, &msg, 0);
+      if (r > 0){
+        up += r;
+        sendBuf.truncate(0);
+        sendCount = 0;
+        return;
+      }
+      if (errno != EAGAIN && errno != EINTR && errno != ENOBUFS){
+        INFO_MSG("Disabling UDP segmentation offload for socket %d: %s", sock, strerror(errno));
+        segmentOffload = false;
+      }
+    }
+  }
+  struct mmsghdr msgs[UDP_BATCH];
+  struct iovec iovs[UDP_BATCH];
+  memset(msgs, 0, sizeof(msgs));
+  size_t offset = 0;
+  for (size_t i = 0; i < sendCount; ++i){
+    iovs[i].iov_base = (char *)sendBuf + offset;
+    iovs[i].iov_len = sendLens[i];
+    offset += sendLens[i];
+    msgs[i].msg_hdr.msg_name = destAddr;
+    msgs[i].msg_hdr.msg_namelen = destAddr_size;
+    msgs[i].msg_hdr.msg_iov = iovs + i;
+    msgs[i].msg_hdr.msg_iovlen = 1;
+  }
+  size_t sent = 0;
+  while (sent < sendCount){
+    int r = sendmmsg(sock, msgs + sent, sendCount - sent, 0);
+    if (r < 1){
+      if (r == -1 && errno == EINTR){continue;}
+      FAIL_MSG("Could not send UDP data through %d: %s", sock, strerror(errno));
+      break;
+    }
+    for (size_t i = sent; i < sent + r; ++i){up += msgs[i].msg_len;}
+    sent += r;
+  }
+#else
+  size_t offset = 0;
+  for (size_t i = 0; i < sendCount; ++i){
+    sendDatagram(sendBuf + offset, sendLens[i]);
+    offset += sendLens[i];
+  }
+#endif
+  sendBuf.truncate(0);
+  sendCount = 0;
+}
+
+/// Sends a single datagram right away, regardless of corking.
+void Socket::UDPConnection::sendDatagram(const char *sdata, size_t len){
   int r = sendto(sock, sdata, len, 0, (sockaddr *)destAddr, destAddr_size);
   if (r > 0){
     up += r;
@@ -2145,8 +2503,27 @@ uint16_t Socket::UDPConnection::bind(int port, std::string iface, const std::str
 /// This will automatically allocate or resize the internal data buffer if needed.
 /// If a packet is received, it will be placed in the "data" member, with it's length in "data_len".
 /// \return True if a packet was received, false otherwise.
+/// On Linux, datagrams are received in batches of up to UDP_BATCH with a single recvmmsg call,
+/// and then returned one by one by the following calls.
 bool Socket::UDPConnection::Receive(){
   if (sock == -1){return false;}
+#ifdef __linux__
+  if (recvNext >= recvCount && !receiveBatch()){return false;}
+  size_t i = recvNext++;
+  uint32_t r = recvLens[i];
+  data.truncate(0);
+  if (destAddr && recvAddrLens[i] && destAddr_size >= recvAddrLens[i]){
+    memcpy(destAddr, recvAddrs + i, recvAddrLens[i]);
+  }
+  data.append(recvBuf + recvSlot * i, std::min((size_t)r, recvSlot));
+  down += r;
+  //Handle UDP packets that are too large
+  if (recvSlot < r && data.rsize() <= recvSlot){
+    INFO_MSG("Doubling UDP socket buffer from %" PRIu32 " to %" PRIu32, data.rsize(), data.rsize()*2);
+    data.allocate(data.rsize()*2);
+  }
+  return (r > 0);
+#else
   data.truncate(0);
   sockaddr_in6 addr;
   socklen_t destsize = sizeof(addr);
@@ -2164,6 +2541,43 @@ bool Socket::UDPConnection::Receive(){
     data.allocate(data.rsize()*2);
   }
   return (r > 0);
+#endif
+}
+
+/// Receives as many datagrams as are available, up to UDP_BATCH, without blocking.
+/// Each slot in the batch is as large as the current data buffer.
+/// Returns false if nothing could be received.
+bool Socket::UDPConnection::receiveBatch(){
+#ifdef __linux__
+  recvCount = 0;
+  recvNext = 0;
+  recvSlot = data.rsize();
+  if (!recvBuf.allocate(recvSlot * UDP_BATCH)){return false;}
+  struct mmsghdr msgs[UDP_BATCH];
+  struct iovec iovs[UDP_BATCH];
+  memset(msgs, 0, sizeof(msgs));
+  for (size_t i = 0; i < UDP_BATCH; ++i){
+    iovs[i].iov_base = recvBuf + recvSlot * i;
+    iovs[i].iov_len = recvSlot;
+    msgs[i].msg_hdr.msg_name = recvAddrs + i;
+    msgs[i].msg_hdr.msg_namelen = sizeof(sockaddr_in6);
+    msgs[i].msg_hdr.msg_iov = iovs + i;
+    msgs[i].msg_hdr.msg_iovlen = 1;
+  }
+  int r = recvmmsg(sock, msgs, UDP_BATCH, MSG_TRUNC | MSG_DONTWAIT, 0);
+  if (r == -1){
+    if (errno != EAGAIN){INFO_MSG("UDP receive: %d (%s)", errno, strerror(errno));}
+    return false;
+  }
+  for (int i = 0; i < r; ++i){
+    recvLens[i] = msgs[i].msg_len;
+    recvAddrLens[i] = msgs[i].msg_hdr.msg_namelen;
+  }
+  recvCount = r;
+  return r > 0;
+#else
+  return false;
+#endif
 }
 
 int Socket::UDPConnection::getSock(){
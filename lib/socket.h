@@ -13,6 +13,7 @@
 #include <string>
 #include <sys/socket.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 #include <sys/un.h>
 #include <unistd.h>
 #include "util.h"
@@ -28,6 +29,9 @@
 
 #include "util.h"
 
+#define SOCKET_CORK_SIZE 65536 ///< Default max bytes queued by a corked Socket::Connection
+#define UDP_BATCH 32           ///< Max datagrams received or sent by Socket::UDPConnection per call
+
 // for being friendly with Socket::Connection down below
 namespace Buffer{
   class user;
@@ -51,22 +55,40 @@ namespace Socket{
   bool getPeerName(int fd, std::string &host, uint32_t &port);
   bool getPeerName(int fd, std::string &host, uint32_t &port, sockaddr * tmpaddr, socklen_t * addrlen);
 
-  /// A buffer made out of std::string objects that can be efficiently read from and written to.
+  /// A contiguous, growable receive buffer that can be efficiently read from and written to.
+  /// All unread data lives in a single block of memory: reading advances the start of the data,
+  /// and appending first moves the unread data back to the beginning of the block before growing
+  /// it. Parsers can therefore read frames in place through peek() and skip(), without copies.
+  /// For line-based readers, get() hands out the first part of the data (up to and including the
+  /// splitter, or at most BUFFER_BLOCKSIZE bytes) as a std::string.
   class Buffer{
   private:
-    std::deque<std::string> data;
+    char *buf;        ///< Allocated block of memory, or null
+    size_t bufSize;   ///< Size of the allocated block
+    size_t start;     ///< Offset of the first unread byte in buf
+    size_t end;       ///< Offset just past the last unread byte in buf
+    std::string part; ///< Part handed out by get(), logically in front of the data in buf
+    void unget();
+    void insert(const char *newdata, size_t newdatasize);
 
   public:
     std::string splitter; ///< String to automatically split on if encountered. \n by default
     Buffer();
+    Buffer(const Buffer &rhs);
+    Buffer &operator=(const Buffer &rhs);
+    ~Buffer();
     unsigned int size();
     unsigned int bytes(unsigned int max);
     unsigned int bytesToSplit();
     void append(const std::string &newdata);
     void append(const char *newdata, const unsigned int newdatasize);
+    char *appendSpace(unsigned int count);
+    void appended(unsigned int count);
     void prepend(const std::string &newdata);
     void prepend(const char *newdata, const unsigned int newdatasize);
     std::string &get();
+    const char *peek(unsigned int count);
+    void skip(unsigned int count);
     bool available(unsigned int count);
     bool available(unsigned int count) const;
     std::string remove(unsigned int count);
@@ -94,6 +116,12 @@ namespace Socket{
     uint64_t logDown;
     long long int conntime;
     Buffer downbuffer;                                ///< Stores temporary data coming in.
+    Util::ResizeablePointer corkBuf;                  ///< Stores SendNow data queued while corked.
+    size_t corkDepth;                                 ///< Amount of cork() calls not yet uncork()ed.
+    size_t corkMax;                                   ///< Max bytes queued while corked.
+    size_t readSize;                                  ///< Max bytes read into downbuffer at once.
+    void sendUncorked(const char *data, size_t len);
+    void sendVec(const struct iovec *iov, size_t count);
     int iread(void *buffer, int len, int flags = 0);  ///< Incremental read call.
     bool iread(Buffer &buffer, int flags = 0); ///< Incremental write call that is compatible with Socket::Buffer.
     void setBoundAddr();
@@ -135,6 +163,7 @@ namespace Socket{
     void drop();                                         ///< Close connection without shutdown.
     void setBlocking(bool blocking); ///< Set this socket to be blocking (true) or nonblocking (false).
     bool isBlocking(); ///< Check if this socket is blocking (true) or nonblocking (false).
+    void setReadSize(size_t bytes); ///< Sets how many bytes are read into the receive buffer at once.
     std::string getHost() const; ///< Gets hostname for connection, if available.
     std::string getBinHost() const;
     void setHost(std::string host); ///< Sets hostname for connection manually.
@@ -154,6 +183,11 @@ namespace Socket{
     void SendNow(const char *data); ///< Will not buffer anything but always send right away. Blocks.
     void SendNow(const char *data,
                  size_t len); ///< Will not buffer anything but always send right away. Blocks.
+    void SendNow(const struct iovec *iov, size_t count); ///< Sends several buffers at once. Blocks.
+    bool SendFile(int fd, uint64_t offset, size_t len); ///< Sends part of a file right away, zero-copy where possible. Blocks.
+    void cork(size_t maxBytes = SOCKET_CORK_SIZE); ///< Queues SendNow data until uncork() is called.
+    void uncork();                                 ///< Sends all data queued since cork().
+    bool isCorked() const;
     void skipBytes(uint32_t byteCount);
     uint32_t skipCount;
     // unbuffered i/o methods
@@ -176,6 +210,16 @@ namespace Socket{
     operator bool() const;
   };
 
+  /// Corks a connection for as long as this object exists.
+  class CorkGuard{
+  public:
+    CorkGuard(Connection &conn, size_t maxBytes = SOCKET_CORK_SIZE);
+    ~CorkGuard();
+
+  private:
+    Connection &myConn;
+  };
+
   /// This class is for easily setting up listening socket, either TCP or Unix.
   class Server{
   private:
@@ -192,6 +236,7 @@ namespace Socket{
     void setBlocking(bool blocking); ///< Set this socket to be blocking (true) or nonblocking (false).
     bool connected() const;          ///< Returns the connected-state for this socket.
     bool isBlocking(); ///< Check if this socket is blocking (true) or nonblocking (false).
+    void setReadSize(size_t bytes); ///< Sets how many bytes are read into the receive buffer at once.
     void close();      ///< Close connection.
     void drop();       ///< Close connection without shutdown.
     int getSocket();   ///< Returns internal socket number.
@@ -209,6 +254,22 @@ namespace Socket{
     std::string boundAddr, boundMulti;
     int boundPort;
     void checkRecvBuf();
+    void initBatches();
+    bool receiveBatch();
+    void sendDatagram(const char *data, size_t len);
+    void sendQueued();
+    Util::ResizeablePointer recvBuf;        ///< Datagrams received in one batch, recvSlot bytes each
+    size_t recvSlot;                        ///< Bytes reserved per datagram in recvBuf
+    size_t recvCount;                       ///< Amount of datagrams in recvBuf
+    size_t recvNext;                        ///< Next datagram in recvBuf to be returned by Receive
+    uint32_t recvLens[UDP_BATCH];           ///< Length of each datagram in recvBuf
+    sockaddr_in6 recvAddrs[UDP_BATCH];      ///< Source address of each datagram in recvBuf
+    socklen_t recvAddrLens[UDP_BATCH];      ///< Length of each source address
+    Util::ResizeablePointer sendBuf;        ///< Datagrams queued while corked, back to back
+    uint32_t sendLens[UDP_BATCH];           ///< Length of each datagram in sendBuf
+    size_t sendCount;                       ///< Amount of datagrams in sendBuf
+    size_t corkDepth;                       ///< Amount of cork() calls not yet uncork()ed
+    bool segmentOffload;                    ///< Whether to try UDP GSO for equally sized datagrams
 
   public:
     Util::ResizeablePointer data;
@@ -231,6 +292,9 @@ namespace Socket{
     void SendNow(const std::string &data);
     void SendNow(const char *data);
     void SendNow(const char *data, size_t len);
+    void cork();
+    void uncork();
+    void setSegmentOffload(bool enable);
     void setSocketFamily(int AF_TYPE);
   };
 }// namespace Socket
@@ -69,10 +69,10 @@ namespace tthread{
 #endif
 
 #if defined(_TTHREAD_WIN32_)
-  void condition_variable::_wait(){
+  void condition_variable::_wait(DWORD aTimeout){
     // Wait for either event to become signaled due to notify_one() or
     // notify_all() being called
-    int result = WaitForMultipleObjects(2, mEvents, FALSE, INFINITE);
+    int result = WaitForMultipleObjects(2, mEvents, FALSE, aTimeout);
 
     // Check if we are the last waiter
     EnterCriticalSection(&mWaitersCountLock);
@@ -80,6 +80,7 @@ freely, subject to the following restrictions:
 #include <pthread.h>
 #include <sched.h>
 #include <signal.h>
+#include <time.h>
 #include <unistd.h>
 #endif
 
@@ -412,6 +413,32 @@ namespace tthread{
 #endif
     }
 
+    /// Wait for the condition, for at most the given amount of milliseconds.
+    /// Behaves like @c wait(), but also returns once the time has passed.
+    /// @param[in] aMutex A mutex that will be unlocked when the wait operation
+    ///   starts, and locked again as soon as the wait operation is finished.
+    /// @param[in] aMillis Maximum amount of milliseconds to wait.
+    template <class _mutexT> inline void wait_for(_mutexT &aMutex, unsigned int aMillis){
+#if defined(_TTHREAD_WIN32_)
+      EnterCriticalSection(&mWaitersCountLock);
+      ++mWaitersCount;
+      LeaveCriticalSection(&mWaitersCountLock);
+      aMutex.unlock();
+      _wait(aMillis);
+      aMutex.lock();
+#else
+      struct timespec until;
+      clock_gettime(CLOCK_REALTIME, &until);
+      until.tv_sec += aMillis / 1000;
+      until.tv_nsec += (aMillis % 1000) * 1000000;
+      if (until.tv_nsec >= 1000000000){
+        until.tv_nsec -= 1000000000;
+        ++until.tv_sec;
+      }
+      pthread_cond_timedwait(&mHandle, &aMutex.mHandle, &until);
+#endif
+    }
+
     /// Notify one thread that is waiting for the condition.
     /// If at least one thread is blocked waiting for this condition variable,
     /// one will be woken up.
@@ -438,7 +465,7 @@ namespace tthread{
 
   private:
 #if defined(_TTHREAD_WIN32_)
-    void _wait();
+    void _wait(DWORD aTimeout = INFINITE);
     HANDLE mEvents[2];                  ///< Signal and broadcast event HANDLEs.
     unsigned int mWaitersCount;         ///< Count of the number of waiters.
     CRITICAL_SECTION mWaitersCountLock; ///< Serialize access to mWaitersCount.
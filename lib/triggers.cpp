@@ -15,8 +15,17 @@
 /// Currently, all triggers are handled asynchronously and responses (if any) are completely
 /// ignored. In the future this may change.
 ///
+/// Responses to blocking triggers can be cached by setting `cache_ttl` (in seconds) on the trigger
+/// configuration. Identical calls to the same handler within that time are answered from the
+/// cache, and identical calls made while one is already in progress wait for it instead of calling
+/// the handler again. By default calls are identical if their payloads are; `cache_key` may list
+/// the (1-based) payload line numbers to compare instead, e.g. `[1, 3]` for USER_NEW to ignore the
+/// host, protocol, request URL and session ID of viewers. Only successful responses of up to
+/// TRIGCACHE_RESPONSE bytes are cached.
+///
 
 #include "bitfields.h"  //for strToBool
+#include "checksum.h"
 #include "defines.h"    //for FAIL_MSG and INFO_MSG
 #include "downloader.h" //for sending http request
 #include "procs.h"      //for StartPiped
@@ -28,9 +37,104 @@
 #include "json.h"
 #include "stream.h"
 #include <string.h> //for strncmp
+#include <unistd.h>
 
 namespace Triggers{
 
+  /// Opens the response cache of the given trigger type.
+  /// If create is true, the cache is created if it does not exist yet.
+  /// Returns true if the cache could be opened.
+  bool ResponseCache::open(const std::string &type, bool create){
+    char name[NAME_BUFFER_SIZE];
+    snprintf(name, NAME_BUFFER_SIZE, SHM_TRIGCACHE, type.c_str());
+    char semName[NAME_BUFFER_SIZE];
+    snprintf(semName, NAME_BUFFER_SIZE, SEM_TRIGCACHE, type.c_str());
+    return openIndex(name, SHM_TRIGCACHE_LEN, semName, create);
+  }
+
+  void ResponseCache::addFields(Util::RelAccX &A){
+    A.addField("expires", RAX_64UINT);
+    A.addField("response", RAX_STRING, TRIGCACHE_RESPONSE + 1);
+  }
+
+  void ResponseCache::mapFields(){
+    expiresField = accX.getFieldData("expires");
+    responseField = accX.getFieldData("response");
+  }
+
+  /// Responses are only used until their TTL runs out.
+  bool ResponseCache::isExpired(size_t rec) const{return accX.getInt(expiresField, rec) <= Util::bootMS();}
+
+  uint64_t ResponseCache::getCoalesced() const{return page.mapped ? *counter(0) : 0;}
+
+  /// Turns a handler and payload into the 64-bit key its response is cached under.
+  /// keyLines is a comma-separated list of 1-based payload line numbers to use; if it is empty
+  /// the whole payload is used.
+  uint64_t ResponseCache::makeKey(const std::string &handler, const std::string &payload,
+                                  const std::string &keyLines){
+    std::string key = handler;
+    key += '\n';
+    if (!keyLines.size()){
+      key += payload;
+    }else{
+      std::deque<std::string> lines;
+      size_t lineStart = 0;
+      while (lineStart <= payload.size()){
+        size_t lineEnd = payload.find('\n', lineStart);
+        if (lineEnd == std::string::npos){lineEnd = payload.size();}
+        lines.push_back(payload.substr(lineStart, lineEnd - lineStart));
+        lineStart = lineEnd + 1;
+      }
+      const char *wanted = keyLines.c_str();
+      while (*wanted){
+        size_t line = strtoul(wanted, (char **)&wanted, 10);
+        if (line && line <= lines.size()){key += lines[line - 1];}
+        key += '\n';
+        while (*wanted && (*wanted < '0' || *wanted > '9')){++wanted;}
+      }
+    }
+    return ((uint64_t)checksum::crc32(0, key.data(), key.size()) << 32) |
+           checksum::crc32c(0, key.data(), key.size());
+  }
+
+  /// Looks up the response for the given key.
+  /// Returns CLAIMIDX_READY (and sets response) if it is available, CLAIMIDX_BUSY if another
+  /// process is handling an identical trigger, or CLAIMIDX_CLAIMED if it was not available and
+  /// the calling process should now handle the trigger and publish() or abandon() the result.
+  /// If waited is true, a response that is available counts as a coalesced call instead of a hit.
+  uint8_t ResponseCache::claim(uint64_t key, std::string &response, bool waited){
+    if (!page.mapped){return CLAIMIDX_NONE;}
+    IPC::semGuard G(&sem);
+    size_t rec;
+    uint8_t res = claimEntry(key, rec);
+    if (res == CLAIMIDX_READY){
+      response = accX.getPointer(responseField, rec);
+      ++(*(waited ? counter(0) : hits));
+    }
+    if (res == CLAIMIDX_CLAIMED){
+      accX.setInt(expiresField, 0, rec);
+      accX.setString(responseField, "", rec);
+    }
+    return res;
+  }
+
+  /// Stores the response to a trigger this process claimed, for ttl seconds.
+  /// Responses that are too long to cache release the claim instead.
+  void ResponseCache::publish(uint64_t key, const std::string &response, uint64_t ttl){
+    if (!page.mapped){return;}
+    IPC::semGuard G(&sem);
+    size_t rec = findClaim(key);
+    if (rec == INVALID_RECORD_INDEX){return;}
+    if (response.size() > TRIGCACHE_RESPONSE){
+      removeEntry(rec);
+      trimFront();
+      return;
+    }
+    accX.setString(responseField, response, rec);
+    accX.setInt(expiresField, Util::bootMS() + ttl * 1000, rec);
+    setReady(rec);
+  }
+
   static void submitTriggerStat(const std::string trigger, uint64_t millis, bool ok){
     JSON::Value j;
     j["trigger_stat"]["name"] = trigger;
@@ -44,10 +148,13 @@ namespace Triggers{
   ///\param value Destination. This can be an (HTTP)URL, or an absolute path to a binary/script
   ///\param payload This data will be sent to the destination URL/program
   ///\param sync If true, handler is executed blocking and uses the response data.
+  ///\param success If set, is set to whether the handler could be executed and responded in time.
   ///\returns String, false if further processing should be aborted.
   std::string handleTrigger(const std::string &trigger, const std::string &value,
-                            const std::string &payload, int sync, const std::string &defaultResponse){
+                            const std::string &payload, int sync, const std::string &defaultResponse,
+                            bool *success){
     uint64_t tStartMs = Util::bootMS();
+    if (success){*success = true;}
     if (!value.size()){
       WARN_MSG("Trigger requested with empty destination");
       return "true";
@@ -79,6 +186,7 @@ namespace Triggers{
         submitTriggerStat(trigger, tStartMs, true);
         return DL.data();
       }
+      if (success){*success = false;}
       FAIL_MSG("%s trigger: %s (%s) failed to execute (%s), using default response: %s",
                trigger.c_str(), value.c_str(), sync ? "blocking" : "asynchronous",
                DL.getStatusText().c_str(), defaultResponse.c_str());
@@ -96,6 +204,7 @@ namespace Triggers{
       pid_t myProc = Util::Procs::StartPiped(argv, &fdIn, &fdOut, &fdErr); // start new process and return stdin file desc.
       if (fdIn == -1 || fdOut == -1 || myProc == -1){
         FAIL_MSG("Could not execute trigger executable: %s", strerror(errno));
+        if (success){*success = false;}
         submitTriggerStat(trigger, tStartMs, false);
         return defaultResponse;
       }
@@ -129,6 +238,7 @@ namespace Triggers{
         close(fdOut);
         if (counter >= 150 && !ret.size()){
           WARN_MSG("Using default trigger response: %s", defaultResponse.c_str());
+          if (success){*success = false;}
           submitTriggerStat(trigger, tStartMs, false);
           return defaultResponse;
         }
@@ -141,6 +251,41 @@ namespace Triggers{
     }
   }
 
+  /// Handles a blocking trigger through the response cache of its type.
+  /// Answers from the cache if an identical call was made less than ttl seconds ago, or waits for
+  /// an identical call that is in progress. Otherwise calls handleTrigger and caches its response.
+  static std::string handleCachedTrigger(const std::string &trigger, const std::string &value,
+                                         const std::string &payload, const std::string &defaultResponse,
+                                         uint64_t ttl, const std::string &keyLines){
+    ResponseCache cache;
+    if (!cache.open(trigger, true)){return handleTrigger(trigger, value, payload, 1, defaultResponse);}
+    uint64_t key = ResponseCache::makeKey(value, payload, keyLines);
+    uint64_t waitUntil = Util::bootMS() + TRIGCACHE_WAIT;
+    bool waited = false;
+    std::string response;
+    while (true){
+      uint8_t res = cache.claim(key, response, waited);
+      if (res == CLAIMIDX_READY){
+        HIGH_MSG("%s trigger response for %s served from cache", trigger.c_str(), value.c_str());
+        return response;
+      }
+      if (res == CLAIMIDX_CLAIMED){break;}
+      if (res != CLAIMIDX_BUSY || !cache.await(waitUntil)){
+        cache.countMiss();
+        return handleTrigger(trigger, value, payload, 1, defaultResponse);
+      }
+      waited = true;
+    }
+    bool success = false;
+    response = handleTrigger(trigger, value, payload, 1, defaultResponse, &success);
+    if (success){
+      cache.publish(key, response, ttl);
+    }else{
+      cache.abandon(key);
+    }
+    return response;
+  }
+
   static std::string usually_empty;
 
   ///\brief returns true if a trigger of the specified type should be handled for a specified stream
@@ -220,12 +365,21 @@ namespace Triggers{
     size_t splitter = streamName.find_first_of("+ ");
     bool retVal = true;
 
+    // Look up the fields once, instead of once per trigger record
+    Util::RelAccXFieldData urlField = trigs.getFieldData("url");
+    Util::RelAccXTypedField<uint8_t> syncField = trigs.getFieldData("sync");
+    Util::RelAccXFieldData streamsField = trigs.getFieldData("streams");
+    Util::RelAccXFieldData paramsField = trigs.getFieldData("params");
+    Util::RelAccXFieldData defaultField = trigs.getFieldData("default");
+    Util::RelAccXFieldData cacheTTLField = trigs.getFieldData("cachettl");
+    Util::RelAccXFieldData cacheKeyField = trigs.getFieldData("cachekey");
+    uint32_t pLen = trigs.getSize("streams");
+
     for (uint32_t i = 0; i < trigs.getRCount(); ++i){
-      std::string uri = std::string(trigs.getPointer("url", i));
-      uint8_t sync = trigs.getInt("sync", i);
+      std::string uri = std::string(trigs.getPointer(urlField, i));
+      uint8_t sync = syncField.get(trigs, i);
 
-      char *strPtr = trigs.getPointer("streams", i);
-      uint32_t pLen = trigs.getSize("streams");
+      char *strPtr = trigs.getPointer(streamsField, i);
       uint32_t bPos = 0;
 
       bool isHandled = !streamName.size();
@@ -242,9 +396,9 @@ namespace Triggers{
       if (bPos <= 4){isHandled = true;}
 
       if (isHandled && paramsCB){
-        isHandled = paramsCB(trigs.getPointer("params", i), extraParam);
+        isHandled = paramsCB(trigs.getPointer(paramsField, i), extraParam);
       }
-      std::string defaultResponse = trigs.getPointer("default", i);
+      std::string defaultResponse = trigs.getPointer(defaultField, i);
       if (!defaultResponse.size()){defaultResponse = "true";}
 
       if (isHandled){
@@ -255,7 +409,14 @@ namespace Triggers{
         setenv("MIST_TRIG_DEF", defaultResponse.c_str(), 1);
         setenv("MIST_UUID", Util::UUID, 1);
         if (sync){
-          response = handleTrigger(type, uri, payload, sync, defaultResponse); // do it.
+          // Triggers written by older controllers have no cache fields
+          uint64_t cacheTTL = cacheTTLField.type ? trigs.getInt(cacheTTLField, i) : 0;
+          if (cacheTTL){
+            response = handleCachedTrigger(type, uri, payload, defaultResponse, cacheTTL,
+                                           trigs.getPointer(cacheKeyField, i));
+          }else{
+            response = handleTrigger(type, uri, payload, sync, defaultResponse); // do it.
+          }
           retVal &= Util::stringToBool(response);
         }else{
           std::string unused_response = handleTrigger(type, uri, payload, sync, defaultResponse); // do it.
@@ -1,15 +1,43 @@
 #pragma once
+#include "claim_index.h"
+#include "shared_memory.h"
+#include "util.h"
 #include <string>
 
+#define TRIGCACHE_WAIT 16000    ///< Max ms to wait for another process handling an identical trigger
+#define TRIGCACHE_RESPONSE 512  ///< Longest trigger response that is cached
+
 namespace Triggers{
 
   static const std::string empty;
 
+  /// Per-trigger-type cache of responses to blocking triggers, keyed on makeKey() of the handler
+  /// and (part of) the payload. A response is only kept until its TTL runs out. Calls that were
+  /// answered by a response another process was still waiting on count as coalesced, not as hits.
+  class ResponseCache : public IPC::claimIndex{
+  public:
+    bool open(const std::string &type, bool create);
+    uint64_t getCoalesced() const;
+    uint8_t claim(uint64_t key, std::string &response, bool waited);
+    void publish(uint64_t key, const std::string &response, uint64_t ttl);
+    static uint64_t makeKey(const std::string &handler, const std::string &payload, const std::string &keyLines);
+
+  protected:
+    virtual void addFields(Util::RelAccX &A);
+    virtual void mapFields();
+    virtual bool isExpired(size_t rec) const;
+
+  private:
+    Util::RelAccXFieldData expiresField;
+    Util::RelAccXFieldData responseField;
+  };
+
   bool doTrigger(const std::string &triggerType, const std::string &payload,
                  const std::string &streamName, bool dryRun, std::string &response,
                  bool paramsCB(const char *, const void *) = 0, const void *extraParam = 0);
   std::string handleTrigger(const std::string &triggerType, const std::string &value,
-                            const std::string &payload, int sync, const std::string &defaultResponse);
+                            const std::string &payload, int sync, const std::string &defaultResponse,
+                            bool *success = 0);
 
   // All of the below are just shorthands for specific usage of the doTrigger function above:
   bool shouldTrigger(const std::string &triggerType, const std::string &streamName = empty,
@@ -11,6 +11,13 @@
 #include <sstream>
 #include <string.h>
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#if defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
 #ifndef FILLER_DATA
 #define FILLER_DATA                                                                                \
   "Lorem ipsum dolor sit amet, consectetur adipiscing elit. Praesent commodo vulputate urna eu "   \
@@ -1727,4 +1734,33 @@ namespace TS{
     return SDT.checkAndGetBuffer();
   }
 
+  /// Returns the offset of the first sync byte in data that is followed by another sync byte one
+  /// packet later, or by the end of data. Returns len if there is no such sync byte.
+  /// Checks 16 positions at a time where SSE2 or NEON are available.
+  size_t findSync(const char *data, size_t len){
+    size_t offset = 0;
+#if defined(__SSE2__)
+    const __m128i sync = _mm_set1_epi8(0x47);
+    while (offset + 16 + 188 <= len){
+      __m128i here = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(data + offset)), sync);
+      __m128i next = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(data + offset + 188)), sync);
+      unsigned int mask = _mm_movemask_epi8(_mm_and_si128(here, next));
+      if (mask){return offset + __builtin_ctz(mask);}
+      offset += 16;
+    }
+#elif defined(__aarch64__)
+    const uint8x16_t sync = vdupq_n_u8(0x47);
+    while (offset + 16 + 188 <= len){
+      uint8x16_t here = vceqq_u8(vld1q_u8((const uint8_t *)(data + offset)), sync);
+      uint8x16_t next = vceqq_u8(vld1q_u8((const uint8_t *)(data + offset + 188)), sync);
+      if (vmaxvq_u8(vandq_u8(here, next))){break;}
+      offset += 16;
+    }
+#endif
+    for (; offset < len; ++offset){
+      if (data[offset] == 0x47 && (offset + 188 >= len || data[offset + 188] == 0x47)){return offset;}
+    }
+    return len;
+  }
+
 }// namespace TS
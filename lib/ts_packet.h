@@ -253,6 +253,8 @@ namespace TS{
 
   extern char PAT[188];
 
+  size_t findSync(const char *data, size_t len);
+
   size_t getUniqTrackID(const DTSC::Meta &M, size_t idx);
 
   const char *createPMT(std::set<size_t> &selectedTracks, const DTSC::Meta &M, int contCounter = 0);
@@ -78,9 +78,11 @@ namespace TS{
         bytePos += 188;
         offset += 188;
       }else{
-        ++junk;
-        ++offset;
-        ++bytePos;
+        size_t skip = findSync(ptr + offset, len - offset);
+        if (!skip){skip = 1;}
+        junk += skip;
+        offset += skip;
+        bytePos += skip;
       }
     }
     return ret;
@@ -133,6 +135,31 @@ namespace TS{
     len = 0;
     bpos = 0;
   }
+  ADTSRemainder::ADTSRemainder(const ADTSRemainder &rhs){
+    data = 0;
+    max = 0;
+    *this = rhs;
+  }
+
+  ADTSRemainder &ADTSRemainder::operator=(const ADTSRemainder &rhs){
+    if (this == &rhs){return *this;}
+    now = 0;
+    len = 0;
+    bpos = rhs.bpos;
+    if (rhs.len && max < rhs.len){
+      void *newmainder = realloc(data, rhs.len);
+      if (!newmainder){return *this;}
+      max = rhs.len;
+      data = (char *)newmainder;
+    }
+    if (rhs.len){
+      memcpy(data, rhs.data, rhs.now);
+      len = rhs.len;
+      now = rhs.now;
+    }
+    return *this;
+  }
+
   ADTSRemainder::~ADTSRemainder(){
     if (data){
       free(data);
@@ -147,9 +174,44 @@ namespace TS{
   uint64_t ADTSRemainder::getTodo(){return len - now;}
   char *ADTSRemainder::getData(){return data;}
 
+  PidState::PidState(){
+    seenUnitStart = 0;
+    hasBuildPacket = false;
+    codec = 0;
+    hasAdtsInfo = false;
+    rolloverCount = 0;
+    lastms = 0;
+    isPMT = false;
+    lastPMT = 0;
+  }
+
   Stream::Stream(){
-    psCache = 0;
-    psCacheTid = 0;
+    lastPAT = 0;
+    memset(pidIndex, 0, sizeof(pidIndex));
+  }
+
+  /// Returns the state for the given PID, or null if there is none yet.
+  PidState *Stream::getState(size_t tid){
+    if (tid >= TS_PID_COUNT || !pidIndex[tid]){return 0;}
+    return &(pidStates[pidIndex[tid] - 1]);
+  }
+
+  /// Returns the state for the given PID, or null if there is none yet.
+  const PidState *Stream::getState(size_t tid) const{
+    if (tid >= TS_PID_COUNT || !pidIndex[tid]){return 0;}
+    return &(pidStates[pidIndex[tid] - 1]);
+  }
+
+  /// Returns the state for the given PID, creating it if needed. Returns null for invalid PIDs.
+  /// References to existing states stay valid, as pidStates is a deque that is only appended to.
+  PidState *Stream::addState(size_t tid){
+    if (tid >= TS_PID_COUNT){return 0;}
+    if (!pidIndex[tid]){
+      pidStates.push_back(PidState());
+      pidIndex[tid] = pidStates.size();
+      pidList.insert(std::lower_bound(pidList.begin(), pidList.end(), tid), tid);
+    }
+    return &(pidStates[pidIndex[tid] - 1]);
   }
 
   Stream::~Stream(){}
@@ -162,42 +224,31 @@ namespace TS{
 
   void Stream::partialClear(){
     tthread::lock_guard<tthread::recursive_mutex> guard(tMutex);
-    pesStreams.clear();
-    psCacheTid = 0;
-    psCache = 0;
-    pesPositions.clear();
-    outPackets.clear();
-    buildPacket.clear();
-    seenUnitStart.clear();
-    lastms.clear();
-    rolloverCount.clear();
+    for (std::deque<PidState>::iterator it = pidStates.begin(); it != pidStates.end(); ++it){
+      it->pesPackets.clear();
+      it->pesPositions.clear();
+      it->seenUnitStart = 0;
+      it->outPackets.clear();
+      it->buildPacket.null();
+      it->hasBuildPacket = false;
+      it->lastms = 0;
+      it->rolloverCount = 0;
+    }
   }
 
   void Stream::clear(){
     tthread::lock_guard<tthread::recursive_mutex> guard(tMutex);
-    partialClear();
-    pidToCodec.clear();
-    adtsInfo.clear();
-    spsInfo.clear();
-    ppsInfo.clear();
-    hevcInfo.clear();
-    metaInit.clear();
-    descriptors.clear();
-    mappingTable.clear();
-    lastPMT.clear();
+    pidStates.clear();
+    pidList.clear();
+    memset(pidIndex, 0, sizeof(pidIndex));
     lastPAT = 0;
-    pmtTracks.clear();
-    remainders.clear();
     associationTable = ProgramAssociationTable();
   }
 
   void Stream::finish(){
     tthread::lock_guard<tthread::recursive_mutex> guard(tMutex);
-    if (!pesStreams.size()){return;}
-
-    for (std::map<size_t, std::deque<Packet> >::const_iterator i = pesStreams.begin();
-         i != pesStreams.end(); i++){
-      parsePES(i->first, true);
+    for (std::vector<size_t>::const_iterator it = pidList.begin(); it != pidList.end(); ++it){
+      parsePES(*it, true);
     }
   }
 
@@ -212,19 +263,17 @@ namespace TS{
     uint32_t tid = newPack.getPID();
     bool unitStart = newPack.getUnitStart();
     static uint32_t wantPrev = 0;
-    bool isData = pidToCodec.count(tid);
-    bool wantTrack = ((wantPrev == tid) || (tid == 0 || newPack.isPMT(pmtTracks) || isData));
+    PidState *st = getState(tid);
+    bool isData = st && st->codec;
+    bool wantTrack = ((wantPrev == tid) || (tid == 0 || (st && st->isPMT) || isData));
     if (!wantTrack){return;}
-    if (psCacheTid != tid || !psCache){
-      psCache = &(pesStreams[tid]);
-      psCacheTid = tid;
-    }
-    if (unitStart || !psCache->empty()){
+    if (!st){st = addState(tid);}
+    if (unitStart || !st->pesPackets.empty()){
       wantPrev = tid;
-      psCache->push_back(newPack);
+      st->pesPackets.push_back(newPack);
       if (unitStart && isData){
-        pesPositions[tid].push_back(bytePos);
-        ++(seenUnitStart[tid]);
+        st->pesPositions.push_back(bytePos);
+        ++(st->seenUnitStart);
       }
     }
   }
@@ -233,27 +282,28 @@ namespace TS{
     if (tid == 0){return false;}
     {
       tthread::lock_guard<tthread::recursive_mutex> guard(tMutex);
-      return pidToCodec.count(tid);
+      const PidState *st = getState(tid);
+      return st && st->codec;
     }
   }
 
   void Stream::parse(size_t tid){
     tthread::lock_guard<tthread::recursive_mutex> guard(tMutex);
-    if (!pesStreams.count(tid) || pesStreams[tid].size() == 0){return;}
-    if (psCacheTid != tid || !psCache){
-      psCache = &(pesStreams[tid]);
-      psCacheTid = tid;
-    }
+    PidState *st = getState(tid);
+    if (!st || !st->pesPackets.size()){return;}
 
     // Handle PAT packets
     if (tid == 0){
       ///\todo Keep track of updates in PAT instead of keeping only the last PAT as a reference
-      associationTable = psCache->back();
+      associationTable = st->pesPackets.back();
       lastPAT = Util::bootSecs();
-      associationTable.parsePIDs(pmtTracks);
-      pesStreams.erase(0);
-      psCacheTid = 0;
-      psCache = 0;
+      std::set<unsigned int> pmtPids;
+      associationTable.parsePIDs(pmtPids);
+      for (std::set<unsigned int>::iterator it = pmtPids.begin(); it != pmtPids.end(); ++it){
+        PidState *pmt = addState(*it);
+        if (pmt){pmt->isPMT = true;}
+      }
+      st->pesPackets.clear();
       return;
     }
 
@@ -261,12 +311,12 @@ namespace TS{
     if (tid == 1){return;}
 
     // Handle PMT packets
-    if (pmtTracks.count(tid)){
+    if (st->isPMT){
       ///\todo Keep track of updates in PMT instead of keeping only the last PMT per program as a
       /// reference
-      mappingTable[tid] = psCache->back();
-      lastPMT[tid] = Util::bootSecs();
-      ProgramMappingEntry entry = mappingTable[tid].getEntry(0);
+      st->mappingTable = st->pesPackets.back();
+      st->lastPMT = Util::bootSecs();
+      ProgramMappingEntry entry = st->mappingTable.getEntry(0);
       while (entry){
         uint32_t pid = entry.getElementaryPid();
         uint32_t sType = entry.getStreamType();
@@ -280,16 +330,18 @@ namespace TS{
         case MPEG2:
         case OPUS:
         case META:{
-          pidToCodec[pid] = sType;
-          std::string & init = metaInit[pid];
+          PidState *es = addState(pid);
+          if (!es){break;}
+          es->codec = sType;
+          std::string & init = es->metaInit;
           init.assign(entry.getESInfo(), entry.getESInfoLength());
           if (sType == META){
             TS::ProgramDescriptors desc(init.data(), init.size());
             std::string reg = desc.getRegistration();
             if (reg == "Opus"){
-              pidToCodec[pid] = OPUS;
+              es->codec = OPUS;
             }else{
-              pidToCodec.erase(pid);
+              es->codec = 0;
             }
           }
         } break;
@@ -298,22 +350,18 @@ namespace TS{
         entry.advance();
       }
 
-      pesStreams.erase(tid);
-      psCacheTid = 0;
-      psCache = 0;
+      st->pesPackets.clear();
       return;
     }
 
-    if (!pidToCodec.count(tid)){
-      pesStreams.erase(tid);
-      pesPositions.erase(tid);
-      seenUnitStart.erase(tid);
-      psCacheTid = 0;
-      psCache = 0;
+    if (!st->codec){
+      st->pesPackets.clear();
+      st->pesPositions.clear();
+      st->seenUnitStart = 0;
       return; // skip unknown codecs
     }
 
-    while (seenUnitStart[tid] > 1){parsePES(tid);}
+    while (st->seenUnitStart > 1){parsePES(tid);}
   }
 
   void Stream::parse(Packet &newPack, uint64_t bytePos){
@@ -324,56 +372,40 @@ namespace TS{
 
   bool Stream::hasPacketOnEachTrack() const{
     tthread::lock_guard<tthread::recursive_mutex> guard(tMutex);
-    if (!pidToCodec.size()){
-      // INFO_MSG("no packet on each track 1, pidtocodec.size: %d, outpacket.size: %d",
-      // pidToCodec.size(), outPackets.size());
-      return false;
-    }
+    size_t tracks = 0;
     size_t missing = 0;
     uint64_t firstTime = 0xffffffffffffffffull, lastTime = 0;
-    for (std::map<size_t, uint32_t>::const_iterator it = pidToCodec.begin(); it != pidToCodec.end(); it++){
-      if (!hasPacket(it->first) || !outPackets.count(it->first) || !outPackets.at(it->first).size()){
+    for (std::vector<size_t>::const_iterator it = pidList.begin(); it != pidList.end(); ++it){
+      const PidState &st = *getState(*it);
+      if (!st.codec){continue;}
+      ++tracks;
+      if (!hasPacket(*it) || !st.outPackets.size()){
         missing++;
       }else{
-        if (outPackets.at(it->first).front().getTime() < firstTime){
-          firstTime = outPackets.at(it->first).front().getTime();
-        }
-        if (outPackets.at(it->first).back().getTime() > lastTime){
-          lastTime = outPackets.at(it->first).back().getTime();
-        }
+        if (st.outPackets.front().getTime() < firstTime){firstTime = st.outPackets.front().getTime();}
+        if (st.outPackets.back().getTime() > lastTime){lastTime = st.outPackets.back().getTime();}
       }
     }
+    if (!tracks){return false;}
 
-    return (!missing || (missing != pidToCodec.size() && lastTime - firstTime > 2000));
+    return (!missing || (missing != tracks && lastTime - firstTime > 2000));
   }
 
   bool Stream::hasPacket(size_t tid) const{
     tthread::lock_guard<tthread::recursive_mutex> guard(tMutex);
-    if (psCacheTid != tid && pesStreams.find(tid) == pesStreams.end()){return false;}
-    if (outPackets.count(tid) && outPackets.at(tid).size()){return true;}
-    if (pidToCodec.count(tid) && seenUnitStart.count(tid) && seenUnitStart.at(tid) > 1){
-      return true;
-    }
+    const PidState *st = getState(tid);
+    if (!st){return false;}
+    if (st->outPackets.size()){return true;}
+    if (st->codec && st->seenUnitStart > 1){return true;}
     return false;
   }
 
   bool Stream::hasPacket() const{
     tthread::lock_guard<tthread::recursive_mutex> guard(tMutex);
-    if (!pesStreams.size()){return false;}
-
-    if (outPackets.size()){
-      for (std::map<size_t, std::deque<DTSC::Packet> >::const_iterator i = outPackets.begin();
-           i != outPackets.end(); i++){
-        if (i->second.size()){return true;}
-      }
+    for (std::deque<PidState>::const_iterator it = pidStates.begin(); it != pidStates.end(); ++it){
+      if (it->outPackets.size()){return true;}
+      if (it->codec && it->seenUnitStart > 1){return true;}
     }
-
-    for (std::map<size_t, uint32_t>::const_iterator i = seenUnitStart.begin(); i != seenUnitStart.end(); i++){
-      if (pidToCodec.count(i->first) && i->second > 1){
-        return true;
-      }
-    }
-
     return false;
   }
 
@@ -389,23 +421,21 @@ namespace TS{
   }
 
   void Stream::parsePES(size_t tid, bool finished){
-    if (!pidToCodec.count(tid)){
+    PidState *st = getState(tid);
+    if (!st || !st->codec){
       return; // skip unknown codecs
     }
-    if (psCacheTid != tid || !psCache){
-      psCache = &(pesStreams[tid]);
-      psCacheTid = tid;
-    }
+    std::deque<Packet> *psCache = &(st->pesPackets);
     if (!psCache->size() || (!finished && psCache->size() <= 1)){
       if (!finished){FAIL_MSG("No PES packets to parse");}
-      seenUnitStart[tid] = 0;
+      st->seenUnitStart = 0;
       return;
     }
     // Find number of packets before unit Start
     size_t packNum = 1;
     std::deque<Packet>::iterator curPack = psCache->begin();
 
-    if (seenUnitStart[tid] == 2 && psCache->begin()->getUnitStart() && psCache->rbegin()->getUnitStart()){
+    if (st->seenUnitStart == 2 && psCache->begin()->getUnitStart() && psCache->rbegin()->getUnitStart()){
       packNum = psCache->size() - 1;
       curPack = psCache->end();
       curPack--;
@@ -417,18 +447,18 @@ namespace TS{
       }
     }
     if (!finished && curPack == psCache->end()){
-      FAIL_MSG("No PES packets to parse (%" PRIu32 ")", seenUnitStart[tid]);
-      seenUnitStart[tid] = 0;
+      FAIL_MSG("No PES packets to parse (%" PRIu32 ")", st->seenUnitStart);
+      st->seenUnitStart = 0;
       return;
     }
 
     // We now know we're deleting 1 UnitStart, so we can pop the pesPositions and lower the seenUnitStart counter.
-    --(seenUnitStart[tid]);
-    std::deque<uint64_t> &inPositions = pesPositions[tid];
+    --(st->seenUnitStart);
+    std::deque<uint64_t> &inPositions = st->pesPositions;
     uint64_t bPos = inPositions.front();
     inPositions.pop_front();
 
-    // Create a buffer for the current PES, and remove it from the pesStreams buffer.
+    // Create a buffer for the current PES, and remove it from the PES packet buffer.
     uint32_t paySize = 0;
 
     // Loop over the packets we need, and calculate the total payload size
@@ -482,7 +512,7 @@ namespace TS{
       // Check for large enough buffer
       if ((paySize - offset) < 9 || (paySize - offset) < 9 + pesHeader[8]){
         INFO_MSG("Not enough data (%d / %d) on track %zu (%" PRIu32 "), discarding remainder of data",
-                 paySize - offset, 9 + pesHeader[8], tid, pidToCodec[tid]);
+                 paySize - offset, 9 + pesHeader[8], tid, st->codec);
         break;
       }
 
@@ -527,11 +557,11 @@ namespace TS{
         }
       }
 
-      timeStamp += (rolloverCount[tid] * TS_PTS_ROLLOVER);
+      timeStamp += (st->rolloverCount * TS_PTS_ROLLOVER);
 
-      if ((timeStamp < lastms[tid]) && ((timeStamp % TS_PTS_ROLLOVER) < 0.1 * TS_PTS_ROLLOVER) &&
-          ((lastms[tid] % TS_PTS_ROLLOVER) > 0.9 * TS_PTS_ROLLOVER)){
-        ++rolloverCount[tid];
+      if ((timeStamp < st->lastms) && ((timeStamp % TS_PTS_ROLLOVER) < 0.1 * TS_PTS_ROLLOVER) &&
+          ((st->lastms % TS_PTS_ROLLOVER) > 0.9 * TS_PTS_ROLLOVER)){
+        ++(st->rolloverCount);
         timeStamp += TS_PTS_ROLLOVER;
       }
 
@@ -558,63 +588,71 @@ namespace TS{
       }else{
         const char *pesPayload = pesHeader + pesOffset;
         parseBitstream(tid, pesPayload, realPayloadSize, timeStamp, timeOffset, bPos, pesHeader[6] & 0x04);
-        lastms[tid] = timeStamp;
+        st->lastms = timeStamp;
       }
 
       // Shift the offset by the payload size, the mandatory headers and the optional
       // headers/padding
       offset += realPayloadSize + (9 + pesHeader[8]);
     }
-    if (finished && (pidToCodec[tid] == H264 || pidToCodec[tid] == H265)){
-      if (buildPacket.count(tid) && buildPacket[tid].getDataStringLen()){
-        outPackets[tid].push_back(buildPacket[tid]);
-        buildPacket.erase(tid);
+    if (finished && (st->codec == H264 || st->codec == H265)){
+      if (st->hasBuildPacket && st->buildPacket.getDataStringLen()){
+        st->outPackets.push_back(st->buildPacket);
+        st->buildPacket.null();
+        st->hasBuildPacket = false;
       }
     }
     free(payload);
   }
 
   void Stream::setLastms(size_t tid, uint64_t timestamp){
-    lastms[tid] = timestamp;
-    rolloverCount[tid] = timestamp / TS_PTS_ROLLOVER;
+    PidState *st = addState(tid);
+    if (!st){return;}
+    st->lastms = timestamp;
+    st->rolloverCount = timestamp / TS_PTS_ROLLOVER;
   }
 
   void Stream::parseBitstream(size_t tid, const char *pesPayload, uint64_t realPayloadSize,
                               uint64_t timeStamp, int64_t timeOffset, uint64_t bPos, bool alignment){
 
+    PidState *st = getState(tid);
+    if (!st){return;}
     // Create a new (empty) DTSC Packet at the end of the buffer
-    unsigned long thisCodec = pidToCodec[tid];
-    std::deque<DTSC::Packet> &out = outPackets[tid];
+    unsigned long thisCodec = st->codec;
+    std::deque<DTSC::Packet> &out = st->outPackets;
+    ADTSRemainder &remainder = st->remainder;
     if (thisCodec == AAC){
       // Parse all the ADTS packets
       uint64_t offsetInPes = 0;
       uint64_t msRead = 0;
 
-      if (remainders.count(tid) && remainders[tid].getLength()){
-        offsetInPes = std::min(remainders[tid].getTodo(), realPayloadSize);
-        remainders[tid].append(pesPayload, offsetInPes);
+      if (remainder.getLength()){
+        offsetInPes = std::min(remainder.getTodo(), realPayloadSize);
+        remainder.append(pesPayload, offsetInPes);
 
-        if (remainders[tid].isComplete()){
-          aac::adts adtsPack(remainders[tid].getData(), remainders[tid].getLength());
+        if (remainder.isComplete()){
+          aac::adts adtsPack(remainder.getData(), remainder.getLength());
           if (adtsPack){
-            if (!adtsInfo.count(tid) || !adtsInfo[tid].sameHeader(adtsPack)){
+            if (!st->hasAdtsInfo || !st->adtsInfo.sameHeader(adtsPack)){
               MEDIUM_MSG("Setting new ADTS header: %s", adtsPack.toPrettyString().c_str());
-              adtsInfo[tid] = adtsPack;
+              st->adtsInfo = adtsPack;
+              st->hasAdtsInfo = true;
             }
             out.push_back(DTSC::Packet());
             out.back().genericFill(
                 timeStamp - ((adtsPack.getSampleCount() * 1000) / adtsPack.getFrequency()), timeOffset,
-                tid, adtsPack.getPayload(), adtsPack.getPayloadSize(), remainders[tid].getBpos(), 0);
+                tid, adtsPack.getPayload(), adtsPack.getPayloadSize(), remainder.getBpos(), 0);
           }
-          remainders[tid].clear();
+          remainder.clear();
         }
       }
       while (offsetInPes < realPayloadSize){
         aac::adts adtsPack(pesPayload + offsetInPes, realPayloadSize - offsetInPes);
         if (adtsPack && adtsPack.getCompleteSize() + offsetInPes <= realPayloadSize){
-          if (!adtsInfo.count(tid) || !adtsInfo[tid].sameHeader(adtsPack)){
+          if (!st->hasAdtsInfo || !st->adtsInfo.sameHeader(adtsPack)){
             DONTEVEN_MSG("Setting new ADTS header: %s", adtsPack.toPrettyString().c_str());
-            adtsInfo[tid] = adtsPack;
+            st->adtsInfo = adtsPack;
+            st->hasAdtsInfo = true;
           }
           out.push_back(DTSC::Packet());
           if (adtsPack.getPayloadSize()){
@@ -631,7 +669,7 @@ namespace TS{
             offsetInPes++;
           }else{
             // remainder, keep it, use it next time
-            remainders[tid].setRemainder(adtsPack, pesPayload + offsetInPes, realPayloadSize - offsetInPes, bPos);
+            remainder.setRemainder(adtsPack, pesPayload + offsetInPes, realPayloadSize - offsetInPes, bPos);
             offsetInPes = realPayloadSize; // skip to end of PES
           }
         }
@@ -640,9 +678,7 @@ namespace TS{
     if (thisCodec == ID3 || thisCodec == AC3 || thisCodec == MP2 || thisCodec == META){
       out.push_back(DTSC::Packet());
       out.back().genericFill(timeStamp, timeOffset, tid, pesPayload, realPayloadSize, bPos, 0);
-      if (thisCodec == MP2 && !mp2Hdr.count(tid)){
-        mp2Hdr[tid] = std::string(pesPayload, realPayloadSize);
-      }
+      if (thisCodec == MP2 && !st->mp2Hdr.size()){st->mp2Hdr.assign(pesPayload, realPayloadSize);}
     }
     if (thisCodec == OPUS){
       size_t offset = 0;
@@ -684,13 +720,14 @@ namespace TS{
       if (!nextPtr){
         nextPtr = pesEnd;
         nalSize = realPayloadSize;
-        if (!alignment && timeStamp && buildPacket.count(tid) && timeStamp != buildPacket[tid].getTime()){
+        if (!alignment && timeStamp && st->hasBuildPacket && timeStamp != st->buildPacket.getTime()){
           FAIL_MSG("No startcode in packet @ %" PRIu64 " ms, and time is not equal to %" PRIu64
                    " ms so can't merge",
-                   timeStamp, buildPacket[tid].getTime());
+                   timeStamp, st->buildPacket.getTime());
           return;
         }
-        DTSC::Packet &bp = buildPacket[tid];
+        DTSC::Packet &bp = st->buildPacket;
+        st->hasBuildPacket = true;
         if (alignment){
           // If the timestamp differs from current PES timestamp, send the previous packet out and
           // fill a new one.
@@ -730,11 +767,12 @@ namespace TS{
 
         if (nalSize){
           // If we don't have a packet yet, init an empty packet with the key frame bit set to true
-          if (!buildPacket.count(tid)){
-            buildPacket[tid].genericFill(timeStamp, timeOffset, tid, 0, 0, bPos, true);
-            buildPacket[tid].setKeyFrame(false);
+          DTSC::Packet &bp = st->buildPacket;
+          if (!st->hasBuildPacket){
+            bp.genericFill(timeStamp, timeOffset, tid, 0, 0, bPos, true);
+            bp.setKeyFrame(false);
+            st->hasBuildPacket = true;
           }
-          DTSC::Packet &bp = buildPacket[tid];
 
           // Check if this is a keyframe
           parseNal(tid, pesPayload, pesPayload + nalSize, isKeyFrame);
@@ -805,40 +843,31 @@ namespace TS{
       return;
     }
 
-    bool packetReady = outPackets.count(tid) && outPackets[tid].size();
-
-    if (!packetReady){
-      parse(tid);
-      packetReady = outPackets.count(tid) && outPackets[tid].size();
-    }
-
-    if (!packetReady){
+    PidState *st = getState(tid);
+    if (st && !st->outPackets.size()){parse(tid);}
+    if (!st || !st->outPackets.size()){
       ERROR_MSG("Track %zu: PES without valid packets?", tid);
       return;
     }
 
-    pack = DTSC::Packet(outPackets[tid].front(), mappedAs);
-    outPackets[tid].pop_front();
-
-    if (!outPackets[tid].size()){outPackets.erase(tid);}
+    pack = DTSC::Packet(st->outPackets.front(), mappedAs);
+    st->outPackets.pop_front();
   }
 
   void Stream::parseNal(size_t tid, const char *pesPayload, const char *nextPtr, bool &isKeyFrame){
     bool firstSlice = true;
     char typeNal;
+    PidState *st = getState(tid);
+    uint32_t codec = st ? st->codec : 0;
 
-    if (pidToCodec[tid] == MPEG2){
+    if (codec == MPEG2){
       typeNal = pesPayload[0];
       switch (typeNal){
       case 0xB3:
-        if (!mpeg2SeqHdr.count(tid)){
-          mpeg2SeqHdr[tid] = std::string(pesPayload, (nextPtr - pesPayload));
-        }
+        if (!st->mpeg2SeqHdr.size()){st->mpeg2SeqHdr.assign(pesPayload, nextPtr - pesPayload);}
         break;
       case 0xB5:
-        if (!mpeg2SeqExt.count(tid)){
-          mpeg2SeqExt[tid] = std::string(pesPayload, (nextPtr - pesPayload));
-        }
+        if (!st->mpeg2SeqExt.size()){st->mpeg2SeqExt.assign(pesPayload, nextPtr - pesPayload);}
         break;
       case 0xB8: isKeyFrame = true; break;
       }
@@ -846,21 +875,19 @@ namespace TS{
     }
 
     isKeyFrame = false;
-    if (pidToCodec[tid] == H264){
+    if (codec == H264){
       typeNal = pesPayload[0] & 0x1F;
       switch (typeNal){
       case 0x01:{
         if (firstSlice){
           firstSlice = false;
           if (!isKeyFrame){
+            // The slice type is always within the first few bytes of the slice header
+            char header[11];
+            size_t nalLen = nextPtr - pesPayload;
             Utils::bitstream bs;
-            for (size_t i = 1; i < 10 && i < (nextPtr - pesPayload); i++){
-              if (i + 2 < (nextPtr - pesPayload) && (memcmp(pesPayload + i, "\000\000\003", 3) == 0)){// Emulation prevention bytes
-                bs.append(pesPayload + i, 2);
-                i += 2;
-              }else{
-                bs.append(pesPayload + i, 1);
-              }
+            if (nalLen > 1){
+              bs.append(header, nalu::removeEmulationPrevention(pesPayload + 1, nalLen - 1 < 11 ? nalLen - 1 : 11, header));
             }
             bs.getExpGolomb(); // Discard first_mb_in_slice
             uint64_t sliceType = bs.getUExpGolomb();
@@ -876,16 +903,16 @@ namespace TS{
         break;
       }
       case 0x07:{
-        spsInfo[tid] = std::string(pesPayload, (nextPtr - pesPayload));
+        st->spsInfo.assign(pesPayload, nextPtr - pesPayload);
         break;
       }
       case 0x08:{
-        ppsInfo[tid] = std::string(pesPayload, (nextPtr - pesPayload));
+        st->ppsInfo.assign(pesPayload, nextPtr - pesPayload);
         break;
       }
       default: break;
       }
-    }else if (pidToCodec[tid] == H265){
+    }else if (codec == H265){
       typeNal = (pesPayload[0] & 0x7E) >> 1;
       switch (typeNal){
       case 2:
@@ -912,7 +939,7 @@ namespace TS{
       case 33:
       case 34:{
         tthread::lock_guard<tthread::recursive_mutex> guard(tMutex);
-        hevcInfo[tid].addUnit(std::string(pesPayload, nextPtr - pesPayload)); // may i convert to (char *)?
+        st->hevcInfo.addUnit(std::string(pesPayload, nextPtr - pesPayload));
         break;
       }
       default: break;
@@ -926,11 +953,11 @@ namespace TS{
     uint64_t packTime = 0xFFFFFFFFull;
     uint32_t packTrack = 0;
 
-    for (std::map<size_t, std::deque<DTSC::Packet> >::iterator it = outPackets.begin();
-         it != outPackets.end(); it++){
-      if (it->second.front().getTime() < packTime){
-        packTrack = it->first;
-        packTime = it->second.front().getTime();
+    for (std::vector<size_t>::const_iterator it = pidList.begin(); it != pidList.end(); ++it){
+      const std::deque<DTSC::Packet> &out = getState(*it)->outPackets;
+      if (out.size() && out.front().getTime() < packTime){
+        packTrack = *it;
+        packTime = out.front().getTime();
       }
     }
 
@@ -941,28 +968,19 @@ namespace TS{
     tthread::lock_guard<tthread::recursive_mutex> guard(tMutex);
     pack.null();
 
-    uint64_t packTime = 0xFFFFFFFFull;
-    uint64_t packTrack = 0;
-
-    for (std::map<size_t, std::deque<DTSC::Packet> >::iterator it = outPackets.begin();
-         it != outPackets.end(); it++){
-      if (it->second.size() && it->second.front().getTime() < packTime){
-        packTrack = it->first;
-        packTime = it->second.front().getTime();
-      }
-    }
-
+    uint32_t packTrack = getEarliestPID();
     if (packTrack){
       getPacket(packTrack, pack);
       return;
     }
 
     //Nothing yet...? Let's see if we can parse something.
-    for (std::map<size_t, uint32_t>::const_iterator i = seenUnitStart.begin(); i != seenUnitStart.end(); i++){
-      if (pidToCodec.count(i->first) && i->second > 1){
-        parse(i->first);
-        if (hasPacket(i->first)){
-          getPacket(packTrack, pack);
+    for (std::vector<size_t>::const_iterator it = pidList.begin(); it != pidList.end(); ++it){
+      const PidState &st = *getState(*it);
+      if (st.codec && st.seenUnitStart > 1){
+        parse(*it);
+        if (hasPacket(*it)){
+          getPacket(*it, pack);
           return;
         }
       }
@@ -972,10 +990,12 @@ namespace TS{
   void Stream::initializeMetadata(DTSC::Meta &meta, size_t tid, size_t mappingId){
     tthread::lock_guard<tthread::recursive_mutex> guard(tMutex);
 
-    for (std::map<size_t, uint32_t>::const_iterator it = pidToCodec.begin(); it != pidToCodec.end(); it++){
-      if (tid != INVALID_TRACK_ID && it->first != tid){continue;}
+    for (std::vector<size_t>::const_iterator it = pidList.begin(); it != pidList.end(); ++it){
+      if (tid != INVALID_TRACK_ID && *it != tid){continue;}
+      PidState &st = *getState(*it);
+      if (!st.codec){continue;}
 
-      size_t mId = (mappingId == INVALID_TRACK_ID ? it->first : mappingId);
+      size_t mId = (mappingId == INVALID_TRACK_ID ? *it : mappingId);
 
       size_t idx = meta.trackIDToIndex(mId, getpid());
       if (idx != INVALID_TRACK_ID && meta.getCodec(idx).size()){continue;}
@@ -985,26 +1005,25 @@ namespace TS{
       std::string type, codec, init;
       uint64_t width = 0, height = 0, fpks = 0, size = 0, rate = 0, channels = 0;
 
-      switch (it->second){
+      switch (st.codec){
       case H264:{
-        if (!spsInfo.count(it->first) || !ppsInfo.count(it->first)){
-          MEDIUM_MSG("Aborted meta fill for h264 track %zu: no SPS/PPS", it->first);
+        if (!st.spsInfo.size() || !st.ppsInfo.size()){
+          MEDIUM_MSG("Aborted meta fill for h264 track %zu: no SPS/PPS", *it);
           continue;
         }
         // First generate needed data
-        std::string tmpBuffer = spsInfo[it->first];
-        h264::sequenceParameterSet sps(tmpBuffer.data(), tmpBuffer.size());
+        h264::sequenceParameterSet sps(st.spsInfo.data(), st.spsInfo.size());
         h264::SPSMeta spsChar = sps.getCharacteristics();
 
         MP4::AVCC avccBox;
         avccBox.setVersion(1);
-        avccBox.setProfile(spsInfo[it->first][1]);
-        avccBox.setCompatibleProfiles(spsInfo[it->first][2]);
-        avccBox.setLevel(spsInfo[it->first][3]);
+        avccBox.setProfile(st.spsInfo[1]);
+        avccBox.setCompatibleProfiles(st.spsInfo[2]);
+        avccBox.setLevel(st.spsInfo[3]);
         avccBox.setSPSCount(1);
-        avccBox.setSPS(spsInfo[it->first]);
+        avccBox.setSPS(st.spsInfo);
         avccBox.setPPSCount(1);
-        avccBox.setPPS(ppsInfo[it->first]);
+        avccBox.setPPS(st.ppsInfo);
 
         // Then set all data for track
         addNewTrack = true;
@@ -1016,15 +1035,15 @@ namespace TS{
         init.assign(avccBox.payload(), avccBox.payloadSize());
       }break;
       case H265:{
-        if (!hevcInfo.count(it->first) || !hevcInfo[it->first].haveRequired()){
-          MEDIUM_MSG("Aborted meta fill for hevc track %zu: no info nal unit", it->first);
+        if (!st.hevcInfo.haveRequired()){
+          MEDIUM_MSG("Aborted meta fill for hevc track %zu: no info nal unit", *it);
           continue;
         }
         addNewTrack = true;
         type = "video";
         codec = "HEVC";
-        init = hevcInfo[it->first].generateHVCC();
-        h265::metaInfo metaInfo = hevcInfo[it->first].getMeta();
+        init = st.hevcInfo.generateHVCC();
+        h265::metaInfo metaInfo = st.hevcInfo.getMeta();
         width = metaInfo.width;
         height = metaInfo.height;
         fpks = metaInfo.fps * 1000;
@@ -1033,8 +1052,8 @@ namespace TS{
         addNewTrack = true;
         type = "video";
         codec = "MPEG2";
-        init = std::string("\000\000\001", 3) + mpeg2SeqHdr[it->first] +
-               std::string("\000\000\001", 3) + mpeg2SeqExt[it->first];
+        init = std::string("\000\000\001", 3) + st.mpeg2SeqHdr +
+               std::string("\000\000\001", 3) + st.mpeg2SeqExt;
         Mpeg::MPEG2Info info = Mpeg::parseMPEG2Header(init);
         width = info.width;
         height = info.height;
@@ -1044,13 +1063,13 @@ namespace TS{
         addNewTrack = true;
         type = "meta";
         codec = "ID3";
-        init = metaInit[it->first];
+        init = st.metaInit;
       }break;
       case META:{
         addNewTrack = true;
         type = "meta";
         codec = "RAW";
-        init = metaInit[it->first];
+        init = st.metaInit;
       }break;
       case AC3:{
         addNewTrack = true;
@@ -1065,7 +1084,7 @@ namespace TS{
         size = 16;
         init = std::string("OpusHead\001\002\170\000\200\273\000\000\000\000\001", 19);
         channels = 2;
-        std::string extData = TS::ProgramDescriptors(metaInit[it->first].data(), metaInit[it->first].size()).getExtension();
+        std::string extData = TS::ProgramDescriptors(st.metaInit.data(), st.metaInit.size()).getExtension();
         if (extData.size() > 1){
           channels = extData[1];
           uint8_t channel_map = extData[2];
@@ -1106,7 +1125,7 @@ namespace TS{
       }break;
       case MP2:{
         addNewTrack = true;
-        Mpeg::MP2Info info = Mpeg::parseMP2Header(mp2Hdr[it->first]);
+        Mpeg::MP2Info info = Mpeg::parseMP2Header(st.mp2Hdr);
         type = "audio";
         codec = (info.layer == 3 ? "MP3" : "MP2");
         rate = info.sampleRate;
@@ -1115,17 +1134,17 @@ namespace TS{
       case AAC:{
         addNewTrack = true;
         init.resize(2);
-        init[0] = ((adtsInfo[it->first].getAACProfile() & 0x1F) << 3) |
-                  ((adtsInfo[it->first].getFrequencyIndex() & 0x0E) >> 1);
-        init[1] = ((adtsInfo[it->first].getFrequencyIndex() & 0x01) << 7) |
-                  ((adtsInfo[it->first].getChannelConfig() & 0x0F) << 3);
+        init[0] = ((st.adtsInfo.getAACProfile() & 0x1F) << 3) |
+                  ((st.adtsInfo.getFrequencyIndex() & 0x0E) >> 1);
+        init[1] = ((st.adtsInfo.getFrequencyIndex() & 0x01) << 7) |
+                  ((st.adtsInfo.getChannelConfig() & 0x0F) << 3);
         // Wait with adding the track until we have init data
         if (init[0] == 0 && init[1] == 0){addNewTrack = false;}
         type = "audio";
         codec = "AAC";
         size = 16;
-        rate = adtsInfo[it->first].getFrequency();
-        channels = adtsInfo[it->first].getChannelCount();
+        rate = st.adtsInfo.getFrequency();
+        channels = st.adtsInfo.getChannelCount();
       }break;
       }
 
@@ -1147,8 +1166,9 @@ namespace TS{
 
       size_t pmtCount = associationTable.getProgramCount();
       for (size_t i = 0; i < pmtCount; i++){
-        uint32_t pid = associationTable.getProgramPID(i);
-        ProgramMappingEntry entry = mappingTable[pid].getEntry(0);
+        const PidState *pmt = getState(associationTable.getProgramPID(i));
+        if (!pmt){continue;}
+        ProgramMappingEntry entry = pmt->mappingTable.getEntry(0);
         while (entry){
           if (entry.getElementaryPid() == tid){
             meta.setLang(idx, ProgramDescriptors(entry.getESInfo(), entry.getESInfoLength()).getLanguage());
@@ -1161,8 +1181,9 @@ namespace TS{
     }
     if (tid != INVALID_TRACK_ID){
       WARN_MSG("Could not init track %zu!", tid);
-      for (std::map<size_t, uint32_t>::const_iterator it = pidToCodec.begin(); it != pidToCodec.end(); it++){
-        INFO_MSG("Track %zu (%" PRIu32 ") no match", it->first, it->second);
+      for (std::vector<size_t>::const_iterator it = pidList.begin(); it != pidList.end(); ++it){
+        const PidState &st = *getState(*it);
+        if (st.codec){INFO_MSG("Track %zu (%" PRIu32 ") no match", *it, st.codec);}
       }
     }
   }
@@ -1181,8 +1202,9 @@ namespace TS{
         // Add PMT track
         result.insert(pid);
         // IF PMT updated in last 5 seconds, check for contents
-        if (Util::bootSecs() - lastPMT[pid] < 5){
-          ProgramMappingEntry entry = mappingTable[pid].getEntry(0);
+        const PidState *pmt = getState(pid);
+        if (pmt && Util::bootSecs() - pmt->lastPMT < 5){
+          ProgramMappingEntry entry = pmt->mappingTable.getEntry(0);
           // Add all tracks in PMT
           while (entry){
             switch (entry.getStreamType()){
@@ -1207,10 +1229,10 @@ namespace TS{
 
   void Stream::eraseTrack(size_t tid){
     tthread::lock_guard<tthread::recursive_mutex> guard(tMutex);
-    pesStreams.erase(tid);
-    psCacheTid = 0;
-    psCache = 0;
-    pesPositions.erase(tid);
-    outPackets.erase(tid);
+    PidState *st = getState(tid);
+    if (!st){return;}
+    st->pesPackets.clear();
+    st->pesPositions.clear();
+    st->outPackets.clear();
   }
 }// namespace TS
@@ -4,9 +4,11 @@
 #include <deque>
 #include <map>
 #include <set>
+#include <vector>
 
 #include "shared_memory.h"
 #define TS_PTS_ROLLOVER 95443718
+#define TS_PID_COUNT 8192
 
 namespace TS{
   enum codecType{
@@ -34,6 +36,8 @@ namespace TS{
     void setRemainder(const aac::adts &p, const void *source, uint32_t avail, uint64_t bPos);
 
     ADTSRemainder();
+    ADTSRemainder(const ADTSRemainder &rhs);
+    ADTSRemainder &operator=(const ADTSRemainder &rhs);
     ~ADTSRemainder();
     uint64_t getLength();
     uint64_t getBpos();
@@ -45,6 +49,34 @@ namespace TS{
     void clear();
   };
 
+  /// Holds all demuxing state for a single PID, so that handling a packet needs only one lookup.
+  class PidState{
+  public:
+    PidState();
+    std::deque<Packet> pesPackets;        ///< TS packets of the PES units not parsed yet
+    std::deque<uint64_t> pesPositions;    ///< Byte positions of the PES units not parsed yet
+    uint32_t seenUnitStart;               ///< Amount of PES unit starts in pesPackets
+    std::deque<DTSC::Packet> outPackets;  ///< Parsed packets, ready to be retrieved
+    DTSC::Packet buildPacket;             ///< H264/HEVC packet being built from NAL units
+    bool hasBuildPacket;
+    uint32_t codec;                       ///< Stream type from the PMT for data tracks, zero otherwise
+    std::string metaInit;                 ///< Elementary stream descriptors from the PMT
+    aac::adts adtsInfo;
+    bool hasAdtsInfo;
+    ADTSRemainder remainder;
+    std::string spsInfo;
+    std::string ppsInfo;
+    h265::initData hevcInfo;
+    std::string mpeg2SeqHdr;
+    std::string mpeg2SeqExt;
+    std::string mp2Hdr;
+    size_t rolloverCount;
+    uint64_t lastms;
+    bool isPMT;                           ///< Whether the PAT lists this PID as a PMT
+    uint64_t lastPMT;
+    ProgramMappingTable mappingTable;
+  };
+
   class Assembler;
 
   class Stream{
@@ -79,33 +111,13 @@ namespace TS{
   private:
     uint64_t lastPAT;
     ProgramAssociationTable associationTable;
-    std::map<size_t, ADTSRemainder> remainders;
-
-    std::set<unsigned int> pmtTracks;
-
-    std::map<size_t, uint64_t> lastPMT;
-    std::map<size_t, ProgramMappingTable> mappingTable;
-
-    std::map<size_t, std::deque<Packet> > pesStreams;
-    std::deque<Packet> *psCache; /// Used only for internal speed optimizes.
-    uint32_t psCacheTid;         /// Used only for internal speed optimizes.
-    std::map<size_t, std::deque<uint64_t> > pesPositions;
-    std::map<size_t, std::deque<DTSC::Packet> > outPackets;
-    std::map<size_t, DTSC::Packet> buildPacket;
-    std::map<size_t, uint32_t> pidToCodec;
-    std::map<size_t, aac::adts> adtsInfo;
-    std::map<size_t, std::string> spsInfo;
-    std::map<size_t, std::string> ppsInfo;
-    std::map<size_t, h265::initData> hevcInfo;
-    std::map<size_t, std::string> metaInit;
-    std::map<size_t, std::string> descriptors;
-    std::map<size_t, uint32_t> seenUnitStart;
-    std::map<size_t, std::string> mpeg2SeqHdr;
-    std::map<size_t, std::string> mpeg2SeqExt;
-    std::map<size_t, std::string> mp2Hdr;
 
-    std::map<size_t, size_t> rolloverCount;
-    std::map<size_t, unsigned long long> lastms;
+    std::deque<PidState> pidStates;  ///< State for every PID seen, in order of first use
+    std::vector<size_t> pidList;     ///< PIDs that have state, in ascending order
+    uint16_t pidIndex[TS_PID_COUNT]; ///< Index into pidStates plus one per PID, zero if none
+    PidState *getState(size_t tid);
+    const PidState *getState(size_t tid) const;
+    PidState *addState(size_t tid);
 
     void parsePES(size_t tid, bool finished = false);
   };
@@ -459,6 +459,10 @@ namespace HTTP{
     return (stateType == HTTP::File);
   }
 
+  /// Memory mapped files keep their read position in this object only, so forked processes can
+  /// each read from them independently.
+  bool URIReader::isMapped() const{return (stateType == HTTP::File && mapped);}
+
   bool URIReader::isEOF() const{
     if (stateType == HTTP::File){
       return (curPos >= totalSize);
@@ -58,6 +58,7 @@ namespace HTTP{
     // Static getters
     bool isSeekable() const; ///< Returns true if seeking is possible in this URI.
     bool isEOF() const;      ///< Returns true if the end of the URI has been reached.
+    bool isMapped() const;   ///< Returns true if the URI is a memory mapped local file.
     operator bool() const{return !isEOF();}///< Returns !isEOF()
     uint64_t getPos();                         ///< Returns the current byte position in the URI.
     const HTTP::URL &getURI() const; ///< Returns the most recently open URI, or the current working directory if not set.
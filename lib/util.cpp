@@ -538,6 +538,7 @@ namespace Util{
       Util::logConverter(1, 0, 2, argv[0], binPid);
       exit(0);
     }
+    Util::Procs::fork_complete();
     if (converterPid == -1){
       FAIL_MSG("Failed to fork log converter for log handling!");
       close(p[1]);
@@ -546,7 +547,6 @@ namespace Util{
       outFile = p[1];
     }
     close(p[0]);
-    Util::Procs::fork_complete();
     return converterPid;
   }
 
@@ -890,10 +890,6 @@ namespace Util{
     return getPointer(it->second, recordNo);
   }
 
-  char *RelAccX::getPointer(const RelAccXFieldData &fd, uint64_t recordNo) const{
-    return RECORD_POINTER;
-  }
-
   /// Returns the value of the given integer-type field in the given record, as an uint64_t type.
   /// Returns 0 if the field does not exist or is not an integer type.
   uint64_t RelAccX::getInt(const std::string &name, uint64_t recordNo) const{
@@ -180,7 +180,11 @@ namespace Util{
     uint32_t getSize(const std::string &name, uint64_t recordNo = 0) const;
 
     char *getPointer(const std::string &name, uint64_t recordNo = 0) const;
-    char *getPointer(const RelAccXFieldData &fd, uint64_t recordNo = 0) const;
+    /// Returns a pointer to the given field in the given record number.
+    /// Inlined, since this is used for every field access that does not go through a name lookup.
+    inline char *getPointer(const RelAccXFieldData &fd, uint64_t recordNo = 0) const{
+      return p + *hdrOffset + (((*hdrRecordCnt) ? (recordNo % *hdrRecordCnt) : recordNo) * *hdrRecordSize) + fd.offset;
+    }
 
     uint64_t getInt(const std::string &name, uint64_t recordNo = 0) const;
     uint64_t getInt(const RelAccXFieldData &fd, uint64_t recordNo = 0) const;
@@ -227,6 +231,34 @@ namespace Util{
     char *p;
   };
 
+  /// Compile-time typed version of RelAccXFieldData, for integer fields of a known width.
+  /// Resolve it once (e.g. from RelAccX::getFieldData), after which get/set are inlined native-width
+  /// memory accesses without any name lookup or type switch.
+  /// If the field turns out to not be an integer of exactly sizeof(T) bytes (e.g. a 24-bit field, or
+  /// a field missing entirely) it falls back to the generic RelAccX::getInt/setInt functions.
+  /// Can be used anywhere a RelAccXFieldData is expected.
+  template <typename T> class RelAccXTypedField : public RelAccXFieldData{
+  public:
+    RelAccXTypedField() : RelAccXFieldData(), native(false){}
+    RelAccXTypedField(const RelAccXFieldData &fd) : RelAccXFieldData(fd){
+      native = (size == sizeof(T) && ((type & 0xF0) == RAX_UINT || (type & 0xF0) == RAX_INT));
+    }
+    inline T get(const RelAccX &src, uint64_t recordNo) const{
+      if (native){return *(T *)src.getPointer(*this, recordNo);}
+      return (T)src.getInt(*this, recordNo);
+    }
+    inline void set(RelAccX &src, T val, uint64_t recordNo) const{
+      if (native){
+        *(T *)src.getPointer(*this, recordNo) = val;
+        return;
+      }
+      src.setInt(*this, val, recordNo);
+    }
+
+  private:
+    bool native;
+  };
+
   class FieldAccX{
   public:
     FieldAccX(RelAccX *_src = NULL, RelAccXFieldData _field = RelAccXFieldData());
@@ -110,7 +110,7 @@ bool AnalyserDTSC::parsePacket(){
         uint32_t shrtest_cnt = 0xFFFFFFFFul;
         uint32_t longest_cnt = 0;
 
-        DTSC::Keys keys(M.keys(*it));
+        DTSC::Keys keys(M.getKeys(*it));
         uint32_t firstKey = keys.getFirstValid();
         uint32_t endKey = keys.getEndValid();
         for (int i = firstKey; i < endKey; i++){
@@ -433,11 +433,12 @@ int Controller::handleAPIConnection(Socket::Connection &conn){
       H.Clean();
       H.SetHeader("Content-Type", "text/javascript");
       H.setCORSHeaders();
-      if (jsonp == ""){
-        H.SetBody(Response.toString() + "\n\n");
-      }else{
-        H.SetBody(jsonp + "(" + Response.toString() + ");\n\n");
-      }
+      Util::ResizeablePointer body;
+      if (jsonp.size()){body.append(jsonp + "(");}
+      Response.toString(body);
+      if (jsonp.size()){body.append(");", 2);}
+      body.append("\n\n", 2);
+      H.SetBody(body, body.size());
       H.SendResponse("200", "OK", conn);
       H.Clean();
     }// if HTTP request received
@@ -628,6 +629,7 @@ void Controller::handleAPICommands(JSON::Value &Request, JSON::Value &Response){
     if (in.isMember("sessionUnspecifiedMode")){out["sessionUnspecifiedMode"] = in["sessionUnspecifiedMode"];}
     if (in.isMember("sessionStreamInfoMode")){out["sessionStreamInfoMode"] = in["sessionStreamInfoMode"];}
     if (in.isMember("tknMode")){out["tknMode"] = in["tknMode"];}
+    if (in.isMember("sessionManager")){out["sessionManager"] = in["sessionManager"].asBool();}
     if (in.isMember("defaultStream")){out["defaultStream"] = in["defaultStream"];}
     if (in.isMember("location") && in["location"].isObject()){
       out["location"]["lat"] = in["location"]["lat"].asDouble();
@@ -10,6 +10,7 @@
 #include <mist/config.h>
 #include <mist/dtsc.h>
 #include <mist/procs.h>
+#include <mist/segment_cache.h>
 #include <mist/shared_memory.h>
 #include <mist/stream.h>
 #include <mist/url.h>
@@ -48,8 +49,25 @@
 #define STAT_TOT_PERCRETRANS 64
 #define STAT_TOT_ALL 0xFF
 
-// Mapping of sessId -> session statistics
-std::map<std::string, Controller::statSession> sessions;
+/// A part of the session statistics with its own lock.
+/// Sessions are spread over the shards by a hash of their session ID, so the stats thread and API
+/// readers only ever contend over the sessions of a single shard at a time.
+struct statShard{
+  tthread::mutex mutex;
+  std::map<std::string, Controller::statSession> sessions; ///< Mapping of sessId -> session statistics
+};
+static statShard statShards[STAT_SHARDS];
+
+/// Returns the shard the given session ID belongs to (FNV-1a hash of the session ID).
+static statShard &shardFor(const std::string &sessId){
+  uint32_t h = 2166136261u;
+  for (size_t i = 0; i < sessId.size(); ++i){
+    h ^= (uint8_t)sessId[i];
+    h *= 16777619u;
+  }
+  return statShards[h % STAT_SHARDS];
+}
+
 std::map<Controller::uxIndex, Controller::uxInfo> experience; ///< Experience data
 std::map<Controller::uxIndex, uint64_t> expCount; ///< Viewer counts
 std::map<Controller::uxIndex, uint64_t> expCountTen; ///< Viewer counts
@@ -57,17 +75,15 @@ std::map<Controller::uxIndex, uint64_t> expCountEighty; ///< Viewer counts
 
 std::map<std::string, Controller::triggerLog> Controller::triggerStats; ///< Holds prometheus stats for trigger executions
 bool Controller::killOnExit = KILL_ON_EXIT;
-tthread::mutex Controller::statsMutex;
 uint64_t Controller::statDropoff = 0;
 static uint64_t cpu_use = 0;
 
 char noBWCountMatches[1717];
 uint64_t bwLimit = 128 * 1024 * 1024; // gigabit default limit
 
-const char nullAddress[16] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
-static Controller::statLog emptyLogEntry = {0, 0, 0, 0, 0, 0 ,0 ,0, "", nullAddress, ""};
+static Controller::statLog emptyLogEntry = {0, 0, 0, 0, 0, 0, 0, 0};
 bool notEmpty(const Controller::statLog & dta){
-  return dta.time || dta.firstActive || dta.lastSecond || dta.down || dta.up || dta.streamName.size() || dta.connectors.size();
+  return dta.time || dta.firstActive || dta.lastSecond || dta.down || dta.up;
 }
 
 // For server-wide totals. Local to this file only.
@@ -110,6 +126,85 @@ static uint64_t servPackRetrans = 0;
 static uint64_t viewSecondsTotal = 0;
 // Mapping of streamName -> summary of stream-wide statistics
 static std::map<std::string, struct streamTotals> streamStats;
+// Copies of configuration used by the stats thread, so it does not need the config mutex while collecting
+static std::string accessLogCfg;
+static char bwMatchesCfg[1717];
+
+/// Immutable copy of the aggregated statistics, published by the stats thread once per second.
+/// API readers only hold a reference to it, so they never wait for (or hold up) stats collection.
+class statSnapshot{
+public:
+  statSnapshot(){
+    refs = 0;
+    upBytes = downBytes = upOtherBytes = downOtherBytes = 0;
+    inputs = outputs = viewers = unspecified = 0;
+    viewSeconds = packSent = packLoss = packRetrans = 0;
+    cachedSessions = 0;
+  }
+  size_t refs; ///< Only changed while holding snapshotMutex
+  uint64_t upBytes;
+  uint64_t downBytes;
+  uint64_t upOtherBytes;
+  uint64_t downOtherBytes;
+  uint64_t inputs;
+  uint64_t outputs;
+  uint64_t viewers;
+  uint64_t unspecified;
+  uint64_t viewSeconds;
+  uint64_t packSent;
+  uint64_t packLoss;
+  uint64_t packRetrans;
+  uint64_t cachedSessions;
+  std::map<std::string, struct streamTotals> streams;
+  std::map<std::string, uint64_t> sessionStreams; ///< Streams with cached sessions, and their viewer session count
+  std::map<Controller::uxIndex, Controller::uxInfo> experience;
+  std::map<Controller::uxIndex, uint64_t> expCount;
+  std::map<Controller::uxIndex, uint64_t> expCountTen;
+  std::map<Controller::uxIndex, uint64_t> expCountEighty;
+};
+
+static tthread::mutex snapshotMutex; ///< Only guards the curSnapshot pointer and reference counts
+static statSnapshot *curSnapshot = 0;
+static const statSnapshot emptySnapshot;
+
+/// Replaces the current snapshot by the given one, which may be null.
+/// The previous snapshot is deleted as soon as the last reader is done with it.
+static void publishSnapshot(statSnapshot *snap){
+  statSnapshot *old = 0;
+  {
+    tthread::lock_guard<tthread::mutex> guard(snapshotMutex);
+    if (snap){snap->refs = 1;}
+    if (curSnapshot && !--curSnapshot->refs){old = curSnapshot;}
+    curSnapshot = snap;
+  }
+  delete old;
+}
+
+/// Holds a reference to the most recently published snapshot for as long as it exists.
+/// Dereferences to an empty snapshot if none was published yet.
+class snapshotRef{
+public:
+  snapshotRef(){
+    tthread::lock_guard<tthread::mutex> guard(snapshotMutex);
+    snap = curSnapshot;
+    if (snap){++snap->refs;}
+  }
+  ~snapshotRef(){
+    if (!snap){return;}
+    bool last = false;
+    {
+      tthread::lock_guard<tthread::mutex> guard(snapshotMutex);
+      last = !--snap->refs;
+    }
+    if (last){delete snap;}
+  }
+  const statSnapshot *operator->() const{return snap ? snap : &emptySnapshot;}
+
+private:
+  snapshotRef(const snapshotRef &);
+  snapshotRef &operator=(const snapshotRef &);
+  statSnapshot *snap;
+};
 
 // If streamName does not exist yet in streamStats, create and init an entry for it
 static void createEmptyStatsIfNeeded(const std::string & streamName){
@@ -236,7 +331,11 @@ void Controller::sessions_invalidate(const std::string &streamname){
     if (statComm.getStream(i) == streamname){
       sessCount++;
       // Re-trigger USER_NEW trigger for this session
-      kill(statComm.getPid(i), SIGUSR1);
+      if (statComm.getStatus(i) & COMM_STATUS_MANAGED){
+        statComm.setStatus(statComm.getStatus(i) | COMM_STATUS_RETRIGGER, i);
+      }else{
+        kill(statComm.getPid(i), SIGUSR1);
+      }
     }
   }
   INFO_MSG("Invalidated %u session(s) for stream %s", sessCount, streamname.c_str());
@@ -273,9 +372,11 @@ void Controller::sessId_tag(const std::string &sessId, const std::string &tag){
     FAIL_MSG("In controller shutdown procedure - cannot tag sessions.");
     return;
   }
-  tthread::lock_guard<tthread::mutex> guard(statsMutex);
-  for (std::map<std::string, statSession>::iterator it = sessions.begin(); it != sessions.end(); it++){
-    if (it->first == sessId){
+  {
+    statShard &shard = shardFor(sessId);
+    tthread::lock_guard<tthread::mutex> guard(shard.mutex);
+    std::map<std::string, statSession>::iterator it = shard.sessions.find(sessId);
+    if (it != shard.sessions.end()){
       it->second.tags.insert(tag);
       return;
     }
@@ -293,11 +394,14 @@ void Controller::tag_shutdown(const std::string &tag){
     return;
   }
   unsigned int sessCount = 0;
-  tthread::lock_guard<tthread::mutex> guard(statsMutex);
-  for (std::map<std::string, statSession>::iterator it = sessions.begin(); it != sessions.end(); it++){
-    if (it->second.tags.count(tag)){
-      sessCount++;
-      killConnections(it->first);
+  for (size_t s = 0; s < STAT_SHARDS; ++s){
+    tthread::lock_guard<tthread::mutex> guard(statShards[s].mutex);
+    std::map<std::string, statSession> &sessions = statShards[s].sessions;
+    for (std::map<std::string, statSession>::iterator it = sessions.begin(); it != sessions.end(); it++){
+      if (it->second.tags.count(tag)){
+        sessCount++;
+        killConnections(it->first);
+      }
     }
   }
   INFO_MSG("Shut down %u session(s) for tag %s", sessCount, tag.c_str());
@@ -311,7 +415,6 @@ void Controller::sessions_shutdown(const std::string &streamname, const std::str
     return;
   }
   unsigned int sessCount = 0;
-  tthread::lock_guard<tthread::mutex> guard(statsMutex);
   // Find all matching streams in statComm and get their sessId
   for (size_t i = 0; i < statComm.recordCount(); i++){
     if (statComm.getStatus(i) == COMM_STATUS_INVALID || (statComm.getStatus(i) & COMM_STATUS_DISCONNECT)){continue;}
@@ -319,7 +422,10 @@ void Controller::sessions_shutdown(const std::string &streamname, const std::str
       (!protocol.size() || statComm.hasConnector(i, protocol))){
       uint32_t pid = statComm.getPid(i);
       sessCount++;
-      if (pid > 1){
+      if (statComm.getStatus(i) & COMM_STATUS_MANAGED){
+        // The session manager disconnects the session when it sees this flag
+        statComm.setStatus(statComm.getStatus(i) | COMM_STATUS_REQDISCONNECT, i);
+      }else if (pid > 1){
         Util::Procs::Stop(pid);
         INFO_MSG("Killing PID %" PRIu32, pid);
       }
@@ -329,6 +435,44 @@ void Controller::sessions_shutdown(const std::string &streamname, const std::str
            streamname.c_str(), protocol.c_str());
 }
 
+/// PID of the session manager, if one is running
+static pid_t sessManagerPid = 0;
+
+/// Starts the session manager (MistSession --manager) while the sessionManager setting is enabled,
+/// and stops it when the setting gets disabled. A manager that survived a controller restart is adopted.
+static void checkSessionManager(){
+  bool wanted = Controller::Storage["config"]["sessionManager"].asBool();
+  if (sessManagerPid && !Util::Procs::isRunning(sessManagerPid)){
+    WARN_MSG("Session manager (PID %d) has exited", (int)sessManagerPid);
+    sessManagerPid = 0;
+  }
+  if (!wanted){
+    if (sessManagerPid){
+      INFO_MSG("Stopping session manager (PID %d)", (int)sessManagerPid);
+      Util::Procs::Stop(sessManagerPid);
+      sessManagerPid = 0;
+    }
+    return;
+  }
+  if (sessManagerPid){return;}
+  IPC::sharedPage reqPage(COMMS_SESSREQ, 0, false, false);
+  if (reqPage){
+    Util::RelAccX reqAccX(reqPage.mapped, false);
+    if (reqAccX.isReady() && reqAccX.getInt("status", 0) != COMM_STATUS_INVALID &&
+        Util::Procs::isRunning(reqAccX.getInt("pid", 0))){
+      sessManagerPid = reqAccX.getInt("pid", 0);
+      INFO_MSG("Using already running session manager (PID %d)", (int)sessManagerPid);
+      return;
+    }
+  }
+  std::deque<std::string> args;
+  args.push_back(Util::getMyPath() + "MistSession");
+  args.push_back("--manager");
+  int err = fileno(stderr);
+  sessManagerPid = Util::Procs::StartPiped(args, 0, 0, &err);
+  if (sessManagerPid){INFO_MSG("Started session manager (PID %d)", (int)sessManagerPid);}
+}
+
 /// This function runs as a thread and roughly once per second retrieves
 /// statistics from all connected clients, as well as wipes
 /// old statistics that have disconnected over 10 minutes ago.
@@ -343,6 +487,11 @@ void Controller::SharedMemStats(void *config){
   Controller::initState();
   bool shiftWrites = true;
   bool firstRun = true;
+  {
+    tthread::lock_guard<tthread::mutex> guard(Controller::configMutex);
+    accessLogCfg = Controller::accesslog;
+    memcpy(bwMatchesCfg, noBWCountMatches, 1717);
+  }
   while (((Util::Config *)config)->is_active){
     {
       std::ifstream cpustat("/proc/stat");
@@ -365,9 +514,15 @@ void Controller::SharedMemStats(void *config){
         }
       }
     }
+    // Refresh our copy of the configuration. Should an API call be holding the config mutex,
+    // don't wait for it but simply keep using the copy from the previous round.
+    if (Controller::configMutex.try_lock()){
+      accessLogCfg = Controller::accesslog;
+      memcpy(bwMatchesCfg, noBWCountMatches, 1717);
+      Controller::configMutex.unlock();
+    }
+    statSnapshot *snap = new statSnapshot();
     {
-      tthread::lock_guard<tthread::mutex> guard(Controller::configMutex);
-      tthread::lock_guard<tthread::mutex> guard2(statsMutex);
       // parse current users
       statLeadIn();
       COMM_LOOP(statComm, statOnActive(id), statOnDisconnect(id));
@@ -406,16 +561,19 @@ void Controller::SharedMemStats(void *config){
         }
       }
       // wipe old statistics and set session type counters
-      if (sessions.size()){
+      // Ensure cutOffPoint is either time of boot or 10 minutes ago, whichever is closer.
+      // Prevents wrapping around to high values close to system boot time.
+      uint64_t cutOffPoint = Util::bootSecs();
+      if (cutOffPoint > STAT_CUTOFF){
+        cutOffPoint -= STAT_CUTOFF;
+      }else{
+        cutOffPoint = 0;
+      }
+      for (size_t s = 0; s < STAT_SHARDS; ++s){
+        tthread::lock_guard<tthread::mutex> guard(statShards[s].mutex);
+        std::map<std::string, statSession> &sessions = statShards[s].sessions;
+        if (!sessions.size()){continue;}
         std::list<std::string> mustWipe;
-        // Ensure cutOffPoint is either time of boot or 10 minutes ago, whichever is closer.
-        // Prevents wrapping around to high values close to system boot time.
-        uint64_t cutOffPoint = Util::bootSecs();
-        if (cutOffPoint > STAT_CUTOFF){
-          cutOffPoint -= STAT_CUTOFF;
-        }else{
-          cutOffPoint = 0;
-        }
         for (std::map<std::string, statSession>::iterator it = sessions.begin(); it != sessions.end(); it++){
           // This part handles ending sessions, keeping them in cache for now
           if (it->second.getEnd() < cutOffPoint){
@@ -424,10 +582,12 @@ void Controller::SharedMemStats(void *config){
             // Don't count this session as a viewer
             continue;
           }
+          uint64_t &streamViewers = snap->sessionStreams[it->second.getStreamName()];
           // Recount input, output and viewer type sessions
           switch (it->second.getSessType()){
           case SESS_UNSET: break;
           case SESS_VIEWER:
+            ++streamViewers;
             if (it->second.hasDataFor(tOut)){
               streamStats[it->second.getStreamName()].currViews++;
             }
@@ -454,7 +614,12 @@ void Controller::SharedMemStats(void *config){
           sessions.erase(mustWipe.front());
           mustWipe.pop_front();
         }
+        snap->cachedSessions += sessions.size();
       }
+    }
+    {
+      // Stream states, triggers and limits work on the configuration
+      tthread::lock_guard<tthread::mutex> guard(Controller::configMutex);
       Util::RelAccX *strmStats = streamsAccessor();
       if (!strmStats || !strmStats->isReady()){strmStats = 0;}
       uint64_t strmPos = 0;
@@ -519,13 +684,36 @@ void Controller::SharedMemStats(void *config){
       /*LTS-START*/
       Controller::checkServerLimits();
       /*LTS-END*/
+      checkSessionManager();
     }
+    // Publish everything API readers need as a new snapshot
+    snap->upBytes = servUpBytes;
+    snap->downBytes = servDownBytes;
+    snap->upOtherBytes = servUpOtherBytes;
+    snap->downOtherBytes = servDownOtherBytes;
+    snap->inputs = servInputs;
+    snap->outputs = servOutputs;
+    snap->viewers = servViewers;
+    snap->unspecified = servUnspecified;
+    snap->viewSeconds = servSeconds + viewSecondsTotal;
+    snap->packSent = servPackSent;
+    snap->packLoss = servPackLoss;
+    snap->packRetrans = servPackRetrans;
+    snap->streams = streamStats;
+    snap->experience = experience;
+    snap->expCount = expCount;
+    snap->expCountTen = expCountTen;
+    snap->expCountEighty = expCountEighty;
+    publishSnapshot(snap);
     Util::wait(1000);
   }
   statCommActive = false;
+  publishSnapshot(0);
   HIGH_MSG("Stopping stats thread");
   if (Util::Config::is_restarting){
     statComm.setMaster(false);
+    // Keep the session manager running, the restarted controller adopts it
+    if (sessManagerPid){Util::Procs::forget(sessManagerPid);}
   }else{/*LTS-START*/
     if (Controller::killOnExit){
       WARN_MSG("Killing all connected clients to force full shutdown");
@@ -566,7 +754,10 @@ void Controller::killConnections(std::string sessId){
       if (statComm.getStatus(i) == COMM_STATUS_INVALID || (statComm.getStatus(i) & COMM_STATUS_DISCONNECT)){continue;}
       if (statComm.getSessId(i) == sessId){
         uint32_t pid = statComm.getPid(i);
-        if (pid > 1){
+        if (statComm.getStatus(i) & COMM_STATUS_MANAGED){
+          // The session manager disconnects the session when it sees this flag
+          statComm.setStatus(statComm.getStatus(i) | COMM_STATUS_REQDISCONNECT, i);
+        }else if (pid > 1){
           Util::Procs::Stop(pid);
           INFO_MSG("Killing PID %" PRIu32, pid);
         }
@@ -593,7 +784,7 @@ void Controller::statSession::update(uint64_t index, Comms::Sessions &statComm){
     }
   }
 
-  uint64_t prevNow = curData.log.size() ? curData.log.rbegin()->first : 0;
+  uint64_t prevNow = curData.getEnd();
   // only parse last received data, if newer
   if (prevNow > statComm.getNow(index)){return;};
   long long prevDown = getDown();
@@ -624,14 +815,14 @@ void Controller::statSession::update(uint64_t index, Comms::Sessions &statComm){
   uint64_t currPktRetrans = getPktRetransmit();
   if (currUp - prevUp < 0 || currDown - prevDown < 0){
     INFO_MSG("Negative data usage! %lldu/%lldd (u%lld->%lld) in %s over %s, #%" PRIu64, currUp - prevUp,
-             currDown - prevDown, prevUp, currUp, streamName.c_str(), curData.log.rbegin()->second.connectors.c_str(), index);
+             currDown - prevDown, prevUp, currUp, streamName.c_str(), curData.connectors.c_str(), index);
   }else{
     if (!noBWCount){
       size_t bwMatchOffset = 0;
       noBWCount = 1;
-      while (noBWCountMatches[bwMatchOffset + 16] != 0 && bwMatchOffset < 1700){
-        if (Socket::matchIPv6Addr(statComm.getHost(index), std::string(noBWCountMatches + bwMatchOffset, 16),
-                                  noBWCountMatches[bwMatchOffset + 16])){
+      while (bwMatchesCfg[bwMatchOffset + 16] != 0 && bwMatchOffset < 1700){
+        if (Socket::matchIPv6Addr(statComm.getHost(index), std::string(bwMatchesCfg + bwMatchOffset, 16),
+                                  bwMatchesCfg[bwMatchOffset + 16])){
           noBWCount = 2;
           break;
         }
@@ -709,8 +900,8 @@ void Controller::statSession::finish(){
   const std::string& host = getStrHost();
   Controller::logAccess(sessId, streamName, curConnector, host, duration, getUp(),
                         getDown(), tagStream.str());
-  if (Controller::accesslog.size()){
-    if (Controller::accesslog == "LOG"){
+  if (accessLogCfg.size()){
+    if (accessLogCfg == "LOG"){
       std::stringstream accessStr;
       accessStr << "Session <" << sessId << "> " << streamName << " (" << curConnector
                 << ") from " << host << " ended after " << duration << "s, avg "
@@ -720,13 +911,13 @@ void Controller::statSession::finish(){
     }else{
       static std::ofstream accLogFile;
       static std::string accLogFileName;
-      if (accLogFileName != Controller::accesslog || !accLogFile.good()){
+      if (accLogFileName != accessLogCfg || !accLogFile.good()){
         accLogFile.close();
-        accLogFile.open(Controller::accesslog.c_str(), std::ios_base::app);
+        accLogFile.open(accessLogCfg.c_str(), std::ios_base::app);
         if (!accLogFile.good()){
-          FAIL_MSG("Could not open access log file '%s': %s", Controller::accesslog.c_str(), strerror(errno));
+          FAIL_MSG("Could not open access log file '%s': %s", accessLogCfg.c_str(), strerror(errno));
         }else{
-          accLogFileName = Controller::accesslog;
+          accLogFileName = accessLogCfg;
         }
       }
       if (accLogFile.good()){
@@ -746,8 +937,7 @@ void Controller::statSession::finish(){
     }
   }
   tags.clear();
-  // Insert null datapoint
-  curData.log[curData.log.rbegin()->first + 1] = emptyLogEntry;
+  curData.finish();
 }
 
 /// Constructs an empty session
@@ -759,14 +949,12 @@ Controller::statSession::statSession(){
 
 /// Returns the first measured timestamp in this session.
 uint64_t Controller::statSession::getStart(){
-  if (!curData.log.size()){return 0;}
-  return curData.log.begin()->first;
+  return curData.getStart();
 }
 
 /// Returns the last measured timestamp in this session.
 uint64_t Controller::statSession::getEnd(){
-  if (!curData.log.size()){return 0;}
-  return curData.log.rbegin()->first;
+  return curData.getEnd();
 }
 
 /// Returns true if there is data for this session at timestamp t.
@@ -780,30 +968,11 @@ const std::string& Controller::statSession::getSessId(){
 }
 
 uint64_t Controller::statSession::getFirstActive(){
-  if (curData.log.size()){
-    return curData.log.rbegin()->second.firstActive;
-  }
-  return 0;
-}
-
-const std::string& Controller::statSession::getStreamName(uint64_t t){
-  if (curData.hasDataFor(t)){
-    return curData.getDataFor(t).streamName;
-  }
-  return emptyLogEntry.streamName;
+  return curData.getLast().firstActive;
 }
 
 const std::string& Controller::statSession::getStreamName(){
-  if (curData.log.size()){
-    return curData.log.rbegin()->second.streamName;
-  }
-  return emptyLogEntry.streamName;
-}
-
-std::string Controller::statSession::getStrHost(uint64_t t){
-  std::string host;
-  Socket::hostBytesToStr(getHost(t).data(), 16, host);
-  return host;
+  return curData.streamName;
 }
 
 std::string Controller::statSession::getStrHost(){
@@ -812,139 +981,83 @@ std::string Controller::statSession::getStrHost(){
   return host;
 }
 
-const std::string& Controller::statSession::getHost(uint64_t t){
-  if (curData.hasDataFor(t)){
-    return curData.getDataFor(t).host;
-  }
-  return emptyLogEntry.host;
-}
-
 const std::string& Controller::statSession::getHost(){
-  if (curData.log.size()){
-    return curData.log.rbegin()->second.host;
-  }
-  return emptyLogEntry.host;
-}
-
-const std::string& Controller::statSession::getConnectors(uint64_t t){
-  if (curData.hasDataFor(t)){
-    return curData.getDataFor(t).connectors;
-  }
-  return emptyLogEntry.connectors;
+  return curData.host;
 }
 
 const std::string& Controller::statSession::getConnectors(){
-  if (curData.log.size()){
-    return curData.log.rbegin()->second.connectors;
-  }
-  return emptyLogEntry.connectors;
+  return curData.connectors;
 }
 
 /// Returns the cumulative connected time for this session at timestamp t.
 uint64_t Controller::statSession::getConnTime(uint64_t t){
-  if (curData.hasDataFor(t)){
-    return curData.getDataFor(t).time;
-  }
-  return 0;
+  return curData.getDataFor(t).time;
 }
 
 /// Returns the cumulative connected time for this session.
 uint64_t Controller::statSession::getConnTime(){
-  if (curData.log.size()){
-    return curData.log.rbegin()->second.time;
-  }
-  return 0;
+  return curData.getLast().time;
 }
 
 /// Returns the last requested media timestamp for this session at timestamp t.
 uint64_t Controller::statSession::getLastSecond(uint64_t t){
-  if (curData.hasDataFor(t)){
-    return curData.getDataFor(t).lastSecond;
-  }
-  return 0;
+  return curData.getDataFor(t).lastSecond;
 }
 
 /// Returns the cumulative downloaded bytes for this session at timestamp t.
 uint64_t Controller::statSession::getDown(uint64_t t){
-  if (curData.hasDataFor(t)){
-    return curData.getDataFor(t).down;
-  }
-  return 0;
+  return curData.getDataFor(t).down;
 }
 
 /// Returns the cumulative uploaded bytes for this session at timestamp t.
 uint64_t Controller::statSession::getUp(uint64_t t){
-  if (curData.hasDataFor(t)){
-    return curData.getDataFor(t).up;
-  }
-  return 0;
+  return curData.getDataFor(t).up;
 }
 
-/// Returns the cumulative downloaded bytes for this session at timestamp t.
+/// Returns the cumulative downloaded bytes for this session.
 uint64_t Controller::statSession::getDown(){
-  if (curData.log.size()){
-    return curData.log.rbegin()->second.down;
-  }
-  return 0;
+  return curData.getLast().down;
 }
 
-/// Returns the cumulative uploaded bytes for this session at timestamp t.
+/// Returns the cumulative uploaded bytes for this session.
 uint64_t Controller::statSession::getUp(){
-  if (curData.log.size()){
-    return curData.log.rbegin()->second.up;
-  }
-  return 0;
+  return curData.getLast().up;
 }
 
+/// Returns the cumulative packet count for this session at timestamp t.
 uint64_t Controller::statSession::getPktCount(uint64_t t){
-  if (curData.hasDataFor(t)){
-    return curData.getDataFor(t).pktCount;
-  }
-  return 0;
+  return curData.getDataFor(t).pktCount;
 }
 
-/// Returns the cumulative uploaded bytes for this session at timestamp t.
+/// Returns the cumulative packet count for this session.
 uint64_t Controller::statSession::getPktCount(){
-  if (curData.log.size()){
-    return curData.log.rbegin()->second.pktCount;
-  }
-  return 0;
+  return curData.getLast().pktCount;
 }
 
+/// Returns the cumulative lost packet count for this session at timestamp t.
 uint64_t Controller::statSession::getPktLost(uint64_t t){
-  if (curData.hasDataFor(t)){
-    return curData.getDataFor(t).pktLost;
-  }
-  return 0;
+  return curData.getDataFor(t).pktLost;
 }
 
-/// Returns the cumulative uploaded bytes for this session at timestamp t.
+/// Returns the cumulative lost packet count for this session.
 uint64_t Controller::statSession::getPktLost(){
-  if (curData.log.size()){
-    return curData.log.rbegin()->second.pktLost;
-  }
-  return 0;
+  return curData.getLast().pktLost;
 }
 
+/// Returns the cumulative retransmitted packet count for this session at timestamp t.
 uint64_t Controller::statSession::getPktRetransmit(uint64_t t){
-  if (curData.hasDataFor(t)){
-    return curData.getDataFor(t).pktRetransmit;
-  }
-  return 0;
+  return curData.getDataFor(t).pktRetransmit;
 }
 
-/// Returns the cumulative uploaded bytes for this session at timestamp t.
+/// Returns the cumulative retransmitted packet count for this session.
 uint64_t Controller::statSession::getPktRetransmit(){
-  if (curData.log.size()){
-    return curData.log.rbegin()->second.pktRetransmit;
-  }
-  return 0;
+  return curData.getLast().pktRetransmit;
 }
 
 /// Returns the cumulative downloaded bytes per second for this session at timestamp t.
 uint64_t Controller::statSession::getBpsDown(uint64_t t){
   uint64_t aTime = t - 5;
-  if (aTime < curData.log.begin()->first){aTime = curData.log.begin()->first;}
+  if (aTime < curData.getStart()){aTime = curData.getStart();}
   if (t <= aTime){return 0;}
   uint64_t valA = getDown(aTime);
   uint64_t valB = getDown(t);
@@ -954,27 +1067,105 @@ uint64_t Controller::statSession::getBpsDown(uint64_t t){
 /// Returns the cumulative uploaded bytes per second for this session at timestamp t.
 uint64_t Controller::statSession::getBpsUp(uint64_t t){
   uint64_t aTime = t - 5;
-  if (aTime < curData.log.begin()->first){aTime = curData.log.begin()->first;}
+  if (aTime < curData.getStart()){aTime = curData.getStart();}
   if (t <= aTime){return 0;}
   uint64_t valA = getUp(aTime);
   uint64_t valB = getUp(t);
   return (valB - valA) / (t - aTime);
 }
 
+Controller::statStorage::statStorage(){
+  first = 0;
+  count = 0;
+}
+
+/// Returns the ring buffer position of the i-th oldest entry.
+size_t Controller::statStorage::pos(size_t i) const{
+  i += first;
+  return i < entries.size() ? i : i - entries.size();
+}
+
+/// Returns the amount of entries in the history.
+size_t Controller::statStorage::size() const{
+  return count;
+}
+
+/// Returns the timestamp of the oldest entry, or zero if there are none.
+uint64_t Controller::statStorage::getStart() const{
+  return count ? times[first] : 0;
+}
+
+/// Returns the timestamp of the newest entry, or zero if there are none.
+uint64_t Controller::statStorage::getEnd() const{
+  return count ? times[pos(count - 1)] : 0;
+}
+
 /// Returns true if there is data available for timestamp t.
-bool Controller::statStorage::hasDataFor(unsigned long long t){
-  if (!log.size()){return false;}
-  return (t >= log.begin()->first);
+bool Controller::statStorage::hasDataFor(uint64_t t) const{
+  if (!count){return false;}
+  return (t >= getStart());
 }
 
 /// Returns a reference to the most current data available at timestamp t.
-Controller::statLog &Controller::statStorage::getDataFor(unsigned long long t){
-  if (!log.size()){
-    return emptyLogEntry;
+/// Returns the oldest entry for timestamps before it, and an empty entry if there is no data at all.
+const Controller::statLog &Controller::statStorage::getDataFor(uint64_t t) const{
+  if (!count){return emptyLogEntry;}
+  // Binary search for the last entry at or before t
+  size_t lo = 0, hi = count;
+  while (lo < hi){
+    size_t mid = (lo + hi) / 2;
+    if (times[pos(mid)] <= t){
+      lo = mid + 1;
+    }else{
+      hi = mid;
+    }
   }
-  std::map<unsigned long long, statLog>::iterator it = log.upper_bound(t);
-  if (it != log.begin()){it--;}
-  return it->second;
+  return entries[pos(lo ? lo - 1 : 0)];
+}
+
+/// Returns a reference to the newest entry, or an empty entry if there is no data.
+const Controller::statLog &Controller::statStorage::getLast() const{
+  if (!count){return emptyLogEntry;}
+  return entries[pos(count - 1)];
+}
+
+/// Adds an entry for timestamp t, replacing the newest entry if it has the same timestamp.
+/// Entries older than the newest one are ignored.
+void Controller::statStorage::insert(uint64_t t, const statLog &data){
+  if (count && t <= getEnd()){
+    if (t == getEnd()){entries[pos(count - 1)] = data;}
+    return;
+  }
+  if (count == entries.size()){
+    if (entries.size() < STAT_RING_SIZE){
+      // Grow the ring, putting the oldest entry back at the start
+      size_t newSize = entries.size() ? entries.size() * 2 : 16;
+      if (newSize > STAT_RING_SIZE){newSize = STAT_RING_SIZE;}
+      std::vector<uint64_t> newTimes(newSize);
+      std::vector<statLog> newEntries(newSize);
+      for (size_t i = 0; i < count; ++i){
+        newTimes[i] = times[pos(i)];
+        newEntries[i] = entries[pos(i)];
+      }
+      times.swap(newTimes);
+      entries.swap(newEntries);
+      first = 0;
+    }else{
+      // Full: overwrite the oldest entry
+      first = pos(1);
+      --count;
+    }
+  }
+  size_t p = pos(count);
+  times[p] = t;
+  entries[p] = data;
+  ++count;
+}
+
+/// Ends the history by inserting a null entry one second after the last entry
+void Controller::statStorage::finish(){
+  if (!count){return;}
+  insert(getEnd() + 1, emptyLogEntry);
 }
 
 /// This function is called by parseStatistics.
@@ -982,10 +1173,10 @@ Controller::statLog &Controller::statStorage::getDataFor(unsigned long long t){
 void Controller::statStorage::update(Comms::Sessions &statComm, size_t index){
   statLog tmp;
   tmp.time = statComm.getTime(index);
-  if (!log.size() || !log.rbegin()->second.firstActive){
+  if (!getLast().firstActive){
     tmp.firstActive = statComm.getNow(index);
   } else{
-    tmp.firstActive = log.rbegin()->second.firstActive;
+    tmp.firstActive = getLast().firstActive;
   }
   tmp.lastSecond = statComm.getLastSecond(index);
   tmp.down = statComm.getDown(index);
@@ -993,10 +1184,9 @@ void Controller::statStorage::update(Comms::Sessions &statComm, size_t index){
   tmp.pktCount = statComm.getPacketCount(index);
   tmp.pktLost = statComm.getPacketLostCount(index);
   tmp.pktRetransmit = statComm.getPacketRetransmitCount(index);
-  tmp.connectors = statComm.getConnector(index);
-  tmp.streamName = statComm.getStream(index);
-  tmp.host = statComm.getHost(index);
-  log[statComm.getNow(index)] = tmp;
+  connectors = statComm.getConnector(index);
+  streamName = statComm.getStream(index);
+  host = statComm.getHost(index);
   // wipe data older than STAT_CUTOFF seconds
   // Ensure cutOffPoint is either time of boot or 10 minutes ago, whichever is closer.
   // Prevents wrapping around to high values close to system boot time.
@@ -1006,7 +1196,11 @@ void Controller::statStorage::update(Comms::Sessions &statComm, size_t index){
   }else{
     cutOffPoint = 0;
   }
-  while (log.size() && log.begin()->first < cutOffPoint){log.erase(log.begin());}
+  while (count && times[first] < cutOffPoint){
+    first = pos(1);
+    --count;
+  }
+  insert(statComm.getNow(index), tmp);
 }
 
 void Controller::statLeadIn(){
@@ -1017,14 +1211,21 @@ void Controller::statLeadIn(){
 void Controller::statOnActive(size_t id){
   if (statComm.getNow(id) >= statDropoff){
     // update the session with the latest data
-    sessions[statComm.getSessId(id)].update(id, statComm);
+    const std::string sessId = statComm.getSessId(id);
+    statShard &shard = shardFor(sessId);
+    tthread::lock_guard<tthread::mutex> guard(shard.mutex);
+    shard.sessions[sessId].update(id, statComm);
   }
 }
 
 void Controller::statOnDisconnect(size_t id){
   // Check to see if cleanup is required (when a Session binary fails)
   const std::string thisSessionId = statComm.getSessId(id);
-  sessions[thisSessionId].finish();
+  {
+    statShard &shard = shardFor(thisSessionId);
+    tthread::lock_guard<tthread::mutex> guard(shard.mutex);
+    shard.sessions[thisSessionId].finish();
+  }
   // Try to lock to see if the session crashed during boot
   IPC::semaphore sessionLock;
   char semName[NAME_BUFFER_SIZE];
@@ -1089,16 +1290,8 @@ void Controller::statLeadOut(){
 
 /// Returns true if this stream has at least one connected client.
 bool Controller::hasViewers(std::string streamName){
-  if (sessions.size()){
-    long long currTime = Util::bootSecs();
-    for (std::map<std::string, statSession>::iterator it = sessions.begin(); it != sessions.end(); it++){
-      if (it->second.getStreamName() == streamName &&
-          (it->second.hasDataFor(currTime) || it->second.hasDataFor(currTime - 1))){
-        return true;
-      }
-    }
-  }
-  return false;
+  snapshotRef snap;
+  return snap->sessionStreams.count(streamName);
 }
 
 /// This takes a "clients" request, and fills in the response data.
@@ -1137,7 +1330,6 @@ bool Controller::hasViewers(std::string streamName){
 /// ~~~~~~~~~~~~~~~
 /// In case of the second method, the response is an array in the same order as the requests.
 void Controller::fillClients(JSON::Value &req, JSON::Value &rep){
-  tthread::lock_guard<tthread::mutex> guard(statsMutex);
   // first, figure out the timestamp wanted
   int64_t reqTime = 0;
   uint64_t epoch = Util::epoch();
@@ -1211,31 +1403,33 @@ void Controller::fillClients(JSON::Value &req, JSON::Value &rep){
   if (fields & STAT_CLI_PKTRETRANSMIT){rep["fields"].append("pktretransmit");}
   // output the data itself
   rep["data"].null();
-  // loop over all sessions
-  if (sessions.size()){
+  // loop over all sessions, one shard at a time
+  for (size_t s = 0; s < STAT_SHARDS; ++s){
+    tthread::lock_guard<tthread::mutex> guard(statShards[s].mutex);
+    std::map<std::string, statSession> &sessions = statShards[s].sessions;
     for (std::map<std::string, statSession>::iterator it = sessions.begin(); it != sessions.end(); it++){
       unsigned long long time = reqTime;
       if (now && reqTime - it->second.getEnd() < 5){time = it->second.getEnd();}
       // data present and wanted? insert it!
       if ((it->second.getEnd() >= time && it->second.getStart() <= time) &&
-          (!streams.size() || streams.count(it->second.getStreamName(time))) &&
-          (!protos.size() || protos.count(it->second.getConnectors(time)))){
+          (!streams.size() || streams.count(it->second.getStreamName())) &&
+          (!protos.size() || protos.count(it->second.getConnectors()))){
         const statLog & dta = it->second.curData.getDataFor(time);
         if (notEmpty(dta)){
           JSON::Value d;
-          if (fields & STAT_CLI_HOST){d.append(it->second.getStrHost(time));}
-          if (fields & STAT_CLI_STREAM){d.append(it->second.getStreamName(time));}
-          if (fields & STAT_CLI_PROTO){d.append(it->second.getConnectors(time));}
-          if (fields & STAT_CLI_CONNTIME){d.append(it->second.getConnTime(time));}
-          if (fields & STAT_CLI_POSITION){d.append(it->second.getLastSecond(time));}
-          if (fields & STAT_CLI_DOWN){d.append(it->second.getDown(time));}
-          if (fields & STAT_CLI_UP){d.append(it->second.getUp(time));}
+          if (fields & STAT_CLI_HOST){d.append(it->second.getStrHost());}
+          if (fields & STAT_CLI_STREAM){d.append(it->second.getStreamName());}
+          if (fields & STAT_CLI_PROTO){d.append(it->second.getConnectors());}
+          if (fields & STAT_CLI_CONNTIME){d.append(dta.time);}
+          if (fields & STAT_CLI_POSITION){d.append(dta.lastSecond);}
+          if (fields & STAT_CLI_DOWN){d.append(dta.down);}
+          if (fields & STAT_CLI_UP){d.append(dta.up);}
           if (fields & STAT_CLI_BPS_DOWN){d.append(it->second.getBpsDown(time));}
           if (fields & STAT_CLI_BPS_UP){d.append(it->second.getBpsUp(time));}
           if (fields & STAT_CLI_SESSID){d.append(it->second.getSessId());}
-          if (fields & STAT_CLI_PKTCOUNT){d.append(it->second.getPktCount(time));}
-          if (fields & STAT_CLI_PKTLOST){d.append(it->second.getPktLost(time));}
-          if (fields & STAT_CLI_PKTRETRANSMIT){d.append(it->second.getPktRetransmit(time));}
+          if (fields & STAT_CLI_PKTCOUNT){d.append(dta.pktCount);}
+          if (fields & STAT_CLI_PKTLOST){d.append(dta.pktLost);}
+          if (fields & STAT_CLI_PKTRETRANSMIT){d.append(dta.pktRetransmit);}
           rep["data"].append(d);
         }
       }
@@ -1288,16 +1482,11 @@ void Controller::fillHasStats(JSON::Value &req, JSON::Value &rep){
   std::map<std::string, uint64_t> clients;
   // check all sessions
   {
-    tthread::lock_guard<tthread::mutex> guard(statsMutex);
-    if (sessions.size()){
-      for (std::map<std::string, statSession>::iterator it = sessions.begin(); it != sessions.end(); it++){
-        if (it->second.getSessType() == SESS_INPUT){
-          streams.insert(it->second.getStreamName());
-        }else{
-          streams.insert(it->second.getStreamName());
-          if (it->second.getSessType() == SESS_VIEWER){clients[it->second.getStreamName()]++;}
-        }
-      }
+    snapshotRef snap;
+    for (std::map<std::string, uint64_t>::const_iterator it = snap->sessionStreams.begin();
+         it != snap->sessionStreams.end(); ++it){
+      streams.insert(it->first);
+      if (it->second){clients[it->first] = it->second;}
     }
   }
   // Good, now output what we found...
@@ -1380,8 +1569,8 @@ void Controller::fillActive(JSON::Value &req, JSON::Value &rep){
   }
   DTSC::Meta M;
   {
-    tthread::lock_guard<tthread::mutex> guard(statsMutex);
-    for (std::map<std::string, struct streamTotals>::iterator it = streamStats.begin(); it != streamStats.end(); ++it){
+    snapshotRef snap;
+    for (std::map<std::string, struct streamTotals>::const_iterator it = snap->streams.begin(); it != snap->streams.end(); ++it){
       //If specific streams were requested, match and skip non-matching
       if (streams.size()){
         bool match = false;
@@ -1520,7 +1709,6 @@ public:
 
 /// This takes a "totals" request, and fills in the response data.
 void Controller::fillTotals(JSON::Value &req, JSON::Value &rep){
-  tthread::lock_guard<tthread::mutex> guard(statsMutex);
   // first, figure out the timestamps wanted
   int64_t reqStart = 0;
   int64_t reqEnd = 0;
@@ -1587,7 +1775,9 @@ void Controller::fillTotals(JSON::Value &req, JSON::Value &rep){
   std::map<uint64_t, totalsData> totalsCount;
   // loop over all sessions
   /// \todo Make the interval configurable instead of 1 second
-  if (sessions.size()){
+  for (size_t s = 0; s < STAT_SHARDS; ++s){
+    tthread::lock_guard<tthread::mutex> guard(statShards[s].mutex);
+    std::map<std::string, statSession> &sessions = statShards[s].sessions;
     for (std::map<std::string, statSession>::iterator it = sessions.begin(); it != sessions.end(); it++){
       // data present and wanted? insert it!
       if ((it->second.getEnd() >= (unsigned long long)reqStart ||
@@ -1676,6 +1866,7 @@ void Controller::handlePrometheus(HTTP::Parser &H, Socket::Connection &conn, int
   }
   H.SetHeader("Server", APPIDENT);
   H.StartResponse("200", "OK", H, conn, true);
+  snapshotRef snap;
 
   // Counters of current active viewers, inputs and outputs of the Session stats cache
   std::map<std::string, uint32_t> outputs;
@@ -1777,31 +1968,31 @@ void Controller::handlePrometheus(HTTP::Parser &H, Socket::Connection &conn, int
 
     response << "# HELP mist_viewseconds_total Number of seconds any media was received by a viewer.\n";
     response << "# TYPE mist_viewseconds_total counter\n";
-    response << "mist_viewseconds_total " << servSeconds + viewSecondsTotal << "\n";
+    response << "mist_viewseconds_total " << snap->viewSeconds << "\n";
 
     response << "\n# HELP mist_sessions_count Counts of unique sessions by type since server "
                 "start.\n";
     response << "# TYPE mist_sessions_count counter\n";
-    response << "mist_sessions_count{sessType=\"viewers\"}" << servViewers << "\n";
-    response << "mist_sessions_count{sessType=\"incoming\"}" << servInputs << "\n";
-    response << "mist_sessions_count{sessType=\"unspecified\"}" << servUnspecified << "\n";
-    response << "mist_sessions_count{sessType=\"outgoing\"}" << servOutputs << "\n\n";
+    response << "mist_sessions_count{sessType=\"viewers\"}" << snap->viewers << "\n";
+    response << "mist_sessions_count{sessType=\"incoming\"}" << snap->inputs << "\n";
+    response << "mist_sessions_count{sessType=\"unspecified\"}" << snap->unspecified << "\n";
+    response << "mist_sessions_count{sessType=\"outgoing\"}" << snap->outputs << "\n\n";
 
     response << "# HELP mist_bw_total Count of bytes handled since server start, by direction.\n";
     response << "# TYPE mist_bw_total counter\n";
     response << "stat_bw_total{direction=\"up\"}" << bw_up_total << "\n";
     response << "stat_bw_total{direction=\"down\"}" << bw_down_total << "\n\n";
-    response << "mist_bw_total{direction=\"up\"}" << servUpBytes << "\n";
-    response << "mist_bw_total{direction=\"down\"}" << servDownBytes << "\n\n";
-    response << "mist_bw_other{direction=\"up\"}" << servUpOtherBytes << "\n";
-    response << "mist_bw_other{direction=\"down\"}" << servDownOtherBytes << "\n\n";
+    response << "mist_bw_total{direction=\"up\"}" << snap->upBytes << "\n";
+    response << "mist_bw_total{direction=\"down\"}" << snap->downBytes << "\n\n";
+    response << "mist_bw_other{direction=\"up\"}" << snap->upOtherBytes << "\n";
+    response << "mist_bw_other{direction=\"down\"}" << snap->downOtherBytes << "\n\n";
     response << "mist_bw_limit " << bwLimit << "\n\n";
 
     response << "# HELP mist_packets_total Total number of packets sent/received/lost over lossy protocols, server-wide.\n";
     response << "# TYPE mist_packets_total counter\n";
-    response << "mist_packets_total{pkttype=\"sent\"}" << servPackSent << "\n";
-    response << "mist_packets_total{pkttype=\"lost\"}" << servPackLoss << "\n";
-    response << "mist_packets_total{pkttype=\"retrans\"}" << servPackRetrans << "\n";
+    response << "mist_packets_total{pkttype=\"sent\"}" << snap->packSent << "\n";
+    response << "mist_packets_total{pkttype=\"lost\"}" << snap->packLoss << "\n";
+    response << "mist_packets_total{pkttype=\"retrans\"}" << snap->packRetrans << "\n";
 
     if (outputs.size()){
       response << "# HELP mist_outputs Number of viewers active right now, server-wide, by output type.\n";
@@ -1812,16 +2003,14 @@ void Controller::handlePrometheus(HTTP::Parser &H, Socket::Connection &conn, int
       response << "\n";
     }
 
-    {// Scope for shortest possible blocking of statsMutex
-      tthread::lock_guard<tthread::mutex> guard(statsMutex);
-
+    {
       response << "# HELP mist_sessions_total Number of sessions active right now, server-wide, by type.\n";
       response << "# TYPE mist_sessions_total gauge\n";
       response << "mist_sessions_total{sessType=\"viewers\"}" << totViewers << "\n";
       response << "mist_sessions_total{sessType=\"incoming\"}" << totInputs << "\n";
       response << "mist_sessions_total{sessType=\"outgoing\"}" << totOutputs << "\n";
       response << "mist_sessions_total{sessType=\"unspecified\"}" << totUnspecified << "\n";
-      response << "mist_sessions_total{sessType=\"cached\"}" << sessions.size() << "\n";
+      response << "mist_sessions_total{sessType=\"cached\"}" << snap->cachedSessions << "\n";
 
       response << "\n# HELP mist_viewcount Count of unique viewer sessions since stream start, per "
                   "stream.\n";
@@ -1832,9 +2021,17 @@ void Controller::handlePrometheus(HTTP::Parser &H, Socket::Connection &conn, int
       response << "# TYPE mist_bw counter\n";
       response << "# HELP mist_packets Total number of packets sent/received/lost over lossy protocols.\n";
       response << "# TYPE mist_packets counter\n";
+      response << "# HELP mist_segcache Count of segment requests served from (hit) or without (miss) the shared segment cache.\n";
+      response << "# TYPE mist_segcache counter\n";
+      response << "# HELP mist_segcache_evictions Count of segments removed from the shared segment cache.\n";
+      response << "# TYPE mist_segcache_evictions counter\n";
+      response << "# HELP mist_segcache_bytes Total size of all segments in the shared segment cache.\n";
+      response << "# TYPE mist_segcache_bytes gauge\n";
+      response << "# HELP mist_segcache_segments Count of segments in the shared segment cache.\n";
+      response << "# TYPE mist_segcache_segments gauge\n";
       size_t healthStreams = 0, unHealthStreams = 0;
-      for (std::map<std::string, struct streamTotals>::iterator it = streamStats.begin();
-            it != streamStats.end(); ++it){
+      for (std::map<std::string, struct streamTotals>::const_iterator it = snap->streams.begin();
+            it != snap->streams.end(); ++it){
         response << "mist_sessions{stream=\"" << it->first << "\",sessType=\"viewers\"}"
                   << it->second.currViews << "\n";
         response << "mist_sessions{stream=\"" << it->first << "\",sessType=\"incoming\"}"
@@ -1850,6 +2047,14 @@ void Controller::handlePrometheus(HTTP::Parser &H, Socket::Connection &conn, int
         response << "mist_packets{stream=\"" << it->first << "\",pkttype=\"sent\"}" << it->second.packSent << "\n";
         response << "mist_packets{stream=\"" << it->first << "\",pkttype=\"lost\"}" << it->second.packLoss << "\n";
         response << "mist_packets{stream=\"" << it->first << "\",pkttype=\"retrans\"}" << it->second.packRetrans << "\n";
+        SegmentCache::Index segCache;
+        if (segCache.open(it->first, false)){
+          response << "mist_segcache{stream=\"" << it->first << "\",result=\"hit\"}" << segCache.getHits() << "\n";
+          response << "mist_segcache{stream=\"" << it->first << "\",result=\"miss\"}" << segCache.getMisses() << "\n";
+          response << "mist_segcache_evictions{stream=\"" << it->first << "\"}" << segCache.getEvictions() << "\n";
+          response << "mist_segcache_bytes{stream=\"" << it->first << "\"}" << segCache.getStored() << "\n";
+          response << "mist_segcache_segments{stream=\"" << it->first << "\"}" << segCache.getCount() << "\n";
+        }
         //Only output stream health if status is ready
         if (it->second.status == STRMSTAT_READY && it->second.statusLive == 1){
           response << "mist_health{stream=\"" << it->first << "\"}" << (int)it->second.statusPerc << "\n";
@@ -1902,6 +2107,7 @@ void Controller::handlePrometheus(HTTP::Parser &H, Socket::Connection &conn, int
       response << "mist_health_count{health=\"good\"}" << healthStreams << "\n";
       response << "mist_health_count{health=\"bad\"}" << unHealthStreams << "\n";
 
+      tthread::lock_guard<tthread::mutex> guard(Controller::configMutex);
       if (Controller::triggerStats.size()){
         response << "\n# HELP mist_trigger_count Total executions for the given trigger\n";
         response << "# HELP mist_trigger_time Total execution time in millis for the given trigger\n";
@@ -1914,7 +2120,25 @@ void Controller::handlePrometheus(HTTP::Parser &H, Socket::Connection &conn, int
         }
         response << "\n";
       }
-
+      bool cacheHelp = false;
+      jsonForEachConst(Storage["config"]["triggers"], it){
+        Triggers::ResponseCache trigCache;
+        if (!trigCache.open(it.key(), false)){continue;}
+        if (!cacheHelp){
+          response << "# HELP mist_trigger_cache Count of blocking trigger calls answered from the response cache (hit), by waiting for an identical call (coalesced) or by the handler (miss).\n";
+          response << "# TYPE mist_trigger_cache counter\n";
+          response << "# HELP mist_trigger_cache_entries Count of responses in the trigger response cache.\n";
+          response << "# TYPE mist_trigger_cache_entries gauge\n";
+          cacheHelp = true;
+        }
+        response << "mist_trigger_cache{trigger=\"" << it.key() << "\",result=\"hit\"}" << trigCache.getHits() << "\n";
+        response << "mist_trigger_cache{trigger=\"" << it.key() << "\",result=\"coalesced\"}" << trigCache.getCoalesced() << "\n";
+        response << "mist_trigger_cache{trigger=\"" << it.key() << "\",result=\"miss\"}" << trigCache.getMisses() << "\n";
+        response << "mist_trigger_cache_entries{trigger=\"" << it.key() << "\"}" << trigCache.getCount() << "\n";
+      }
+      if (cacheHelp){response << "\n";}
+    }
+    {
       response << "\n\n";
       response << "# TYPE mist_playux_perfect gauge\n";
       response << "# HELP mist_playux_perfect Count of people that have a perfect viewer experience.\n";
@@ -1924,19 +2148,19 @@ void Controller::handlePrometheus(HTTP::Parser &H, Socket::Connection &conn, int
       response << "# HELP mist_playux_bad Count of people that have a bad viewer experience.\n";
       response << "# TYPE mist_playux_count counter\n";
       response << "# HELP mist_playux_count Total people that had a viewer experience.\n";
-      for (std::map<Controller::uxIndex, Controller::uxInfo>::iterator it = experience.begin();
-           it != experience.end(); ++it){
+      for (std::map<Controller::uxIndex, Controller::uxInfo>::const_iterator it = snap->experience.begin();
+           it != snap->experience.end(); ++it){
         response << "mist_playux_perfect{strm=\"" << it->first.stream << "\",prot=\"" << it->first.proto << "\",geo=\"" << it->first.geo << "\",qual=\"" << (int)it->first.qual << "\"}" << it->second.great << "\n";
         response << "mist_playux_okay{strm=\"" << it->first.stream << "\",prot=\"" << it->first.proto << "\",geo=\"" << it->first.geo << "\",qual=\"" << (int)it->first.qual << "\"}" << it->second.good << "\n";
         response << "mist_playux_bad{strm=\"" << it->first.stream << "\",prot=\"" << it->first.proto << "\",geo=\"" << it->first.geo << "\",qual=\"" << (int)it->first.qual << "\"}" << it->second.bad << "\n";
       }
-      for (std::map<Controller::uxIndex, uint64_t>::iterator it = expCount.begin(); it != expCount.end(); ++it){
+      for (std::map<Controller::uxIndex, uint64_t>::const_iterator it = snap->expCount.begin(); it != snap->expCount.end(); ++it){
         response << "mist_playux_count{strm=\"" << it->first.stream << "\",prot=\"" << it->first.proto << "\",geo=\"" << it->first.geo << "\",qual=\"" << (int)it->first.qual << "\"}" << it->second << "\n";
       }
-      for (std::map<Controller::uxIndex, uint64_t>::iterator it = expCountTen.begin(); it != expCountTen.end(); ++it){
+      for (std::map<Controller::uxIndex, uint64_t>::const_iterator it = snap->expCountTen.begin(); it != snap->expCountTen.end(); ++it){
         response << "mist_playux_count_10{strm=\"" << it->first.stream << "\",prot=\"" << it->first.proto << "\",geo=\"" << it->first.geo << "\",qual=\"" << (int)it->first.qual << "\"}" << it->second << "\n";
       }
-      for (std::map<Controller::uxIndex, uint64_t>::iterator it = expCountEighty.begin(); it != expCountEighty.end(); ++it){
+      for (std::map<Controller::uxIndex, uint64_t>::const_iterator it = snap->expCountEighty.begin(); it != snap->expCountEighty.end(); ++it){
         response << "mist_playux_count_80{strm=\"" << it->first.stream << "\",prot=\"" << it->first.proto << "\",geo=\"" << it->first.geo << "\",qual=\"" << (int)it->first.qual << "\"}" << it->second << "\n";
       }
     }
@@ -1954,22 +2178,21 @@ void Controller::handlePrometheus(HTTP::Parser &H, Socket::Connection &conn, int
     resp["curr"].append(totInputs);
     resp["curr"].append(totOutputs);
     resp["curr"].append(totUnspecified);
-    resp["tot"].append(servViewers);
-    resp["tot"].append(servInputs);
-    resp["tot"].append(servOutputs);
-    resp["tot"].append(servUnspecified);
+    resp["tot"].append(snap->viewers);
+    resp["tot"].append(snap->inputs);
+    resp["tot"].append(snap->outputs);
+    resp["tot"].append(snap->unspecified);
     resp["st"].append(bw_up_total);
     resp["st"].append(bw_down_total);
-    resp["bw"].append(servUpBytes);
-    resp["bw"].append(servDownBytes);
-    resp["pkts"].append(servPackSent);
-    resp["pkts"].append(servPackLoss);
-    resp["pkts"].append(servPackRetrans);
+    resp["bw"].append(snap->upBytes);
+    resp["bw"].append(snap->downBytes);
+    resp["pkts"].append(snap->packSent);
+    resp["pkts"].append(snap->packLoss);
+    resp["pkts"].append(snap->packRetrans);
     resp["bwlimit"] = bwLimit;
-    {// Scope for shortest possible blocking of statsMutex
-      tthread::lock_guard<tthread::mutex> guard(statsMutex);
-      resp["curr"].append((uint64_t)sessions.size());
-
+    resp["curr"].append(snap->cachedSessions);
+    {
+      tthread::lock_guard<tthread::mutex> guard(Controller::configMutex);
       if (Controller::triggerStats.size()){
         for (std::map<std::string, Controller::triggerLog>::iterator it = Controller::triggerStats.begin();
             it != Controller::triggerStats.end(); it++){
@@ -1979,6 +2202,15 @@ void Controller::handlePrometheus(HTTP::Parser &H, Socket::Connection &conn, int
           tVal["fails"] = it->second.failCount;
         }
       }
+      jsonForEachConst(Storage["config"]["triggers"], it){
+        Triggers::ResponseCache trigCache;
+        if (!trigCache.open(it.key(), false)){continue;}
+        JSON::Value &tCache = resp["triggers"][it.key()]["cache"];
+        tCache.append(trigCache.getHits());
+        tCache.append(trigCache.getMisses());
+        tCache.append(trigCache.getCoalesced());
+        tCache.append((uint64_t)trigCache.getCount());
+      }
       if (Storage["config"].isMember("location") && Storage["config"]["location"].isMember("lat") && Storage["config"]["location"].isMember("lon")){
         resp["loc"]["lat"] = Storage["config"]["location"]["lat"].asDouble();
         resp["loc"]["lon"] = Storage["config"]["location"]["lon"].asDouble();
@@ -1986,11 +2218,13 @@ void Controller::handlePrometheus(HTTP::Parser &H, Socket::Connection &conn, int
           resp["loc"]["name"] = Storage["config"]["location"]["name"].asStringRef();
         }
       }
-      resp["obw"].append(servUpOtherBytes);
-      resp["obw"].append(servDownOtherBytes);
+    }
+    {
+      resp["obw"].append(snap->upOtherBytes);
+      resp["obw"].append(snap->downOtherBytes);
 
-      for (std::map<std::string, struct streamTotals>::iterator it = streamStats.begin();
-           it != streamStats.end(); ++it){
+      for (std::map<std::string, struct streamTotals>::const_iterator it = snap->streams.begin();
+           it != snap->streams.end(); ++it){
         resp["streams"][it->first]["tot"].append(it->second.viewers);
         resp["streams"][it->first]["tot"].append(it->second.inputs);
         resp["streams"][it->first]["tot"].append(it->second.outputs);
@@ -2003,6 +2237,14 @@ void Controller::handlePrometheus(HTTP::Parser &H, Socket::Connection &conn, int
         resp["streams"][it->first]["pkts"].append(it->second.packSent);
         resp["streams"][it->first]["pkts"].append(it->second.packLoss);
         resp["streams"][it->first]["pkts"].append(it->second.packRetrans);
+        SegmentCache::Index segCache;
+        if (segCache.open(it->first, false)){
+          resp["streams"][it->first]["segcache"].append(segCache.getHits());
+          resp["streams"][it->first]["segcache"].append(segCache.getMisses());
+          resp["streams"][it->first]["segcache"].append(segCache.getEvictions());
+          resp["streams"][it->first]["segcache"].append(segCache.getStored());
+          resp["streams"][it->first]["segcache"].append((uint64_t)segCache.getCount());
+        }
       }
       for (std::map<std::string, uint32_t>::iterator it = outputs.begin(); it != outputs.end(); ++it){
         resp["output_counts"][it->first] = it->second;
@@ -9,12 +9,21 @@
 #include <mist/timing.h>
 #include <mist/tinythread.h>
 #include <string>
+#include <vector>
 
 /// The STAT_CUTOFF define sets how many seconds of statistics history is kept.
 #ifndef STAT_CUTOFF
 #define STAT_CUTOFF 600
 #endif
 
+/// Maximum amount of history entries per session: one per second, plus the closing null entry.
+#define STAT_RING_SIZE (STAT_CUTOFF + 2)
+
+/// The amount of independently locked shards the session statistics are spread over.
+#ifndef STAT_SHARDS
+#define STAT_SHARDS 16
+#endif
+
 namespace Controller{
 
   extern bool killOnExit;
@@ -35,9 +44,6 @@ namespace Controller{
     uint64_t pktCount;
     uint64_t pktLost;
     uint64_t pktRetransmit;
-    std::string streamName;
-    std::string host;
-    std::string connectors;
   };
 
   enum sessType{SESS_UNSET = 0, SESS_INPUT, SESS_OUTPUT, SESS_VIEWER, SESS_UNSPECIFIED};
@@ -81,12 +87,31 @@ namespace Controller{
   };
 
 
+  /// Per-second history of a single session, kept in a ring buffer of at most STAT_RING_SIZE entries.
+  /// Storage grows as needed up to that size, after which the oldest entry is overwritten.
+  /// The stream name, host and connectors are not part of the history; only the latest values are kept.
   class statStorage{
   public:
+    statStorage();
     void update(Comms::Sessions &statComm, size_t index);
-    bool hasDataFor(unsigned long long);
-    statLog &getDataFor(unsigned long long);
-    std::map<unsigned long long, statLog> log;
+    void finish();
+    size_t size() const;
+    uint64_t getStart() const;
+    uint64_t getEnd() const;
+    bool hasDataFor(uint64_t t) const;
+    const statLog &getDataFor(uint64_t t) const;
+    const statLog &getLast() const;
+    std::string streamName;
+    std::string host;
+    std::string connectors;
+
+  private:
+    void insert(uint64_t t, const statLog &data);
+    size_t pos(size_t i) const;
+    std::vector<uint64_t> times; ///< bootSecs timestamp of each entry
+    std::vector<statLog> entries;
+    size_t first; ///< Position of the oldest entry
+    size_t count; ///< Amount of valid entries
   };
 
   /// A session class that keeps track of both current and archived connections.
@@ -108,13 +133,9 @@ namespace Controller{
     uint64_t getEnd();
     bool hasDataFor(uint64_t time);
     const std::string& getSessId();
-    const std::string& getStreamName(uint64_t t);
     const std::string& getStreamName();
-    std::string getStrHost(uint64_t t);
     std::string getStrHost();
-    const std::string& getHost(uint64_t t);
     const std::string& getHost();
-    const std::string& getConnectors(uint64_t t);
     const std::string& getConnectors();
     uint64_t getFirstActive();
     uint64_t getConnTime(uint64_t time);
@@ -136,7 +157,6 @@ namespace Controller{
     uint64_t getBpsUp(uint64_t start, uint64_t end);
   };
 
-  extern tthread::mutex statsMutex;
   extern uint64_t statDropoff;
 
   struct triggerLog{
@@ -669,6 +669,11 @@ namespace Controller{
     char tmpBuf[NAME_BUFFER_SIZE];
 
     if (writtenTrigs != Storage["config"]["triggers"]){
+      // Cached responses may no longer match the new trigger configuration
+      jsonForEach(writtenTrigs, it){
+        Triggers::ResponseCache cache;
+        if (cache.open(it.key(), false)){cache.clear();}
+      }
       writtenTrigs = Storage["config"]["triggers"];
       // for all shm pages that hold triggers
       pageForType.clear();
@@ -690,6 +695,8 @@ namespace Controller{
           tPage.addField("streams", RAX_256RAW);
           tPage.addField("params", RAX_128STRING);
           tPage.addField("default", RAX_128STRING);
+          tPage.addField("cachettl", RAX_32UINT);
+          tPage.addField("cachekey", RAX_64STRING);
           tPage.setReady();
           uint32_t i = 0;
           uint32_t max = (32 * 1024 - tPage.getOffset()) / tPage.getRSize();
@@ -701,6 +708,8 @@ namespace Controller{
               break;
             }
 
+            tPage.setInt("cachettl", 0, i);
+            tPage.setString("cachekey", "", i);
             if (triggIt->isArray()){
               tPage.setString("url", (*triggIt)[0u].asStringRef(), i);
               tPage.setInt("sync", ((*triggIt)[1u].asBool() ? 1 : 0), i);
@@ -750,6 +759,22 @@ namespace Controller{
               }else{
                 tPage.setString("default", "", i);
               }
+              if (triggIt->isMember("cache_ttl") && (*triggIt)["cache_ttl"].asInt() > 0){
+                tPage.setInt("cachettl", (*triggIt)["cache_ttl"].asInt(), i);
+              }
+              if (triggIt->isMember("cache_key")){
+                // Stored as a comma-separated list of payload line numbers
+                std::string keyLines;
+                if ((*triggIt)["cache_key"].isArray()){
+                  jsonForEachConst((*triggIt)["cache_key"], kIt){
+                    if (keyLines.size()){keyLines += ",";}
+                    keyLines += kIt->asString();
+                  }
+                }else{
+                  keyLines = (*triggIt)["cache_key"].asString();
+                }
+                tPage.setString("cachekey", keyLines, i);
+              }
             }
 
             ++i;
@@ -10,6 +10,7 @@
 #include <mist/defines.h>
 #include <mist/encode.h>
 #include <mist/procs.h>
+#include <mist/segment_cache.h>
 #include <mist/stream.h>
 #include <mist/triggers.h>
 #include <mist/urireader.h>
@@ -47,7 +48,7 @@ namespace Mist{
 
       const Util::RelAccX &tPages = M.pages(track);
       if (!tPages.getEndPos()){return;}
-      DTSC::Keys keys(M.keys(track));
+      DTSC::Keys keys(M.getKeys(track));
       if (i > keys.getValidCount()){return;}
       uint64_t pageIdx = 0;
       for (uint64_t j = tPages.getDeleted(); j < tPages.getEndPos(); j++){
@@ -69,6 +70,7 @@ namespace Mist{
   }
   void Input::userOnDisconnect(size_t id){}
   void Input::userLeadOut(){
+    reapBufferWorkers();
     if (!keyLoadPriority.size()){return;}
     //Make reverse mapping
     std::multimap<uint64_t, trackKey> reverse;
@@ -76,12 +78,88 @@ namespace Mist{
       reverse.insert(std::pair<uint64_t, trackKey>(i->second, i->first));
       VERYHIGH_MSG("Key priority for %zu:%zu = %" PRIu64, i->first.track, i->first.key, i->second);
     }
+    //If possible, the highest priority pages are handed off to worker processes so they load in parallel.
+    //Whatever the workers can't take, we buffer ourselves while they run.
+    bool parallel = M.getVod() && parallelBuffering();
     uint64_t timer = Util::bootMS();
     for (std::multimap<uint64_t, trackKey>::reverse_iterator i = reverse.rbegin(); i != reverse.rend() && Util::bootMS() < timer + INPUT_USER_INTERVAL; ++i){
+      if (parallel && bufferFrameAsync(i->second.track, i->second.key)){continue;}
       bufferFrame(i->second.track, i->second.key);
     }
   }
 
+  /// Hands buffering of the given page off to a forked worker process.
+  /// Returns true if the page is already buffered, being buffered or handed off,
+  /// false if it should be buffered by the calling process instead.
+  bool Input::bufferFrameAsync(size_t idx, uint32_t pageNumber){
+    // The subtitle source is a stream with a shared file offset; never read it from two processes
+    if (hasSrt && idx == srtTrack){return false;}
+    if (isBufferingPage(idx, pageNumber) || isBuffered(idx, pageNumber, meta)){
+      // Mark the page as still actively requested
+      pageCounter[idx][pageNumber] = Util::bootSecs();
+      return true;
+    }
+    if (bufferWorkers.size() >= INPUT_BUFFER_WORKERS){
+      reapBufferWorkers();
+      if (bufferWorkers.size() >= INPUT_BUFFER_WORKERS){return false;}
+    }
+    Util::Procs::fork_prepare();
+    pid_t pid = fork();
+    if (!pid){
+      // Worker process: buffer the page and exit without running any destructors,
+      // as those would tear down shared memory owned by the main input process.
+      // It has no children of its own to reap, so no reaper thread is started either.
+      Util::Procs::fork_complete(false);
+      isBufferWorker = true;
+      bufferWorkers.clear();
+      bool ret = bufferFrame(idx, pageNumber);
+      _exit(ret ? 0 : 1);
+    }
+    Util::Procs::fork_complete();
+    if (pid == -1){
+      WARN_MSG("Could not fork page buffering worker: %s", strerror(errno));
+      return false;
+    }
+    HIGH_MSG("Worker %d is buffering track %zu, page %" PRIu32, pid, idx, pageNumber);
+    bufferWorkers[pid] = trackKey(idx, pageNumber);
+    pageCounter[idx][pageNumber] = Util::bootSecs();
+    return true;
+  }
+
+  /// Returns true if a worker process is currently buffering the given page.
+  bool Input::isBufferingPage(size_t idx, uint32_t pageNumber) const{
+    for (std::map<pid_t, trackKey>::const_iterator it = bufferWorkers.begin(); it != bufferWorkers.end(); ++it){
+      if (it->second.track == idx && it->second.key == pageNumber){return true;}
+    }
+    return false;
+  }
+
+  /// Cleans up after worker processes that are done buffering their page.
+  /// The result is read back from the page metadata rather than the exit code, as the child
+  /// may have been reaped elsewhere already. Waits for all workers to finish if block is true.
+  void Input::reapBufferWorkers(bool block){
+    while (bufferWorkers.size()){
+      std::map<pid_t, trackKey>::iterator it = bufferWorkers.begin();
+      while (it != bufferWorkers.end()){
+        if (Util::Procs::childRunning(it->first)){
+          ++it;
+          continue;
+        }
+        size_t idx = it->second.track;
+        uint32_t pageNumber = it->second.key;
+        if (isBuffered(idx, pageNumber, meta)){
+          pageCounter[idx][pageNumber] = Util::bootSecs();
+        }else{
+          // A failed worker already removed its page, allow a later retry
+          pageCounter[idx].erase(pageNumber);
+        }
+        bufferWorkers.erase(it++);
+      }
+      if (!block || !bufferWorkers.size()){return;}
+      Util::sleep(10);
+    }
+  }
+
   void Input::reloadClientMeta(){
     if (M.getStreamName() != "" && M.getMaster()){return;}
     meta.reInit(streamName, false);
@@ -140,6 +218,31 @@ namespace Mist{
     capa["optional"]["inputtimeout"]["type"] = "uint";
     capa["optional"]["inputtimeout"]["option"] = "--inputtimeout";
 
+    option.null();
+    option["arg"] = "string";
+    option["long"] = "pagecache";
+    option["value"].append("");
+    option["help"] = "Directory to keep buffered VoD pages in across input restarts";
+    config->addOption("pagecache", option);
+    capa["optional"]["pagecache"]["name"] = "Page cache directory";
+    capa["optional"]["pagecache"]["help"] = "When set, buffered pages of local VoD files are also written to this directory and loaded from there the next time the input starts, instead of reading them from the file again. May be shared by all streams.";
+    capa["optional"]["pagecache"]["default"] = "";
+    capa["optional"]["pagecache"]["type"] = "str";
+    capa["optional"]["pagecache"]["option"] = "--pagecache";
+
+    option.null();
+    option["arg"] = "integer";
+    option["long"] = "pagecachesize";
+    option["value"].append(1024);
+    option["help"] = "Maximum size in MiB of the page cache directory";
+    config->addOption("pagecachesize", option);
+    capa["optional"]["pagecachesize"]["name"] = "Page cache size";
+    capa["optional"]["pagecachesize"]["help"] = "Maximum size of the page cache directory. Least recently used pages are removed first.";
+    capa["optional"]["pagecachesize"]["default"] = 1024;
+    capa["optional"]["pagecachesize"]["unit"] = "MiB";
+    capa["optional"]["pagecachesize"]["type"] = "uint";
+    capa["optional"]["pagecachesize"]["option"] = "--pagecachesize";
+
     /*LTS-START*/
     /*
     //Encryption
@@ -240,6 +343,7 @@ namespace Mist{
     isBuffer = false;
     startTime = Util::bootSecs();
     lastStats = 0;
+    isBufferWorker = false;
   }
 
   void Input::checkHeaderTimes(const HTTP::URL & streamFile){
@@ -643,6 +747,9 @@ namespace Mist{
         streamStatus.master = true;
         streamStatus.close();
       }
+      //Clear cached segments
+      SegmentCache::Index segCache;
+      if (segCache.open(streamName, false)){segCache.clear();}
       //Delete lock
       playerLock.unlink();
     }
@@ -850,6 +957,22 @@ namespace Mist{
       //}
     }
     meta.setSource(config->getString("input"));
+    if (M.getVod() && standAlone && config->getString("pagecache").size()){
+      // Cached pages are only valid for the exact same division of the tracks into pages
+      std::stringstream layout;
+      std::set<size_t> validTracks = M.getValidTracks();
+      for (std::set<size_t>::iterator it = validTracks.begin(); it != validTracks.end(); ++it){
+        const Util::RelAccX &tPages = M.pages(*it);
+        layout << *it << " " << M.getCodec(*it);
+        for (uint64_t i = tPages.getDeleted(); i < tPages.getEndPos(); ++i){
+          layout << " " << tPages.getInt("firstkey", i) << "+" << tPages.getInt("keycount", i) << "/"
+                 << tPages.getInt("parts", i) << "/" << tPages.getInt("size", i);
+        }
+        layout << "\n";
+      }
+      pageStore.open(config->getString("pagecache"), config->getString("input"), layout.str(),
+                     config->getInteger("pagecachesize") * 1024 * 1024);
+    }
 
     internalOnly = (config->getString("input").find("INTERNAL_ONLY") != std::string::npos);
     isBuffer = (capa["name"].asStringRef() == "Buffer");
@@ -906,6 +1029,8 @@ namespace Mist{
   }
 
   void Input::inputServeStats(){
+    // Workers share the statistics connection of the main input process
+    if (isBufferWorker){return;}
     uint64_t now = Util::bootSecs();
     if (now != lastStats){
       if (!internalOnly && !isBuffer && capa["name"] != "DTSC"){
@@ -1226,6 +1351,8 @@ namespace Mist{
 
   void Input::finish(){
     if (!standAlone || config->getBool("realtime")){return;}
+    // Pages can only be removed safely once no worker is writing to them anymore
+    reapBufferWorkers(true);
     for (std::map<size_t, std::map<uint32_t, uint64_t> >::iterator it = pageCounter.begin();
          it != pageCounter.end(); it++){
       for (std::map<uint32_t, uint64_t>::iterator it2 = it->second.begin(); it2 != it->second.end(); it2++){
@@ -1246,7 +1373,7 @@ namespace Mist{
         checkedPages[*it].insert(pageNum);
         if (pageCounter[*it].count(pageNum)){
           // If the page is still being written to, reset the counter rather than potentially unloading it
-          if (isCurrentLivePage(*it, pageNum)){
+          if (isCurrentLivePage(*it, pageNum) || isBufferingPage(*it, pageNum)){
             pageCounter[*it][pageNum] = cTime;
             continue;
           }
@@ -1305,7 +1432,7 @@ namespace Mist{
     std::set<size_t> validTracks = M.getValidTracks(true);
 
     for (std::set<size_t>::iterator it = validTracks.begin(); it != validTracks.end(); ++it){
-      DTSC::Keys keys(M.keys(*it));
+      DTSC::Keys keys(M.getKeys(*it));
       size_t endKey = keys.getEndValid();
       INFO_MSG("Track %zu has %zu keys", *it, endKey);
       std::set<uint64_t> &kTimes = keyTimes[*it];
@@ -1317,7 +1444,7 @@ namespace Mist{
 
     if (!hasKeySizes){
       for (std::set<size_t>::iterator it = validTracks.begin(); it != validTracks.end(); ++it){
-        DTSC::Keys keys(M.keys(*it));
+        DTSC::Keys keys(M.getKeys(*it));
         DTSC::Parts parts(M.parts(*it));
         size_t partIndex = 0;
         size_t keyCount = keys.getEndValid();
@@ -1333,7 +1460,7 @@ namespace Mist{
     for (std::set<size_t>::iterator it = validTracks.begin(); it != validTracks.end(); ++it){
       bool newData = true;
 
-      DTSC::Keys keys(M.keys(*it));
+      DTSC::Keys keys(M.getKeys(*it));
       uint32_t endKey = keys.getEndValid();
 
       Util::RelAccX &tPages = meta.pages(*it);
@@ -1498,7 +1625,7 @@ namespace Mist{
     if (sourceIdx == INVALID_TRACK_ID){sourceIdx = idx;}
 
     const Util::RelAccX &tPages = M.pages(idx);
-    DTSC::Keys keys(M.keys(idx));
+    DTSC::Keys keys(M.getKeys(idx));
     uint32_t keyCount = keys.getValidCount();
     if (!tPages.getEndPos()){
       WARN_MSG("No pages for track %zu found! Cancelling bufferFrame", idx);
@@ -1541,6 +1668,24 @@ namespace Mist{
     inputServeStats();
 
     bool isSrt = (hasSrt && idx == srtTrack);
+    // Pages of tracks taken from the source as-is may be loaded from the page cache
+    bool cachable = (pageStore && !isSrt && sourceIdx == idx);
+    if (cachable){
+      uint64_t len = 0;
+      if (pageStore.load(idx, pageNumber, page.mapped, tPages.getInt("size", pageIdx), len)){
+        if (PageCache::countPackets(page.mapped, len) == tPages.getInt("parts", pageIdx)){
+          meta.pages(idx).setInt("avail", len, pageIdx);
+          bufferFinalize(idx, page);
+          bufferTimer = Util::bootMS() - bufferTimer;
+          INFO_MSG("Track %zu, page %" PRIu32 " loaded from page cache in %" PRIu64 "ms", idx, pageNumber, bufferTimer);
+          pageCounter[idx][pageNumber] = Util::bootSecs();
+          return true;
+        }
+        WARN_MSG("Cached copy of track %zu, page %" PRIu32 " does not match, removing it", idx, pageNumber);
+        memset(page.mapped, 0, len);
+        pageStore.remove(idx, pageNumber);
+      }
+    }
     if (isSrt){
       srtSource.clear();
       srtSource.seekg(0, srtSource.beg);
@@ -1582,8 +1727,7 @@ namespace Mist{
       }
     }else{
       size_t prevPos = 0;
-      size_t partNo = 0;
-      for (size_t i = 0; i < keyNum; ++i){partNo += keys.getParts(i);}
+      size_t partNo = keys.getFirstPart(keyNum);
       DTSC::Parts parts(M.parts(idx));
       while (thisPacket && thisTime < stopTime){
         if (connectedUsers || isAlwaysOn()){activityCounter = Util::bootSecs();}
@@ -1668,6 +1812,9 @@ namespace Mist{
         }
       }
     }
+    if (cachable && packCounter == tPages.getInt("parts", pageIdx)){
+      pageStore.store(idx, pageNumber, page.mapped, tPages.getInt("avail", pageIdx));
+    }
     bufferFinalize(idx, page);
     bufferTimer = Util::bootMS() - bufferTimer;
     if (packCounter != tPages.getInt("parts", pageIdx)){
@@ -1717,17 +1864,28 @@ namespace Mist{
     // Try to read any existing DTSH file
     std::string fileName = config->getString("input") + ".dtsh";
     HIGH_MSG("Loading metadata for stream '%s' from file '%s'", streamName.c_str(), fileName.c_str());
-    char *scanBuf;
-    size_t fileSize;
     HTTP::URIReader inFile(fileName);
     if (!inFile){return false;}
-    inFile.readAll(scanBuf, fileSize);
-    inFile.close();
-    if (!fileSize){return false;}
-    DTSC::Packet pkt(scanBuf, fileSize, true);
-    HIGH_MSG("Retrieved header of %zu bytes", fileSize);
-    meta.reInit(config->getBool("realtime") ? "" : streamName, pkt.getScan());
+    if (inFile.isMapped()){
+      // Local header files are mapped and loaded in place
+      std::string filePath = inFile.getURI().getFilePath();
+      inFile.close();
+      meta.reInit(config->getBool("realtime") ? "" : streamName, filePath);
+    }else{
+      char *scanBuf;
+      size_t fileSize;
+      inFile.readAll(scanBuf, fileSize);
+      inFile.close();
+      if (!fileSize){return false;}
+      HIGH_MSG("Retrieved header of %zu bytes", fileSize);
+      meta.reInit(config->getBool("realtime") ? "" : streamName, scanBuf, fileSize);
+    }
 
+    if (meta && meta.version == DTSH_PACKED_VERSION){
+      INFO_MSG("Converting header file from version %u to %u", meta.version, DTSH_VERSION);
+      meta.toFile(fileName);
+      meta.version = DTSH_VERSION;
+    }
     if (meta.version != DTSH_VERSION){
       INFO_MSG("Updating wrong version header file from version %u to %u", meta.version, DTSH_VERSION);
       return false;
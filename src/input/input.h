@@ -7,6 +7,7 @@
 #include <mist/dtsc.h>
 #include <mist/encryption.h>
 #include <mist/json.h>
+#include <mist/page_cache.h>
 #include <mist/shared_memory.h>
 #include <mist/timing.h>
 #include <mist/url.h>
@@ -96,6 +97,14 @@ namespace Mist{
     virtual void connStats(Comms::Connections & statComm);
     virtual void parseHeader();
     bool bufferFrame(size_t track, uint32_t keyNum);
+    /// Returns true if pages may be buffered by forked worker processes in parallel to the main
+    /// input process. Only safe if reading from the source keeps no state shared between
+    /// processes (such as a file offset) and tracks are not looked up by the PID that created
+    /// them. Defaults to false.
+    virtual bool parallelBuffering(){return false;}
+    bool bufferFrameAsync(size_t track, uint32_t pageNumber);
+    bool isBufferingPage(size_t track, uint32_t pageNumber) const;
+    void reapBufferWorkers(bool block = false);
     void doInputAbortTrigger(pid_t pid, char *mRExitReason, char *exitReason);
     bool exitAndLogReason();
     bool onUnsupportedTrack(std::string trackType);
@@ -116,6 +125,9 @@ namespace Mist{
     IPC::sharedPage streamStatus;
 
     std::map<size_t, std::map<uint32_t, uint64_t> > pageCounter;
+    std::map<pid_t, trackKey> bufferWorkers; ///< Worker processes buffering a page, by PID
+    bool isBufferWorker; ///< True if this process is a page buffering worker
+    PageCache::Store pageStore; ///< On-disk copies of buffered pages, if enabled
 
     static Input *singleton;
 
@@ -316,7 +316,7 @@ namespace Mist{
       }
     }
 
-    DTSC::Keys keys(M.keys(audioTrack));
+    DTSC::Keys keys(M.getKeys(audioTrack));
     uint32_t keyIdx = M.getKeyIndexForTime(audioTrack, seekTime);
     // We minus the filePos by one, since we init it 1 higher
     inFile.seek(keys.getBpos(keyIdx)-1);
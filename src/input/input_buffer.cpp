@@ -206,7 +206,7 @@ namespace Mist{
       }else{
         if (initData.count(i)){meta.setInit(i, initData[i]);}
       }
-      DTSC::Fragments fragments(M.fragments(i));
+      DTSC::Fragments fragments(M.getFragments(i));
       if (fragments.getEndValid() < fragCount){fragCount = fragments.getEndValid();}
       if (M.getFirstms(i) < firstms){firstms = M.getFirstms(i);}
       if (M.getLastms(i) > lastms){lastms = M.getLastms(i);}
@@ -279,13 +279,13 @@ namespace Mist{
   /// * less than 8 times the biggest fragment duration is buffered
   /// If a key was deleted and the first buffered data page is no longer used, it is deleted also.
   bool inputBuffer::removeKey(size_t tid){
-    DTSC::Keys keys(M.keys(tid));
+    DTSC::Keys keys(M.getKeys(tid));
     // If this track is empty, abort
     if (!keys.getValidCount()){return false;}
     // the following checks only run if we're not shutting down
     if (config->is_active){
       // Make sure we have at least 4 whole fragments at all times,
-      DTSC::Fragments fragments(M.fragments(tid));
+      DTSC::Fragments fragments(M.getFragments(tid));
       if (fragments.getValidCount() < 5){return false;}
       // ensure we have each fragment buffered for at least the whole bufferTime
       if ((M.getLastms(tid) - M.getFirstms(tid)) < bufferTime){return false;}
@@ -420,7 +420,7 @@ namespace Mist{
     for (std::set<size_t>::iterator idx = tracks.begin(); idx != tracks.end(); idx++){
       size_t i = *idx;
       std::string type = M.getType(i);
-      DTSC::Keys keys(M.keys(i));
+      DTSC::Keys keys(M.getKeys(i));
       // non-video tracks need to have a second keyframe that is <= firstVideo
       // firstVideo = 1 happens when there are no tracks, in which case we don't care any more
       uint32_t firstKey = keys.getFirstValid();
@@ -438,6 +438,9 @@ namespace Mist{
         if (!removeKey(i)){break;}
       }
     }
+    // Drop any cached segments of data that is no longer buffered
+    if (!segCache){segCache.open(streamName, false);}
+    segCache.evictStale(M);
     updateMeta();
   }
 
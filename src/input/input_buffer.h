@@ -1,6 +1,7 @@
 #include "input.h"
 #include <fstream>
 #include <mist/dtsc.h>
+#include <mist/segment_cache.h>
 #include <mist/shared_memory.h>
 
 namespace Mist{
@@ -25,6 +26,7 @@ namespace Mist{
     uint8_t resumeMode;
     uint64_t maxKeepAway;
     IPC::semaphore *liveMeta;
+    SegmentCache::Index segCache;
 
   protected:
     // Private Functions
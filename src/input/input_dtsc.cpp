@@ -8,7 +8,10 @@
 #include <string>
 
 #include <mist/bitfields.h>
+#include <mist/dtsc_mux.h>
+#include <mist/procs.h>
 #include <mist/util.h>
+#include <unistd.h>
 
 #include "input_dtsc.h"
 
@@ -69,7 +72,20 @@ namespace Mist{
     capa["optional"]["maxkeepaway"]["default"] = 7500;
     /*LTS-END*/
 
+    capa["optional"]["mux"]["name"] = "Share connection to origin";
+    capa["optional"]["mux"]["help"] = "Pull over a single connection shared with all other streams "
+                                      "pulled from the same origin with this option enabled, instead "
+                                      "of a separate connection for this stream. Not available for "
+                                      "dtscs:// sources.";
+    capa["optional"]["mux"]["option"] = "--mux";
+    option.null();
+    option["long"] = "mux";
+    option["short"] = "M";
+    option["help"] = "Pull over a single connection shared with other streams from the same origin";
+    config->addOption("mux", option);
+
     F = NULL;
+    packetInBuffer = 0;
     lockCache = false;
     lockNeeded = false;
   }
@@ -146,31 +162,33 @@ namespace Mist{
   void inputDTSC::parseStreamHeader(){
     while (srcConn.connected() && config->is_active){
       srcConn.spool();
-      if (!srcConn.Received().available(8)){
+      const char *hdr = srcConn.Received().peek(8);
+      if (!hdr){
         Util::sleep(100);
         keepAlive();
         continue;
       }
 
-      if (srcConn.Received().copy(4) != "DTCM" && srcConn.Received().copy(4) != "DTSC"){
-        INFO_MSG("Received a wrong type of packet - '%s'", srcConn.Received().copy(4).c_str());
+      if (memcmp(hdr, "DTCM", 4) && memcmp(hdr, "DTSC", 4)){
+        INFO_MSG("Received a wrong type of packet - '%s'", std::string(hdr, 4).c_str());
         break;
       }
       // Command message
-      std::string toRec = srcConn.Received().copy(8);
-      uint32_t rSize = Bit::btohl(toRec.c_str() + 4);
-      if (!srcConn.Received().available(8 + rSize)){
+      uint32_t rSize = Bit::btohl(hdr + 4);
+      bool isCmd = !memcmp(hdr, "DTCM", 4);
+      const char *dataPacket = srcConn.Received().peek(8 + rSize);
+      if (!dataPacket){
         keepAlive();
         Util::sleep(100);
         continue; // abort - not enough data yet
       }
       // Ignore initial DTCM message, as this is a "hi" message from the server
-      if (srcConn.Received().copy(4) == "DTCM"){
-        srcConn.Received().remove(8 + rSize);
+      if (isCmd){
+        srcConn.Received().skip(8 + rSize);
         continue;
       }
-      std::string dataPacket = srcConn.Received().remove(8 + rSize);
-      DTSC::Packet metaPack(dataPacket.data(), dataPacket.size());
+      DTSC::Packet metaPack(dataPacket, 8 + rSize);
+      srcConn.Received().skip(8 + rSize);
       DTSC::Meta nM("", metaPack.getScan());
       meta.reInit(streamName, false);
       if (!meta){
@@ -191,6 +209,7 @@ namespace Mist{
   }
 
   bool inputDTSC::openStreamSource(){
+    packetInBuffer = 0;
     std::string source = config->getString("input");
     if (source == "-"){
       srcConn.open(fileno(stdout), fileno(stdin));
@@ -210,8 +229,18 @@ namespace Mist{
     parseDTSCURI(source, host, port, password, streamName, secure);
     std::string givenStream = config->getString("streamname");
     if (streamName == ""){streamName = givenStream;}
-    srcConn.open(host, port, true, secure);
+    srcConn.drop();
+    if (config->getBool("mux")){
+      if (secure){
+        WARN_MSG("Connections to dtscs:// sources cannot be shared; connecting directly");
+      }else if (!openMuxSource(host, port)){
+        WARN_MSG("Could not share the connection to %s:%" PRIu16 "; connecting directly", host.c_str(), port);
+      }
+    }
+    if (!srcConn){srcConn.open(host, port, true, secure);}
     srcConn.Received().splitter.clear();
+    // Packets are parsed in place from the receive buffer, so read them in large blocks
+    srcConn.setReadSize(64 * 1024);
     if (!srcConn.connected()){return false;}
     JSON::Value prep;
     prep["cmd"] = "play";
@@ -225,7 +254,47 @@ namespace Mist{
     return true;
   }
 
-  void inputDTSC::closeStreamSource(){srcConn.close();}
+  /// Connects srcConn to the process sharing a multiplexed connection to the given origin (see
+  /// DTSC::Mux), starting that process first if there is none yet. Over it, the regular DTSC
+  /// protocol is spoken as if connected to the origin directly.
+  /// Returns true if connected.
+  bool inputDTSC::openMuxSource(const std::string &host, uint16_t port){
+    std::string path = DTSC::muxSocket(host, port);
+    if (!access(path.c_str(), F_OK)){
+      srcConn.open(path, true);
+      if (srcConn){
+        srcConn.setHost(host);
+        return true;
+      }
+    }
+    std::string relay = Util::getMyPath() + "MistUtilDTSCMux";
+    std::string portStr = JSON::Value((uint64_t)port).asString();
+    char *argv[] ={(char *)relay.c_str(), (char *)host.c_str(), (char *)portStr.c_str(), 0};
+    int err = fileno(stderr);
+    pid_t pid = Util::Procs::StartPiped(argv, 0, 0, &err);
+    if (!pid){
+      FAIL_MSG("Could not start %s", relay.c_str());
+      return false;
+    }
+    // The shared connection outlives this input, serving the other inputs using it
+    Util::Procs::forget(pid);
+    // Another input may have started one at the same time; either way, wait for one to listen
+    for (size_t i = 0; i < 50 && config->is_active; ++i){
+      Util::sleep(100);
+      if (access(path.c_str(), F_OK)){continue;}
+      srcConn.open(path, true);
+      if (srcConn){
+        srcConn.setHost(host);
+        return true;
+      }
+    }
+    return false;
+  }
+
+  void inputDTSC::closeStreamSource(){
+    packetInBuffer = 0;
+    srcConn.close();
+  }
 
   bool inputDTSC::checkArguments(){
     if (!needsLock()){return true;}
@@ -356,8 +425,19 @@ namespace Mist{
     fseek(F, thisPos.bytePos, SEEK_SET);
   }
 
+  /// Reads the next packet from the source connection into thisPacket.
+  /// Packets are used in place in the receive buffer, so that buffering them into the live pages is
+  /// their only copy. The previous packet is done with by now, and is skipped first.
+  void inputDTSC::readStreamPacket(){
+    if (packetInBuffer){
+      srcConn.Received().skip(packetInBuffer);
+      packetInBuffer = 0;
+    }
+    packetInBuffer = thisPacket.reInitInPlace(srcConn);
+  }
+
   void inputDTSC::getNextFromStream(size_t idx){
-    thisPacket.reInit(srcConn);
+    readStreamPacket();
     while (config->is_active){
       if (thisPacket.getVersion() == DTSC::DTCM){
         // userClient.keepAlive();
@@ -365,14 +445,14 @@ namespace Mist{
         thisPacket.getString("cmd", cmd);
         if (cmd == "reset"){
           // Read next packet
-          thisPacket.reInit(srcConn);
+          readStreamPacket();
           if (thisPacket.getVersion() != DTSC::DTSC_HEAD){
             meta.clear();
             continue;
           }
           DTSC::Meta nM("", thisPacket.getScan());
           meta.merge(nM, true, false);
-          thisPacket.reInit(srcConn); // read the next packet before continuing
+          readStreamPacket(); // read the next packet before continuing
           continue;                   // parse the next packet before returning
         }
         if (cmd == "error"){
@@ -382,7 +462,7 @@ namespace Mist{
           return;
         }
         if (cmd == "ping"){
-          thisPacket.reInit(srcConn);
+          readStreamPacket();
           JSON::Value prep;
           prep["cmd"] = "ok";
           prep["msg"] = "Pong!";
@@ -394,13 +474,13 @@ namespace Mist{
           continue;
         }
         INFO_MSG("Unhandled command: %s", cmd.c_str());
-        thisPacket.reInit(srcConn);
+        readStreamPacket();
         continue;
       }
       if (thisPacket.getVersion() == DTSC::DTSC_HEAD){
         DTSC::Meta nM("", thisPacket.getScan());
         meta.merge(nM, false, false);
-        thisPacket.reInit(srcConn); // read the next packet before continuing
+        readStreamPacket(); // read the next packet before continuing
         continue;                   // parse the next packet before returning
       }
       thisTime = thisPacket.getTime();
@@ -408,7 +488,7 @@ namespace Mist{
       if (thisPacket.getFlag("keyframe") && M.trackValid(thisIdx)){
         uint32_t shrtest_key = 0xFFFFFFFFul;
         uint32_t longest_key = 0;
-        DTSC::Keys Mkeys(M.keys(thisIdx));
+        DTSC::Keys Mkeys(M.getKeys(thisIdx));
         uint32_t firstKey = Mkeys.getFirstValid();
         uint32_t endKey = Mkeys.getEndValid();
         uint32_t checkKey = (endKey-firstKey <= 3)?firstKey:endKey-3;
@@ -463,7 +543,7 @@ namespace Mist{
       tmpPos.bytePos = 0;
       tmpPos.seekTime = 0;
     }
-    DTSC::Keys keys(M.keys(trackIdx));
+    DTSC::Keys keys(M.getKeys(trackIdx));
     uint32_t keyNum = M.getKeyNumForTime(trackIdx, ms);
     if (keys.getTime(keyNum) > tmpPos.seekTime){
       tmpPos.seekTime = keys.getTime(keyNum);
@@ -35,6 +35,7 @@ namespace Mist{
   protected:
     // Private Functions
     bool openStreamSource();
+    bool openMuxSource(const std::string &host, uint16_t port);
     void closeStreamSource();
     void parseStreamHeader();
     bool checkArguments();
@@ -42,11 +43,13 @@ namespace Mist{
     bool needHeader();
     void getNext(size_t idx = INVALID_TRACK_ID);
     void getNextFromStream(size_t idx = INVALID_TRACK_ID);
+    void readStreamPacket();
     void seek(uint64_t seekTime, size_t idx = INVALID_TRACK_ID);
 
     FILE *F;
 
     Socket::Connection srcConn;
+    uint32_t packetInBuffer; ///< Bytes of thisPacket still in the receive buffer of srcConn
 
     bool lockCache;
     bool lockNeeded;
@@ -709,7 +709,7 @@ namespace Mist{
     bufferedPacks = 0;
     uint64_t mainTrack = M.mainTrack();
 
-    DTSC::Keys keys(M.keys(mainTrack));
+    DTSC::Keys keys(M.getKeys(mainTrack));
     DTSC::Parts parts(M.parts(mainTrack));
     uint64_t seekPos = keys.getBpos(0);
     // Replay the parts of the previous keyframe, so the timestaps match up
@@ -327,7 +327,7 @@ namespace Mist{
     flacBuffer.clear();
     stopProcessing = false;
     stopFilling = false;
-    DTSC::Keys keys(M.keys(mainTrack));
+    DTSC::Keys keys(M.getKeys(mainTrack));
     DTSC::Parts parts(M.parts(mainTrack));
     uint64_t seekPos = keys.getBpos(0);
     uint64_t seekKeyTime = keys.getTime(0);
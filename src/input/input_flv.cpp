@@ -299,7 +299,7 @@ namespace Mist{
     // keyframe. Flv files are never multi-track, so track 1 is video, track 2 is audio.
     size_t seekTrack = (idx == INVALID_TRACK_ID ? M.mainTrack() : idx);
     uint32_t keyNum = M.getKeyNumForTime(seekTrack, seekTime);
-    if (!slideWindowTo(DTSC::Keys(M.keys(seekTrack)).getBpos(keyNum), 4)){
+    if (!slideWindowTo(DTSC::Keys(M.getKeys(seekTrack)).getBpos(keyNum), 4)){
       WARN_MSG("Failed to seek to %" PRIu64, seekTime);
     }
   }
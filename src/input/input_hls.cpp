@@ -1197,7 +1197,7 @@ namespace Mist{
 
     unsigned long plistEntry = 0;
 
-    DTSC::Keys keys(M.keys(idx));
+    DTSC::Keys keys(M.getKeys(idx));
     for (size_t i = keys.getFirstValid(); i < keys.getEndValid(); i++){
       if (keys.getTime(i) > seekTime){
         VERYHIGH_MSG("Found elapsed key with a time of %" PRIu64 " ms at playlist index %zu while seeking", keys.getTime(i), keys.getBpos(i)-1);
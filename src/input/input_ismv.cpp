@@ -137,7 +137,7 @@ namespace Mist{
 
     // For each selected track
     for (std::set<size_t>::iterator it = validTracks.begin(); it != validTracks.end(); ++it){
-      DTSC::Keys keys(M.keys(*it));
+      DTSC::Keys keys(M.getKeys(*it));
       uint32_t i;
       for (i = keys.getFirstValid(); i < keys.getEndValid(); i++){
         if (keys.getTime(i) >= seekTime){break;}
@@ -214,7 +214,7 @@ namespace Mist{
   void inputISMV::bufferFragmentData(size_t trackId, uint32_t keyNum){
     INFO_MSG("Bpos seek for %zu/%" PRIu32, trackId, keyNum);
     if (trackId == INVALID_TRACK_ID){return;}
-    DTSC::Keys keys(M.keys(trackId));
+    DTSC::Keys keys(M.getKeys(trackId));
     INFO_MSG("Key %" PRIu32 " / %zu", keyNum, keys.getEndValid());
     if (keyNum >= keys.getEndValid()){return;}
     uint64_t currentPosition = keys.getBpos(keyNum);
@@ -154,7 +154,7 @@ namespace Mist{
 
   void inputMP3::seek(uint64_t seekTime, size_t idx){
     idx = 0;
-    DTSC::Keys keys(M.keys(idx));
+    DTSC::Keys keys(M.getKeys(idx));
     uint32_t keyNum = M.getKeyNumForTime(idx, seekTime);
     fseek(inFile, keys.getBpos(keyNum), SEEK_SET);
     timestamp = keys.getTime(keyNum);
@@ -572,7 +572,7 @@ namespace Mist{
     curPositions.erase(curPositions.begin());
 
     bool isKeyframe = false;
-    DTSC::Keys keys(M.keys(curPart.trackID));
+    DTSC::Keys keys(M.getKeys(curPart.trackID));
     DTSC::Parts parts(M.parts(curPart.trackID));
     uint32_t nextKeyNum = nextKeyframe[curPart.trackID];
     if (nextKeyNum < keys.getEndValid()){
@@ -643,7 +643,7 @@ namespace Mist{
       std::string tmpStr = thisPack.toNetPacked();
       thisPacket.reInit(tmpStr.data(), tmpStr.size());
     }else{
-      thisPacket.genericFill(curPart.time, curPart.offset, curPart.trackID, readBuffer + (curPart.bpos-readPos), curPart.size, 0, isKeyframe);
+      thisPacket.genericFill(curPart.time, curPart.offset, curPart.trackID, readBuffer + (curPart.bpos-readPos), curPart.size, curPart.bpos, isKeyframe);
     }
     thisTime = curPart.time;
     thisIdx = curPart.trackID;
@@ -680,7 +680,7 @@ namespace Mist{
     // for all stsz samples in those tracks
     mp4TrackHeader &thisHeader = headerData(M.getID(idx));
     size_t headerDataSize = thisHeader.size();
-    DTSC::Keys keys(M.keys(idx));
+    DTSC::Keys keys(M.getKeys(idx));
     DTSC::Parts parts(M.parts(idx));
     for (size_t i = 0; i < headerDataSize; i++){
 
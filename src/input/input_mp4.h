@@ -83,6 +83,7 @@ namespace Mist{
     void getNext(size_t idx = INVALID_TRACK_ID);
     void seek(uint64_t seekTime, size_t idx = INVALID_TRACK_ID);
     void handleSeek(uint64_t seekTime, size_t idx);
+    virtual bool parallelBuffering(){return inFile.isMapped();}
 
     HTTP::URIReader inFile;
     Util::ResizeablePointer readBuffer;
@@ -401,7 +401,7 @@ namespace Mist{
       // find first keyframe before keyframe with ms > seektime
       position tmpPos;
       tmpPos.trackID = it->first;
-      DTSC::Keys keys(M.keys(it->first));
+      DTSC::Keys keys(M.getKeys(it->first));
       tmpPos.time = keys.getTime(keys.getFirstValid());
       tmpPos.bytepos = keys.getBpos(keys.getFirstValid());
       for (size_t i = keys.getFirstValid(); i < keys.getEndValid(); ++i){
@@ -26,6 +26,8 @@ TS::Stream liveStream;
 Util::Config *cfgPointer = NULL;
 
 #define THREAD_TIMEOUT 15
+/// Amount of bytes to read per call when reading live TS data; a whole amount of TS packets
+#define TS_READ_BLOCK (188 * 348)
 std::map<size_t, uint64_t> threadTimer;
 
 std::set<size_t> claimableThreads;
@@ -367,8 +369,11 @@ namespace Mist{
   void inputTS::dataCallback(const char *ptr, size_t size){
     if (standAlone){
       unitStartSeen |= assembler.assemble(tsStream, ptr, size, true, readPos);
-    }else{
+    }else if (rawMode){
       liveReadBuffer.append(ptr, size);
+    }else{
+      // Live data is fed to the stream straight from the reader's buffer
+      assembler.assemble(liveStream, ptr, size);
     }
     readPos += size;
   }
@@ -503,13 +508,13 @@ namespace Mist{
     uint64_t seekPos = 0xFFFFFFFFull;
     if (idx != INVALID_TRACK_ID){
       uint32_t keyNum = M.getKeyNumForTime(idx, seekTime);
-      DTSC::Keys keys(M.keys(idx));
+      DTSC::Keys keys(M.getKeys(idx));
       seekPos = keys.getBpos(keyNum);
     }else{
       std::set<size_t> tracks = M.getValidTracks();
       for (std::set<size_t>::iterator it = tracks.begin(); it != tracks.end(); it++){
         uint32_t keyNum = M.getKeyNumForTime(*it, seekTime);
-        DTSC::Keys keys(M.keys(*it));
+        DTSC::Keys keys(M.getKeys(*it));
         uint64_t thisBPos = keys.getBpos(keyNum);
         if (thisBPos < seekPos){seekPos = thisBPos;}
       }
@@ -544,42 +549,30 @@ namespace Mist{
     while (config->is_active){
       if (!udpMode){
         uint64_t prePos = readPos;
-        reader.readSome(188, *this);
+        reader.readSome(TS_READ_BLOCK, *this);
         if (readPos == prePos){
           Util::sleep(50);
         }else{
-          while (liveReadBuffer.size() >= 188){
-            while (liveReadBuffer[0] != 0x47 && liveReadBuffer.size() >= 188){
-              liveReadBuffer.shift(1);
+          if (rawMode){
+            keepAlive();
+            // Skip to the first sync byte, in one go
+            if (liveReadBuffer.size() && liveReadBuffer[0] != 0x47){
+              liveReadBuffer.shift(TS::findSync(liveReadBuffer, liveReadBuffer.size()));
             }
-            if (liveReadBuffer.size() >= 188 && liveReadBuffer[0] == 0x47){
-              if (rawMode){
-                keepAlive();
-                if (liveReadBuffer.size() >= 1316 && (lastRawPacket == 0 || lastRawPacket != Util::bootMS())){
-                  if (rawIdx == INVALID_TRACK_ID){
-                    rawIdx = meta.addTrack();
-                    meta.setType(rawIdx, "meta");
-                    meta.setCodec(rawIdx, "rawts");
-                    meta.setID(rawIdx, 1);
-                    userSelect[rawIdx].reload(streamName, rawIdx, COMM_STATUS_SOURCE);
-                  }
-                  uint64_t packetTime = Util::bootMS();
-                  uint64_t packetLen = (liveReadBuffer.size() / 188) * 188;
-                  thisPacket.genericFill(packetTime, 0, 1, liveReadBuffer, packetLen, 0, 0);
-                  bufferLivePacket(thisPacket);
-                  lastRawPacket = packetTime;
-                  liveReadBuffer.shift(packetLen);
-                }
-              }else {
-                size_t shiftAmount = 0;
-                for (size_t offset = 0; liveReadBuffer.size() >= offset + 188; offset += 188){
-                  tsBuf.FromPointer(liveReadBuffer + offset);
-                  liveStream.add(tsBuf);
-                  if (!liveStream.isDataTrack(tsBuf.getPID())){liveStream.parse(tsBuf.getPID());}
-                  shiftAmount += 188;
-                }
-                liveReadBuffer.shift(shiftAmount);
+            if (liveReadBuffer.size() >= 1316 && (lastRawPacket == 0 || lastRawPacket != Util::bootMS())){
+              if (rawIdx == INVALID_TRACK_ID){
+                rawIdx = meta.addTrack();
+                meta.setType(rawIdx, "meta");
+                meta.setCodec(rawIdx, "rawts");
+                meta.setID(rawIdx, 1);
+                userSelect[rawIdx].reload(streamName, rawIdx, COMM_STATUS_SOURCE);
               }
+              uint64_t packetTime = Util::bootMS();
+              uint64_t packetLen = (liveReadBuffer.size() / 188) * 188;
+              thisPacket.genericFill(packetTime, 0, 1, liveReadBuffer, packetLen, 0, 0);
+              bufferLivePacket(thisPacket);
+              lastRawPacket = packetTime;
+              liveReadBuffer.shift(packetLen);
             }
           }
           noDataSince = Util::bootSecs();
@@ -43,7 +43,6 @@ namespace Mist{
     TS::Stream tsStream; ///< Used for parsing the incoming ts stream
     Socket::UDPConnection udpCon;
     HTTP::URIReader reader;
-    TS::Packet tsBuf;
     pid_t inputProcess;
     bool isFinished;
 
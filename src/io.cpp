@@ -233,15 +233,16 @@ namespace Mist{
     Util::RelAccX &tPages = aMeta.pages(packTrack);
     uint32_t pageIdx = 0;
     uint32_t currPagNum = atoi(page.name.data() + page.name.rfind('_') + 1);
-    Util::RelAccXFieldData firstkey = tPages.getFieldData("firstkey");
+    Util::RelAccXTypedField<uint32_t> firstkey = tPages.getFieldData("firstkey");
+    Util::RelAccXTypedField<uint32_t> avail = tPages.getFieldData("avail");
     for (uint64_t i = tPages.getDeleted(); i < tPages.getEndPos(); i++){
-      if (tPages.getInt(firstkey, i) == currPagNum){
+      if (firstkey.get(tPages, i) == currPagNum){
         pageIdx = i;
         break;
       }
     }
     // Save the current write position
-    uint64_t pageOffset = tPages.getInt("avail", pageIdx);
+    uint64_t pageOffset = avail.get(tPages, pageIdx);
     uint64_t pageSize = tPages.getInt("size", pageIdx);
     INSANE_MSG("Current packet %" PRIu64 " on track %" PRIu32 " has an offset on page %s of %" PRIu64, packTime, packTrack, page.name.c_str(), pageOffset);
     // Do nothing when there is not enough free space on the page to add the packet.
@@ -294,7 +295,7 @@ namespace Mist{
     memcpy(page.mapped + pageOffset, "DTP2", 4);
 
     DONTEVEN_MSG("Setting page %" PRIu32 " available to %" PRIu64, pageIdx, pageOffset + packDataLen);
-    tPages.setInt("avail", pageOffset + packDataLen, pageIdx);
+    avail.set(tPages, pageOffset + packDataLen, pageIdx);
   }
 
   /// Wraps up the buffering of a shared memory data page
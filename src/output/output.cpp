@@ -113,6 +113,7 @@ namespace Mist{
     firstData = true;
     newUA = true;
     lastPushUpdate = 0;
+    selectGeneration = 0;
     Util::Config::binaryType = Util::OUTPUT;
 
     lastRecv = Util::bootSecs();
@@ -272,7 +273,7 @@ namespace Mist{
 
     size_t trkCount = 0;
     for (std::set<size_t>::iterator it = trks.begin(); it != trks.end(); ++it){
-      DTSC::Keys keys(M.keys(*it));
+      DTSC::Keys keys(M.getKeys(*it));
       if (keys.getValidCount() >= minKeys || M.getLastms(*it) - M.getFirstms(*it) > minMs){
         ++trkCount;
         if (trkCount >= minTracks){return true;}
@@ -404,6 +405,15 @@ namespace Mist{
     return Util::getSupportedTracks(M, capa, type);
   }
 
+  /// Returns true if the metadata changed in a way that may affect the track selection since the
+  /// last call to this function or selectDefaultTracks(). Cheap enough to call for every packet.
+  bool Output::metaChanged(){
+    uint64_t gen = M.getGeneration();
+    if (gen == selectGeneration){return false;}
+    selectGeneration = gen;
+    return true;
+  }
+
   /// Automatically selects the tracks that are possible and/or wanted.
   /// Returns true if the track selection changed in any way.
   bool Output::selectDefaultTracks(){
@@ -413,6 +423,7 @@ namespace Mist{
     }
 
     meta.reloadReplacedPagesIfNeeded();
+    selectGeneration = M.getGeneration();
     if (!M){
       userSelect.clear();
       buffer.clear();
@@ -522,7 +533,7 @@ namespace Mist{
     }
     //Abort if the track is not loaded
     if (!M.trackLoaded(trk)){return 0;}
-    const DTSC::Keys &keys = M.keys(trk);
+    const DTSC::Keys &keys = M.getKeys(trk);
     //Abort if there are no keys
     if (!keys.getValidCount()){return 0;}
     //Get the key for the current time
@@ -534,28 +545,11 @@ namespace Mist{
   }
 
   uint64_t Output::pageNumForKey(size_t trackId, size_t keyNum){
-    const Util::RelAccX &tPages = M.pages(trackId);
-    for (uint64_t i = tPages.getDeleted(); i < tPages.getEndPos(); i++){
-      uint64_t pageNum = tPages.getInt("firstkey", i);
-      if (pageNum > keyNum) continue;
-      uint64_t pageKeys = tPages.getInt("keycount", i);
-      if (keyNum > pageNum + pageKeys - 1) continue;
-      uint64_t pageAvail = tPages.getInt("avail", i);
-      return pageAvail == 0 ? INVALID_KEY_NUM : pageNum;
-    }
-    return INVALID_KEY_NUM;
+    return M.getAvailablePageForKey(trackId, keyNum);
   }
 
   /// Gets the highest page number available for the given trackId.
-  uint64_t Output::pageNumMax(size_t trackId){
-    const Util::RelAccX &tPages = M.pages(trackId);
-    uint64_t highest = 0;
-    for (uint64_t i = tPages.getDeleted(); i < tPages.getEndPos(); i++){
-      uint64_t pageNum = tPages.getInt("firstkey", i);
-      if (pageNum > highest){highest = pageNum;}
-    }
-    return highest;
-  }
+  uint64_t Output::pageNumMax(size_t trackId){return M.getHighestPageNumber(trackId);}
 
   void Output::initSegmenter(std::string &origTarget){
     if (targetParams.count("maxEntries")){
@@ -945,7 +939,7 @@ namespace Mist{
       return;
     }
     if (!M.trackLoaded(trackId)){meta.reloadReplacedPagesIfNeeded();}
-    DTSC::Keys keys(M.keys(trackId));
+    DTSC::Keys keys(M.getKeys(trackId));
     if (!keys.getValidCount()){
       WARN_MSG("Load for track %zu key %zu aborted - track is empty", trackId, keyNum);
       return;
@@ -1100,7 +1094,7 @@ namespace Mist{
         return seek(pos);
       }
       if (M.getType(mainTrack) == "video"){
-        DTSC::Keys keys(M.keys(mainTrack));
+        DTSC::Keys keys(M.getKeys(mainTrack));
         uint32_t keyNum = M.getKeyNumForTime(mainTrack, pos);
         if (keyNum == INVALID_KEY_NUM){
           FAIL_MSG("Attempted seek on empty track %zu", mainTrack);
@@ -1155,7 +1149,7 @@ namespace Mist{
       userSelect.erase(tid);
       return false;
     }
-    DTSC::Keys keys(M.keys(tid));
+    DTSC::Keys keys(M.getKeys(tid));
     if (M.getLive() && !pos && !buffer.getSyncMode()){
       uint64_t tmpTime = (M.getFirstms(tid) + M.getLastms(tid))/2;
       uint32_t tmpKey = M.getKeyNumForTime(tid, tmpTime);
@@ -1243,7 +1237,7 @@ namespace Mist{
     if (meta.getLive()){
       size_t mainTrack = getMainSelectedTrack();
       if (mainTrack == INVALID_TRACK_ID){return;}
-      DTSC::Keys keys(M.keys(mainTrack));
+      DTSC::Keys keys(M.getKeys(mainTrack));
       if (!keys.getValidCount()){return;}
       // seek to the newest keyframe, unless that is <5s, then seek to the oldest keyframe
       uint32_t firstKey = keys.getFirstValid();
@@ -1550,7 +1544,7 @@ namespace Mist{
     }
     // cancel if there are no keys in the main track
     if (mainTrack == INVALID_TRACK_ID){return false;}
-    DTSC::Keys mainKeys(meta.keys(mainTrack));
+    DTSC::Keys mainKeys(meta.getKeys(mainTrack));
     if (!mainKeys.getValidCount()){return false;}
 
     for (uint32_t keyNum = mainKeys.getEndValid() - 1; keyNum >= mainKeys.getFirstValid(); keyNum--){
@@ -2025,7 +2019,7 @@ namespace Mist{
     userSelect.clear();
     userSelect[mainTrack].reload(streamName, mainTrack);
     // now, seek to the exact timestamp of the keyframe
-    DTSC::Keys keys(M.keys(mainTrack));
+    DTSC::Keys keys(M.getKeys(mainTrack));
     uint32_t targetKey = M.getKeyNumForTime(mainTrack, currTime);
     bool ret = false;
     if (targetKey == INVALID_KEY_NUM){
@@ -2217,7 +2211,7 @@ namespace Mist{
       uint32_t thisKey = M.getKeyNumForTime(nxt.tid, nxt.time);
       uint32_t nextKeyPage = INVALID_KEY_NUM;
       //Make sure we only try to read the page for the next key if it actually should be available
-      DTSC::Keys keys(M.keys(nxt.tid));
+      DTSC::Keys keys(M.getKeys(nxt.tid));
       if (keys.getEndValid() >= thisKey+1){nextKeyPage = M.getPageNumberForKey(nxt.tid, thisKey + 1);}
       if (nextKeyPage != INVALID_KEY_NUM && nextKeyPage != currentPage[nxt.tid]){
         // If so, the next key is our next packet
@@ -2228,7 +2222,7 @@ namespace Mist{
           //Re-try the read in ~50ms, hoping this is a race condition we missed somewhere.
           Util::sleep(50);
           meta.reloadReplacedPagesIfNeeded();
-          DTSC::Keys keys(M.keys(nxt.tid));
+          DTSC::Keys keys(M.getKeys(nxt.tid));
           nextTime = keys.getTime(thisKey + 1);
           //Still wrong? Abort, abort!
           if (nextTime < nxt.time){
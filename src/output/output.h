@@ -44,6 +44,7 @@ namespace Mist{
     uint64_t endTime();
     void setBlocking(bool blocking);
     bool selectDefaultTracks();
+    bool metaChanged();
     bool connectToFile(std::string file, bool append = false, Socket::Connection *conn = 0);
     static bool listenMode(){return true;}
     uint32_t currTrackCount() const;
@@ -103,6 +104,7 @@ namespace Mist{
     uint64_t lastPushUpdate;
     uint64_t outputStartMs; ///< bootMS() at time of output start (unrelated to media start)
     bool newUA;
+    uint64_t selectGeneration; ///< Metadata generation at the time of the last track selection
 
     // Segmenter related internal variables and functions
     void initSegmenter(std::string &origTarget);
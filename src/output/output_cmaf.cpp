@@ -71,7 +71,7 @@ namespace Mist{
     if (!M.getValidTracks().size()){return false;}
     uint32_t mainTrack = M.mainTrack();
     if (mainTrack == INVALID_TRACK_ID){return false;}
-    DTSC::Fragments fragments(M.fragments(mainTrack));
+    DTSC::Fragments fragments(M.getFragments(mainTrack));
     return fragments.getValidCount() > 6;
   }
 
@@ -203,6 +203,7 @@ namespace Mist{
     capa["optional"]["chunkpath"]["short"] = "e";
     capa["optional"]["chunkpath"]["default"] = "";
 
+    addSegmentCacheOption(cfg);
     config->addStandardPushCapabilities(capa);
     capa["push_urls"].append("cmaf://*");
     capa["push_urls"].append("cmafs://*");
@@ -283,8 +284,8 @@ namespace Mist{
     };
 
     // Fragment & Key handlers
-    DTSC::Fragments fragments(M.fragments(trackData.timingTrackId));
-    DTSC::Keys keys(M.keys(trackData.timingTrackId));
+    DTSC::Fragments fragments(M.getFragments(trackData.timingTrackId));
+    DTSC::Keys keys(M.getKeys(trackData.timingTrackId));
 
     uint32_t bprErrCode = HLS::blockPlaylistReload(M, userSelect, trackData, hlsSpec, fragments, keys);
     if (bprErrCode == 400){
@@ -298,19 +299,24 @@ namespace Mist{
     HLS::FragmentData fragData;
     HLS::populateFragmentData(M, userSelect, fragData, trackData, fragments, keys);
 
+    // Render only when the playlist changed, and only once for everyone without a session token
+    std::string state = HLS::mediaManifestState(M, fragData, trackData, hlsSpec, fragments, keys);
+    uint64_t firstTime = keys.getTime(fragments.getFirstKey(fragments.getFirstValid()));
+    if (sendCachedPlaylist(state, timingTid, firstTime, trackData.sessionId.empty())){return;}
+
     std::stringstream result;
     HLS::addStartingMetaTags(result, fragData, trackData, hlsSpec);
     HLS::addMediaFragments(result, M, fragData, trackData, fragments, keys);
     HLS::addEndingTags(result, M, userSelect, fragData, trackData);
 
-    H.SetBody(result.str());
-    H.SendResponse("200", "OK", myConn);
+    sendPlaylist(result.str());
   }// namespace Mist
 
   void OutCMAF::sendHlsManifest(const std::string url){
     H.setCORSHeaders();
     H.SetHeader("Content-Type", "application/vnd.apple.mpegurl;version=7"); // for .m3u8
-    H.SetHeader("Cache-Control", "no-store");
+    // Media playlists carry an ETag, so clients may keep them as long as they revalidate
+    H.SetHeader("Cache-Control", "no-cache");
     if (H.method == "OPTIONS" || H.method == "HEAD"){
       H.SetBody("");
       H.SendResponse("200", "OK", myConn);
@@ -318,6 +324,7 @@ namespace Mist{
     }
 
     if (url.find("/") == std::string::npos){
+      H.SetHeader("Cache-Control", "no-store");
       sendHlsMasterManifest();
     }else{
       sendHlsMediaManifest(atoll(url.c_str()));
@@ -453,8 +460,13 @@ namespace Mist{
     Bit::htobl(mdatHeader, mdatSize);
 
     H.StartResponse(H, myConn, config->getBool("nonchunked"));
+    std::stringstream segKey;
+    segKey << "CMAF_" << idx << "/" << fragmentIndex << "_" << startTime << "_" << targetTime;
+    if (sendCachedSegment(segKey.str(), idx, startTime)){return;}
     H.Chunkify(headerData.c_str(), headerData.size(), myConn);
     H.Chunkify(mdatHeader, 8, myConn);
+    segment.append(headerData);
+    segment.append(mdatHeader, 8);
 
     seek(startTime);
 
@@ -472,12 +484,14 @@ namespace Mist{
       wantRequest = true;
       parseData = false;
       H.Chunkify("", 0, myConn);
+      segment.finish();
       return;
     }
     char *data;
     size_t dataLen;
     thisPacket.getString("data", data, dataLen);
     H.Chunkify(data, dataLen, myConn);
+    segment.append(data, dataLen);
   }
 
   /***************************************************************************************************/
@@ -505,14 +519,14 @@ namespace Mist{
     size_t mainTrack = *M.getValidTracks().begin(); // M.mainTrack();
 
     if (mainTrack == INVALID_TRACK_ID){return;}
-    DTSC::Fragments fragments(M.fragments(mainTrack));
+    DTSC::Fragments fragments(M.getFragments(mainTrack));
     uint32_t firstFragment = fragments.getFirstValid();
     uint32_t lastFragment = fragments.getEndValid();
     bool first = true;
     // skip the first two fragments if live
     if (M.getLive() && (lastFragment - firstFragment) > 6){firstFragment += 2;}
 
-    DTSC::Keys keys(M.keys(mainTrack));
+    DTSC::Keys keys(M.getKeys(mainTrack));
     for (; firstFragment < lastFragment; ++firstFragment){
       uint32_t duration = fragments.getDuration(firstFragment);
       uint64_t starttime = keys.getTime(fragments.getFirstKey(firstFragment));
@@ -567,20 +581,64 @@ namespace Mist{
 
   void OutCMAF::sendDashManifest(){
     std::string method = H.method;
+    std::string known = H.GetHeader("If-None-Match");
     H.Clean();
     H.SetHeader("Content-Type", "application/dash+xml");
-    H.SetHeader("Cache-Control", "no-store");
+    // The MPD carries an ETag, so clients may keep it as long as they revalidate
+    H.SetHeader("Cache-Control", "no-cache");
     H.setCORSHeaders();
     if (method == "OPTIONS" || method == "HEAD"){
       H.SendResponse("200", "OK", myConn);
       H.Clean();
       return;
     }
-    H.SetBody(dashManifest());
-    H.SendResponse("200", "OK", myConn);
+    // Render only when the MPD changed, and only once for everyone: it holds no session data.
+    // sendCachedPlaylist compares the ETag against the request header the clean dropped.
+    size_t track;
+    uint64_t firstTime;
+    std::string state = dashManifestState(track, firstTime);
+    if (known.size()){H.SetHeader("If-None-Match", known);}
+    if (sendCachedPlaylist(state, track, firstTime, true)){
+      H.Clean();
+      return;
+    }
+    sendPlaylist(dashManifest());
     H.Clean();
   }
 
+  /// Returns a string that changes whenever the DASH manifest for the selected tracks would,
+  /// used as key for the shared segment cache and as ETag. Sets track and time to those of the
+  /// first fragment listed in the manifest.
+  std::string OutCMAF::dashManifestState(size_t &track, uint64_t &time){
+    initialize();
+    selectDefaultTracks();
+    std::stringstream r;
+    r << "DASH_" << M.getLive() << "_" << M.getGeneration() << "_" << systemBoot + bootMsOffset;
+    // Track alignment depends on the fragments of every selected track
+    for (std::map<size_t, Comms::Users>::iterator it = userSelect.begin(); it != userSelect.end();
+         it++){
+      DTSC::Fragments fragments(M.getFragments(it->first));
+      r << "/" << it->first << "_" << M.getBps(it->first) << "_" << fragments.getFirstValid()
+        << "_" << fragments.getEndValid();
+    }
+    size_t mainTrack = getMainSelectedTrack();
+    r << "/" << mainTrack;
+    if (M.getVod()){r << "_" << M.getDuration(mainTrack);}
+    track = INVALID_TRACK_ID;
+    time = 0;
+    std::set<size_t> validTracks = M.getValidTracks();
+    if (validTracks.size()){
+      // The segment lists are those of this track, see generateSegmentlist
+      track = *validTracks.begin();
+      DTSC::Fragments fragments(M.getFragments(track));
+      DTSC::Keys keys(M.getKeys(track));
+      time = keys.getTime(fragments.getFirstKey(fragments.getFirstValid()));
+      r << "/" << track << "_" << fragments.getFirstValid() << "_" << fragments.getEndValid();
+      if (M.getVod()){r << "_" << M.getFirstms(track) << "_" << M.getLastms(track);}
+    }
+    return r.str();
+  }
+
   void dashSegment(uint64_t start, uint64_t duration, std::stringstream &s, bool first){
     s << "<S ";
     if (first){s << "t=\"" << start << "\" ";}
@@ -686,11 +744,26 @@ namespace Mist{
       r << "type=\"static\" mediaPresentationDuration=\"" << dashTime(mainDuration)
         << "\" minBufferTime=\"PT1.5S\" ";
     }else{
+      // Times only depend on the listed fragments, so equal states render equal manifests:
+      // media time zero is at systemBoot + bootMsOffset, and the manifest last changed when the
+      // fragment at the live edge started.
+      uint64_t firstTime = 0, lastTime = 0;
+      std::set<size_t> validTracks = M.getValidTracks();
+      if (validTracks.size()){
+        size_t listTrack = *validTracks.begin();
+        DTSC::Fragments fragments(M.getFragments(listTrack));
+        DTSC::Keys keys(M.getKeys(listTrack));
+        if (fragments.getEndValid() > fragments.getFirstValid()){
+          firstTime = keys.getTime(fragments.getFirstKey(fragments.getFirstValid()));
+          lastTime = keys.getTime(fragments.getFirstKey(fragments.getEndValid() - 1));
+        }
+      }
+      uint64_t zeroTime = systemBoot + bootMsOffset;
       r << "type=\"dynamic\" minimumUpdatePeriod=\"PT2.0S\" availabilityStartTime=\""
-        << Util::getUTCString(Util::epoch() - M.getLastms(mainTrack) / 1000)
-        << "\" timeShiftBufferDepth=\"" << dashTime(mainDuration)
+        << Util::getUTCString(zeroTime / 1000) << "\" timeShiftBufferDepth=\""
+        << dashTime(lastTime - firstTime)
         << "\" suggestedPresentationDelay=\"PT5.0S\" minBufferTime=\"PT2.0S\" publishTime=\""
-        << Util::getUTCString(Util::epoch()) << "\" ";
+        << Util::getUTCString((zeroTime + lastTime) / 1000) << "\" ";
     }
 
     r << "xmlns:xsi=\"http://www.w3.org/2001/XMLSchema-instance\" ";
@@ -769,7 +842,7 @@ namespace Mist{
   void OutCMAF::smoothAdaptation(const std::string &type, std::set<size_t> tracks,
                                  std::stringstream &r){
     if (!tracks.size()){return;}
-    DTSC::Keys keys(M.keys(*tracks.begin()));
+    DTSC::Keys keys(M.getKeys(*tracks.begin()));
     r << "<StreamIndex Type=\"" << type << "\" QualityLevels=\"" << tracks.size() << "\" Name=\""
       << type << "\" Chunks=\"" << keys.getValidCount() << "\" Url=\"Q({bitrate})/"
       << "chunk_{start_time}.m4s\" ";
@@ -891,7 +964,7 @@ namespace Mist{
     uint64_t mTrk = getMainSelectedTrack();
     size_t currentKey = M.getKeyIndexForTime(mTrk, thisTime);
     uint64_t startTime = Util::bootMS();
-    DTSC::Keys keys(M.keys(mTrk));
+    DTSC::Keys keys(M.getKeys(mTrk));
     while (startTime + maxWait > Util::bootMS() && keepGoing()){
       if (keys.getEndValid() > currentKey + 1 &&
           M.getLastms(thisIdx) >= M.getTimeForKeyIndex(mTrk, currentKey + 1)){
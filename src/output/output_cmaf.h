@@ -44,6 +44,7 @@ namespace Mist{
     bool hasSessionIDs(){return !config->getBool("mergesessions");}
 
     void sendDashManifest();
+    std::string dashManifestState(size_t &track, uint64_t &time);
     void dashAdaptationSet(size_t id, size_t idx, std::stringstream &r);
     void dashRepresentation(size_t id, size_t idx, std::stringstream &r);
     void dashSegmentTemplate(std::stringstream &r);
@@ -1,12 +1,16 @@
 #include "output_dtsc.h"
+#include <cerrno>
 #include <cstdlib>
 #include <cstring>
 #include <mist/auth.h>
 #include <mist/bitfields.h>
 #include <mist/defines.h>
+#include <mist/dtsc_mux.h>
 #include <mist/stream.h>
 #include <mist/triggers.h>
 #include <mist/http_parser.h>
+#include <mist/procs.h>
+#include <sys/socket.h>
 #include <sys/stat.h>
 
 namespace Mist{
@@ -117,19 +121,31 @@ namespace Mist{
   std::string OutDTSC::getStatsName(){return (pushing ? "INPUT:DTSC" : "OUTPUT:DTSC");}
 
   void OutDTSC::sendNext(){
-    DTSC::Packet p(thisPacket, thisIdx+1);
-    myConn.SendNow(p.getData(), p.getDataLen());
+    char *data = thisPacket.getData();
+    uint32_t dataLen = thisPacket.getDataLen();
+    if (thisPacket.getVersion() == DTSC::DTSC_V2 && dataLen >= 12){
+      // Only the track ID differs from the buffered packet: send a rewritten copy of the header,
+      // followed by the rest of the packet straight from the data page.
+      char hdr[12];
+      memcpy(hdr, data, 8);
+      Bit::htobl(hdr + 8, thisIdx + 1);
+      struct iovec vec[2];
+      vec[0].iov_base = hdr;
+      vec[0].iov_len = 12;
+      vec[1].iov_base = data + 12;
+      vec[1].iov_len = dataLen - 12;
+      myConn.SendNow(vec, 2);
+    }else{
+      DTSC::Packet p(thisPacket, thisIdx+1);
+      myConn.SendNow(p.getData(), p.getDataLen());
+    }
     lastActive = Util::epoch();
 
     // If selectable tracks changed, set sentHeader to false to force it to send init data
-    static uint64_t lastMeta = 0;
-    if (Util::epoch() > lastMeta + 5){
-      lastMeta = Util::epoch();
-      if (selectDefaultTracks()){
-        INFO_MSG("Track selection changed - resending headers and continuing");
-        sentHeader = false;
-        return;
-      }
+    if (metaChanged() && selectDefaultTracks()){
+      INFO_MSG("Track selection changed - resending headers and continuing");
+      sentHeader = false;
+      return;
     }
   }
 
@@ -152,11 +168,11 @@ namespace Mist{
   }
 
   void OutDTSC::onRequest(){
-    while (myConn.Received().available(8)){
-      if (myConn.Received().copy(4) == "DTCM"){
+    const char *hdr;
+    while ((hdr = myConn.Received().peek(8))){
+      if (!memcmp(hdr, "DTCM", 4)){
         // Command message
-        std::string toRec = myConn.Received().copy(8);
-        unsigned long rSize = Bit::btohl(toRec.c_str() + 4);
+        unsigned long rSize = Bit::btohl(hdr + 4);
         if (!myConn.Received().available(8 + rSize)){return;}// abort - not enough data yet
         myConn.Received().remove(8);
         std::string dataPacket = myConn.Received().remove(rSize);
@@ -174,6 +190,10 @@ namespace Mist{
           handlePlay(dScan);
           continue;
         }
+        if (dScan.getMember("cmd").asString() == "mux"){
+          handleMux();
+          return;
+        }
         if (dScan.getMember("cmd").asString() == "ping"){
           sendOk("Pong!");
           continue;
@@ -203,7 +223,7 @@ namespace Mist{
             return;
           }
           uint32_t longest_key = 0;
-          DTSC::Keys Mkeys(M.keys(idx));
+          DTSC::Keys Mkeys(M.getKeys(idx));
           uint32_t firstKey = Mkeys.getFirstValid();
           uint32_t endKey = Mkeys.getEndValid();
           for (uint32_t k = firstKey; k+1 < endKey; k++){
@@ -219,14 +239,13 @@ namespace Mist{
           continue;
         }
         WARN_MSG("Unhandled DTCM command: '%s'", dScan.getMember("cmd").asString().c_str());
-      }else if (myConn.Received().copy(4) == "DTSC"){
+      }else if (!memcmp(hdr, "DTSC", 4)){
         // Header packet
         if (!isPushing()){
           onFail("DTSC_HEAD ignored: you are not cleared for pushing data!", true);
           return;
         }
-        std::string toRec = myConn.Received().copy(8);
-        unsigned long rSize = Bit::btohl(toRec.c_str() + 4);
+        unsigned long rSize = Bit::btohl(hdr + 4);
         if (!myConn.Received().available(8 + rSize)){return;}// abort - not enough data yet
         std::string dataPacket = myConn.Received().remove(8 + rSize);
         DTSC::Packet metaPack(dataPacket.data(), dataPacket.size());
@@ -263,19 +282,19 @@ namespace Mist{
         std::stringstream rep;
         rep << "DTSC_HEAD parsed, we went from " << prevTracks << " to " << meta.getValidTracks().size() << " tracks. Bring on those data packets!";
         sendOk(rep.str());
-      }else if (myConn.Received().copy(4) == "DTP2"){
+      }else if (!memcmp(hdr, "DTP2", 4)){
         if (!isPushing()){
           onFail("DTSC_V2 ignored: you are not cleared for pushing data!", true);
           return;
         }
-        // Data packet
-        std::string toRec = myConn.Received().copy(8);
-        unsigned long rSize = Bit::btohl(toRec.c_str() + 4);
-        if (!myConn.Received().available(8 + rSize)){return;}// abort - not enough data yet
-        std::string dataPacket = myConn.Received().remove(8 + rSize);
-        DTSC::Packet inPack(dataPacket.data(), dataPacket.size(), true);
+        // Data packet, read in place from the receive buffer
+        unsigned long rSize = Bit::btohl(hdr + 4);
+        const char *dataPacket = myConn.Received().peek(8 + rSize);
+        if (!dataPacket){return;}// abort - not enough data yet
+        DTSC::Packet inPack(dataPacket, 8 + rSize, true);
         size_t tid = M.trackIDToIndex(inPack.getTrackId(), getpid());
         if (tid == INVALID_TRACK_ID){
+          myConn.Received().skip(8 + rSize);
           //WARN_MSG("Received data for unknown track: %zu", inPack.getTrackId());
           onFail("DTSC_V2 received for a track that was not announced in a header!", true);
           return;
@@ -287,6 +306,7 @@ namespace Mist{
         size_t dataLen;
         inPack.getString("data", data, dataLen);
         bufferLivePacket(inPack.getTime(), inPack.getInt("offset"), tid, data, dataLen, inPack.getInt("bpos"), inPack.getFlag("keyframe"));
+        myConn.Received().skip(8 + rSize);
       }else{
         // Invalid
         onFail("Invalid packet header received. Aborting.", true);
@@ -310,6 +330,58 @@ namespace Mist{
     setBlocking(false);
   }
 
+  /// Serves a multiplexed session (see DTSC::Mux) over this connection until it closes.
+  /// Every channel the other end opens is served by a forked child process over a socket pair,
+  /// exactly as if it were a separate DTSC connection from the same host.
+  void OutDTSC::handleMux(){
+    JSON::Value prep;
+    prep["cmd"] = "mux";
+    prep["version"] = APPIDENT;
+    sendCmd(prep);
+    INFO_MSG("Serving multiplexed session for %s", getConnectedHost().c_str());
+    std::string host = getConnectedHost();
+    DTSC::Mux mux(myConn);
+    while (config->is_active && mux){
+      mux.pump(1000);
+      uint32_t channel;
+      while ((channel = mux.accept())){
+        int fds[2];
+        if (socketpair(PF_LOCAL, SOCK_STREAM, 0, fds)){
+          WARN_MSG("Could not create socket pair for channel %" PRIu32 ": %s", channel, strerror(errno));
+          Socket::Connection none;
+          mux.attach(channel, none);
+          continue;
+        }
+        Util::Procs::fork_prepare();
+        pid_t pid = fork();
+        if (!pid){
+          // Child: serve the channel as a regular connection, leaving the session to the parent
+          Util::Procs::fork_complete();
+          ::close(fds[0]);
+          mux.drop();
+          myConn.drop();
+          Socket::Connection chanConn(fds[1]);
+          chanConn.setHost(host);
+          OutDTSC chanOut(chanConn);
+          exit(chanOut.run());
+        }
+        Util::Procs::fork_complete();
+        ::close(fds[1]);
+        Socket::Connection local(fds[0]);
+        if (pid == -1){
+          WARN_MSG("Could not fork process for channel %" PRIu32 ": %s", channel, strerror(errno));
+          local.close();
+        }else{
+          HIGH_MSG("Serving channel %" PRIu32 " from process %d", channel, (int)pid);
+        }
+        mux.attach(channel, local);
+      }
+    }
+    INFO_MSG("Multiplexed session for %s ended", host.c_str());
+    wantRequest = false;
+    parseData = false;
+  }
+
   void OutDTSC::handlePush(DTSC::Scan &dScan){
     streamName = dScan.getMember("stream").asString();
     std::string passString = dScan.getMember("password").asString();
@@ -24,6 +24,7 @@ namespace Mist{
     HTTP::URL pushUrl;
     void handlePush(DTSC::Scan &dScan);
     void handlePlay(DTSC::Scan &dScan);
+    void handleMux();
   };
 }// namespace Mist
 
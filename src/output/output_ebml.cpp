@@ -124,7 +124,7 @@ namespace Mist{
   size_t OutEBML::clusterSize(uint64_t start, uint64_t end){
     size_t sendLen = EBML::sizeElemUInt(EBML::EID_TIMECODE, start);
     for (std::map<size_t, Comms::Users>::iterator it = userSelect.begin(); it != userSelect.end(); it++){
-      DTSC::Keys keys(M.keys(it->first));
+      DTSC::Keys keys(M.getKeys(it->first));
       DTSC::Parts parts(M.parts(it->first));
 
       uint32_t firstPart = keys.getFirstPart(keys.getFirstValid());
@@ -156,7 +156,7 @@ namespace Mist{
         // EXCEPT when they are more than 30 seconds long, because clusters are limited to -32 to 32
         // seconds.
         size_t idx = getMainSelectedTrack();
-        DTSC::Fragments fragments(M.fragments(idx));
+        DTSC::Fragments fragments(M.getFragments(idx));
         uint32_t fragIndice = M.getFragmentIndexForTime(idx, currentClusterTime);
         newClusterTime = M.getTimeForFragmentIndex(idx, fragIndice) + fragments.getDuration(fragIndice);
         // Limit clusters to 30s, and the last fragment should always be 30s, just in case.
@@ -179,7 +179,7 @@ namespace Mist{
     }
 
     DTSC::Packet p(thisPacket, thisIdx + 1);
-    EBML::sendSimpleBlock(myConn, p, currentClusterTime, M.getType(thisIdx) != "video");
+    EBML::sendSimpleBlock(myConn, p, currentClusterTime, M.getTypeId(thisIdx) != DTSC::TYPE_VIDEO);
   }
 
   std::string OutEBML::trackCodecID(size_t idx){
@@ -506,7 +506,7 @@ namespace Mist{
     // Which, in turn, is dependent on the Cluster offsets.
     // We make this a bit easier by pre-calculating the sizes of all clusters first
     uint64_t fragNo = 0;
-    DTSC::Fragments fragments(M.fragments(idx));
+    DTSC::Fragments fragments(M.getFragments(idx));
     for (size_t i = fragments.getFirstValid(); i < fragments.getEndValid(); i++){
       uint64_t clusterStart = M.getTimeForFragmentIndex(idx, i);
       uint64_t clusterEnd = clusterStart + fragments.getDuration(i);
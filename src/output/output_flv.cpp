@@ -53,30 +53,26 @@ namespace Mist{
   void OutFLV::sendNext(){
     // If there are now more selectable tracks, select the new track and do a seek to the current
     // timestamp
-    if (M.getLive() && userSelect.size() < 2){
-      static uint64_t lastMeta = 0;
-      if (Util::epoch() > lastMeta + 5){
-        lastMeta = Util::epoch();
-        std::set<size_t> validTracks = getSupportedTracks();
-        if (validTracks.size() > 1){
-          if (selectDefaultTracks()){
-            INFO_MSG("Track selection changed - resending headers and continuing");
-            for (std::map<size_t, Comms::Users>::iterator it = userSelect.begin();
-                 it != userSelect.end(); it++){
-              if (M.getType(it->first) == "video" && tag.DTSCVideoInit(meta, it->first)){
-                myConn.SendNow(tag.data, tag.len);
-              }
-              if (M.getType(it->first) == "audio" && tag.DTSCAudioInit(meta.getCodec(it->first), meta.getRate(it->first), meta.getSize(it->first), meta.getChannels(it->first), meta.getInit(it->first))){
-                myConn.SendNow(tag.data, tag.len);
-              }
+    if (M.getLive() && userSelect.size() < 2 && metaChanged()){
+      std::set<size_t> validTracks = getSupportedTracks();
+      if (validTracks.size() > 1){
+        if (selectDefaultTracks()){
+          INFO_MSG("Track selection changed - resending headers and continuing");
+          for (std::map<size_t, Comms::Users>::iterator it = userSelect.begin();
+               it != userSelect.end(); it++){
+            if (M.getTypeId(it->first) == DTSC::TYPE_VIDEO && tag.DTSCVideoInit(meta, it->first)){
+              myConn.SendNow(tag.data, tag.len);
+            }
+            if (M.getTypeId(it->first) == DTSC::TYPE_AUDIO && tag.DTSCAudioInit(meta.getCodec(it->first), meta.getRate(it->first), meta.getSize(it->first), meta.getChannels(it->first), meta.getInit(it->first))){
+              myConn.SendNow(tag.data, tag.len);
             }
-            return;
           }
+          return;
         }
       }
     }
     tag.DTSCLoader(thisPacket, M, thisIdx);
-    if (M.getCodec(thisIdx) == "PCM" && M.getSize(thisIdx) == 16){
+    if (M.getCodecId(thisIdx) == DTSC::CODEC_PCM && M.getSize(thisIdx) == 16){
       char *ptr = tag.getData();
       uint32_t ptrSize = tag.getDataLen();
       for (uint32_t i = 0; i < ptrSize; i += 2){
@@ -125,7 +121,7 @@ namespace Mist{
     }
     if (config->getBool("keyframeonly")){
       size_t tid = userSelect.begin()->first;
-      DTSC::Keys keys(M.keys(tid));
+      DTSC::Keys keys(M.getKeys(tid));
       uint32_t endKey = keys.getEndValid();
       uint64_t keyTime = keys.getTime(endKey - 1);
       INFO_MSG("Seeking for time %" PRIu64 " on track %zu key %" PRIu32, keyTime, tid, endKey - 1);
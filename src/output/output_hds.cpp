@@ -34,8 +34,8 @@ namespace Mist{
   ///\param tid The track this bootstrap is generated for.
   ///\return The generated bootstrap.
   std::string OutHDS::dynamicBootstrap(size_t idx){
-    DTSC::Fragments fragments(M.fragments(idx));
-    DTSC::Keys keys(M.keys(idx));
+    DTSC::Fragments fragments(M.getFragments(idx));
+    DTSC::Keys keys(M.getKeys(idx));
     std::string empty;
 
     MP4::ASRT asrt;
@@ -189,7 +189,7 @@ namespace Mist{
       return;
     }
     tag.DTSCLoader(thisPacket, M, thisIdx);
-    if (M.getCodec(thisIdx) == "PCM" && M.getSize(thisIdx) == 16){
+    if (M.getCodecId(thisIdx) == DTSC::CODEC_PCM && M.getSize(thisIdx) == 16){
       char *ptr = tag.getData();
       uint32_t ptrSize = tag.getDataLen();
       for (uint32_t i = 0; i < ptrSize; i += 2){
@@ -247,8 +247,8 @@ namespace Mist{
       }
       // delay if we don't have the next fragment available yet
       unsigned int timeout = 0;
-      DTSC::Fragments fragments(M.fragments(idx));
-      DTSC::Keys keys(M.keys(idx));
+      DTSC::Fragments fragments(M.getFragments(idx));
+      DTSC::Keys keys(M.getKeys(idx));
       while (myConn && fragIdx >= fragments.getEndValid() - 1){
         // time out after 21 seconds
         if (++timeout > 42){
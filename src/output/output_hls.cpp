@@ -11,7 +11,7 @@ namespace Mist{
     if (!M.getValidTracks().size()){return false;}
     uint32_t mainTrack = M.mainTrack();
     if (mainTrack == INVALID_TRACK_ID){return false;}
-    DTSC::Fragments fragments(M.fragments(mainTrack));
+    DTSC::Fragments fragments(M.getFragments(mainTrack));
     return fragments.getValidCount() > 4;
   }
 
@@ -76,11 +76,35 @@ namespace Mist{
     return result.str();
   }
 
-  std::string OutHLS::liveIndex(size_t tid, const std::string &tknStr, const std::string &urlPrefix){
-    //Timing track is current track, unless non-video, then time by video track
+  /// Returns the track whose fragments make up the index of the given track: the track itself,
+  /// unless it is not a video track, then the main track.
+  size_t OutHLS::indexTimingTrack(size_t tid){
     size_t timingTid = tid;
     if (M.getType(timingTid) != "video"){timingTid = M.mainTrack();}
     if (timingTid == INVALID_TRACK_ID){timingTid = tid;}
+    return timingTid;
+  }
+
+  /// Describes everything the index of the given track depends on. Indexes built while the
+  /// description stays the same are identical; it changes once per new fragment.
+  std::string OutHLS::liveIndexState(size_t tid, const std::string &tknStr, const std::string &urlPrefix){
+    size_t timingTid = indexTimingTrack(tid);
+    DTSC::Fragments fragments(M.getFragments(timingTid));
+    std::stringstream r;
+    r << "HLSTS_" << tid << "_" << timingTid << "_" << M.getLive() << "_" << M.getGeneration();
+    r << "_" << M.biggestFragment(timingTid) << "_" << config->getInteger("listlimit");
+    r << "_" << M.getUTCOffset() << "_" << M.getBootMsOffset() << "_" << Util::getGlobalConfig("systemBoot").asInt();
+    r << "/" << fragments.getFirstValid() << "_" << fragments.getEndValid();
+    // The last fragment is only listed when it is the only one, or for VoD
+    if (!M.getLive() || fragments.getEndValid() - fragments.getFirstValid() < 2){
+      r << "_" << M.getLastms(timingTid);
+    }
+    r << "/" << M.getEncryption(tid) << "/" << tknStr << "/" << urlPrefix;
+    return r.str();
+  }
+
+  std::string OutHLS::liveIndex(size_t tid, const std::string &tknStr, const std::string &urlPrefix){
+    size_t timingTid = indexTimingTrack(tid);
 
     std::stringstream result;
     // parse single track
@@ -101,8 +125,8 @@ namespace Mist{
     std::deque<std::string> lines;
     std::deque<uint16_t> durations;
     uint32_t totalDuration = 0;
-    DTSC::Keys keys(M.keys(timingTid));
-    DTSC::Fragments fragments(M.fragments(timingTid));
+    DTSC::Keys keys(M.getKeys(timingTid));
+    DTSC::Fragments fragments(M.getFragments(timingTid));
     uint32_t firstFragment = fragments.getFirstValid();
     uint32_t endFragment = fragments.getEndValid();
     for (int i = firstFragment; i < endFragment; i++){
@@ -249,6 +273,7 @@ namespace Mist{
     capa["optional"]["chunkpath"]["option"] = "--chunkpath";
     capa["optional"]["chunkpath"]["short"] = "e";
     capa["optional"]["chunkpath"]["default"] = "";
+    addSegmentCacheOption(cfg);
     cfg->addConnectorOptions(8081, capa);
   }
 
@@ -405,6 +430,17 @@ namespace Mist{
 
       H.StartResponse(H, myConn, VLCworkaround || config->getBool("nonchunked"));
       responded = true;
+      // Segments are identical for everyone requesting the same tracks and time range
+      std::stringstream segKey;
+      segKey << "HLS";
+      for (std::map<size_t, Comms::Users>::iterator it = userSelect.begin(); it != userSelect.end(); ++it){
+        segKey << "_" << it->first;
+      }
+      segKey << "/" << from << "_" << until;
+      if (sendCachedSegment(segKey.str(), vidTrack, from)){
+        H.Clean();
+        return;
+      }
       // we assume whole fragments - but timestamps may be altered at will
       uint32_t fragIndice = M.getFragmentIndexForTime(vidTrack, from);
       contPAT = fragIndice; // PAT continuity counter
@@ -428,29 +464,36 @@ namespace Mist{
         H.SendResponse("200", "OK", myConn);
         return;
       }
-      std::string manifest;
       if (request.find("/") == std::string::npos){
-        manifest = liveIndex();
+        std::string manifest = liveIndex();
         if (manifest == ""){
           onFail("No HLS compatible tracks found");
           return;
         }
-      }else{
-        size_t idx = atoi(request.substr(0, request.find("/")).c_str());
-        if (!M.getValidTracks().count(idx)){
-          H.SendResponse("404", "No corresponding track found", myConn);
-          return;
-        }
-        if (config->getString("chunkpath").size()){
-          manifest = liveIndex(idx, "", HTTP::URL(config->getString("chunkpath")).link("./" + H.url).link("./").getUrl());
-        }else{
-          std::string tknStr;
-          if (tkn.size() && Comms::tknMode & 0x04){tknStr = "?tkn=" + tkn;}
-          manifest = liveIndex(idx, tknStr);
-        }
+        H.SetBody(manifest);
+        H.SendResponse("200", "OK", myConn);
+        return;
       }
-      H.SetBody(manifest);
-      H.SendResponse("200", "OK", myConn);
+      size_t idx = atoi(request.substr(0, request.find("/")).c_str());
+      if (!M.getValidTracks().count(idx)){
+        H.SendResponse("404", "No corresponding track found", myConn);
+        return;
+      }
+      std::string tknStr, urlPrefix;
+      if (config->getString("chunkpath").size()){
+        urlPrefix = HTTP::URL(config->getString("chunkpath")).link("./" + H.url).link("./").getUrl();
+      }else if (tkn.size() && Comms::tknMode & 0x04){
+        tknStr = "?tkn=" + tkn;
+      }
+      // Render only when the index changed, and only once for everyone without a session token
+      size_t timingTid = indexTimingTrack(idx);
+      DTSC::Fragments fragments(M.getFragments(timingTid));
+      DTSC::Keys keys(M.getKeys(timingTid));
+      uint64_t firstTime = keys.getTime(fragments.getFirstKey(fragments.getFirstValid()));
+      if (sendCachedPlaylist(liveIndexState(idx, tknStr, urlPrefix), timingTid, firstTime, tknStr.empty())){
+        return;
+      }
+      sendPlaylist(liveIndex(idx, tknStr, urlPrefix));
     }
   }
 
@@ -478,13 +521,17 @@ namespace Mist{
       // Signal end of data
       H.Chunkify("", 0, myConn);
       H.Clean();
+      segment.finish();
       return;
     }
     // Invoke the generic TS output sendNext handler
     TSOutput::sendNext();
   }
 
-  void OutHLS::sendTS(const char *tsData, size_t len){H.Chunkify(tsData, len, myConn);}
+  void OutHLS::sendTS(const char *tsData, size_t len){
+    H.Chunkify(tsData, len, myConn);
+    segment.append(tsData, len);
+  }
 
   void OutHLS::onFail(const std::string &msg, bool critical){
     if (HTTP::URL(H.url).getExt().substr(0, 3) != "m3u"){
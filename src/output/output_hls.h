@@ -19,6 +19,8 @@ namespace Mist{
     std::string h265init(const std::string &initData);
     std::string liveIndex();
     std::string liveIndex(size_t tid, const std::string &sessId, const std::string &urlPrefix = "");
+    std::string liveIndexState(size_t tid, const std::string &sessId, const std::string &urlPrefix);
+    size_t indexTimingTrack(size_t tid);
 
     size_t vidTrack;
     size_t audTrack;
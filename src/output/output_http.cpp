@@ -67,6 +67,80 @@ namespace Mist{
     cfg->addBasicConnectorOptions(capa);
   }
 
+  void HTTPOutput::addSegmentCacheOption(Util::Config *cfg){
+    cfg->addOption("segmentcache",
+                   JSON::fromString("{\"arg\":\"integer\",\"default\":0,\"short\":\"K\",\"long\":"
+                                    "\"segmentcache\",\"help\":\"Maximum amount of MiB of segments to "
+                                    "keep in the shared segment cache per stream (0 = disabled).\"}"));
+    capa["optional"]["segmentcache"]["name"] = "Segment cache size (MiB)";
+    capa["optional"]["segmentcache"]["help"] =
+        "When non-zero, generated segments are kept in shared memory (up to this many MiB per stream) "
+        "and served from there to all other viewers requesting the same segment, instead of being "
+        "generated again for every viewer. Segments are removed once they leave the stream buffer.";
+    capa["optional"]["segmentcache"]["default"] = 0;
+    capa["optional"]["segmentcache"]["type"] = "uint";
+    capa["optional"]["segmentcache"]["option"] = "--segmentcache";
+    capa["optional"]["segmentcache"]["short"] = "K";
+  }
+
+  /// Sends the segment described by key from the shared segment cache, if it is enabled and the
+  /// segment is available. The response must have been started already.
+  /// Returns true if the segment was sent. Otherwise the caller generates the segment as usual,
+  /// passing everything it sends through segment.append() and calling segment.finish() at the end,
+  /// so the segment is cached for the next viewer.
+  bool HTTPOutput::sendCachedSegment(const std::string &key, size_t track, uint64_t time){
+    segment.release();
+    if (!config->hasOption("segmentcache") || config->getInteger("segmentcache") <= 0){return false;}
+    uint64_t maxBytes = config->getInteger("segmentcache") * 1024 * 1024;
+    if (!segment.get(streamName, key, track, time, maxBytes)){return false;}
+    H.Chunkify(segment.data(), segment.size(), myConn);
+    H.Chunkify("", 0, myConn);
+    segment.release();
+    return true;
+  }
+
+  /// Sends a playlist that is the same for everyone requesting it while the stream stays in the
+  /// given state (e.g. HLS::mediaManifestState), without rendering it if possible.
+  /// Sets the ETag header, then sends a 304 response if the client has this version already, or
+  /// the playlist from the shared segment cache if enabled, shared and available.
+  /// Returns true if a response was sent. Otherwise the caller renders the playlist and sends it
+  /// through sendPlaylist(), which caches it for the next viewer. Track and time are those of the
+  /// first fragment in the buffer, so older versions are evicted once it leaves the buffer.
+  bool HTTPOutput::sendCachedPlaylist(const std::string &state, size_t track, uint64_t time, bool shared){
+    segment.release();
+    char etag[24];
+    snprintf(etag, 24, "\"%016" PRIx64 "\"", SegmentCache::hashKey(state));
+    std::string known = H.GetHeader("If-None-Match");
+    H.clearHeader("If-None-Match");
+    H.SetHeader("ETag", etag);
+    if (known.size() && known.find(etag) != std::string::npos){
+      H.SetBody("");
+      H.SendResponse("304", "Not Modified", myConn);
+      return true;
+    }
+    if (!shared || !config->hasOption("segmentcache") || config->getInteger("segmentcache") <= 0){
+      return false;
+    }
+    uint64_t maxBytes = config->getInteger("segmentcache") * 1024 * 1024;
+    if (!segment.get(streamName, state, track, time, maxBytes)){return false;}
+    H.SetBody(segment.data(), segment.size());
+    H.SendResponse("200", "OK", myConn);
+    segment.release();
+    return true;
+  }
+
+  /// Sends a playlist rendered because sendCachedPlaylist() returned false, storing it in the
+  /// shared segment cache if it was asked to produce it.
+  void HTTPOutput::sendPlaylist(const std::string &playlist){
+    if (segment.isProducing()){
+      segment.append(playlist);
+      segment.finish();
+    }
+    segment.release();
+    H.SetBody(playlist);
+    H.SendResponse("200", "OK", myConn);
+  }
+
   void HTTPOutput::onFail(const std::string &msg, bool critical){
     if (!webSock && !isRecording() && !responded){
       H.Clean(); // make sure no parts of old requests are left in any buffers
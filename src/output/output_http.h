@@ -2,6 +2,7 @@
 #include "output.h"
 #include <mist/defines.h>
 #include <mist/http_parser.h>
+#include <mist/segment_cache.h>
 #include <mist/websocket.h>
 
 namespace Mist{
@@ -11,6 +12,7 @@ namespace Mist{
     HTTPOutput(Socket::Connection &conn);
     virtual ~HTTPOutput();
     static void init(Util::Config *cfg);
+    static void addSegmentCacheOption(Util::Config *cfg);
     virtual void onFail(const std::string &msg, bool critical = false);
     virtual void onHTTP();
     virtual void respondHTTP(const HTTP::Parser & req, bool headersOnly);
@@ -35,6 +37,10 @@ namespace Mist{
     HTTP::Websocket *webSock;
     uint32_t idleInterval;
     uint64_t idleLast;
+    SegmentCache::Segment segment;
+    bool sendCachedSegment(const std::string &key, size_t track, uint64_t time);
+    bool sendCachedPlaylist(const std::string &state, size_t track, uint64_t time, bool shared);
+    void sendPlaylist(const std::string &playlist);
     std::string getConnectedHost();             // LTS
     std::string getConnectedBinHost();          // LTS
     bool isTrustedProxy(const std::string &ip); // LTS
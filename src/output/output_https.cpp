@@ -162,14 +162,15 @@ namespace Mist{
       }
 
       // attempt to read HTTP data, pass to SSL
-      if (http.spool() || http_buf.size()){
+      if (http.spool() || http_buf.available(1)){
         // We have data - pass it on
         activity = true;
-        while (http_buf.size() && http){
-          int toSend = http_buf.get().size();
+        while (http_buf.available(1) && http){
+          int toSend = http_buf.bytes(0xFFFFFFFFul);
+          const char *toWrite = http_buf.peek(toSend);
           int done = 0;
           while (done < toSend){
-            ret = mbedtls_ssl_write(&ssl, (const unsigned char *)http_buf.get().data() + done, toSend - done);
+            ret = mbedtls_ssl_write(&ssl, (const unsigned char *)toWrite + done, toSend - done);
             if (ret == MBEDTLS_ERR_NET_CONN_RESET || ret == MBEDTLS_ERR_SSL_CLIENT_RECONNECT){
               HIGH_MSG("SSL disconnect!");
               Util::logExitReason(ER_CLEAN_REMOTE_CLOSE, "SSL client disconnected");
@@ -182,7 +183,7 @@ namespace Mist{
               Util::sleep(20);
             }
           }
-          http_buf.get().clear();
+          http_buf.skip(toSend);
         }
       }
       if (!activity){Util::sleep(20);}
@@ -11,12 +11,7 @@ namespace Mist{
   OutJPG::OutJPG(Socket::Connection &conn) : HTTPOutput(conn){
     HTTP = false;
     cachedir = config->getString("cachedir");
-    if (cachedir.size()){
-      cachedir += "/MstJPEG" + streamName;
-      cachetime = config->getInteger("cachetime");
-    }else{
-      cachetime = 0;
-    }
+    cachetime = cachedir.size() ? config->getInteger("cachetime") : 0;
     if (config->getString("target").size()){
       initialize();
       if (!streamName.size()){
@@ -109,6 +104,12 @@ namespace Mist{
     capa["methods"][0u]["priority"] = 0;
     config->addStandardPushCapabilities(capa);
     capa["push_urls"].append("/*.jpg");
+    addSegmentCacheOption(cfg);
+    capa["optional"]["segmentcache"]["help"] =
+        "When non-zero, generated images are kept in shared memory (up to this many MiB per stream) "
+        "and served from there to everyone requesting an image of the same key frame. Only one "
+        "ffmpeg process runs per key frame; other requests wait for its result. Images are removed "
+        "once their key frame leaves the stream buffer.";
 
     capa["optional"]["cachedir"]["name"] = "Cache directory";
     capa["optional"]["cachedir"]["help"] =
@@ -176,12 +177,6 @@ namespace Mist{
       NoFFMPEG();
     }else{
       H.Chunkify(jpg_buffer.str().c_str(), jpg_buffer.str().size(), myConn);
-      if (cachedir.size()){
-        std::ofstream cachefile;
-        cachefile.open(cachedir.c_str());
-        cachefile << jpg_buffer.str();
-        cachefile.close();
-      }
     }
     H.Chunkify("", 0, myConn);
     H.Clean();
@@ -198,26 +193,22 @@ namespace Mist{
     }
   }
 
+  /// Generates a thumbnail of the stream into jpg_buffer, leaving it empty on failure.
   void OutJPG::generate(){
+    jpg_buffer.str("");
+    jpg_buffer.clear();
+    std::string cachefile;
+    if (cachedir.size()){cachefile = cachedir + "/MstJPEG" + streamName;}
     // If we're caching, check if the cache hasn't expired yet...
-    if (cachedir.size() && cachetime){
+    if (cachefile.size() && cachetime){
       struct stat statData;
-      if (stat(cachedir.c_str(), &statData) != -1){
+      if (stat(cachefile.c_str(), &statData) != -1){
         if (Util::epoch() - statData.st_mtime <= cachetime || M.getVod()){
-          std::ifstream cachefile;
-          cachefile.open(cachedir.c_str());
-          char buffer[8 * 1024];
-          while (cachefile.good() && myConn){
-            cachefile.read(buffer, 8 * 1024);
-            uint32_t s = cachefile.gcount();
-            if (HTTP){
-              H.Chunkify(buffer, s, myConn);
-            }else{
-              myConn.SendNow(buffer, s);
-            }
-          }
-          cachefile.close();
-          return;
+          std::ifstream cached(cachefile.c_str());
+          jpg_buffer << cached.rdbuf();
+          if (jpg_buffer.str().size()){return;}
+          jpg_buffer.str("");
+          jpg_buffer.clear();
         }
       }
     }
@@ -229,6 +220,33 @@ namespace Mist{
       return;
     }
 
+    // Images are identical for everyone requesting the same key frame with the same ffmpeg options
+    if (config->getInteger("segmentcache") > 0){
+      uint32_t keyNum = M.getKeyIndexForTime(mainTrack, currentTime());
+      uint64_t keyTime = M.getTimeForKeyIndex(mainTrack, keyNum);
+      std::stringstream thumbKey;
+      thumbKey << "JPG_" << mainTrack << "/" << keyNum << "/" << config->getString("ffopts");
+      if (segment.get(streamName, thumbKey.str(), mainTrack, keyTime, config->getInteger("segmentcache") * 1024 * 1024)){
+        jpg_buffer.write(segment.data(), segment.size());
+        segment.release();
+        return;
+      }
+    }
+    runFFMPEG(mainTrack);
+    if (jpg_buffer.str().size()){
+      segment.append(jpg_buffer.str());
+      segment.finish();
+      if (cachefile.size()){
+        std::ofstream cached(cachefile.c_str());
+        cached << jpg_buffer.str();
+      }
+    }
+    // Lets others generate the image instead if we could not
+    segment.release();
+  }
+
+  /// Decodes the key frame at the current position through ffmpeg, storing the image in jpg_buffer.
+  void OutJPG::runFFMPEG(size_t mainTrack){
     int fin = -1, fout = -1, ferr = 2;
     pid_t ffmpeg = -1;
     // Start ffmpeg quietly if we're < MEDIUM debug level
@@ -302,8 +320,7 @@ namespace Mist{
       }while (ffconn && prepareNext() && thisPacket && thisPacket.getTime() == keytime);
     }
     ffconn.close();
-    // Output ffmpeg result data to socket
-    jpg_buffer.clear();
+    // Collect ffmpeg result data
     Socket::Connection ffout(-1, fout);
     while (myConn && ffout && (ffout.spool() || ffout.Received().size())){
       while (myConn && ffout.Received().size()){
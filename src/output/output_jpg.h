@@ -10,6 +10,7 @@ namespace Mist{
 
   private:
     void generate();
+    void runFFMPEG(size_t mainTrack);
     void initialSeek();
     void NoFFMPEG();
     std::string cachedir;
@@ -40,7 +40,7 @@ namespace Mist{
       }
     }
     JSON::Value jPack;
-    if (M.getCodec(thisIdx) == "JSON"){
+    if (M.getCodecId(thisIdx) == DTSC::CODEC_JSON){
       char *dPtr;
       size_t dLen;
       thisPacket.getString("data", dPtr, dLen);
@@ -56,8 +56,10 @@ namespace Mist{
       }
       lastVal = jPack;
     }
+    jsonBuf.truncate(0);
+    jPack.toString(jsonBuf);
     if (webSock){
-      webSock->sendFrame(jPack.toString());
+      webSock->sendFrame(jsonBuf, jsonBuf.size());
       return;
     }
     if (!jsonp.size()){
@@ -70,7 +72,7 @@ namespace Mist{
     }else{
       myConn.SendNow(jsonp + "(");
     }
-    myConn.SendNow(jPack.toString());
+    myConn.SendNow(jsonBuf, jsonBuf.size());
     if (jsonp.size()){myConn.SendNow(");\n", 3);}
   }
 
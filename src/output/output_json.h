@@ -19,6 +19,7 @@ namespace Mist{
 
   protected:
     JSON::Value lastVal;
+    Util::ResizeablePointer jsonBuf;
     std::string lastOutData;
     uint64_t lastOutTime;
     uint64_t lastSendTime;
@@ -10,6 +10,7 @@
 #include <mist/stream.h> /* for `Util::codecString()` when streaming mp4 over websockets and playback using media source extensions. */
 #include <mist/nal.h>
 #include <inttypes.h>
+#include <fcntl.h>
 #include <fstream>
 
 std::set<std::string> supportedAudio;
@@ -114,8 +115,13 @@ namespace Mist{
     stayLive = true;
     target_rate = 0.0;
     forwardTo = 0;
+    fileFd = -1;
+    fileRunStart = 0;
+    fileRunLen = 0;
+  }
+  OutMP4::~OutMP4(){
+    if (fileFd != -1){close(fileFd);}
   }
-  OutMP4::~OutMP4(){}
 
   void OutMP4::init(Util::Config *cfg){
     HTTPOutput::init(cfg);
@@ -155,7 +161,7 @@ namespace Mist{
   uint64_t OutMP4::estimateFileSize() const{
     uint64_t retVal = 0;
     for (std::map<size_t, Comms::Users>::const_iterator it = userSelect.begin(); it != userSelect.end(); it++){
-      DTSC::Keys keys(M.keys(it->first));
+      DTSC::Keys keys(M.getKeys(it->first));
       size_t endKey = keys.getEndValid();
       for (size_t i = 0; i < endKey; i++){
         retVal += keys.getSize(i); // Handle number as index, faster for VoD
@@ -181,9 +187,9 @@ namespace Mist{
          subIt != userSelect.end(); subIt++){
       tmpRes += 8 + 20; // TRAF + TFHD Box
 
-      DTSC::Keys keys(M.keys(subIt->first));
+      DTSC::Keys keys(M.getKeys(subIt->first));
       DTSC::Parts parts(M.parts(subIt->first));
-      DTSC::Fragments fragments(M.fragments(subIt->first));
+      DTSC::Fragments fragments(M.getFragments(subIt->first));
 
       uint32_t startKey = M.getKeyIndexForTime(subIt->first, startFragmentTime);
       uint32_t endKey = M.getKeyIndexForTime(subIt->first, endFragmentTime) + 1;
@@ -273,7 +279,7 @@ namespace Mist{
                   + 16                               // PASP
                   + 8 + M.getInit(it->first).size(); // avcC
         if (!fragmented){
-          DTSC::Keys keys(M.keys(it->first));
+          DTSC::Keys keys(M.getKeys(it->first));
           tmpRes += 16 + (keys.getValidCount() * 4); // STSS
         }
       }
@@ -627,7 +633,7 @@ namespace Mist{
       if (tType == "video" && !fragmented){
         MP4::STSS stssBox(0);
         size_t tmpCount = 0;
-        DTSC::Keys keys(M.keys(it->first));
+        DTSC::Keys keys(M.getKeys(it->first));
         uint32_t firstKey = keys.getFirstValid();
         uint32_t endKey = keys.getEndValid();
         for (size_t i = firstKey; i < endKey; ++i){
@@ -941,9 +947,9 @@ namespace Mist{
 
     for (std::map<size_t, Comms::Users>::const_iterator subIt = userSelect.begin();
          subIt != userSelect.end(); subIt++){
-      DTSC::Keys keys(M.keys(subIt->first));
+      DTSC::Keys keys(M.getKeys(subIt->first));
       DTSC::Parts parts(M.parts(subIt->first));
-      DTSC::Fragments fragments(M.fragments(subIt->first));
+      DTSC::Fragments fragments(M.getFragments(subIt->first));
 
       uint32_t startKey = M.getKeyIndexForTime(subIt->first, startFragmentTime);
       uint32_t endKey = M.getKeyIndexForTime(subIt->first, endFragmentTime) + 1;
@@ -1077,7 +1083,74 @@ namespace Mist{
     H.Chunkify(mdatHeader, 8, myConn);
   }
 
+  /// Opens the source file of a VoD stream, so packet payloads can be sent from it directly.
+  /// Only plain local files are used; returns true if the file is (already) open.
+  bool OutMP4::openSourceFile(){
+    if (fileFd != -1){return true;}
+    std::string src = M.getSource();
+    if (src.substr(0, 7) == "file://"){src.erase(0, 7);}
+    if (!src.size() || src == "-" || src.find("://") != std::string::npos){return false;}
+    fileFd = open(src.c_str(), O_RDONLY);
+    if (fileFd == -1){
+      HIGH_MSG("Not sending from source file %s: %s", src.c_str(), strerror(errno));
+      return false;
+    }
+    fileState.clear();
+    return true;
+  }
+
+  /// Sends the pending run of source file bytes, if any.
+  /// Returns false (and closes the connection) if the file could not be read.
+  bool OutMP4::flushFile(){
+    if (!fileRunLen){return true;}
+    uint64_t start = fileRunStart, len = fileRunLen;
+    fileRunLen = 0;
+    if (!H.ChunkifyFile(fileFd, start, len, myConn)){
+      FAIL_MSG("Could not read %" PRIu64 " bytes at %" PRIu64 " from source file", len, start);
+      myConn.close();
+      return false;
+    }
+    return true;
+  }
+
+  /// Sends count bytes starting skip bytes into the payload of the current packet.
+  /// After the first FILE_VERIFY packets of a track were confirmed to be identical to the source
+  /// file at their byte position, the payload is sent straight from the file instead; consecutive
+  /// payloads are coalesced into a single zero-copy send. Any mismatch disables this for the track.
+  void OutMP4::sendPayload(const char *data, size_t len, size_t skip, size_t count){
+    if (!count){return;}
+    uint64_t bpos = (fileFd != -1) ? thisPacket.getInt("bpos") : 0;
+    uint8_t &state = fileState[thisIdx];
+    // Subtitle payloads are prefixed with their length, so they never match the file
+    if (!state && M.getCodec(thisIdx) == "subtitle"){state = FILE_DISABLED;}
+    if (!bpos || state == FILE_DISABLED){
+      flushFile();
+      H.Chunkify(data + skip, count, myConn);
+      return;
+    }
+    if (state < FILE_VERIFY){
+      Util::ResizeablePointer fileData;
+      fileData.allocate(len);
+      ssize_t r = pread(fileFd, fileData, len, bpos);
+      if (r == (ssize_t)len && !memcmp(fileData, data, len)){
+        ++state;
+      }else{
+        INFO_MSG("Track %zu payloads do not match source file; sending them normally", thisIdx);
+        state = FILE_DISABLED;
+      }
+      flushFile();
+      H.Chunkify(data + skip, count, myConn);
+      return;
+    }
+    if (fileRunLen && (fileRunStart + fileRunLen != bpos + skip || fileRunLen >= FILE_MAX_RUN)){
+      if (!flushFile()){return;}
+    }
+    if (!fileRunLen){fileRunStart = bpos + skip;}
+    fileRunLen += count;
+  }
+
   void OutMP4::respondHTTP(const HTTP::Parser & req, bool headersOnly){
+    flushFile();
     //Set global defaults, first
     HTTPOutput::respondHTTP(req, headersOnly);
 
@@ -1094,7 +1167,7 @@ namespace Mist{
       return;
     }
 
-    DTSC::Fragments fragments(M.fragments(mainTrack));
+    DTSC::Fragments fragments(M.getFragments(mainTrack));
 
     if (req.GetVar("startfrag") != ""){
       realTime = 0;
@@ -1188,6 +1261,7 @@ namespace Mist{
     parseData = true;
     wantRequest = false;
     sentHeader = false;
+    if (!M.getLive()){openSourceFile();}
 
     //Send MP4 header if needed
     leftOver = byteEnd - byteStart + 1; // add one byte, because range "0-0" = 1 byte of data
@@ -1250,7 +1324,7 @@ namespace Mist{
       }
 
       // Handle nice move-over to new track ID
-      if (prevVidTrack != INVALID_TRACK_ID && thisIdx != prevVidTrack && M.getType(thisIdx) == "video"){
+      if (prevVidTrack != INVALID_TRACK_ID && thisIdx != prevVidTrack && M.getTypeId(thisIdx) == DTSC::TYPE_VIDEO){
         if (!thisPacket.getFlag("keyframe")){
           // Ignore the packet if not a keyframe
           return;
@@ -1371,7 +1445,7 @@ namespace Mist{
     }
 
     // prepend subtitle text with 2 bytes datalength
-    if (M.getCodec(firstKeyPart.trackID) == "subtitle"){
+    if (M.getCodecId(firstKeyPart.trackID) == DTSC::CODEC_SUBTITLE){
       char pre[2];
       Bit::htobs(pre, len);
       subtitle.assign(pre, 2);
@@ -1381,16 +1455,18 @@ namespace Mist{
     }
 
     if (currPos >= byteStart){
-      H.Chunkify(dataPointer, std::min(leftOver, (int64_t)len), myConn);
-
+      if (leftOver > 0){sendPayload(dataPointer, len, 0, std::min(leftOver, (int64_t)len));}
       leftOver -= len;
     }else{
       if (currPos + len > byteStart){
-        H.Chunkify(dataPointer + (byteStart - currPos),
-                   std::min((uint64_t)leftOver, (len - (byteStart - currPos))), myConn);
+        if (leftOver > 0){
+          sendPayload(dataPointer, len, byteStart - currPos,
+                      std::min((uint64_t)leftOver, (len - (byteStart - currPos))));
+        }
         leftOver -= len - (byteStart - currPos);
       }
     }
+    if (leftOver <= 0){flushFile();}
 
     // keep track of where we are
     if (!sortSet.empty()){
@@ -1757,6 +1833,7 @@ namespace Mist{
 
   bool OutMP4::onFinish() {
     if (!webSock){
+      flushFile();
       H.Chunkify(0, 0, myConn);
       wantRequest = true;
       return true;
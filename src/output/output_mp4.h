@@ -2,6 +2,10 @@
 #include <list>
 #include <mist/http_parser.h>
 
+#define FILE_VERIFY 8                  ///< Packets per track compared to the source file before sending from it
+#define FILE_DISABLED 0xFF             ///< Track payloads are never sent from the source file
+#define FILE_MAX_RUN (4 * 1024 * 1024) ///< Max bytes of source file data coalesced into one send
+
 namespace Mist{
   class keyPart{
   public:
@@ -153,6 +157,15 @@ namespace Mist{
 
     std::string protectionHeader(size_t idx);
     Util::ResizeablePointer webBuf;
+
+    // variables for sending VoD payloads straight from the source file
+    bool openSourceFile();
+    void sendPayload(const char *data, size_t len, size_t skip, size_t count);
+    bool flushFile();
+    int fileFd;                          ///< Source file, or -1 if not in use
+    std::map<size_t, uint8_t> fileState; ///< Per track: amount of verified packets, or FILE_DISABLED
+    uint64_t fileRunStart;               ///< Start offset in the source file of the pending run
+    uint64_t fileRunLen;                 ///< Length of the pending run, 0 if none
   };
 }// namespace Mist
 
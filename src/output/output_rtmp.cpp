@@ -370,84 +370,8 @@ namespace Mist{
     */
     const char * tmpData = "\257\001!\020\004`\214\034";
 
-    size_t data_len = 8;
-
-    char rtmpheader[] ={0,                // byte 0 = cs_id | ch_type
-                         0,    0, 0,      // bytes 1-3 = timestamp
-                         0,    0, 0,      // bytes 4-6 = length
-                         0x08,            // byte 7 = msg_type_id
-                         1,    0, 0, 0,   // bytes 8-11 = msg_stream_id = 1
-                         0,    0, 0, 0};  // bytes 12-15 = extended timestamp
-
-    bool allow_short = RTMPStream::lastsend.count(4);
-    RTMPStream::Chunk &prev = RTMPStream::lastsend[4];
-    uint8_t chtype = 0x00;
-    size_t header_len = 12;
-    bool time_is_diff = false;
-    if (allow_short && (prev.cs_id == 4)){
-      if (prev.msg_stream_id == 1){
-        chtype = 0x40;
-        header_len = 8; // do not send msg_stream_id
-        if (data_len == prev.len && rtmpheader[7] == prev.msg_type_id){
-          chtype = 0x80;
-          header_len = 4; // do not send len and msg_type_id
-          if (timestamp == prev.timestamp){
-            chtype = 0xC0;
-            header_len = 1; // do not send timestamp
-          }
-        }
-        // override - we always sent type 0x00 if the timestamp has decreased since last chunk in this channel
-        if (timestamp < prev.timestamp){
-          chtype = 0x00;
-          header_len = 12;
-        }else{
-          // store the timestamp diff instead of the whole timestamp
-          timestamp -= prev.timestamp;
-          time_is_diff = true;
-        }
-      }
-    }
-
-    // update previous chunk variables
-    prev.cs_id = 4;
-    prev.msg_stream_id = 1;
-    prev.len = data_len;
-    prev.msg_type_id = 0x08;
-    if (time_is_diff){
-      prev.timestamp += timestamp;
-    }else{
-      prev.timestamp = timestamp;
-    }
-
-    // cs_id and ch_type
-    rtmpheader[0] = chtype | 4;
-    // data length, 3 bytes
-    rtmpheader[4] = (data_len >> 16) & 0xff;
-    rtmpheader[5] = (data_len >> 8) & 0xff;
-    rtmpheader[6] = data_len & 0xff;
-    // timestamp, 3 bytes
-    if (timestamp >= 0x00ffffff){
-      // send extended timestamp
-      rtmpheader[1] = 0xff;
-      rtmpheader[2] = 0xff;
-      rtmpheader[3] = 0xff;
-      rtmpheader[header_len++] = (timestamp >> 24) & 0xff;
-      rtmpheader[header_len++] = (timestamp >> 16) & 0xff;
-      rtmpheader[header_len++] = (timestamp >> 8) & 0xff;
-      rtmpheader[header_len++] = timestamp & 0xff;
-    }else{
-      // regular timestamp
-      rtmpheader[1] = (timestamp >> 16) & 0xff;
-      rtmpheader[2] = (timestamp >> 8) & 0xff;
-      rtmpheader[3] = timestamp & 0xff;
-    }
-
-    // send the packet
-    myConn.setBlocking(true);
-    myConn.SendNow(rtmpheader, header_len);
-    myConn.SendNow(tmpData, data_len);
-    RTMPStream::snd_cnt += header_len+data_len; // update the sent data counter
-    myConn.setBlocking(false);
+    chunker.pack(4, 0x08, 1, timestamp, tmpData, 8);
+    myConn.SendNow(chunker.vec, chunker.count);
   }
 
   // Gets next ADTS frame and loops back to 0 is EOF is reached
@@ -506,101 +430,11 @@ namespace Mist{
 
     // Keep parsing ADTS frames until we reach a frame which starts in the future
     while (currentFrameTimestamp < untilTimestamp){
-      // Init RTMP header info
-      char rtmpheader[] ={0,              // byte 0 = cs_id | ch_type
-                          0,    0, 0,     // bytes 1-3 = timestamp
-                          0,    0, 0,     // bytes 4-6 = length
-                          0x08,           // byte 7 = msg_type_id
-                          1,    0, 0, 0,  // bytes 8-11 = msg_stream_id = 1
-                          0,    0, 0, 0}; // bytes 12-15 = extended timestamp
-
-      // Separate timestamp since we store Δtimestamps
-      uint64_t rtmpTimestamp = currentFrameTimestamp;
-      // Since we have to prepend an FLV audio tag, increase size by 2 bytes
-      uint64_t aacPacketSize = currentFrameInfo.getPayloadSize() + 2;
-      // If there is a previous sent package, we do not need to send all data
-      bool allow_short = RTMPStream::lastsend.count(4);
-      RTMPStream::Chunk &prev = RTMPStream::lastsend[4];
-      // Defines the type of header. Only the 2 most significant bits are counted:
-      //  0x00 = 000.. = 12 byte header
-      //  0x40 = 010.. = 8 byte header, leave out message ID if it's the same as prev
-      //  0x80 = 100.. = 4 byte header, above + leave out msg type and size if the packets are all the same size and type
-      //  0xC0 = 110.. = 1 byte header, above + leave out timestamp as well
-      uint8_t chtype = 0x00;
-      size_t header_len = 12;
-      bool time_is_diff = false;
-      if (allow_short && (prev.cs_id == 4)){
-        if (prev.msg_stream_id == 1){
-          chtype = 0x40;
-          header_len = 8;
-          if (aacPacketSize == prev.len && rtmpheader[7] == prev.msg_type_id){
-            chtype = 0x80;
-            header_len = 4;
-            if (rtmpTimestamp == prev.timestamp){
-              chtype = 0xC0;
-              header_len = 1;
-            }
-          }
-          // override - we always sent type 0x00 if the timestamp has decreased since last chunk in this channel
-          if (rtmpTimestamp < prev.timestamp){
-            chtype = 0x00;
-            header_len = 12;
-          }else{
-            // store the timestamp diff instead of the whole timestamp
-            rtmpTimestamp -= prev.timestamp;
-            time_is_diff = true;
-          }
-        }
-      }
-
-      // Update previous chunk variables
-      prev.cs_id = 4;
-      prev.msg_stream_id = 1;
-      prev.len = aacPacketSize;
-      prev.msg_type_id = 0x08;
-      if (time_is_diff){
-        prev.timestamp += rtmpTimestamp;
-      }else{
-        prev.timestamp = rtmpTimestamp;
-      }
-
-      // Now fill in type...
-      rtmpheader[0] = chtype | 4;
-      // data length...
-      rtmpheader[4] = (aacPacketSize >> 16) & 0xff;
-      rtmpheader[5] = (aacPacketSize >> 8) & 0xff;
-      rtmpheader[6] = aacPacketSize & 0xff;
-      // and timestamp (3 bytes unless extended)
-      if (rtmpTimestamp >= 0x00ffffff){
-        rtmpheader[1] = 0xff;
-        rtmpheader[2] = 0xff;
-        rtmpheader[3] = 0xff;
-        rtmpheader[header_len++] = (rtmpTimestamp >> 24) & 0xff;
-        rtmpheader[header_len++] = (rtmpTimestamp >> 16) & 0xff;
-        rtmpheader[header_len++] = (rtmpTimestamp >> 8) & 0xff;
-        rtmpheader[header_len++] = rtmpTimestamp & 0xff;
-      }else{
-        rtmpheader[1] = (rtmpTimestamp >> 16) & 0xff;
-        rtmpheader[2] = (rtmpTimestamp >> 8) & 0xff;
-        rtmpheader[3] = rtmpTimestamp & 0xff;
-      }
-
-      // Send RTMP packet containing header only
-      myConn.setBlocking(true);
-      myConn.SendNow(rtmpheader, header_len);
-      // Prepend FLV AAC audio tag
-      char *tmpData = (char*)malloc(aacPacketSize);
-      const char *tmpBuf = currentFrameInfo.getPayload();
       // Prepend FLV Audio tag: always 10101111 00000001 + raw AAC
-      tmpData[0] = '\257';
-      tmpData[1] = '\001';
-      for (int i = 2; i < aacPacketSize; i++)
-        tmpData[i] = tmpBuf[i-2];
-
-      myConn.SendNow(tmpData, aacPacketSize);
-      // Update internal variables
-      RTMPStream::snd_cnt += header_len+aacPacketSize;
-      myConn.setBlocking(false);
+      static const char aacHeader[] ={'\257', '\001'};
+      chunker.pack(4, 0x08, 1, currentFrameTimestamp, aacHeader, 2, currentFrameInfo.getPayload(),
+                   currentFrameInfo.getPayloadSize());
+      myConn.SendNow(chunker.vec, chunker.count);
 
       // get next ADTS frame for new raw AAC data
       calcNextFrameInfo();
@@ -609,16 +443,12 @@ namespace Mist{
 
 
   void OutRTMP::sendNext(){
-    //Every 5s, check if the track selection should change in live streams, and do it.
+    //Whenever the metadata changes, check if the track selection should change in live streams, and do it.
     if (M.getLive()){
-      static uint64_t lastMeta = 0;
-      if (Util::epoch() > lastMeta + 5){
-        lastMeta = Util::epoch();
-        if (selectDefaultTracks()){
-          INFO_MSG("Track selection changed - resending headers and continuing");
-          sentHeader = false;
-          return;
-        }
+      if (metaChanged() && selectDefaultTracks()){
+        INFO_MSG("Track selection changed - resending headers and continuing");
+        sentHeader = false;
+        return;
       }
       if (liveSeek()){return;}
     }
@@ -669,12 +499,7 @@ namespace Mist{
       lastAudioInserted = timestamp;
     }
 
-    char rtmpheader[] ={ 0,              // byte 0 = cs_id | ch_type
-                         0,    0, 0,     // bytes 1-3 = timestamp
-                         0,    0, 0,     // bytes 4-6 = length
-                         0x12,           // byte 7 = msg_type_id
-                         1,    0, 0, 0,  // bytes 8-11 = msg_stream_id = 1
-                         0,    0, 0, 0}; // bytes 12-15 = extended timestamp
+    char msg_type_id = 0x12;
     char dataheader[] ={0, 0, 0, 0, 0};
     unsigned int dheader_len = 1;
     static Util::ResizeablePointer swappy;
@@ -682,13 +507,13 @@ namespace Mist{
     size_t data_len = 0; // length of processed media data
     thisPacket.getString("data", tmpData, data_len);
 
-    std::string type = M.getType(thisIdx);
-    std::string codec = M.getCodec(thisIdx);
+    DTSC::trackType type = M.getTypeId(thisIdx);
+    DTSC::trackCodec codec = M.getCodecId(thisIdx);
 
     // set msg_type_id
-    if (type == "video"){
-      rtmpheader[7] = 0x09;
-      if (codec == "H264"){
+    if (type == DTSC::TYPE_VIDEO){
+      msg_type_id = 0x09;
+      if (codec == DTSC::CODEC_H264){
         dheader_len += 4;
         dataheader[0] = 7;
         dataheader[1] = 1;
@@ -699,25 +524,25 @@ namespace Mist{
           dataheader[4] = offset & 0xFF;
         }
       }
-      if (codec == "H263"){dataheader[0] = 2;}
+      if (codec == DTSC::CODEC_H263){dataheader[0] = 2;}
       dataheader[0] |= (thisPacket.getFlag("keyframe") ? 0x10 : 0x20);
       if (thisPacket.getFlag("disposableframe")){dataheader[0] |= 0x30;}
     }
 
-    if (type == "audio"){
+    if (type == DTSC::TYPE_AUDIO){
       uint32_t rate = M.getRate(thisIdx);
-      rtmpheader[7] = 0x08;
-      if (codec == "AAC"){
+      msg_type_id = 0x08;
+      if (codec == DTSC::CODEC_AAC){
         dataheader[0] += 0xA0;
         dheader_len += 1;
         dataheader[1] = 1; // raw AAC data, not sequence header
       }
-      if (codec == "MP3"){
+      if (codec == DTSC::CODEC_MP3){
         dataheader[0] += 0x20;
         dataheader[0] |= (rate == 8000 ? 0xE0 : 0x20);
       }
-      if (codec == "ADPCM"){dataheader[0] |= 0x10;}
-      if (codec == "PCM"){
+      if (codec == DTSC::CODEC_ADPCM){dataheader[0] |= 0x10;}
+      if (codec == DTSC::CODEC_PCM){
         if (M.getSize(thisIdx) == 16 && swappy.allocate(data_len)){
           for (uint32_t i = 0; i < data_len; i += 2){
             swappy[i] = tmpData[i + 1];
@@ -727,12 +552,12 @@ namespace Mist{
         }
         dataheader[0] |= 0x30;
       }
-      if (codec == "Nellymoser"){
+      if (codec == DTSC::CODEC_NELLYMOSER){
         dataheader[0] |= (rate == 8000 ? 0x50 : (rate == 16000 ? 0x40 : 0x60));
       }
-      if (codec == "ALAW"){dataheader[0] |= 0x70;}
-      if (codec == "ULAW"){dataheader[0] |= 0x80;}
-      if (codec == "Speex"){dataheader[0] |= 0xB0;}
+      if (codec == DTSC::CODEC_ALAW){dataheader[0] |= 0x70;}
+      if (codec == DTSC::CODEC_ULAW){dataheader[0] |= 0x80;}
+      if (codec == DTSC::CODEC_SPEEX){dataheader[0] |= 0xB0;}
 
       if (rate >= 44100){
         dataheader[0] |= 0x0C;
@@ -744,108 +569,10 @@ namespace Mist{
       if (M.getSize(thisIdx) != 8){dataheader[0] |= 0x02;}
       if (M.getChannels(thisIdx) > 1){dataheader[0] |= 0x01;}
     }
-    data_len += dheader_len;
-
-    bool allow_short = RTMPStream::lastsend.count(4);
-    RTMPStream::Chunk &prev = RTMPStream::lastsend[4];
-    uint8_t chtype = 0x00;
-    size_t header_len = 12;
-    bool time_is_diff = false;
-    if (allow_short && (prev.cs_id == 4)){
-      if (prev.msg_stream_id == 1){
-        chtype = 0x40;
-        header_len = 8; // do not send msg_stream_id
-        if (data_len == prev.len && rtmpheader[7] == prev.msg_type_id){
-          chtype = 0x80;
-          header_len = 4; // do not send len and msg_type_id
-          if (timestamp == prev.timestamp){
-            chtype = 0xC0;
-            header_len = 1; // do not send timestamp
-          }
-        }
-        // override - we always sent type 0x00 if the timestamp has decreased since last chunk in this channel
-        if (timestamp < prev.timestamp){
-          chtype = 0x00;
-          header_len = 12;
-        }else{
-          // store the timestamp diff instead of the whole timestamp
-          timestamp -= prev.timestamp;
-          time_is_diff = true;
-        }
-      }
-    }
-
-    // update previous chunk variables
-    prev.cs_id = 4;
-    prev.msg_stream_id = 1;
-    prev.len = data_len;
-    prev.msg_type_id = rtmpheader[7];
-    if (time_is_diff){
-      prev.timestamp += timestamp;
-    }else{
-      prev.timestamp = timestamp;
-    }
-
-    // cs_id and ch_type
-    rtmpheader[0] = chtype | 4;
-    // data length, 3 bytes
-    rtmpheader[4] = (data_len >> 16) & 0xff;
-    rtmpheader[5] = (data_len >> 8) & 0xff;
-    rtmpheader[6] = data_len & 0xff;
-    // timestamp, 3 bytes
-    if (timestamp >= 0x00ffffff){
-      // send extended timestamp
-      rtmpheader[1] = 0xff;
-      rtmpheader[2] = 0xff;
-      rtmpheader[3] = 0xff;
-      rtmpheader[header_len++] = (timestamp >> 24) & 0xff;
-      rtmpheader[header_len++] = (timestamp >> 16) & 0xff;
-      rtmpheader[header_len++] = (timestamp >> 8) & 0xff;
-      rtmpheader[header_len++] = timestamp & 0xff;
-    }else{
-      // regular timestamp
-      rtmpheader[1] = (timestamp >> 16) & 0xff;
-      rtmpheader[2] = (timestamp >> 8) & 0xff;
-      rtmpheader[3] = timestamp & 0xff;
-    }
-
-    // send the header
-    myConn.setBlocking(true);
-    myConn.SendNow(rtmpheader, header_len);
-    RTMPStream::snd_cnt += header_len; // update the sent data counter
-    // set the header's first byte to the "continue" type chunk, for later use
-    rtmpheader[0] = 0xC4;
-    if (timestamp >= 0x00ffffff){
-      rtmpheader[1] = (timestamp >> 24) & 0xff;
-      rtmpheader[2] = (timestamp >> 16) & 0xff;
-      rtmpheader[3] = (timestamp >> 8) & 0xff;
-      rtmpheader[4] = timestamp & 0xff;
-    }
 
-    // sent actual data - never send more than chunk_snd_max at a time
-    // interleave blocks of max chunk_snd_max bytes with 0xC4 bytes to indicate continue
-    size_t len_sent = 0;
-    while (len_sent < data_len){
-      size_t to_send = std::min(data_len - len_sent, RTMPStream::chunk_snd_max);
-      if (!len_sent){
-        myConn.SendNow(dataheader, dheader_len);
-        RTMPStream::snd_cnt += dheader_len; // update the sent data counter
-        to_send -= dheader_len;
-        len_sent += dheader_len;
-      }
-      myConn.SendNow(tmpData + len_sent - dheader_len, to_send);
-      len_sent += to_send;
-      if (len_sent < data_len){
-        if (timestamp >= 0x00ffffff){
-          myConn.SendNow(rtmpheader, 5);
-          RTMPStream::snd_cnt += 5; // update the sent data counter
-        }else{
-          myConn.SendNow(rtmpheader, 1);
-          RTMPStream::snd_cnt += 1; // update the sent data counter
-        }
-      }
-    }
-    myConn.setBlocking(false);
+    // Chunk headers go into the chunker, the media data is sent as-is from the packet
+    chunker.pack(4, msg_type_id, 1, timestamp, dataheader, dheader_len, tmpData, data_len);
+    myConn.SendNow(chunker.vec, chunker.count);
   }
 
   void OutRTMP::sendHeader(){
@@ -32,6 +32,7 @@ namespace Mist{
     void sendCommand(AMF::Object &amfReply, int messageType, int streamId);
     void startPushOut(const char *args);
     uint64_t lastAck;
+    RTMPStream::ChunkWriter chunker; ///< Splits outgoing media into chunks without copying it
     HTTP::URL pushApp, pushUrl;
     uint8_t authAttempts;
     void sendSilence(uint64_t currTime);
@@ -155,8 +155,11 @@ namespace Mist{
 
     uint64_t offset = thisPacket.getInt("offset");
     sdpState.tracks[thisIdx].pack.setTimestamp((timestamp + offset) * SDP::getMultiplier(&M, thisIdx));
+    // Send all RTP packets of this frame in one go
+    if (sdpState.tracks[thisIdx].channel == -1){sdpState.tracks[thisIdx].data.cork();}
     sdpState.tracks[thisIdx].pack.sendData(socket, callBack, dataPointer, dataLen,
                                            sdpState.tracks[thisIdx].channel, meta.getCodec(thisIdx));
+    if (sdpState.tracks[thisIdx].channel == -1){sdpState.tracks[thisIdx].data.uncork();}
 
 
     if (Util::bootSecs() != sdpState.tracks[thisIdx].rtcpSent){
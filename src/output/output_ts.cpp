@@ -85,6 +85,8 @@ namespace Mist{
         }
       }
       pushSock.SetDestination(target.host, target.getPort());
+      // Every datagram holds the same amount of TS packets, so they can be segmented by the kernel
+      pushSock.setSegmentOffload(true);
       myConn.setHost(target.host);
       pushing = false;
     }else{
@@ -203,6 +205,13 @@ namespace Mist{
     Output::initialSeek();
   }
 
+  void OutTS::sendNext(){
+    // Send all datagrams of this media packet in one go
+    pushSock.cork();
+    TSOutput::sendNext();
+    pushSock.uncork();
+  }
+
   void OutTS::sendTS(const char *tsData, size_t len){
     if (pushOut){
       static size_t curFilled = 0;
@@ -61,19 +61,17 @@ namespace Mist{
   }
 
   void TSOutput::sendNext(){
-    static uint64_t lastMeta = 0;
-    if (Util::epoch() > lastMeta + 5){
-      lastMeta = Util::epoch();
-      if (selectDefaultTracks()){
-        INFO_MSG("Track selection changed - resending headers and continuing");
-        packCounter = 0;
-        return;
-      }
+    // Queue up all TS packets of this media packet, instead of sending them one by one
+    Socket::CorkGuard corked(myConn);
+    if (metaChanged() && selectDefaultTracks()){
+      INFO_MSG("Track selection changed - resending headers and continuing");
+      packCounter = 0;
+      return;
     }
     // Get ready some data to speed up accesses
-    std::string type = M.getType(thisIdx);
-    std::string codec = M.getCodec(thisIdx);
-    bool video = (type == "video");
+    DTSC::trackType type = M.getTypeId(thisIdx);
+    DTSC::trackCodec codec = M.getCodecId(thisIdx);
+    bool video = (type == DTSC::TYPE_VIDEO);
     size_t pkgPid = TS::getUniqTrackID(M, thisIdx);
     bool &firstPack = first[thisIdx];
     uint16_t &contPkg = contCounters[pkgPid];
@@ -84,7 +82,7 @@ namespace Mist{
     size_t dataLen = 0;
     thisPacket.getString("data", dataPointer, dataLen); // data
 
-    if (codec == "rawts"){
+    if (codec == DTSC::CODEC_RAWTS){
       for (size_t i = 0; i+188 <= dataLen; i+=188){sendTS(dataPointer+i, 188);}
       return;
     }
@@ -95,10 +93,10 @@ namespace Mist{
     if (video){
       bool addInit = keyframe;
       bool addEndNal = true;
-      if (codec == "H264" || codec == "HEVC"){
+      if (codec == DTSC::CODEC_H264 || codec == DTSC::CODEC_HEVC){
         uint32_t extraSize = 0;
         //Check if we need to skip sending some things
-        if (codec == "H264"){
+        if (codec == DTSC::CODEC_H264){
           size_t ctr = 0;
           char * ptr = dataPointer;
           while (ptr+4 < dataPointer+dataLen && ++ctr <= 5){
@@ -116,15 +114,15 @@ namespace Mist{
           }
         }
 
-        if (addEndNal && codec == "H264"){extraSize += 6;}
+        if (addEndNal && codec == DTSC::CODEC_H264){extraSize += 6;}
         if (addInit){
-          if (codec == "H264"){
+          if (codec == DTSC::CODEC_H264){
             MP4::AVCC avccbox;
             avccbox.setPayload(M.getInit(thisIdx));
             bs = avccbox.asAnnexB();
             extraSize += bs.size();
           }
-          if (codec == "HEVC"){
+          if (codec == DTSC::CODEC_HEVC){
             MP4::HVCC hvccbox;
             hvccbox.setPayload(M.getInit(thisIdx));
             bs = hvccbox.asAnnexB();
@@ -144,19 +142,19 @@ namespace Mist{
         fillPacket(bs.data(), bs.size(), firstPack, video, keyframe, pkgPid, contPkg);
 
         // End of previous nal unit, if not already present
-        if (addEndNal && codec == "H264"){
+        if (addEndNal && codec == DTSC::CODEC_H264){
           fillPacket("\000\000\000\001\011\360", 6, firstPack, video, keyframe, pkgPid, contPkg);
         }
         // Init data, if keyframe and not already present
         if (addInit){
-          if (codec == "H264"){
+          if (codec == DTSC::CODEC_H264){
             MP4::AVCC avccbox;
             avccbox.setPayload(M.getInit(thisIdx));
             bs = avccbox.asAnnexB();
             fillPacket(bs.data(), bs.size(), firstPack, video, keyframe, pkgPid, contPkg);
           }
           /*LTS-START*/
-          if (codec == "HEVC"){
+          if (codec == DTSC::CODEC_HEVC){
             MP4::HVCC hvccbox;
             hvccbox.setPayload(M.getInit(thisIdx));
             bs = hvccbox.asAnnexB();
@@ -165,7 +163,7 @@ namespace Mist{
           /*LTS-END*/
         }
         size_t lenSize = 4;
-        if (codec == "H264"){lenSize = (M.getInit(thisIdx)[4] & 3) + 1;}
+        if (codec == DTSC::CODEC_H264){lenSize = (M.getInit(thisIdx)[4] & 3) + 1;}
         while (i + lenSize < (unsigned int)dataLen){
           if (lenSize == 4){
             ThisNaluSize = Bit::btohl(dataPointer + i);
@@ -191,9 +189,9 @@ namespace Mist{
 
         fillPacket(dataPointer, dataLen, firstPack, video, keyframe, pkgPid, contPkg);
       }
-    }else if (type == "audio"){
+    }else if (type == DTSC::TYPE_AUDIO){
       size_t tempLen = dataLen;
-      if (codec == "AAC"){
+      if (codec == DTSC::CODEC_AAC){
         tempLen += 7;
         // Make sure TS timestamp is sample-aligned, if possible
         uint32_t freq = M.getRate(thisIdx);
@@ -206,7 +204,7 @@ namespace Mist{
           packTime = aacSamples * 90000 / freq;
         }
       }
-      if (codec == "opus"){
+      if (codec == DTSC::CODEC_OPUS){
         tempLen += 3 + (dataLen/255);
         bs = TS::Packet::getPESPS1LeadIn(tempLen, packTime, M.getBps(thisIdx));
         fillPacket(bs.data(), bs.size(), firstPack, video, keyframe, pkgPid, contPkg);
@@ -218,13 +216,13 @@ namespace Mist{
         bs.clear();
         TS::Packet::getPESAudioLeadIn(bs, tempLen, packTime, M.getBps(thisIdx));
         fillPacket(bs.data(), bs.size(), firstPack, video, keyframe, pkgPid, contPkg);
-        if (codec == "AAC"){
+        if (codec == DTSC::CODEC_AAC){
           bs = TS::getAudioHeader(dataLen, M.getInit(thisIdx));
           fillPacket(bs.data(), bs.size(), firstPack, video, keyframe, pkgPid, contPkg);
         }
       }
       fillPacket(dataPointer, dataLen, firstPack, video, keyframe, pkgPid, contPkg);
-    }else if (type == "meta"){
+    }else if (type == DTSC::TYPE_META){
       long unsigned int tempLen = dataLen;
       bs = TS::Packet::getPESMetaLeadIn(tempLen, packTime, M.getBps(thisIdx));
       fillPacket(bs.data(), bs.size(), firstPack, video, keyframe, pkgPid, contPkg);
@@ -41,7 +41,7 @@ namespace Mist{
 
     // PCM must be converted to little-endian if > 8 bits per sample
     static Util::ResizeablePointer swappy;
-    if (M.getCodec(thisIdx) == "PCM"){
+    if (M.getCodecId(thisIdx) == DTSC::CODEC_PCM){
       if (M.getSize(thisIdx) > 8 && swappy.allocate(len)){
         if (M.getSize(thisIdx) == 16){
           for (uint32_t i = 0; i < len; i += 2){
@@ -78,7 +78,7 @@ namespace Mist{
     // VoD size of the whole thing is RIFF(4)+fmt(26)+fact(12)+LIST(30)+data(8)+data itself
     uint32_t total_data = 0xFFFFFFFFul - 80;
     if (!M.getLive()){
-      DTSC::Keys keys(M.keys(mainTrack));
+      DTSC::Keys keys(M.getKeys(mainTrack));
       total_data = 0;
       size_t keyCount = keys.getEndValid();
       for (size_t i = 0; i < keyCount; ++i){total_data += keys.getSize(i);}
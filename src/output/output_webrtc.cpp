@@ -1735,7 +1735,7 @@ namespace Mist{
     }
 
     // Handle nice move-over to new track ID
-    if (prevVidTrack != INVALID_TRACK_ID && thisIdx != prevVidTrack && M.getType(thisIdx) == "video"){
+    if (prevVidTrack != INVALID_TRACK_ID && thisIdx != prevVidTrack && M.getTypeId(thisIdx) == DTSC::TYPE_VIDEO){
       if (!thisPacket.getFlag("keyframe")){
         // Ignore the packet if not a keyframe
         return;
@@ -1766,7 +1766,7 @@ namespace Mist{
     WebRTCTrack *trackPointer = 0;
 
     // If we see this is audio or video, use the webrtc track we negotiated
-    if (M.getType(tid) == "video" && webrtcTracks.count(vidTrack)){
+    if (M.getTypeId(tid) == DTSC::TYPE_VIDEO && webrtcTracks.count(vidTrack)){
       trackPointer = &webrtcTracks[vidTrack];
 
       if (lastPackMs){
@@ -1777,7 +1777,7 @@ namespace Mist{
 
 
     }
-    if (M.getType(tid) == "audio" && webrtcTracks.count(audTrack)){
+    if (M.getTypeId(tid) == DTSC::TYPE_AUDIO && webrtcTracks.count(audTrack)){
       trackPointer = &webrtcTracks[audTrack];
     }
 
@@ -1802,7 +1802,7 @@ namespace Mist{
 
     bool isKeyFrame = thisPacket.getFlag("keyframe");
     didReceiveKeyFrame = isKeyFrame;
-    if (M.getCodec(thisIdx) == "H264"){
+    if (M.getCodecId(thisIdx) == DTSC::CODEC_H264){
       if (isKeyFrame && firstKey){
         size_t offset = 0;
         while (offset + 4 < dataLen){
@@ -1820,8 +1820,11 @@ namespace Mist{
       if (repeatInit && isKeyFrame){sendSPSPPS(thisIdx, rtcTrack);}
     }
 
+    // Send all RTP packets of this frame in one go
+    udp.cork();
     rtcTrack.rtpPacketizer.sendData(&udp, onRTPPacketizerHasDataCallback, dataPointer, dataLen,
                                     rtcTrack.payloadType, M.getCodec(thisIdx));
+    udp.uncork();
 
     //Trigger a re-send of the Sender Report for every track every ~250ms
     if (lastSR+250 < Util::bootMS()){
@@ -4,35 +4,15 @@
 #include <mist/config.h>
 #include <mist/auth.h>
 #include <mist/comms.h>
+#include <mist/procs.h>
+#include <mist/timing.h>
 #include <mist/triggers.h>
+#include <deque>
+#include <set>
 #include <signal.h>
 #include <stdio.h>
+#include <unistd.h>
 
-// Global counters
-uint64_t thisType = 0;
-uint64_t now = Util::bootSecs();
-uint64_t currentConnections = 0;
-uint64_t lastSecond = 0;
-uint64_t globalTime = 0;
-uint64_t globalDown = 0;
-uint64_t globalUp = 0;
-uint64_t globalPktcount = 0;
-uint64_t globalPktloss = 0;
-uint64_t globalPktretrans = 0;
-// Stores last values of each connection
-std::map<size_t, uint64_t> connTime;
-std::map<size_t, uint64_t> connDown;
-std::map<size_t, uint64_t> connUp;
-std::map<size_t, uint64_t> connPktcount;
-std::map<size_t, uint64_t> connPktloss;
-std::map<size_t, uint64_t> connPktretrans;
-// Counts the duration a connector has been active
-std::map<std::string, uint64_t> connectorCount;
-std::map<std::string, uint64_t> connectorLastActive;
-std::map<std::string, uint64_t> hostCount;
-std::map<std::string, uint64_t> hostLastActive;
-std::map<std::string, uint64_t> streamCount;
-std::map<std::string, uint64_t> streamLastActive;
 // Set to True when a session gets invalidated, so that we know to run a new USER_NEW trigger
 bool forceTrigger = false;
 void handleSignal(int signum){
@@ -41,13 +21,203 @@ void handleSignal(int signum){
   }
 }
 
-uint64_t lastUrlCookieTime;
-std::string lastUrl;
-std::string lastCookie;
-
 const char nullAddress[16] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
 
-void userOnActive(Comms::Connections &connections, size_t idx){
+/// Last values of each connection, used to add the increase in stats to the session totals
+struct connStats{
+  uint64_t time;
+  uint64_t down;
+  uint64_t up;
+  uint64_t pktcount;
+  uint64_t pktloss;
+  uint64_t pktretrans;
+  connStats() : time(0), down(0), up(0), pktcount(0), pktloss(0), pktretrans(0){}
+};
+
+/// A single session: its connections page, its record on the statistics page and everything needed
+/// to fill in the USER_NEW and USER_END trigger payloads. Used once by a standalone MistSession
+/// process, and once for every session by the session manager.
+class Session{
+public:
+  Session(const std::string &sessId, const std::string &stream, const std::string &ip,
+          const std::string &tkn, const std::string &protocol, const std::string &reqUrl);
+  ~Session();
+  bool init(Comms::Sessions &stats, bool blocking);
+  void unlock();
+  bool isViewer() const{return !thisType;}
+  bool isActive();
+  bool isInactive() const{return Util::bootSecs() - lastSeen > statDelay;}
+  size_t getStatDelay() const{return statDelay;}
+  void update(Comms::Sessions &stats);
+  void close();
+  void release(Comms::Sessions &stats);
+  std::string newPayload(bool reSync) const;
+  std::string endPayload(const std::string &tags) const;
+  void onActive(size_t idx);
+  void onDisconnect(size_t idx);
+
+  const std::string sessionId;
+  const std::string streamName;
+  const std::string ip;
+  const std::string token;
+  const std::string protocol;
+  const std::string reqUrl;
+  Comms::Connections *connections;
+  uint64_t statIdx;
+  bool duplicate;
+  bool rejected;
+  std::string lastCookie;
+
+private:
+  Session(const Session &rhs);
+  Session &operator=(const Session &rhs);
+  IPC::semaphore sessionLock;
+  bool locked;
+  std::string host;
+  uint64_t thisType;
+  size_t statDelay;
+  uint64_t bootTime;
+  uint64_t now;
+  uint64_t lastSeen;
+  uint64_t currentConnections;
+  uint64_t lastSecond;
+  uint64_t globalTime;
+  uint64_t globalDown;
+  uint64_t globalUp;
+  uint64_t globalPktcount;
+  uint64_t globalPktloss;
+  uint64_t globalPktretrans;
+  uint64_t lastUrlCookieTime;
+  std::string lastUrl;
+  // Stores last values of each connection
+  std::map<size_t, connStats> conns;
+  // Counts the duration a connector has been active
+  std::map<std::string, uint64_t> connectorCount;
+  std::map<std::string, uint64_t> connectorLastActive;
+  std::map<std::string, uint64_t> hostCount;
+  std::map<std::string, uint64_t> hostLastActive;
+  std::map<std::string, uint64_t> streamCount;
+  std::map<std::string, uint64_t> streamLastActive;
+};
+
+Session::Session(const std::string &sessId, const std::string &stream, const std::string &_ip,
+                 const std::string &tkn, const std::string &_protocol, const std::string &_reqUrl)
+    : sessionId(sessId), streamName(stream), ip(_ip), token(tkn), protocol(_protocol), reqUrl(_reqUrl){
+  connections = 0;
+  statIdx = INVALID_RECORD_INDEX;
+  duplicate = false;
+  rejected = false;
+  locked = false;
+  bootTime = Util::getMicros();
+  now = Util::bootSecs();
+  lastSeen = now;
+  currentConnections = 0;
+  lastSecond = 0;
+  globalTime = 0;
+  globalDown = 0;
+  globalUp = 0;
+  globalPktcount = 0;
+  globalPktloss = 0;
+  globalPktretrans = 0;
+  lastUrlCookieTime = 0;
+  host = Socket::getBinForms(ip);
+  if (host.size() > 16){host = host.substr(0, 16);}
+  statDelay = STATS_DELAY;
+  thisType = 0;
+  // Determine session type, since triggers only get run for viewer type sessions
+  if (sessionId[0] == 'I'){
+    thisType = 1;
+    statDelay = 2;
+  }else if (sessionId[0] == 'O'){
+    thisType = 2;
+    statDelay = 2;
+  }else if (sessionId[0] == 'U'){
+    thisType = 3;
+  }
+}
+
+Session::~Session(){
+  unlock();
+  delete connections;
+}
+
+/// \brief Takes the session lock, claims a record on the statistics page and creates the connections page.
+/// The session lock stays taken until unlock() is called, which is what keeps outputs from
+/// registering their connections before the USER_NEW trigger has been answered.
+/// \param blocking: Wait up to a second for the session lock, instead of failing right away
+/// \return False if the session could not be started. Sets duplicate if it was already running.
+bool Session::init(Comms::Sessions &stats, bool blocking){
+  std::string ipHex;
+  Socket::hostBytesToStr(host.c_str(), host.size(), ipHex);
+  VERYHIGH_MSG("Starting a new session. Passed variables are stream name '%s', session token '%s', protocol '%s', requested URL '%s', IP '%s' and session id '%s'",
+  streamName.c_str(), token.c_str(), protocol.c_str(), reqUrl.c_str(), ipHex.c_str(), sessionId.c_str());
+
+  // Try to lock to ensure we are the only process initialising this session
+  char semName[NAME_BUFFER_SIZE];
+  snprintf(semName, NAME_BUFFER_SIZE, SEM_SESSION, sessionId.c_str());
+  sessionLock.open(semName, O_CREAT | O_RDWR, ACCESSPERMS, 1);
+  // If the lock fails, the previous Session process must've failed in spectacular fashion
+  // It's the Controller's task to clean everything up. When the lock fails, this cleanup hasn't happened yet
+  if (!(blocking ? sessionLock.tryWaitOneSecond() : sessionLock.tryWait())){
+    FAIL_MSG("Session '%s' already locked", sessionId.c_str());
+    return false;
+  }
+  locked = true;
+
+  // Check if a page already exists for this session ID. If so, quit
+  {
+    IPC::sharedPage dataPage;
+    char userPageName[NAME_BUFFER_SIZE];
+    snprintf(userPageName, NAME_BUFFER_SIZE, COMMS_SESSIONS, sessionId.c_str());
+    dataPage.init(userPageName, 0, false, false);
+    if (dataPage){
+      INFO_MSG("Session '%s' already has a running process", sessionId.c_str());
+      duplicate = true;
+      unlock();
+      return false;
+    }
+  }
+
+  // Claim a spot in shared memory for this session on the global statistics page
+  stats.reload(false, true);
+  if (!stats){
+    FAIL_MSG("Unable to register entry for session '%s' on the stats page", sessionId.c_str());
+    unlock();
+    return false;
+  }
+  statIdx = stats.getIndex();
+
+  // Initialise global session data
+  stats.setHost(host);
+  stats.setSessId(sessionId);
+  stats.setStream(streamName);
+  if (protocol.size() && protocol != "HTTP"){connectorLastActive[protocol] = now;}
+  if (streamName.size()){streamLastActive[streamName] = now;}
+  if (memcmp(host.data(), nullAddress, 16)){hostLastActive[host] = now;}
+
+  // Open the shared memory page containing statistics for each individual connection in this session
+  connections = new Comms::Connections();
+  connections->reload(sessionId, true);
+  return true;
+}
+
+/// Starts allowing viewers
+void Session::unlock(){
+  if (!locked){return;}
+  locked = false;
+  sessionLock.post();
+  if (!duplicate && statIdx != INVALID_RECORD_INDEX){
+    INFO_MSG("Started new session %s in %.3f ms", sessionId.c_str(), (double)Util::getMicros(bootTime)/1000.0);
+  }
+}
+
+/// Returns true as long as there are active connections, or were so recently, and the session was not rejected
+bool Session::isActive(){
+  return connections && (currentConnections || now - lastSeen <= statDelay) && !connections->getExit();
+}
+
+void Session::onActive(size_t idx){
+  Comms::Connections &connections = *this->connections;
   uint64_t lastUpdate = connections.getNow(idx);
   if (lastUpdate < now - 10 && thisType != 1){return;}
   ++currentConnections;
@@ -77,55 +247,419 @@ void userOnActive(Comms::Connections &connections, size_t idx){
     hostCount[thisHost]++;
     if (!hostLastActive.count(thisHost) || hostLastActive[thisHost] < lastUpdate){hostLastActive[thisHost] = lastUpdate;}
   }
+  connStats &conn = conns[idx];
   // Sanity checks
-  if (connections.getDown(idx) < connDown[idx]){
+  if (connections.getDown(idx) < conn.down){
     MEDIUM_MSG("Connection downloaded bytes should be a counter, but has decreased in value");
-    connDown[idx] = connections.getDown(idx);
+    conn.down = connections.getDown(idx);
   }
-  if (connections.getUp(idx) < connUp[idx]){
+  if (connections.getUp(idx) < conn.up){
     MEDIUM_MSG("Connection uploaded bytes should be a counter, but has decreased in value");
-    connUp[idx] = connections.getUp(idx);
+    conn.up = connections.getUp(idx);
   }
-  if (connections.getPacketCount(idx) < connPktcount[idx]){
+  if (connections.getPacketCount(idx) < conn.pktcount){
     MEDIUM_MSG("Connection packet count should be a counter, but has decreased in value");
-    connPktcount[idx] = connections.getPacketCount(idx);
+    conn.pktcount = connections.getPacketCount(idx);
   }
-  if (connections.getPacketLostCount(idx) < connPktloss[idx]){
+  if (connections.getPacketLostCount(idx) < conn.pktloss){
     MEDIUM_MSG("Connection packet loss count should be a counter, but has decreased in value");
-    connPktloss[idx] = connections.getPacketLostCount(idx);
+    conn.pktloss = connections.getPacketLostCount(idx);
   }
-  if (connections.getPacketRetransmitCount(idx) < connPktretrans[idx]){
+  if (connections.getPacketRetransmitCount(idx) < conn.pktretrans){
     MEDIUM_MSG("Connection packets retransmitted should be a counter, but has decreased in value");
-    connPktretrans[idx] = connections.getPacketRetransmitCount(idx);
+    conn.pktretrans = connections.getPacketRetransmitCount(idx);
   }
   // Add increase in stats to global stats
-  globalDown += connections.getDown(idx) - connDown[idx];
-  globalUp += connections.getUp(idx) - connUp[idx];
-  globalPktcount += connections.getPacketCount(idx) - connPktcount[idx];
-  globalPktloss += connections.getPacketLostCount(idx) - connPktloss[idx];
-  globalPktretrans += connections.getPacketRetransmitCount(idx) - connPktretrans[idx];
+  globalDown += connections.getDown(idx) - conn.down;
+  globalUp += connections.getUp(idx) - conn.up;
+  globalPktcount += connections.getPacketCount(idx) - conn.pktcount;
+  globalPktloss += connections.getPacketLostCount(idx) - conn.pktloss;
+  globalPktretrans += connections.getPacketRetransmitCount(idx) - conn.pktretrans;
   // Set last values of this connection
-  connTime[idx]++;
-  connDown[idx] = connections.getDown(idx);
-  connUp[idx] = connections.getUp(idx);
-  connPktcount[idx] = connections.getPacketCount(idx);
-  connPktloss[idx] = connections.getPacketLostCount(idx);
-  connPktretrans[idx] = connections.getPacketRetransmitCount(idx);
+  conn.time++;
+  conn.down = connections.getDown(idx);
+  conn.up = connections.getUp(idx);
+  conn.pktcount = connections.getPacketCount(idx);
+  conn.pktloss = connections.getPacketLostCount(idx);
+  conn.pktretrans = connections.getPacketRetransmitCount(idx);
 }
 
 /// \brief Remove mappings of inactive connections
-void userOnDisconnect(Comms::Connections & connections, size_t idx){
-  connTime.erase(idx);
-  connDown.erase(idx);
-  connUp.erase(idx);
-  connPktcount.erase(idx);
-  connPktloss.erase(idx);
-  connPktretrans.erase(idx);
+void Session::onDisconnect(size_t idx){
+  conns.erase(idx);
+}
+
+/// Loops through all connection entries to get a summary of statistics, and writes it to the statistics page.
+/// Meant to be called once per second.
+void Session::update(Comms::Sessions &stats){
+  currentConnections = 0;
+  lastSecond = 0;
+  now = Util::bootSecs();
+  lastUrlCookieTime = 0;
+
+  if (connections){COMM_LOOP((*connections), onActive(id), onDisconnect(id));}
+  if (currentConnections){
+    globalTime++;
+    lastSeen = now;
+  }
+
+  stats.setIndex(statIdx);
+  if (!stats){return;}
+  stats.setTime(globalTime);
+  stats.setDown(globalDown);
+  stats.setUp(globalUp);
+  stats.setPacketCount(globalPktcount);
+  stats.setPacketLostCount(globalPktloss);
+  stats.setPacketRetransmitCount(globalPktretrans);
+  stats.setLastSecond(lastSecond);
+  stats.setNow(now);
+
+  if (currentConnections){
+    {
+      // Convert active protocols to string
+      std::stringstream connectorSummary;
+      for (std::map<std::string, uint64_t>::iterator it = connectorLastActive.begin();
+            it != connectorLastActive.end(); ++it){
+        if (now - it->second < statDelay){
+          connectorSummary << (connectorSummary.str().size() ? "," : "") << it->first;
+        }
+      }
+      stats.setConnector(connectorSummary.str());
+    }
+
+    {
+      // Set active host to last active or 0 if there were various hosts active recently
+      std::string thisHost;
+      for (std::map<std::string, uint64_t>::iterator it = hostLastActive.begin();
+            it != hostLastActive.end(); ++it){
+        if (now - it->second < statDelay){
+          if (!thisHost.size()){
+            thisHost = it->first;
+          }else if (thisHost != it->first){
+            thisHost = nullAddress;
+            break;
+          }
+        }
+      }
+      if (!thisHost.size()){
+        thisHost = nullAddress;
+      }
+      stats.setHost(thisHost);
+    }
+
+    {
+      // Set active stream name to last active or "" if there were multiple streams active recently
+      std::string thisStream = "";
+      for (std::map<std::string, uint64_t>::iterator it = streamLastActive.begin();
+            it != streamLastActive.end(); ++it){
+        if (now - it->second < statDelay){
+          if (!thisStream.size()){
+            thisStream = it->first;
+          }else if (thisStream != it->first){
+            thisStream = "";
+            break;
+          }
+        }
+      }
+      stats.setStream(thisStream);
+    }
+  }
+}
+
+/// Deletes the connections page, after disconnecting any connections that are left
+void Session::close(){
+  if (!connections){return;}
+  rejected = connections->getExit();
+  delete connections;
+  connections = 0;
+}
+
+/// Gives up the record on the statistics page
+void Session::release(Comms::Sessions &stats){
+  if (statIdx == INVALID_RECORD_INDEX){return;}
+  stats.setIndex(statIdx);
+  stats.unload();
+  statIdx = INVALID_RECORD_INDEX;
+}
+
+/// Returns the USER_NEW payload. Re-syncs include the last requested URL and use the summarised host.
+std::string Session::newPayload(bool reSync) const{
+  if (!reSync){
+    return streamName + "\n" + ip + "\n" + token + "\n" + protocol + "\n" + reqUrl + "\n" + sessionId;
+  }
+  std::string hostStr;
+  Socket::hostBytesToStr(host.data(), 16, hostStr);
+  return streamName + "\n" + hostStr + "\n" + token + "\n" + protocol + "\n" + reqUrl + "\n" + sessionId + "\n" + lastUrl;
+}
+
+/// Returns the USER_END payload
+std::string Session::endPayload(const std::string &tags) const{
+  // Convert connector, host and stream into lists and counts
+  std::stringstream connectorSummary;
+  std::stringstream connectorTimes;
+  for (std::map<std::string, uint64_t>::const_iterator it = connectorCount.begin(); it != connectorCount.end(); ++it){
+    connectorSummary << (connectorSummary.str().size() ? "," : "") << it->first;
+    connectorTimes << (connectorTimes.str().size() ? "," : "") << it->second;
+  }
+  std::stringstream hostSummary;
+  std::stringstream hostTimes;
+  for (std::map<std::string, uint64_t>::const_iterator it = hostCount.begin(); it != hostCount.end(); ++it){
+    std::string host;
+    Socket::hostBytesToStr(it->first.data(), 16, host);
+    hostSummary << (hostSummary.str().size() ? "," : "") << host;
+    hostTimes << (hostTimes.str().size() ? "," : "") << it->second;
+  }
+  std::stringstream streamSummary;
+  std::stringstream streamTimes;
+  for (std::map<std::string, uint64_t>::const_iterator it = streamCount.begin(); it != streamCount.end(); ++it){
+    streamSummary << (streamSummary.str().size() ? "," : "") << it->first;
+    streamTimes << (streamTimes.str().size() ? "," : "") << it->second;
+  }
+
+  std::stringstream summary;
+  summary << token << "\n"
+        << streamSummary.str() << "\n"
+        << connectorSummary.str() << "\n"
+        << hostSummary.str() << "\n"
+        << globalTime << "\n"
+        << globalUp << "\n"
+        << globalDown << "\n"
+        << tags << "\n"
+        << hostTimes.str() << "\n"
+        << connectorTimes.str() << "\n"
+        << streamTimes.str() << "\n"
+        << sessionId;
+  return summary.str();
+}
+
+/// Runs the USER_NEW trigger, rejecting the session if it is denied.
+/// Returns false if the session was rejected.
+bool userNew(Session &S, bool reSync){
+  if (!S.isViewer() || !Triggers::shouldTrigger("USER_NEW", S.streamName)){return true;}
+  if (reSync){INFO_MSG("Triggering USER_NEW for stream %s", S.streamName.c_str());}
+  if (S.lastCookie.size()){setenv("Cookie", S.lastCookie.c_str(), 1);}
+  if (!Triggers::doTrigger("USER_NEW", S.newPayload(reSync), S.streamName)){
+    if (reSync){INFO_MSG("USER_NEW rejected stream %s", S.streamName.c_str());}
+    // Mark all connections of this session as finished, since this viewer is not allowed to view this stream
+    Util::logExitReason(ER_TRIGGER, "Session rejected by USER_NEW");
+    S.connections->setExit();
+    S.connections->finishAll();
+    return false;
+  }
+  if (reSync){INFO_MSG("USER_NEW accepted stream %s", S.streamName.c_str());}
+  return true;
+}
+
+/// Runs the USER_END trigger
+void userEnd(Session &S, const std::string &tags){
+  if (!S.isViewer() || !Triggers::shouldTrigger("USER_END", S.streamName)){return;}
+  if (S.lastCookie.size()){setenv("Cookie", S.lastCookie.c_str(), 1);}
+  Triggers::doTrigger("USER_END", S.endPayload(tags), S.streamName);
+}
+
+/// What a session manager helper process does for a session
+enum helperType{HELPER_USER_NEW, HELPER_RESYNC, HELPER_USER_END, HELPER_STOP};
+
+/// Forks off a short-lived child process that does the blocking work for a session: running
+/// USER_NEW, USER_END or disconnecting all connections. The trigger code passes data through
+/// environment variables and static buffers, so this cannot be done in threads. The child shares
+/// the connections page with the manager, so rejections are seen through connections.getExit().
+/// Returns the child PID, or 0 if the work was done in this process because forking failed.
+pid_t startHelper(Session &S, helperType type, const std::string &tags){
+  Util::Procs::fork_prepare();
+  pid_t child = fork();
+  if (child > 0){
+    Util::Procs::fork_complete();
+    return child;
+  }
+  // The child exits as soon as its work is done and has no use for a reaper thread
+  Util::Procs::fork_complete(false);
+  if (child < 0){
+    WARN_MSG("Could not fork helper for session %s, running in-process", S.sessionId.c_str());
+  }
+  switch (type){
+  case HELPER_USER_NEW: userNew(S, false); break;
+  case HELPER_RESYNC: userNew(S, true); break;
+  case HELPER_USER_END: userEnd(S, tags); break;
+  case HELPER_STOP: S.connections->finishAll(); break;
+  }
+  if (!child){_exit(0);}
+  return 0;
+}
+
+/// Session states in the session manager
+enum managedState{
+  MANAGED_STARTING, ///< Session lock is held while USER_NEW runs
+  MANAGED_ACTIVE,   ///< Tracking connections
+  MANAGED_STOPPING, ///< Disconnecting all connections on request of the controller
+  MANAGED_SLEEPING  ///< Rejected viewer session, kept invalidated until it times out or is re-synced
+};
+
+/// A session tracked by the session manager, with its helper process and state
+struct managedSession{
+  Session *S;
+  managedState state;
+  pid_t helper;
+  uint64_t sleepStart;
+};
+
+/// Ends a session tracked by the manager: deletes the connections page, fires USER_END and then
+/// either keeps the rejected session around or gives up its statistics record.
+/// Returns true if the session can be removed.
+bool endManaged(managedSession &M, Comms::Sessions &stats){
+  M.S->close();
+  stats.setIndex(M.S->statIdx);
+  std::string tags = stats ? stats.getTags() : "";
+  if (M.S->isViewer() && Triggers::shouldTrigger("USER_END", M.S->streamName)){startHelper(*M.S, HELPER_USER_END, tags);}
+  if (M.S->isViewer() && M.S->rejected){
+    M.state = MANAGED_SLEEPING;
+    M.sleepStart = Util::bootSecs();
+    return false;
+  }
+  INFO_MSG("Shutting down session %s", M.S->sessionId.c_str());
+  M.S->release(stats);
+  return true;
+}
+
+/// Runs MistSession as the session manager: a single process that tracks every session that
+/// outputs queue on the session request page, instead of a process per session.
+int runManager(Util::Config &config){
+  Comms::SessionRequests requests;
+  requests.reload(true);
+  if (!requests){
+    FAIL_MSG("Unable to create the session request page");
+    return 1;
+  }
+  if (requests.getStatus(0) != COMM_STATUS_INVALID && requests.getPid(0) != (uint32_t)getpid() &&
+      Util::Procs::isRunning(requests.getPid(0))){
+    FAIL_MSG("Session manager already running as PID %" PRIu32, requests.getPid(0));
+    requests.setMaster(false);
+    return 1;
+  }
+  // Drop anything left behind by a previous manager and claim the first record for ourselves
+  for (size_t i = 0; i < requests.recordCount(); ++i){requests.setStatus(COMM_STATUS_INVALID, i);}
+  requests.setPid(getpid(), 0);
+  requests.setStatus(COMM_STATUS_ACTIVE | COMM_STATUS_NOKILL, 0);
+
+  Comms::Sessions stats;
+  std::map<std::string, managedSession> active;
+  std::deque<managedSession> sleeping;
+  uint64_t lastTick = 0;
+  INFO_MSG("Session manager started");
+
+  while (config.is_active){
+    // Start tracking newly requested sessions
+    for (size_t id = 1; id < requests.recordCount(); ++id){
+      if (requests.getStatus(id) == COMM_STATUS_INVALID){continue;}
+      if (!(requests.getStatus(id) & COMM_STATUS_DISCONNECT) && !Util::Procs::isRunning(requests.getPid(id))){
+        requests.setStatus(COMM_STATUS_INVALID, id);
+        continue;
+      }
+      if (!(requests.getStatus(id) & COMM_STATUS_DISCONNECT)){continue;}
+      std::string sessId = requests.getSessId(id);
+      if (sessId.size() && !active.count(sessId)){
+        managedSession M;
+        M.S = new Session(sessId, requests.getStream(id), requests.getHost(id), requests.getTkn(id),
+                          requests.getProtocol(id), requests.getReqUrl(id));
+        M.helper = 0;
+        M.sleepStart = 0;
+        if (!M.S->init(stats, false)){
+          delete M.S;
+        }else{
+          stats.setStatus(stats.getStatus() | COMM_STATUS_MANAGED);
+          M.state = MANAGED_STARTING;
+          if (M.S->isViewer() && Triggers::shouldTrigger("USER_NEW", M.S->streamName)){
+            M.helper = startHelper(*M.S, HELPER_USER_NEW, "");
+          }
+          active[sessId] = M;
+        }
+      }
+      requests.setStatus(COMM_STATUS_INVALID, id);
+    }
+
+    // Sessions waiting for a helper process, or for the controller to change their status
+    std::set<std::string> ended;
+    for (std::map<std::string, managedSession>::iterator it = active.begin(); it != active.end(); ++it){
+      managedSession &M = it->second;
+      if (M.helper && Util::Procs::childRunning(M.helper)){continue;}
+      M.helper = 0;
+      if (M.state == MANAGED_STARTING){
+        M.S->unlock();
+        M.state = MANAGED_ACTIVE;
+      }
+      if (M.state == MANAGED_STOPPING){
+        ended.insert(it->first);
+        continue;
+      }
+      stats.setIndex(M.S->statIdx);
+      if (stats && (stats.getStatus() & COMM_STATUS_REQDISCONNECT)){
+        M.helper = startHelper(*M.S, HELPER_STOP, "");
+        M.state = MANAGED_STOPPING;
+        continue;
+      }
+      if (stats && (stats.getStatus() & COMM_STATUS_RETRIGGER)){
+        stats.setStatus(stats.getStatus() & ~COMM_STATUS_RETRIGGER);
+        if (M.S->isViewer() && Triggers::shouldTrigger("USER_NEW", M.S->streamName)){
+          M.helper = startHelper(*M.S, HELPER_RESYNC, "");
+        }
+      }
+    }
+
+    // Once per second, update statistics for all sessions and end the inactive ones
+    if (Util::bootMS() - lastTick >= 1000){
+      lastTick = Util::bootMS();
+      for (std::map<std::string, managedSession>::iterator it = active.begin(); it != active.end(); ++it){
+        managedSession &M = it->second;
+        if (M.state == MANAGED_STARTING){continue;}
+        M.S->update(stats);
+        if (M.state == MANAGED_ACTIVE && !M.helper && !M.S->isActive()){ended.insert(it->first);}
+      }
+      for (std::deque<managedSession>::iterator it = sleeping.begin(); it != sleeping.end();){
+        stats.setIndex(it->S->statIdx);
+        // Keep session invalidated for 10 minutes, or until the session gets re-synced
+        if (Util::bootSecs() - it->sleepStart >= SESS_TIMEOUT || !stats || (stats.getStatus() & COMM_STATUS_RETRIGGER)){
+          INFO_MSG("Shutting down session %s", it->S->sessionId.c_str());
+          it->S->release(stats);
+          delete it->S;
+          it = sleeping.erase(it);
+        }else{
+          ++it;
+        }
+      }
+    }
+
+    for (std::set<std::string>::iterator it = ended.begin(); it != ended.end(); ++it){
+      managedSession &M = active[*it];
+      M.S->update(stats);
+      if (endManaged(M, stats)){
+        delete M.S;
+      }else{
+        sleeping.push_back(M);
+      }
+      active.erase(*it);
+    }
+    Util::sleep(10);
+  }
+
+  // Shut down all sessions, and stop accepting new ones
+  for (size_t i = 0; i < requests.recordCount(); ++i){requests.setStatus(COMM_STATUS_INVALID, i);}
+  for (std::map<std::string, managedSession>::iterator it = active.begin(); it != active.end(); ++it){
+    if (it->second.state == MANAGED_STARTING){it->second.S->unlock();}
+    endManaged(it->second, stats);
+    it->second.S->release(stats);
+    delete it->second.S;
+  }
+  for (std::deque<managedSession>::iterator it = sleeping.begin(); it != sleeping.end(); ++it){
+    it->S->release(stats);
+    delete it->S;
+  }
+  stats.setIndex(INVALID_RECORD_INDEX);
+  INFO_MSG("Session manager shutting down: %s", Util::exitReason);
+  return 0;
 }
 
 int main(int argc, char **argv){
   Comms::Sessions sessions;
-  uint64_t lastSeen = Util::bootSecs();
   Util::redirectLogsIfNeeded();
   signal(SIGUSR1, handleSignal);
   // Init config and parse arguments
@@ -136,9 +670,17 @@ int main(int argc, char **argv){
   option.null();
   option["arg_num"] = 1;
   option["arg"] = "string";
-  option["help"] = "Session identifier of the entire session";
+  option["default"] = "";
+  option["help"] = "Session identifier of the entire session. Required unless running as session manager";
   config.addOption("sessionid", option);
 
+  option.null();
+  option["long"] = "manager";
+  option["short"] = "m";
+  option["value"].append(0u);
+  option["help"] = "Run as session manager, tracking all sessions that outputs hand over in this single process";
+  config.addOption("manager", option);
+
   option.null();
   option["long"] = "streamname";
   option["short"] = "s";
@@ -185,258 +727,43 @@ int main(int argc, char **argv){
   config.addOption("requrl", option);
 
   config.activate();
-  if (!(config.parseArgs(argc, argv))){
+  if (!(config.parseArgs(argc, argv)) || (!config.getBool("manager") && !config.getString("sessionid").size())){
     config.printHelp(std::cout);
     FAIL_MSG("Cannot start a new session due to invalid arguments");
     return 1;
   }
 
-  const uint64_t bootTime = Util::getMicros();
-  // Get session ID, session mode and other variables used as payload for the USER_NEW and USER_END triggers
-  const std::string thisStreamName = config.getString("streamname");
-  const std::string thisToken = config.getString("tkn");
-  const std::string thisProtocol = config.getString("protocol");
-  const std::string thisReqUrl = config.getString("requrl");
-  const std::string thisSessionId = config.getString("sessionid");
-  std::string thisHost = Socket::getBinForms(config.getString("ip"));
-  if (thisHost.size() > 16){thisHost = thisHost.substr(0, 16);}
-
-  std::string ipHex;
-  Socket::hostBytesToStr(thisHost.c_str(), thisHost.size(), ipHex);
-  VERYHIGH_MSG("Starting a new session. Passed variables are stream name '%s', session token '%s', protocol '%s', requested URL '%s', IP '%s' and session id '%s'",
-  thisStreamName.c_str(), thisToken.c_str(), thisProtocol.c_str(), thisReqUrl.c_str(), ipHex.c_str(), thisSessionId.c_str());
-
-  // Try to lock to ensure we are the only process initialising this session
-  IPC::semaphore sessionLock;
-  char semName[NAME_BUFFER_SIZE];
-  snprintf(semName, NAME_BUFFER_SIZE, SEM_SESSION, thisSessionId.c_str());
-  sessionLock.open(semName, O_CREAT | O_RDWR, ACCESSPERMS, 1);
-  // If the lock fails, the previous Session process must've failed in spectacular fashion
-  // It's the Controller's task to clean everything up. When the lock fails, this cleanup hasn't happened yet
-  if (!sessionLock.tryWaitOneSecond()){
-    FAIL_MSG("Session '%s' already locked", thisSessionId.c_str());
-    return 1;
-  }
+  if (config.getBool("manager")){return runManager(config);}
 
-  // Check if a page already exists for this session ID. If so, quit
-  {
-    IPC::sharedPage dataPage;
-    char userPageName[NAME_BUFFER_SIZE];
-    snprintf(userPageName, NAME_BUFFER_SIZE, COMMS_SESSIONS, thisSessionId.c_str());
-    dataPage.init(userPageName, 0, false, false);
-    if (dataPage){
-      INFO_MSG("Session '%s' already has a running process", thisSessionId.c_str());
-      sessionLock.post();
-      return 0;
+  // Get session ID, session mode and other variables used as payload for the USER_NEW and USER_END triggers
+  Session S(config.getString("sessionid"), config.getString("streamname"), config.getString("ip"),
+            config.getString("tkn"), config.getString("protocol"), config.getString("requrl"));
+  if (!S.init(sessions, true)){return S.duplicate ? 0 : 1;}
+
+  // Do a USER_NEW trigger if it is defined for this stream
+  userNew(S, false);
+  S.unlock();
+
+  // Stay active until Mist exits or we no longer have an active connection
+  while (config.is_active && S.isActive()){
+    S.update(sessions);
+
+    // Retrigger USER_NEW if a re-sync was requested
+    if (S.isViewer() && forceTrigger){
+      forceTrigger = false;
+      if (!userNew(S, true)){break;}
     }
+    Util::wait(1000);
   }
-
-  // Claim a spot in shared memory for this session on the global statistics page
-  sessions.reload();
-  if (!sessions){
-    FAIL_MSG("Unable to register entry for session '%s' on the stats page", thisSessionId.c_str());
-    sessionLock.post();
-    return 1;
-  }
-
-  // Initialise global session data
-  sessions.setHost(thisHost);
-  sessions.setSessId(thisSessionId);
-  sessions.setStream(thisStreamName);
-  if (thisProtocol.size() && thisProtocol != "HTTP"){connectorLastActive[thisProtocol] = now;}
-  if (thisStreamName.size()){streamLastActive[thisStreamName] = now;}
-  if (memcmp(thisHost.data(), nullAddress, 16)){hostLastActive[thisHost] = now;}
-
-  size_t statDelay = STATS_DELAY;
-  // Determine session type, since triggers only get run for viewer type sessions
-  if (thisSessionId[0] == 'I'){
-    thisType = 1;
-    statDelay = 2;
-  } else if (thisSessionId[0] == 'O'){
-    thisType = 2;
-    statDelay = 2;
-  } else if (thisSessionId[0] == 'U'){
-    thisType = 3;
-  }
-  bool shouldSleep = false;
-
-  //Scope to ensure the connections page is deleted before other cleanup happens
-  {
-    // Open the shared memory page containing statistics for each individual connection in this session
-    Comms::Connections connections;
-    connections.reload(thisSessionId, true);
-
-    // Do a USER_NEW trigger if it is defined for this stream
-    if (!thisType && Triggers::shouldTrigger("USER_NEW", thisStreamName)){
-      std::string payload = thisStreamName + "\n" + config.getString("ip") + "\n" +
-                            thisToken + "\n" + thisProtocol +
-                            "\n" + thisReqUrl + "\n" + thisSessionId;
-      if (!Triggers::doTrigger("USER_NEW", payload, thisStreamName)){
-        // Mark all connections of this session as finished, since this viewer is not allowed to view this stream
-        Util::logExitReason(ER_TRIGGER, "Session rejected by USER_NEW");
-        connections.setExit();
-        connections.finishAll();
-      }
-    }
-
-    //start allowing viewers
-    sessionLock.post();
-
-    INFO_MSG("Started new session %s in %.3f ms", thisSessionId.c_str(), (double)Util::getMicros(bootTime)/1000.0);
-
-    // Stay active until Mist exits or we no longer have an active connection
-    while (config.is_active && (currentConnections || now - lastSeen <= statDelay) && !connections.getExit()){
-      currentConnections = 0;
-      lastSecond = 0;
-      now = Util::bootSecs();
-      lastUrlCookieTime = 0;
-
-      // Loop through all connection entries to get a summary of statistics
-      COMM_LOOP(connections, userOnActive(connections, id), userOnDisconnect(connections, id));
-      if (currentConnections){
-        globalTime++;
-        lastSeen = now;
-        if (lastCookie.size()){
-          setenv("Cookie", lastCookie.c_str(), 1);
-        }
-      }
-
-
-      sessions.setTime(globalTime);
-      sessions.setDown(globalDown);
-      sessions.setUp(globalUp);
-      sessions.setPacketCount(globalPktcount);
-      sessions.setPacketLostCount(globalPktloss);
-      sessions.setPacketRetransmitCount(globalPktretrans);
-      sessions.setLastSecond(lastSecond);
-      sessions.setNow(now);
-
-      if (currentConnections){
-        {
-          // Convert active protocols to string
-          std::stringstream connectorSummary;
-          for (std::map<std::string, uint64_t>::iterator it = connectorLastActive.begin();
-                it != connectorLastActive.end(); ++it){
-            if (now - it->second < statDelay){
-              connectorSummary << (connectorSummary.str().size() ? "," : "") << it->first;
-            }
-          }
-          sessions.setConnector(connectorSummary.str());
-        }
-
-        {
-          // Set active host to last active or 0 if there were various hosts active recently
-          std::string thisHost;
-          for (std::map<std::string, uint64_t>::iterator it = hostLastActive.begin();
-                it != hostLastActive.end(); ++it){
-            if (now - it->second < statDelay){
-              if (!thisHost.size()){
-                thisHost = it->first;
-              }else if (thisHost != it->first){
-                thisHost = nullAddress;
-                break;
-              }
-            }
-          }
-          if (!thisHost.size()){
-            thisHost = nullAddress;
-          }
-          sessions.setHost(thisHost);
-        }
-
-        {
-          // Set active stream name to last active or "" if there were multiple streams active recently
-          std::string thisStream = "";
-          for (std::map<std::string, uint64_t>::iterator it = streamLastActive.begin();
-                it != streamLastActive.end(); ++it){
-            if (now - it->second < statDelay){
-              if (!thisStream.size()){
-                thisStream = it->first;
-              }else if (thisStream != it->first){
-                thisStream = "";
-                break;
-              }
-            }
-          }
-          sessions.setStream(thisStream);
-        }
-      }
-
-      // Retrigger USER_NEW if a re-sync was requested
-      if (!thisType && forceTrigger){
-        forceTrigger = false;
-        std::string host;
-        Socket::hostBytesToStr(thisHost.data(), 16, host);
-        if (Triggers::shouldTrigger("USER_NEW", thisStreamName)){
-          INFO_MSG("Triggering USER_NEW for stream %s", thisStreamName.c_str());
-          std::string payload = thisStreamName + "\n" + host + "\n" +
-                                thisToken + "\n" + thisProtocol +
-                                "\n" + thisReqUrl + "\n" + thisSessionId + "\n" + lastUrl;
-          if (!Triggers::doTrigger("USER_NEW", payload, thisStreamName)){
-            INFO_MSG("USER_NEW rejected stream %s", thisStreamName.c_str());
-            Util::logExitReason(ER_TRIGGER, "Session rejected by USER_NEW");
-            connections.setExit();
-            connections.finishAll();
-            break;
-          }else{
-            INFO_MSG("USER_NEW accepted stream %s", thisStreamName.c_str());
-          }
-        }
-      }
-
-      // Remember latest activity so we know when this session ends
-      if (currentConnections){
-      }
-      Util::wait(1000);
-    }
-    shouldSleep = connections.getExit();
-  }//connections scope end
-  if (Util::bootSecs() - lastSeen > statDelay){
-    Util::logExitReason(ER_CLEAN_INACTIVE, "Session inactive for %d seconds", statDelay);
+  S.close();
+  if (S.isInactive()){
+    Util::logExitReason(ER_CLEAN_INACTIVE, "Session inactive for %zu seconds", S.getStatDelay());
   }
 
   // Trigger USER_END
-  if (!thisType && Triggers::shouldTrigger("USER_END", thisStreamName)){
-
-    // Convert connector, host and stream into lists and counts
-    std::stringstream connectorSummary;
-    std::stringstream connectorTimes;
-    for (std::map<std::string, uint64_t>::iterator it = connectorCount.begin(); it != connectorCount.end(); ++it){
-      connectorSummary << (connectorSummary.str().size() ? "," : "") << it->first;
-      connectorTimes << (connectorTimes.str().size() ? "," : "") << it->second;
-    }
-    std::stringstream hostSummary;
-    std::stringstream hostTimes;
-    for (std::map<std::string, uint64_t>::iterator it = hostCount.begin(); it != hostCount.end(); ++it){
-      std::string host;
-      Socket::hostBytesToStr(it->first.data(), 16, host);
-      hostSummary << (hostSummary.str().size() ? "," : "") << host;
-      hostTimes << (hostTimes.str().size() ? "," : "") << it->second;
-    }
-    std::stringstream streamSummary;
-    std::stringstream streamTimes;
-    for (std::map<std::string, uint64_t>::iterator it = streamCount.begin(); it != streamCount.end(); ++it){
-      streamSummary << (streamSummary.str().size() ? "," : "") << it->first;
-      streamTimes << (streamTimes.str().size() ? "," : "") << it->second;
-    }
+  userEnd(S, sessions.getTags());
 
-    std::stringstream summary;
-    summary << thisToken << "\n"
-          << streamSummary.str() << "\n"
-          << connectorSummary.str() << "\n"
-          << hostSummary.str() << "\n"
-          << globalTime << "\n"
-          << globalUp << "\n"
-          << globalDown << "\n"
-          << sessions.getTags() << "\n"
-          << hostTimes.str() << "\n"
-          << connectorTimes.str() << "\n"
-          << streamTimes.str() << "\n"
-          << thisSessionId;
-    Triggers::doTrigger("USER_END", summary.str(), thisStreamName);
-  }
-
-  if (!thisType && shouldSleep){
+  if (S.isViewer() && S.rejected){
     uint64_t sleepStart = Util::bootSecs();
     // Keep session invalidated for 10 minutes, or until the session stops
     while (config.is_active && Util::bootSecs() - sleepStart < SESS_TIMEOUT){
@@ -444,6 +771,6 @@ int main(int argc, char **argv){
       if (forceTrigger){break;}
     }
   }
-  INFO_MSG("Shutting down session %s: %s", thisSessionId.c_str(), Util::exitReason);
+  INFO_MSG("Shutting down session %s: %s", S.sessionId.c_str(), Util::exitReason);
   return 0;
 }
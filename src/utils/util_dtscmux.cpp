@@ -0,0 +1,150 @@
+/// \file util_dtscmux.cpp
+/// Shares a single multiplexed DTSC connection to an origin between all local DTSC inputs pulling
+/// from it. Started by MistInDTSC when pulling with the mux option enabled.
+/// Exits when the connection to the origin closes, or after a minute without any channels.
+
+#include <mist/bitfields.h>
+#include <mist/config.h>
+#include <mist/defines.h>
+#include <mist/dtsc.h>
+#include <mist/dtsc_mux.h>
+#include <mist/timing.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/// Waits for the origin to confirm it serves a multiplexed session on the link.
+bool awaitMux(Socket::Connection &link){
+  uint64_t start = Util::bootMS();
+  while (link && Util::bootMS() - start < 5000){
+    const char *hdr = link.Received().peek(8);
+    const char *cmd = hdr ? link.Received().peek(8 + Bit::btohl(hdr + 4)) : 0;
+    if (!cmd){
+      if (!link.spool()){Util::sleep(10);}
+      continue;
+    }
+    if (memcmp(hdr, DTSC::Magic_Command, 4)){
+      FAIL_MSG("Origin sent unexpected data instead of confirming the multiplexed session");
+      return false;
+    }
+    DTSC::Scan S((char *)cmd + 8, Bit::btohl(hdr + 4));
+    std::string name = S.getMember("cmd").asString();
+    if (name == "mux"){
+      INFO_MSG("Origin running %s confirmed multiplexed session", S.getMember("version").asString().c_str());
+      link.Received().skip(8 + Bit::btohl(hdr + 4));
+      return true;
+    }
+    if (name == "error"){
+      FAIL_MSG("Origin refused multiplexed session: %s", S.getMember("msg").asString().c_str());
+      return false;
+    }
+    // Skips the greeting sent to every new connection
+    link.Received().skip(8 + Bit::btohl(hdr + 4));
+  }
+  FAIL_MSG("Origin did not confirm the multiplexed session; it may not support it");
+  return false;
+}
+
+/// Takes the lock file at the given path, returning its file descriptor or -1 if another process
+/// holds it. As the holder removes the file when done, a lock taken on a file that was removed in
+/// the meantime is retried on the new one.
+int takeLock(const std::string &path){
+  for (size_t i = 0; i < 5; ++i){
+    int fd = open(path.c_str(), O_CREAT | O_RDWR, 0600);
+    if (fd == -1){return -1;}
+    if (flock(fd, LOCK_EX | LOCK_NB)){
+      close(fd);
+      return -1;
+    }
+    struct stat held, current;
+    if (!fstat(fd, &held) && !stat(path.c_str(), &current) && held.st_ino == current.st_ino){return fd;}
+    close(fd);
+  }
+  return -1;
+}
+
+/// Removes the lock file taken with takeLock, then releases the lock.
+void dropLock(int fd, const std::string &path){
+  unlink(path.c_str());
+  close(fd);
+}
+
+int main(int argc, char **argv){
+  Util::redirectLogsIfNeeded();
+  if (argc < 3){
+    FAIL_MSG("Usage: %s HOST PORT", argv[0]);
+    return 1;
+  }
+  Util::Config conf(argv[0]);
+  conf.activate();
+  std::string host = argv[1];
+  uint16_t port = atoi(argv[2]);
+  std::string sockPath = DTSC::muxSocket(host, port);
+
+  // Only one process may share each origin connection
+  std::string lockPath = sockPath + ".lock";
+  int lockFd = takeLock(lockPath);
+  if (lockFd == -1){
+    HIGH_MSG("Connection to %s:%" PRIu16 " is already shared by another process", host.c_str(), port);
+    return 0;
+  }
+
+  Socket::Connection link(host, port, false);
+  if (!link){
+    FAIL_MSG("Could not connect to %s:%" PRIu16 ": %s", host.c_str(), port, link.getError().c_str());
+    dropLock(lockFd, lockPath);
+    return 1;
+  }
+  link.Received().splitter.clear();
+  JSON::Value prep;
+  prep["cmd"] = "mux";
+  prep["version"] = APPIDENT;
+  char sSize[4] ={0, 0, 0, 0};
+  Bit::htobl(sSize, prep.packedSize());
+  link.SendNow("DTCM");
+  link.SendNow(sSize, 4);
+  prep.sendTo(link);
+  link.setBlocking(false);
+  if (!awaitMux(link)){
+    link.close();
+    dropLock(lockFd, lockPath);
+    return 1;
+  }
+
+  Socket::Server srv(sockPath, true);
+  if (!srv.connected()){
+    FAIL_MSG("Could not listen on %s", sockPath.c_str());
+    link.close();
+    dropLock(lockFd, lockPath);
+    return 1;
+  }
+  INFO_MSG("Sharing connection to %s:%" PRIu16 " on %s", host.c_str(), port, sockPath.c_str());
+
+  DTSC::Mux mux(link);
+  mux.watch(srv.getSocket());
+  uint64_t lastBusy = Util::bootSecs();
+  while (conf.is_active && mux){
+    mux.pump(1000);
+    Socket::Connection local = srv.accept(true);
+    while (local){
+      uint32_t channel = mux.open(local);
+      HIGH_MSG("Opened channel %" PRIu32 " to %s:%" PRIu16, channel, host.c_str(), port);
+      local = srv.accept(true);
+    }
+    if (mux.channels()){
+      lastBusy = Util::bootSecs();
+    }else if (Util::bootSecs() - lastBusy > 60){
+      break;
+    }
+  }
+  // Stop accepting new inputs first, so they start a new process instead
+  unlink(sockPath.c_str());
+  srv.close();
+  dropLock(lockFd, lockPath);
+  INFO_MSG("Stopped sharing connection to %s:%" PRIu16 " (%s)", host.c_str(), port,
+           mux ? "idle" : "origin connection closed");
+  return 0;
+}
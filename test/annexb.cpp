@@ -0,0 +1,328 @@
+/// \file annexb.cpp
+/// Benchmark for the Annex B start code scanner and the emulation prevention kernels: runs the
+/// current implementations against the previous byte-by-byte ones on raw H264/HEVC bitstreams,
+/// checks that both produce identical results and reports the throughput of each.
+/// Takes raw Annex B files as arguments; without arguments, 1080p and 4K-sized streams are generated.
+
+#include <mist/bitfields.h>
+#include <mist/bitstream.h>
+#include <mist/nal.h>
+#include <mist/timing.h>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+/// Previous implementation of nalu::scanAnnexB.
+const char *legacyScanAnnexB(const char *data, uint32_t dataSize){
+  char *offset = (char *)data;
+  const char *maxData = data + dataSize - 2;
+  while (offset < maxData){
+    if (offset[2] > 1){
+      offset += 3;
+      continue;
+    }
+    if (!offset[2]){
+      ++offset;
+      continue;
+    }
+    if (!offset[0] && !offset[1]){return offset;}
+    offset += 3;
+  }
+  return 0;
+}
+
+/// Previous implementation of nalu::fromAnnexB.
+unsigned long legacyFromAnnexB(const char *data, unsigned long dataSize, char *&result){
+  const char *lastCheck = data + dataSize - 3;
+  int offset = 0;
+  int newOffset = 0;
+  while (offset < dataSize){
+    const char *begin = data + offset;
+    while (begin < lastCheck && !(!begin[0] && !begin[1] && begin[2] == 0x01)){
+      begin++;
+      if (begin < lastCheck && begin[0]){begin++;}
+    }
+    begin += 3;
+    if (begin > data + dataSize){
+      offset = dataSize;
+      continue;
+    }
+    const char *end = (const char *)memmem(begin, dataSize - (begin - data), "\000\000\001", 3);
+    if (!end){end = data + dataSize;}
+    if (end > begin && (end - data) != dataSize && end[-1] == 0x00){end--;}
+    unsigned int nalSize = end - begin;
+    Bit::htobl(result + newOffset, nalSize);
+    memcpy(result + newOffset + 4, begin, nalSize);
+    newOffset += 4 + nalSize;
+    offset = end - data;
+  }
+  return newOffset;
+}
+
+/// Previous implementation of nalu::removeEmulationPrevention.
+std::string legacyRemoveEmulationPrevention(const std::string &data){
+  std::string result;
+  result.resize(data.size());
+  result[0] = data[0];
+  result[1] = data[1];
+  size_t dataPtr = 2;
+  size_t dataLen = data.size();
+  size_t resPtr = 2;
+  while (dataPtr + 2 < dataLen){
+    if (!data[dataPtr] && !data[dataPtr + 1] && data[dataPtr + 2] == 3){
+      result[resPtr++] = data[dataPtr++];
+      result[resPtr++] = data[dataPtr++];
+      dataPtr++;
+    }else{
+      result[resPtr++] = data[dataPtr++];
+    }
+  }
+  while (dataPtr < dataLen){result[resPtr++] = data[dataPtr++];}
+  return result.substr(0, resPtr);
+}
+
+/// Previous way of filling a bitstream from a NAL unit, as used by the H264 parsers.
+void legacyFillBitstream(const char *data, size_t len, Utils::bitstream &bs){
+  for (size_t i = 1; i < len; i++){
+    if (i + 2 < len && (memcmp(data + i, "\000\000\003", 3) == 0)){
+      bs.append(data + i, 2);
+      i += 2;
+    }else{
+      bs.append(data + i, 1);
+    }
+  }
+}
+
+/// Previous way of inserting emulation prevention bytes, as used by the H264 generators.
+std::string legacyAddEmulationPrevention(const std::string &tmp){
+  std::string res;
+  for (int i = 0; i < tmp.size(); i++){
+    if (res.size() > 2 && res[res.size() - 1] == 0x00 && res[res.size() - 2] == 0x00){
+      if (tmp[i] == 0x00 || tmp[i] == 0x01 || tmp[i] == 0x02 || tmp[i] == 0x03){res += (char)0x03;}
+    }
+    res += tmp[i];
+  }
+  return res;
+}
+
+/// Generates an Annex B stream of the given amount of frames with the given key and delta frame
+/// sizes. Payloads are random, with enough zero bytes to need regular emulation prevention.
+std::string generateStream(size_t frames, size_t keySize, size_t deltaSize){
+  std::string stream;
+  for (size_t f = 0; f < frames; ++f){
+    size_t size = (f % 30) ? deltaSize : keySize;
+    std::string rbsp;
+    rbsp.resize(size);
+    rbsp[0] = (f % 30) ? 0x41 : 0x65;
+    for (size_t i = 1; i < size; ++i){rbsp[i] = (rand() % 50) ? (char)(rand() % 256) : 0;}
+    rbsp[size - 1] = 0x80;
+    stream.append("\000\000\000\001", 4);
+    stream.append(legacyAddEmulationPrevention(rbsp));
+  }
+  return stream;
+}
+
+/// Prints the throughput of a single benchmark step.
+void report(const char *name, uint64_t bytes, uint64_t oldTime, uint64_t newTime){
+  std::cout << "  " << name << ": " << (oldTime ? bytes / oldTime : 0) << " MB/s before, "
+            << (newTime ? bytes / newTime : 0) << " MB/s now" << std::endl;
+}
+
+/// Runs all benchmark steps on a single stream. Returns the amount of mismatches found.
+int benchStream(const std::string &name, const std::string &stream, size_t rounds){
+  int failures = 0;
+  const char *data = stream.data();
+  uint32_t len = stream.size();
+  uint64_t bytes = (uint64_t)len * rounds;
+  std::cout << name << " (" << len << " bytes, " << rounds << " rounds, " << nalu::simdName() << "):" << std::endl;
+
+  // Start code scanning
+  std::vector<size_t> oldPos, newPos, scalarPos;
+  uint64_t start = Util::getMicros();
+  for (size_t r = 0; r < rounds; ++r){
+    oldPos.clear();
+    const char *p = legacyScanAnnexB(data, len);
+    while (p){
+      oldPos.push_back(p - data);
+      p = legacyScanAnnexB(p + 3, len - (p + 3 - data));
+    }
+  }
+  uint64_t oldTime = Util::getMicros(start);
+  start = Util::getMicros();
+  for (size_t r = 0; r < rounds; ++r){
+    newPos.clear();
+    const char *p = nalu::scanAnnexB(data, len);
+    while (p){
+      newPos.push_back(p - data);
+      p = nalu::scanAnnexB(p + 3, len - (p + 3 - data));
+    }
+  }
+  uint64_t newTime = Util::getMicros(start);
+  report("Start code scan", bytes, oldTime, newTime);
+  nalu::useSIMD(false);
+  const char *p = nalu::scanAnnexB(data, len);
+  while (p){
+    scalarPos.push_back(p - data);
+    p = nalu::scanAnnexB(p + 3, len - (p + 3 - data));
+  }
+  nalu::useSIMD(true);
+  if (oldPos != newPos || oldPos != scalarPos){
+    std::cerr << "  Start code positions differ!" << std::endl;
+    ++failures;
+  }
+
+  // NAL unit boundaries, with 4-byte start codes trimmed
+  std::vector<std::pair<size_t, size_t> > nals;
+  for (size_t i = 0; i < newPos.size(); ++i){
+    size_t nalStart = newPos[i] + 3;
+    size_t nalEnd = (i + 1 < newPos.size()) ? newPos[i + 1] : len;
+    nalEnd = nalu::nalEndPosition(data + nalStart, nalEnd - nalStart) - data;
+    if (nalEnd > nalStart + 3){nals.push_back(std::make_pair(nalStart, nalEnd - nalStart));}
+  }
+
+  // Annex B to length-prefixed conversion
+  char *oldConverted = (char *)malloc(len + 4);
+  char *converted = (char *)malloc(len + 4);
+  unsigned long oldConvLen = 0, convLen = 0;
+  start = Util::getMicros();
+  for (size_t r = 0; r < rounds; ++r){oldConvLen = legacyFromAnnexB(data, len, oldConverted);}
+  oldTime = Util::getMicros(start);
+  start = Util::getMicros();
+  for (size_t r = 0; r < rounds; ++r){convLen = nalu::fromAnnexB(data, len, converted);}
+  newTime = Util::getMicros(start);
+  report("Annex B conversion", bytes, oldTime, newTime);
+  if (oldConvLen != convLen || memcmp(oldConverted, converted, convLen)){
+    std::cerr << "  Annex B conversion differs!" << std::endl;
+    ++failures;
+  }
+  free(oldConverted);
+  free(converted);
+
+  // Emulation prevention removal into a new string versus into a reused buffer
+  std::vector<std::string> oldRbsp(nals.size());
+  std::vector<char> buffer(len);
+  size_t newTotal = 0;
+  start = Util::getMicros();
+  for (size_t r = 0; r < rounds; ++r){
+    for (size_t i = 0; i < nals.size(); ++i){
+      oldRbsp[i] = legacyRemoveEmulationPrevention(std::string(data + nals[i].first, nals[i].second));
+    }
+  }
+  oldTime = Util::getMicros(start);
+  start = Util::getMicros();
+  for (size_t r = 0; r < rounds; ++r){
+    newTotal = 0;
+    for (size_t i = 0; i < nals.size(); ++i){
+      newTotal += nalu::removeEmulationPrevention(data + nals[i].first, nals[i].second, &buffer[newTotal]);
+    }
+  }
+  newTime = Util::getMicros(start);
+  report("Emulation prevention removal", bytes, oldTime, newTime);
+  size_t oldTotal = 0;
+  for (size_t i = 0; i < nals.size(); ++i){
+    if (oldRbsp[i] != nalu::removeEmulationPrevention(std::string(data + nals[i].first, nals[i].second)) ||
+        memcmp(oldRbsp[i].data(), &buffer[oldTotal], oldRbsp[i].size())){
+      std::cerr << "  Emulation prevention removal differs for NAL unit " << i << "!" << std::endl;
+      ++failures;
+      break;
+    }
+    oldTotal += oldRbsp[i].size();
+  }
+  if (oldTotal != newTotal){
+    std::cerr << "  Emulation prevention removal sizes differ!" << std::endl;
+    ++failures;
+  }
+
+  // Filling a bitstream for parsing, one round only: the previous version is very slow
+  start = Util::getMicros();
+  for (size_t i = 0; i < nals.size(); ++i){
+    Utils::bitstream bs;
+    legacyFillBitstream(data + nals[i].first, nals[i].second, bs);
+  }
+  oldTime = Util::getMicros(start);
+  start = Util::getMicros();
+  for (size_t i = 0; i < nals.size(); ++i){
+    Utils::bitstream bs;
+    nalu::removeEmulationPrevention(data + nals[i].first + 1, nals[i].second - 1, bs);
+  }
+  newTime = Util::getMicros(start);
+  report("Bitstream filling", len, oldTime, newTime);
+
+  // Emulation prevention insertion, from the unescaped NAL units back to the original ones
+  std::vector<char> escaped(len + len / 2 + 1);
+  start = Util::getMicros();
+  for (size_t r = 0; r < rounds; ++r){
+    for (size_t i = 0; i < nals.size(); ++i){legacyAddEmulationPrevention(oldRbsp[i]);}
+  }
+  oldTime = Util::getMicros(start);
+  start = Util::getMicros();
+  for (size_t r = 0; r < rounds; ++r){
+    for (size_t i = 0; i < nals.size(); ++i){
+      nalu::addEmulationPrevention(oldRbsp[i].data(), oldRbsp[i].size(), &escaped[0]);
+    }
+  }
+  newTime = Util::getMicros(start);
+  report("Emulation prevention insertion", bytes, oldTime, newTime);
+  for (size_t i = 0; i < nals.size(); ++i){
+    std::string old = legacyAddEmulationPrevention(oldRbsp[i]);
+    size_t escLen = nalu::addEmulationPrevention(oldRbsp[i].data(), oldRbsp[i].size(), &escaped[0]);
+    if (old != std::string(&escaped[0], escLen)){
+      std::cerr << "  Emulation prevention insertion differs for NAL unit " << i << "!" << std::endl;
+      ++failures;
+      break;
+    }
+  }
+  return failures;
+}
+
+/// Compares the vectorized kernels with the plain ones on short inputs full of zero bytes, to
+/// cover all tail and boundary cases. Returns the amount of mismatches found.
+int checkEdgeCases(){
+  int failures = 0;
+  char data[80], simd[256], scalar[256];
+  for (size_t iter = 0; iter < 20000; ++iter){
+    size_t len = rand() % sizeof(data);
+    for (size_t i = 0; i < len; ++i){data[i] = (rand() % 3) ? 0 : (rand() % 5);}
+    nalu::useSIMD(true);
+    const char *a = nalu::scanAnnexB(data, len);
+    size_t aLen = nalu::removeEmulationPrevention(data, len, simd);
+    size_t aEsc = nalu::addEmulationPrevention(data, len, simd + aLen);
+    nalu::useSIMD(false);
+    const char *b = nalu::scanAnnexB(data, len);
+    size_t bLen = nalu::removeEmulationPrevention(data, len, scalar);
+    size_t bEsc = nalu::addEmulationPrevention(data, len, scalar + bLen);
+    nalu::useSIMD(true);
+    if (a != b || a != (len ? legacyScanAnnexB(data, len) : 0) || aLen != bLen || aEsc != bEsc ||
+        memcmp(simd, scalar, aLen + aEsc)){
+      ++failures;
+    }
+  }
+  if (failures){std::cerr << failures << " edge case mismatches between kernels" << std::endl;}
+  return failures;
+}
+
+int main(int argc, char **argv){
+  srand(1);
+  int failures = checkEdgeCases();
+  if (argc > 1){
+    for (int i = 1; i < argc; ++i){
+      std::ifstream in(argv[i], std::ios::binary);
+      std::stringstream buf;
+      buf << in.rdbuf();
+      if (!buf.str().size()){
+        std::cerr << "Could not read " << argv[i] << std::endl;
+        ++failures;
+        continue;
+      }
+      failures += benchStream(argv[i], buf.str(), 10);
+    }
+  }else{
+    failures += benchStream("1080p", generateStream(120, 250000, 40000), 10);
+    failures += benchStream("4K", generateStream(120, 1000000, 160000), 5);
+  }
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,70 @@
+/// \file buffer_worker.cpp
+/// Tests the process model inputs use to buffer VoD pages in parallel: worker processes forked
+/// while the reaper thread runs fill shared memory pages and exit without running destructors,
+/// after which the parent notices they are done and finds their pages intact.
+
+#include <mist/procs.h>
+#include <mist/shared_memory.h>
+#include <mist/timing.h>
+#include <cassert>
+#include <iostream>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+/// Forks a worker the way Input::bufferFrameAsync does, filling the named page with its name.
+pid_t startWorker(const std::string &name){
+  Util::Procs::fork_prepare();
+  pid_t pid = fork();
+  if (!pid){
+    Util::Procs::fork_complete();
+    IPC::sharedPage page(name, 4096, true, false);
+    if (!page){_exit(1);}
+    memcpy(page.mapped, name.data(), name.size());
+    // Skips the page destructor, which would remove the page again
+    _exit(0);
+  }
+  Util::Procs::fork_complete();
+  return pid;
+}
+
+int main(int argc, char **argv){
+  Util::printDebugLevel = DLVL_FAIL;
+  // Starting any process sets up the reaper thread, which forking must not be confused by
+  const char *trueArgs[] ={"true", 0};
+  pid_t helper = Util::Procs::StartPiped(trueArgs, 0, 0, 0);
+  assert(helper);
+
+  std::deque<pid_t> workers;
+  std::deque<std::string> names;
+  for (size_t i = 0; i < 4; ++i){
+    char name[64];
+    snprintf(name, sizeof(name), "MstTestWorker%d_%zu", (int)getpid(), i);
+    names.push_back(name);
+    pid_t pid = startWorker(name);
+    assert(pid > 0);
+    workers.push_back(pid);
+  }
+
+  // Workers may be reaped by the reaper thread or by childRunning; either way they end
+  uint64_t start = Util::bootMS();
+  while (workers.size() && Util::bootMS() - start < 10000){
+    if (!Util::Procs::childRunning(workers.front())){
+      workers.pop_front();
+    }else{
+      Util::sleep(10);
+    }
+  }
+  assert(!workers.size());
+
+  for (size_t i = 0; i < names.size(); ++i){
+    IPC::sharedPage page(names[i], 4096, false, false);
+    assert(page);
+    assert(!memcmp(page.mapped, names[i].data(), names[i].size()));
+    // Removes the page when done
+    page.master = true;
+  }
+
+  std::cout << "All buffer worker tests passed" << std::endl;
+  return 0;
+}
@@ -0,0 +1,168 @@
+/// \file dtsc_mux.cpp
+/// Tests for multiplexed DTSC sessions: opening channels, moving data both ways, per-channel flow
+/// control, closing channels and the link, and rejecting oversized frames.
+
+#include <mist/dtsc_mux.h>
+#include <cassert>
+#include <iostream>
+#include <signal.h>
+#include <string.h>
+#include <sys/socket.h>
+
+/// Creates a connected pair of sockets.
+void makePair(Socket::Connection &a, Socket::Connection &b){
+  int fds[2];
+  int ret = socketpair(PF_LOCAL, SOCK_STREAM, 0, fds);
+  assert(!ret);
+  a.open(fds[0]);
+  b.open(fds[1]);
+  a.setBlocking(false);
+  b.setBlocking(false);
+}
+
+/// Pumps both ends of a session for the given amount of rounds.
+void pump(DTSC::Mux &a, DTSC::Mux &b, size_t rounds = 20){
+  for (size_t i = 0; i < rounds; ++i){
+    a.pump(1);
+    b.pump(1);
+  }
+}
+
+/// Reads everything available on a connection into data.
+void drain(Socket::Connection &conn, std::string &data){
+  while (conn.spool()){}
+  data.append(conn.Received().copy(conn.Received().bytes(0xFFFFFFFFul)));
+  conn.Received().clear();
+}
+
+/// Writes as much of data to a connection as fits, removing what was written.
+void fill(Socket::Connection &conn, std::string &data){
+  while (data.size()){
+    unsigned int w = conn.iwrite(data.data(), data.size() > 65536 ? 65536 : data.size());
+    if (!w){break;}
+    data.erase(0, w);
+  }
+}
+
+int main(int argc, char **argv){
+  signal(SIGPIPE, SIG_IGN);
+  Util::printDebugLevel = DLVL_FAIL;
+  Socket::Connection edgeLink, originLink;
+  makePair(edgeLink, originLink);
+  DTSC::Mux edge(edgeLink), origin(originLink);
+  assert(edge && origin);
+
+  // Channels opened on one end show up on the other, and data arrives in both directions
+  Socket::Connection inA, inB, outA, outB;
+  makePair(inA, inB);
+  uint32_t chanA = edge.open(inB);
+  assert(chanA);
+  inA.SendNow("play stream A");
+  pump(edge, origin);
+  uint32_t accepted = origin.accept();
+  assert(accepted == chanA);
+  accepted = origin.accept();
+  assert(!accepted);
+  makePair(outA, outB);
+  origin.attach(chanA, outB);
+  pump(edge, origin);
+  std::string got;
+  drain(outA, got);
+  assert(got == "play stream A");
+  std::string big(3 * 1024 * 1024, 'x');
+  for (size_t i = 0; i < big.size(); ++i){big[i] = (char)(i * 7);}
+  std::string toSend = big;
+  got.clear();
+  for (size_t i = 0; i < 2000 && got.size() < big.size(); ++i){
+    fill(outA, toSend);
+    pump(edge, origin, 1);
+    drain(inA, got);
+  }
+  assert(got == big);
+
+  // A channel whose receiver stops reading does not hold up the others
+  Socket::Connection stallA, stallB, stallOutA, stallOutB;
+  makePair(stallA, stallB);
+  uint32_t chanB = edge.open(stallB);
+  assert(chanB != chanA);
+  pump(edge, origin);
+  accepted = origin.accept();
+  assert(accepted == chanB);
+  makePair(stallOutA, stallOutB);
+  origin.attach(chanB, stallOutB);
+  std::string stalled(4 * DTSC_MUX_WINDOW, 's');
+  toSend = big;
+  got.clear();
+  for (size_t i = 0; i < 2000 && got.size() < big.size(); ++i){
+    fill(stallOutA, stalled);
+    fill(outA, toSend);
+    pump(edge, origin, 1);
+    drain(inA, got);
+  }
+  assert(got == big);
+  // The stalled channel stopped sending once its window was used up
+  assert(stalled.size() > DTSC_MUX_WINDOW);
+  // ...and continues once its receiver reads again
+  got.clear();
+  for (size_t i = 0; i < 4000 && got.size() < 4 * DTSC_MUX_WINDOW; ++i){
+    fill(stallOutA, stalled);
+    pump(edge, origin, 1);
+    drain(stallA, got);
+  }
+  assert(got.size() == 4 * DTSC_MUX_WINDOW);
+
+  // Data a connection read before being opened as a channel is sent without it becoming readable
+  // again, even when it does not fit on the link at once
+  Socket::Connection readA, readB, readOutA, readOutB;
+  makePair(readA, readB);
+  std::string early(3 * DTSC_MUX_FRAME, 'e');
+  for (size_t i = 0; i < early.size(); ++i){early[i] = (char)(i * 13);}
+  toSend = early;
+  while (toSend.size()){
+    fill(readA, toSend);
+    while (readB.spool()){}
+  }
+  assert(readB.Received().bytes(0xFFFFFFFFul) == early.size());
+  uint32_t chanC = edge.open(readB);
+  pump(edge, origin);
+  accepted = origin.accept();
+  assert(accepted == chanC);
+  makePair(readOutA, readOutB);
+  origin.attach(chanC, readOutB);
+  got.clear();
+  for (size_t i = 0; i < 2000 && got.size() < early.size(); ++i){
+    pump(edge, origin, 1);
+    drain(readOutA, got);
+  }
+  assert(got == early);
+  readA.close();
+  pump(edge, origin);
+
+  // Closing a local connection closes the channel on both ends
+  inA.close();
+  pump(edge, origin);
+  assert(edge.channels() == 1);
+  assert(origin.channels() == 1);
+  got.clear();
+  drain(outA, got);
+  assert(!outA);
+
+  // Closing the link ends the session
+  edgeLink.close();
+  pump(edge, origin);
+  assert(!origin);
+
+  // Frames larger than the other end could ever send close the link right away
+  const char *bad[] ={"DTMX\x00\x04\x00\x05", "DTCM\x00\x01\x00\x01"};
+  for (size_t i = 0; i < 2; ++i){
+    Socket::Connection rawLink, muxLink;
+    makePair(rawLink, muxLink);
+    DTSC::Mux m(muxLink);
+    rawLink.SendNow(bad[i], 8);
+    for (size_t j = 0; j < 20 && m; ++j){m.pump(1);}
+    assert(!m);
+  }
+
+  std::cout << "All DTSC multiplexing tests passed" << std::endl;
+  return 0;
+}
@@ -0,0 +1,171 @@
+/// \file dtsc_relay_bench.cpp
+/// Benchmark for relaying DTSC packets over a loopback TCP connection, like an origin sending a
+/// stream to an edge. The sender rewrites the track ID of every packet, either by copying the
+/// packet (DTSC::Packet copy constructor) or by sending a rewritten header followed by the packet
+/// in place. The receiver either copies every packet out of the receive buffer
+/// (DTSC::Packet::reInit) or uses it in place (DTSC::Packet::reInitInPlace), then copies the
+/// payload into a "data page" as buffering it would. Reports packets and megabytes per second and
+/// the CPU time used on both ends, and checks that all packets arrive intact with their new track ID.
+/// Arguments: amount of packets (default 100000).
+
+#include <mist/bitfields.h>
+#include <mist/dtsc.h>
+#include <mist/timing.h>
+#include <arpa/inet.h>
+#include <iostream>
+#include <netinet/in.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+
+/// Sends all packets over the connection with the given track ID, the old way or in place.
+void sendPackets(Socket::Connection &conn, const std::vector<DTSC::Packet *> &pkts, size_t trackId, bool inPlace){
+  for (size_t i = 0; i < pkts.size(); ++i){
+    if (!inPlace){
+      DTSC::Packet p(*pkts[i], trackId);
+      conn.SendNow(p.getData(), p.getDataLen());
+      continue;
+    }
+    char *data = pkts[i]->getData();
+    char hdr[12];
+    memcpy(hdr, data, 8);
+    Bit::htobl(hdr + 8, trackId);
+    struct iovec vec[2];
+    vec[0].iov_base = hdr;
+    vec[0].iov_len = 12;
+    vec[1].iov_base = data + 12;
+    vec[1].iov_len = pkts[i]->getDataLen() - 12;
+    conn.SendNow(vec, 2);
+  }
+}
+
+/// Returns the user and system CPU time used by this process or its waited-for children, in
+/// microseconds.
+uint64_t cpuMicros(int who){
+  struct rusage r;
+  getrusage(who, &r);
+  return (r.ru_utime.tv_sec + r.ru_stime.tv_sec) * 1000000ull + r.ru_utime.tv_usec + r.ru_stime.tv_usec;
+}
+
+/// Runs one relay over loopback TCP, returning the time taken in microseconds, or zero on failure.
+/// Sets the amount of bytes relayed and the CPU time used by sender and receiver.
+uint64_t relay(const std::vector<DTSC::Packet *> &pkts, bool inPlaceSend, bool inPlaceRecv, uint64_t &bytes,
+               uint64_t &sendCpu, uint64_t &recvCpu){
+  int srv = socket(AF_INET, SOCK_STREAM, 0);
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  socklen_t addrLen = sizeof(addr);
+  if (bind(srv, (struct sockaddr *)&addr, sizeof(addr)) || listen(srv, 1) ||
+      getsockname(srv, (struct sockaddr *)&addr, &addrLen)){
+    std::cerr << "Could not listen on loopback" << std::endl;
+    return 0;
+  }
+  uint64_t start = Util::getMicros();
+  uint64_t startCpu = cpuMicros(RUSAGE_SELF);
+  uint64_t childCpu = cpuMicros(RUSAGE_CHILDREN);
+  pid_t child = fork();
+  if (!child){
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr))){_exit(1);}
+    Socket::Connection out(fd, -1);
+    sendPackets(out, pkts, 7, inPlaceSend);
+    out.close();
+    _exit(0);
+  }
+  int fd = accept(srv, 0, 0);
+  close(srv);
+  Socket::Connection in(-1, fd);
+  // Reads in the same block size as MistInDTSC
+  in.setReadSize(64 * 1024);
+  Util::ResizeablePointer page;
+  page.allocate(8 * 1024 * 1024);
+  uint64_t pageOffset = 0;
+  bool intact = true;
+  bytes = 0;
+  DTSC::Packet pkt;
+  for (size_t i = 0; i < pkts.size(); ++i){
+    uint32_t inBuffer = 0;
+    if (inPlaceRecv){
+      inBuffer = pkt.reInitInPlace(in);
+    }else{
+      pkt.reInit(in);
+    }
+    if (!pkt){
+      std::cerr << "Connection ended after " << i << " packets" << std::endl;
+      intact = false;
+      break;
+    }
+    char *data, *orig;
+    size_t dataLen, origLen;
+    pkt.getString("data", data, dataLen);
+    pkts[i]->getString("data", orig, origLen);
+    if (pkt.getTrackId() != 7 || pkt.getTime() != pkts[i]->getTime() || dataLen != origLen || memcmp(data, orig, dataLen)){
+      intact = false;
+    }
+    if (pageOffset + dataLen > page.rsize()){pageOffset = 0;}
+    memcpy((char *)page + pageOffset, data, dataLen);
+    pageOffset += dataLen;
+    bytes += pkt.getDataLen();
+    if (inBuffer){in.Received().skip(inBuffer);}
+  }
+  uint64_t taken = Util::getMicros(start);
+  recvCpu = cpuMicros(RUSAGE_SELF) - startCpu;
+  in.close();
+  int status = 0;
+  waitpid(child, &status, 0);
+  sendCpu = cpuMicros(RUSAGE_CHILDREN) - childCpu;
+  if (!intact){
+    std::cerr << "Packets did not arrive intact" << std::endl;
+    return 0;
+  }
+  return taken;
+}
+
+int main(int argc, char **argv){
+  Util::printDebugLevel = DLVL_WARN;
+  size_t packets = 100000;
+  if (argc > 1){packets = atoll(argv[1]);}
+
+  // 25 fps video with a large frame every 50 frames, and AAC audio
+  std::vector<DTSC::Packet *> pkts;
+  std::string payload(150000, 'x');
+  for (size_t i = 0; i < payload.size(); ++i){payload[i] = (char)rand();}
+  srand(42);
+  uint64_t vTime = 0, aTime = 0;
+  while (pkts.size() < packets){
+    DTSC::Packet *p = new DTSC::Packet();
+    if (vTime <= aTime){
+      size_t len = (pkts.size() % 100) ? 8000 + rand() % 8000 : 120000;
+      p->genericFill(vTime, 0, 1, payload.data() + rand() % 1000, len, 0, !(pkts.size() % 100));
+      vTime += 40;
+    }else{
+      p->genericFill(aTime, 0, 2, payload.data() + rand() % 1000, 300 + rand() % 100, 0, false);
+      aTime += 21;
+    }
+    pkts.push_back(p);
+  }
+  std::cout << packets << " packets over loopback TCP:" << std::endl;
+
+  int failures = 0;
+  const char *names[] ={"Copying send, copying receive", "In place send, copying receive",
+                        "In place send, in place receive"};
+  for (int mode = 0; mode < 3; ++mode){
+    uint64_t bytes = 0, sendCpu = 0, recvCpu = 0;
+    uint64_t taken = relay(pkts, mode > 0, mode > 1, bytes, sendCpu, recvCpu);
+    if (!taken){
+      ++failures;
+      continue;
+    }
+    std::cout << "  " << names[mode] << ": " << taken << "us (" << packets * 1000000 / taken
+              << " packets/s, " << bytes / taken << " MB/s), CPU " << sendCpu << "us sending, "
+              << recvCpu << "us receiving" << std::endl;
+  }
+  for (size_t i = 0; i < pkts.size(); ++i){delete pkts[i];}
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,217 @@
+/// \file dtsc_seek.cpp
+/// Microbenchmark for the time/key/fragment/page lookups in DTSC::Meta.
+/// Builds a single track with a large amount of keys (100k by default, override with the first
+/// argument), then seeks across it using both the DTSC::Meta lookup functions and a reference
+/// linear scan. Exits with a non-zero status if any results differ.
+
+#include <mist/dtsc.h>
+#include <mist/timing.h>
+#include <iostream>
+#include <stdlib.h>
+
+#define SEEK_KEY_DURATION 2000
+#define SEEK_PARTS_PER_KEY 25
+#define SEEK_KEYS_PER_PAGE 10
+
+class SeekMeta : public DTSC::Meta{
+public:
+  size_t trk;
+  SeekMeta(size_t keyCount) : DTSC::Meta(){
+    reInit("", true);
+    size_t pageCount = keyCount / SEEK_KEYS_PER_PAGE + 1;
+    trk = addTrack(keyCount, keyCount, keyCount * SEEK_PARTS_PER_KEY, pageCount, true);
+    setType(trk, "video");
+    setCodec(trk, "H264");
+    DTSC::Track &t = tracks.at(trk);
+    Util::RelAccXFieldData pFirstkey = t.pages.getFieldData("firstkey");
+    Util::RelAccXFieldData pKeycount = t.pages.getFieldData("keycount");
+    Util::RelAccXFieldData pAvail = t.pages.getFieldData("avail");
+    Util::RelAccXFieldData pFirsttime = t.pages.getFieldData("firsttime");
+    uint64_t partDur = SEEK_KEY_DURATION / SEEK_PARTS_PER_KEY;
+    for (size_t i = 0; i < keyCount * SEEK_PARTS_PER_KEY; ++i){
+      t.parts.setInt(t.partSizeField, 1000, i);
+      t.parts.setInt(t.partDurationField, partDur, i);
+      t.parts.setInt(t.partOffsetField, 0, i);
+    }
+    t.parts.addRecords(keyCount * SEEK_PARTS_PER_KEY);
+    for (size_t i = 0; i < keyCount; ++i){
+      t.keys.setInt(t.keyFirstPartField, i * SEEK_PARTS_PER_KEY, i);
+      t.keys.setInt(t.keyBposField, 0, i);
+      t.keys.setInt(t.keyDurationField, SEEK_KEY_DURATION, i);
+      t.keys.setInt(t.keyNumberField, i, i);
+      t.keys.setInt(t.keyPartsField, SEEK_PARTS_PER_KEY, i);
+      t.keys.setInt(t.keyTimeField, i * SEEK_KEY_DURATION, i);
+      t.keys.setInt(t.keySizeField, SEEK_PARTS_PER_KEY * 1000, i);
+      t.fragments.setInt(t.fragmentDurationField, SEEK_KEY_DURATION, i);
+      t.fragments.setInt(t.fragmentKeysField, 1, i);
+      t.fragments.setInt(t.fragmentFirstKeyField, i, i);
+      t.fragments.setInt(t.fragmentSizeField, SEEK_PARTS_PER_KEY * 1000, i);
+    }
+    t.keys.addRecords(keyCount);
+    t.fragments.addRecords(keyCount);
+    for (size_t i = 0; i < pageCount; ++i){
+      t.pages.setInt(pFirstkey, i * SEEK_KEYS_PER_PAGE, i);
+      t.pages.setInt(pKeycount, SEEK_KEYS_PER_PAGE, i);
+      // Only every third page is loaded, like a VoD input that is being seeked around in
+      t.pages.setInt(pAvail, (i % 3) ? 0 : 1000, i);
+      t.pages.setInt(pFirsttime, i * SEEK_KEYS_PER_PAGE * SEEK_KEY_DURATION, i);
+    }
+    t.pages.addRecords(pageCount);
+    setFirstms(trk, 0);
+    setLastms(trk, keyCount * SEEK_KEY_DURATION - partDur);
+  }
+};
+
+// Reference linear implementations, used to verify results and as a performance baseline
+
+uint32_t linearKeyIndexForTime(const DTSC::Meta &M, size_t idx, uint64_t timestamp){
+  DTSC::Keys keys(M.keys(idx));
+  for (size_t i = keys.getFirstValid(); i < keys.getEndValid(); i++){
+    if (keys.getTime(i) + keys.getDuration(i) > timestamp){return i;}
+  }
+  return keys.getEndValid();
+}
+
+uint32_t linearFragmentIndexForTime(const DTSC::Meta &M, size_t idx, uint64_t timestamp){
+  DTSC::Fragments fragments(M.fragments(idx));
+  DTSC::Keys keys(M.keys(idx));
+  uint32_t firstFragment = fragments.getFirstValid();
+  uint32_t endFragment = fragments.getEndValid();
+  for (size_t i = firstFragment; i < endFragment; i++){
+    if (timestamp < keys.getTime(fragments.getFirstKey(i)) + fragments.getDuration(i)){return i;}
+  }
+  if (endFragment > firstFragment && timestamp < M.getLastms(idx)){return endFragment - 1;}
+  return endFragment;
+}
+
+size_t linearKeyNumForTime(const DTSC::Meta &M, size_t idx, uint64_t time){
+  DTSC::Keys keys(M.keys(idx));
+  DTSC::Parts parts(M.parts(idx));
+  size_t res = M.keys(idx).getStartPos();
+  for (size_t i = res; i < keys.getEndValid(); i++){
+    if (keys.getTime(i) > time){
+      if (keys.getFirstPart(i) > M.parts(idx).getStartPos()){
+        if (keys.getTime(i) - parts.getDuration(keys.getFirstPart(i) - 1) < time){res = i;}
+      }
+      continue;
+    }
+    res = i;
+  }
+  return res;
+}
+
+size_t linearPageNumberForTime(const DTSC::Meta &M, size_t idx, uint64_t time){
+  const Util::RelAccX &pages = M.pages(idx);
+  uint64_t res = pages.getStartPos();
+  for (uint64_t i = res; i < pages.getEndPos(); ++i){
+    if (pages.getInt("avail", i) == 0){continue;}
+    if (pages.getInt("firsttime", i) > time){break;}
+    res = i;
+  }
+  return pages.getInt("firstkey", res);
+}
+
+size_t linearPageNumberForKey(const DTSC::Meta &M, size_t idx, uint64_t keyNum){
+  const Util::RelAccX &pages = M.pages(idx);
+  uint64_t res = pages.getStartPos();
+  for (uint64_t i = res; i < pages.getEndPos(); ++i){
+    if (pages.getInt("avail", i) == 0){continue;}
+    if (pages.getInt("firstkey", i) > keyNum){break;}
+    res = i;
+  }
+  return pages.getInt("firstkey", res);
+}
+
+uint64_t linearPartTime(const DTSC::Meta &M, size_t idx, uint32_t partIndex){
+  DTSC::Keys keys(M.keys(idx));
+  DTSC::Parts parts(M.parts(idx));
+  for (size_t kId = keys.getFirstValid(); kId < keys.getEndValid(); ++kId){
+    size_t keyPartId = keys.getFirstPart(kId);
+    if (keyPartId + keys.getParts(kId) > partIndex){
+      uint64_t res = keys.getTime(kId);
+      while (keyPartId < partIndex){res += parts.getDuration(keyPartId++);}
+      return res;
+    }
+  }
+  return 0;
+}
+
+int main(int argc, char **argv){
+  size_t keyCount = 100000;
+  if (argc > 1){keyCount = atoll(argv[1]);}
+  size_t seekCount = 200;
+  if (argc > 2){seekCount = atoll(argv[2]);}
+
+  std::cout << "Building track with " << keyCount << " keys..." << std::endl;
+  SeekMeta M(keyCount);
+  size_t idx = M.trk;
+  uint64_t duration = M.getLastms(idx);
+
+  std::vector<uint64_t> times;
+  srand(0x6D697374);
+  for (size_t i = 0; i < seekCount; ++i){
+    times.push_back(((uint64_t)rand() * RAND_MAX + rand()) % (duration + SEEK_KEY_DURATION));
+  }
+
+  int failures = 0;
+  uint64_t checkSum = 0;
+
+  uint64_t start = Util::getMicros();
+  for (size_t i = 0; i < seekCount; ++i){
+    checkSum += M.getKeyIndexForTime(idx, times[i]);
+    checkSum += M.getFragmentIndexForTime(idx, times[i]);
+    checkSum += M.getKeyNumForTime(idx, times[i]);
+    checkSum += M.getPageNumberForTime(idx, times[i]);
+    checkSum += M.getPageNumberForKey(idx, times[i] / SEEK_KEY_DURATION);
+    checkSum += M.getPartTime(times[i] * SEEK_PARTS_PER_KEY / SEEK_KEY_DURATION, idx);
+  }
+  uint64_t metaTime = Util::getMicros(start);
+
+  start = Util::getMicros();
+  for (size_t i = 0; i < seekCount; ++i){
+    checkSum += linearKeyIndexForTime(M, idx, times[i]);
+    checkSum += linearFragmentIndexForTime(M, idx, times[i]);
+    checkSum += linearKeyNumForTime(M, idx, times[i]);
+    checkSum += linearPageNumberForTime(M, idx, times[i]);
+    checkSum += linearPageNumberForKey(M, idx, times[i] / SEEK_KEY_DURATION);
+    checkSum += linearPartTime(M, idx, times[i] * SEEK_PARTS_PER_KEY / SEEK_KEY_DURATION);
+  }
+  uint64_t linearTime = Util::getMicros(start);
+
+  for (size_t i = 0; i < seekCount; ++i){
+    uint64_t t = times[i];
+    uint64_t k = t / SEEK_KEY_DURATION;
+    uint32_t p = t * SEEK_PARTS_PER_KEY / SEEK_KEY_DURATION;
+    if (M.getKeyIndexForTime(idx, t) != linearKeyIndexForTime(M, idx, t)){
+      std::cerr << "getKeyIndexForTime mismatch @ " << t << std::endl;
+      ++failures;
+    }
+    if (M.getFragmentIndexForTime(idx, t) != linearFragmentIndexForTime(M, idx, t)){
+      std::cerr << "getFragmentIndexForTime mismatch @ " << t << std::endl;
+      ++failures;
+    }
+    if (M.getKeyNumForTime(idx, t) != linearKeyNumForTime(M, idx, t)){
+      std::cerr << "getKeyNumForTime mismatch @ " << t << std::endl;
+      ++failures;
+    }
+    if (M.getPageNumberForTime(idx, t) != linearPageNumberForTime(M, idx, t)){
+      std::cerr << "getPageNumberForTime mismatch @ " << t << std::endl;
+      ++failures;
+    }
+    if (M.getPageNumberForKey(idx, k) != linearPageNumberForKey(M, idx, k)){
+      std::cerr << "getPageNumberForKey mismatch @ " << k << std::endl;
+      ++failures;
+    }
+    if (M.getPartTime(p, idx) != linearPartTime(M, idx, p)){
+      std::cerr << "getPartTime mismatch @ " << p << std::endl;
+      ++failures;
+    }
+  }
+
+  std::cout << seekCount << " seeks (6 lookups each) over " << keyCount << " keys:" << std::endl;
+  std::cout << "  DTSC::Meta: " << metaTime << "us (" << (metaTime * 1000 / seekCount) << "ns/seek)" << std::endl;
+  std::cout << "  Linear:     " << linearTime << "us (" << (linearTime * 1000 / seekCount) << "ns/seek)" << std::endl;
+  std::cout << "  Checksum:   " << checkSum << std::endl;
+  if (failures){std::cerr << failures << " mismatches!" << std::endl;}
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,143 @@
+/// \file dtsh_raw.cpp
+/// Tests for the raw DTSH header format: writing and loading it back, converting from the packed
+/// version 4 format and rejecting damaged files.
+
+#include <mist/dtsc.h>
+#include <cassert>
+#include <iostream>
+#include <sstream>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+/// Asserts the given integer fields are the same in all records present in both structures.
+void sameRecords(const Util::RelAccX &a, const Util::RelAccX &b, const char **names){
+  assert(a.getPresent() == b.getPresent());
+  assert(a.getDeleted() == b.getDeleted());
+  for (uint64_t i = a.getDeleted(); i < a.getDeleted() + a.getPresent(); ++i){
+    for (const char **n = names; *n; ++n){assert(a.getInt(*n, i) == b.getInt(*n, i));}
+  }
+}
+
+/// Asserts the loaded metadata holds the same tracks and data as the original.
+void sameMeta(const DTSC::Meta &a, const DTSC::Meta &b){
+  static const char *fragFields[] ={"duration", "keys", "firstkey", "size", 0};
+  static const char *keyFields[] ={"firstpart", "bpos", "duration", "number", "parts", "time", "size", 0};
+  static const char *partFields[] ={"size", "duration", "offset", 0};
+  assert(b.getValidTracks().size());
+  assert(a.getVod() == b.getVod());
+  assert(a.getUUID() == b.getUUID());
+  std::set<size_t> aTracks = a.getValidTracks(), bTracks = b.getValidTracks();
+  assert(aTracks.size() == bTracks.size());
+  std::set<size_t>::iterator j = bTracks.begin();
+  for (std::set<size_t>::iterator i = aTracks.begin(); i != aTracks.end(); ++i, ++j){
+    assert(a.getID(*i) == b.getID(*j));
+    assert(a.getType(*i) == b.getType(*j));
+    assert(a.getCodec(*i) == b.getCodec(*j));
+    assert(a.getInit(*i) == b.getInit(*j));
+    assert(a.getLang(*i) == b.getLang(*j));
+    assert(a.getFirstms(*i) == b.getFirstms(*j));
+    assert(a.getLastms(*i) == b.getLastms(*j));
+    assert(a.getBps(*i) == b.getBps(*j));
+    assert(a.getMaxBps(*i) == b.getMaxBps(*j));
+    assert(a.getWidth(*i) == b.getWidth(*j));
+    assert(a.getRate(*i) == b.getRate(*j));
+    sameRecords(a.fragments(*i), b.fragments(*j), fragFields);
+    sameRecords(a.keys(*i), b.keys(*j), keyFields);
+    sameRecords(a.parts(*i), b.parts(*j), partFields);
+  }
+}
+
+/// Writes the metadata in the packed version 4 format, as headers were written before.
+void writePacked(const DTSC::Meta &M, const std::string &path){
+  FILE *F = fopen(path.c_str(), "w");
+  assert(F);
+  Socket::Connection out(fileno(F), -1);
+  M.send(out, false, M.getValidTracks(), false);
+  fclose(F);
+}
+
+/// Returns the contents of the given file.
+std::string readFile(const std::string &path){
+  std::string data;
+  FILE *F = fopen(path.c_str(), "r");
+  assert(F);
+  char buf[4096];
+  size_t r;
+  while ((r = fread(buf, 1, sizeof(buf), F))){data.append(buf, r);}
+  fclose(F);
+  return data;
+}
+
+int main(int argc, char **argv){
+  Util::printDebugLevel = DLVL_FAIL;
+  std::stringstream base;
+  base << "/tmp/mist_dtsh_" << getpid();
+  std::string packed = base.str() + "_v4.dtsh", raw = base.str() + "_v5.dtsh";
+
+  DTSC::Meta M;
+  M.reInit("", true);
+  M.setVod(true);
+  M.setUUID("some-uuid");
+  size_t vid = M.addTrack(100, 100, 1000, 10, true);
+  M.setType(vid, "video");
+  M.setCodec(vid, "H264");
+  M.setInit(vid, std::string("\001\000\377init", 7));
+  M.setID(vid, 1);
+  M.setWidth(vid, 1920);
+  M.setHeight(vid, 1080);
+  M.setFpks(vid, 25000);
+  size_t aud = M.addTrack(100, 100, 1000, 10, true);
+  M.setType(aud, "audio");
+  M.setCodec(aud, "AAC");
+  M.setInit(aud, "\022\020");
+  M.setID(aud, 2);
+  M.setLang(aud, "nld");
+  M.setRate(aud, 48000);
+  M.setChannels(aud, 2);
+  M.setSize(aud, 16);
+  for (uint64_t t = 0; t < 20000; t += 40){
+    M.update(t, (t % 120) ? 40 : 0, vid, 1000 + t % 333, t * 10, !(t % 2000));
+    M.update(t + 3, 0, aud, 300, t * 10 + 5000, true);
+  }
+
+  // The packed format still loads, and converts to a raw file holding the same data
+  writePacked(M, packed);
+  DTSC::Meta fromPacked("", packed);
+  assert(fromPacked.version == DTSH_PACKED_VERSION);
+  sameMeta(M, fromPacked);
+  fromPacked.toFile(raw);
+  std::string data = readFile(raw);
+  assert(!memcmp(data.data(), DTSC::Magic_RawHeader, 4));
+  DTSC::Meta fromRaw("", raw);
+  assert(fromRaw.version == DTSH_VERSION);
+  sameMeta(M, fromRaw);
+
+  // Loading from memory works the same as loading the file
+  DTSC::Meta fromMem;
+  fromMem.reInit("", data.data(), data.size());
+  sameMeta(M, fromMem);
+
+  // Records keep their numbers after the first keys were removed
+  M.removeFirstKey(vid);
+  M.removeFirstKey(vid);
+  assert(M.keys(vid).getDeleted() == 2);
+  M.toFile(raw);
+  DTSC::Meta fromRemoved("", raw);
+  sameMeta(M, fromRemoved);
+  assert(fromRemoved.getKeyNumForTime(vid, 10000) == M.getKeyNumForTime(vid, 10000));
+
+  // Damaged files do not load
+  data = readFile(raw);
+  DTSC::Meta broken;
+  broken.reInit("", data.data(), data.size() - 8);
+  assert(!broken.getValidTracks().size());
+  data[4] = 9;
+  broken.reInit("", data.data(), data.size());
+  assert(!broken.getValidTracks().size());
+
+  unlink(packed.c_str());
+  unlink(raw.c_str());
+  std::cout << "All raw DTSH tests passed" << std::endl;
+  return 0;
+}
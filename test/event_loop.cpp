@@ -0,0 +1,75 @@
+/// \file event_loop.cpp
+/// Tests for Event::Loop: waiting for readability of many connections at once.
+
+#include <mist/defines.h>
+#include <mist/ev.h>
+#include <mist/socket.h>
+#include <cassert>
+#include <iostream>
+#include <sys/socket.h>
+#include <unistd.h>
+
+/// Creates a connected pair of sockets.
+void makePair(int fds[2]){
+  int ret = socketpair(PF_LOCAL, SOCK_STREAM, 0, fds);
+  assert(!ret);
+}
+
+/// Waits for readable connections, returning the argument of the only one, or 0 if there is none.
+void *awaitOne(Event::Loop &ev, uint64_t timeout){
+  std::deque<void *> ready;
+  size_t count = ev.await(ready, timeout);
+  assert(count == ready.size());
+  assert(count <= 1);
+  return count ? ready[0] : 0;
+}
+
+int main(int argc, char **argv){
+  Util::printDebugLevel = DLVL_FAIL;
+  Event::Loop ev;
+  assert(ev);
+  int a[2], b[2];
+  makePair(a);
+  makePair(b);
+  int argA = 1, argB = 2;
+  bool added = ev.add(a[1], &argA);
+  assert(added);
+  added = ev.add(b[1], &argB);
+  assert(added);
+  assert(ev.size() == 2);
+  void *ready = awaitOne(ev, 0);
+  assert(!ready);
+
+  // Readable connections are reported with their argument, until all data was read
+  ssize_t w = write(a[0], "GET / HTTP/1.1\r\n\r\n", 18);
+  assert(w == 18);
+  ready = awaitOne(ev, 100);
+  assert(ready == &argA);
+  ready = awaitOne(ev, 0);
+  assert(ready == &argA);
+  char buf[64];
+  ssize_t r = read(a[1], buf, sizeof(buf));
+  assert(r == 18);
+  ready = awaitOne(ev, 0);
+  assert(!ready);
+
+  // Removed connections are no longer reported
+  ev.remove(a[1]);
+  assert(ev.size() == 1);
+  w = write(a[0], "x", 1);
+  assert(w == 1);
+  ready = awaitOne(ev, 0);
+  assert(!ready);
+
+  // A hangup makes a connection readable, so the loop notices it closing
+  close(b[0]);
+  ready = awaitOne(ev, 100);
+  assert(ready == &argB);
+  ev.remove(b[1]);
+  close(b[1]);
+  close(a[0]);
+  close(a[1]);
+
+  std::cout << "All event loop tests passed" << std::endl;
+  return 0;
+}
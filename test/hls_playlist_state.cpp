@@ -0,0 +1,80 @@
+/// \file hls_playlist_state.cpp
+/// Tests for HLS::mediaManifestState: while a live stream grows, media manifests rendered with the
+/// same state description must be identical, and the description must change with every new
+/// fragment and partial fragment.
+
+#include <mist/hls_support.h>
+#include <cassert>
+#include <iostream>
+#include <set>
+#include <sstream>
+
+/// Renders the media manifest of the given track, setting state to its description.
+std::string render(const DTSC::Meta &M, size_t tid, bool noLLHLS, std::string &state){
+  std::map<size_t, Comms::Users> userSelect;
+  const HLS::HlsSpecData hlsSpec ={"", "", ""};
+  const HLS::TrackData trackData ={
+      true, true, noLLHLS, ".m4s", "", "", tid, tid, M.biggestFragment(tid) / 1000, 0, 0, "", 0, 0,
+  };
+  DTSC::Fragments fragments(M.fragments(tid));
+  DTSC::Keys keys(M.keys(tid));
+  HLS::FragmentData fragData;
+  HLS::populateFragmentData(M, userSelect, fragData, trackData, fragments, keys);
+  state = HLS::mediaManifestState(M, fragData, trackData, hlsSpec, fragments, keys);
+  std::stringstream result;
+  HLS::addStartingMetaTags(result, fragData, trackData, hlsSpec);
+  HLS::addMediaFragments(result, M, fragData, trackData, fragments, keys);
+  HLS::addEndingTags(result, M, userSelect, fragData, trackData);
+  return result.str();
+}
+
+int main(int argc, char **argv){
+  Util::printDebugLevel = DLVL_FAIL;
+  DTSC::Meta M;
+  M.reInit("", true);
+  M.setLive(true);
+  size_t vid = M.addTrack(100, 100, 1000, 10, true);
+  M.setType(vid, "video");
+  M.setCodec(vid, "H264");
+  M.setID(vid, 1);
+
+  for (int noLLHLS = 0; noLLHLS < 2; ++noLLHLS){
+    std::map<std::string, std::string> seen;
+    std::set<size_t> fragmentCounts;
+    std::string lastState;
+    size_t changes = 0;
+    for (uint64_t t = 0; t < 60000; t += 40){
+      uint64_t time = t + noLLHLS * 60000;
+      M.update(time, 0, vid, 1000, time * 10, !(time % 2000));
+      std::string state;
+      std::string manifest = render(M, vid, noLLHLS, state);
+      // Equal states always render equal manifests
+      bool isNew = !seen.count(state);
+      if (isNew){
+        seen[state] = manifest;
+      }else{
+        assert(seen[state] == manifest);
+      }
+      DTSC::Fragments fragments(M.fragments(vid));
+      // Until there are two fragments, the state changes with every packet
+      if (state != lastState && fragments.getEndValid() > 2){++changes;}
+      lastState = state;
+      // Every new fragment changes the state
+      if (!fragmentCounts.count(fragments.getEndValid())){
+        fragmentCounts.insert(fragments.getEndValid());
+        assert(isNew);
+      }
+    }
+    // Only changes once per fragment without LL-HLS, and once per partial fragment with it
+    assert(changes >= fragmentCounts.size() - 3);
+    if (noLLHLS){
+      assert(changes <= fragmentCounts.size());
+    }else{
+      assert(changes >= 56000 / HLS::partDurationMaxMs);
+      assert(changes <= 60000 / HLS::partDurationMaxMs + fragmentCounts.size());
+    }
+  }
+
+  std::cout << "All HLS playlist state tests passed" << std::endl;
+  return 0;
+}
@@ -0,0 +1,99 @@
+/// \file http_send_file.cpp
+/// Tests for sending file ranges as HTTP bodies: Socket::Connection::SendFile and
+/// HTTP::Parser::ChunkifyFile, in chunked, plain and buffered mode.
+
+#include <mist/http_parser.h>
+#include <cassert>
+#include <iostream>
+#include <stdlib.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+/// Creates a connected pair of sockets.
+void makePair(Socket::Connection &a, Socket::Connection &b){
+  int fds[2];
+  int ret = socketpair(PF_LOCAL, SOCK_STREAM, 0, fds);
+  assert(!ret);
+  a.open(fds[0]);
+  b.open(fds[1]);
+}
+
+/// Reads everything currently available on a connection.
+std::string drain(Socket::Connection &conn){
+  conn.setBlocking(false);
+  while (conn.spool()){}
+  return conn.Received().remove(conn.Received().bytes(0xFFFFFFFFul));
+}
+
+int main(int argc, char **argv){
+  Util::printDebugLevel = DLVL_FAIL;
+  std::string content(100000, 0);
+  for (size_t i = 0; i < content.size(); ++i){content[i] = (char)(i * 31 + i / 256);}
+  char path[] = "/tmp/mist_sendfile_XXXXXX";
+  int fd = mkstemp(path);
+  assert(fd != -1);
+  unlink(path);
+  ssize_t w = write(fd, content.data(), content.size());
+  assert(w == (ssize_t)content.size());
+
+  Socket::Connection out, in;
+  makePair(out, in);
+
+  // File ranges arrive as-is
+  bool ok = out.SendFile(fd, 0, 1000);
+  assert(ok);
+  std::string got = drain(in);
+  assert(got == content.substr(0, 1000));
+  ok = out.SendFile(fd, 12345, 5000);
+  assert(ok);
+  got = drain(in);
+  assert(got == content.substr(12345, 5000));
+  // Ranges running past the end of the file send what there is and report failure
+  ok = out.SendFile(fd, content.size() - 10, 20);
+  assert(!ok);
+  got = drain(in);
+  assert(got == content.substr(content.size() - 10));
+
+  // Chunked: each part gets its hexadecimal size line, exactly like Chunkify
+  HTTP::Parser H;
+  H.sendingChunks = true;
+  ok = H.ChunkifyFile(fd, 100, 0x1a2b, out);
+  assert(ok);
+  got = drain(in);
+  assert(got == "1a2b\r\n" + content.substr(100, 0x1a2b) + "\r\n");
+  H.Chunkify(content.data() + 100, 0x1a2b, out);
+  std::string viaChunkify = drain(in);
+  assert(viaChunkify == got);
+  ok = H.ChunkifyFile(fd, 7, 1, out);
+  assert(ok);
+  got = drain(in);
+  assert(got == "1\r\n" + content.substr(7, 1) + "\r\n");
+  // Empty parts are ignored, as they would end the response
+  ok = H.ChunkifyFile(fd, 7, 0, out);
+  assert(ok);
+  got = drain(in);
+  assert(!got.size());
+
+  // Not chunked: only the data itself
+  H.sendingChunks = false;
+  ok = H.ChunkifyFile(fd, 500, 2000, out);
+  assert(ok);
+  got = drain(in);
+  assert(got == content.substr(500, 2000));
+
+  // Buffered: collected into the body, to be sent with a Content-Length
+  H.bufferChunks = true;
+  H.body = "start";
+  ok = H.ChunkifyFile(fd, 40000, 30000, out);
+  assert(ok);
+  assert(H.body == "start" + content.substr(40000, 30000));
+  ok = H.ChunkifyFile(fd, content.size() - 5, 10, out);
+  assert(!ok);
+  assert(H.body == "start" + content.substr(40000, 30000) + content.substr(content.size() - 5));
+  got = drain(in);
+  assert(!got.size());
+
+  close(fd);
+  std::cout << "All HTTP file sending tests passed" << std::endl;
+  return 0;
+}
@@ -0,0 +1,146 @@
+/// \file json_bench.cpp
+/// Benchmark for JSON parsing and serializing: parses a large document the old way (through an
+/// std::istream) and straight from memory, serializes it again and reports the throughput of each.
+/// Uses a captured /api response if a file name is given, otherwise generates a similar document
+/// of about 5 MB. Also checks that all ways of parsing agree and that the output parses back to
+/// the same value.
+
+#include <mist/json.h>
+#include <mist/timing.h>
+#include <iostream>
+#include <sstream>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+
+/// Returns true if both values are equal, allowing for the rounding errors of the std::istream
+/// parser in doubles.
+bool similar(const JSON::Value &a, const JSON::Value &b){
+  if (a.isDouble() && b.isDouble()){
+    double diff = a.asDouble() - b.asDouble();
+    double mag = a.asDouble() < 0 ? -a.asDouble() : a.asDouble();
+    return (diff < 0 ? -diff : diff) <= mag * 1e-12;
+  }
+  if (a.isArray() != b.isArray() || a.isObject() != b.isObject()){return false;}
+  if (!a.isArray() && !a.isObject()){return a == b;}
+  if (a.size() != b.size()){return false;}
+  JSON::ConstIter j(b);
+  jsonForEachConst(a, i){
+    if (a.isObject() && (!b.isMember(i.key()) || !similar(*i, b[i.key()]))){return false;}
+    if (a.isArray() && !similar(*i, *j)){return false;}
+    ++j;
+  }
+  return true;
+}
+
+/// Generates a document shaped like a controller /api response for the given amount of streams.
+std::string generateDocument(size_t streams){
+  JSON::Value api;
+  api["authorize"]["status"] = "OK";
+  api["config"]["controller"]["interface"] = "0.0.0.0";
+  api["config"]["protocols"].append()["connector"] = "HTTP";
+  for (size_t i = 0; i < streams; ++i){
+    std::stringstream name;
+    name << "live_" << i;
+    JSON::Value &strm = api["streams"][name.str()];
+    strm["name"] = name.str();
+    strm["source"] = "push://";
+    strm["online"] = (int64_t)(i % 3);
+    strm["tags"].append("live");
+    strm["tags"].append("caf\xC3\xA9 \"quoted\"\n");
+    strm["processes"].append()["process"] = "AV";
+    for (size_t t = 0; t < 4; ++t){
+      std::stringstream tid;
+      tid << "track_" << t;
+      JSON::Value &trk = strm["meta"]["tracks"][tid.str()];
+      trk["codec"] = t ? "AAC" : "H264";
+      trk["bps"] = (int64_t)(rand() % 1000000);
+      trk["fpks"] = (int64_t)25000;
+      trk["firstms"] = (int64_t)rand();
+      trk["jitter"] = (double)(rand() % 10000) / 100.0;
+      trk["init"] = std::string(40, (char)('a' + t));
+    }
+  }
+  for (size_t i = 0; i < streams * 4; ++i){
+    JSON::Value &row = api["clients"]["data"].append();
+    row.append((int64_t)rand());
+    row.append("127.0.0.1");
+    row.append(-(int64_t)(rand() % 1000));
+    row.append((double)rand() / 7.0);
+    row.append(i % 2 == 0);
+    row.append(JSON::Value());
+  }
+  return api.toString();
+}
+
+int main(int argc, char **argv){
+  Util::printDebugLevel = DLVL_WARN;
+  size_t rounds = 5;
+  std::string data;
+  if (argc > 1){
+    FILE *F = fopen(argv[1], "r");
+    if (!F){
+      std::cerr << "Could not open " << argv[1] << std::endl;
+      return 1;
+    }
+    char buf[64 * 1024];
+    size_t r;
+    while ((r = fread(buf, 1, sizeof(buf), F))){data.append(buf, r);}
+    fclose(F);
+  }else{
+    srand(42);
+    data = generateDocument(5000);
+  }
+  if (argc > 2){rounds = atoll(argv[2]);}
+  std::cout << "Document of " << data.size() << " bytes, " << rounds << " rounds:" << std::endl;
+
+  int failures = 0;
+  JSON::Value viaStream, viaMemory;
+  uint64_t start = Util::getMicros();
+  for (size_t r = 0; r < rounds; ++r){
+    std::istringstream is(data);
+    JSON::Value parsed(is);
+    if (r + 1 == rounds){viaStream = parsed;}
+  }
+  uint64_t streamTime = Util::getMicros(start);
+
+  start = Util::getMicros();
+  for (size_t r = 0; r < rounds; ++r){
+    const char *p = data.data();
+    viaMemory.parse(p, p + data.size());
+  }
+  uint64_t memoryTime = Util::getMicros(start);
+
+  std::string out;
+  start = Util::getMicros();
+  for (size_t r = 0; r < rounds; ++r){out = viaMemory.toString();}
+  uint64_t writeTime = Util::getMicros(start);
+
+  Util::ResizeablePointer buf;
+  start = Util::getMicros();
+  for (size_t r = 0; r < rounds; ++r){
+    buf.truncate(0);
+    viaMemory.toString(buf);
+  }
+  uint64_t bufTime = Util::getMicros(start);
+
+  uint64_t bytes = (uint64_t)data.size() * rounds;
+  std::cout << "  Parse from stream: " << streamTime << "us (" << (streamTime ? bytes / streamTime : 0) << " MB/s)" << std::endl;
+  std::cout << "  Parse from memory: " << memoryTime << "us (" << (memoryTime ? bytes / memoryTime : 0) << " MB/s)" << std::endl;
+  std::cout << "  Serialize to string: " << writeTime << "us (" << (writeTime ? bytes / writeTime : 0) << " MB/s)" << std::endl;
+  std::cout << "  Serialize to buffer: " << bufTime << "us (" << (bufTime ? bytes / bufTime : 0) << " MB/s)" << std::endl;
+
+  if (!similar(viaStream, viaMemory)){
+    std::cerr << "Parsing from stream and from memory gave different results" << std::endl;
+    ++failures;
+  }
+  if (out.size() != buf.size() || out.compare(0, out.size(), (const char *)buf, buf.size())){
+    std::cerr << "Serializing to a string and to a buffer gave different results" << std::endl;
+    ++failures;
+  }
+  if (JSON::fromString(out) != viaMemory && JSON::fromString(out).toString() != out){
+    std::cerr << "Serialized document does not parse back to the same value" << std::endl;
+    ++failures;
+  }
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,59 @@
+/// \file meta_ids.cpp
+/// Tests for the interned track type and codec identifiers of DTSC::Meta and the metadata
+/// generation counter that invalidates them.
+
+#include <mist/dtsc.h>
+#include <cassert>
+#include <iostream>
+
+int main(int argc, char **argv){
+  assert(DTSC::typeFromString("video") == DTSC::TYPE_VIDEO);
+  assert(DTSC::typeFromString("audio") == DTSC::TYPE_AUDIO);
+  assert(DTSC::typeFromString("meta") == DTSC::TYPE_META);
+  assert(DTSC::typeFromString("") == DTSC::TYPE_UNKNOWN);
+  assert(DTSC::codecFromString("H264") == DTSC::CODEC_H264);
+  assert(DTSC::codecFromString("opus") == DTSC::CODEC_OPUS);
+  assert(DTSC::codecFromString("Opus") == DTSC::CODEC_UNKNOWN);
+  assert(DTSC::codecFromString("rawts") == DTSC::CODEC_RAWTS);
+
+  DTSC::Meta M;
+  M.reInit("", true);
+  uint64_t gen = M.getGeneration();
+
+  // Adding and setting up a track changes the generation
+  size_t vid = M.addTrack(10, 10, 10, 10, true);
+  assert(M.getGeneration() != gen);
+  M.setType(vid, "video");
+  M.setCodec(vid, "H264");
+  assert(M.getTypeId(vid) == DTSC::TYPE_VIDEO);
+  assert(M.getCodecId(vid) == DTSC::CODEC_H264);
+
+  size_t aud = M.addTrack(10, 10, 10, 10, true);
+  M.setType(aud, "audio");
+  M.setCodec(aud, "AAC");
+  assert(M.getTypeId(aud) == DTSC::TYPE_AUDIO);
+  assert(M.getCodecId(aud) == DTSC::CODEC_AAC);
+
+  // Cached identifiers follow codec changes
+  gen = M.getGeneration();
+  M.setCodec(vid, "HEVC");
+  assert(M.getGeneration() != gen);
+  assert(M.getCodecId(vid) == DTSC::CODEC_HEVC);
+  assert(M.getCodecId(aud) == DTSC::CODEC_AAC);
+
+  // Only the first key of a track changes the generation, other packets do not
+  gen = M.getGeneration();
+  M.update(0, 0, vid, 100, 0, true);
+  assert(M.getGeneration() != gen);
+  gen = M.getGeneration();
+  M.update(40, 0, vid, 100, 0, false);
+  M.update(80, 0, vid, 100, 0, true);
+  assert(M.getGeneration() == gen);
+
+  // Removing a track changes the generation
+  M.removeTrack(aud);
+  assert(M.getGeneration() != gen);
+
+  std::cout << "All metadata identifier tests passed" << std::endl;
+  return 0;
+}
@@ -0,0 +1,188 @@
+/// \file page_cache.cpp
+/// Tests for the on-disk VoD page cache: storing and loading pages, packet counting, invalidation
+/// when the source file or its page layout changes, and least recently used eviction across
+/// sources that leaves files not created by the cache alone.
+
+#include <mist/bitfields.h>
+#include <mist/page_cache.h>
+#include <cassert>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utime.h>
+
+/// Returns a page holding the given amount of DTSC packets with 100 bytes of payload each.
+std::string makePage(size_t packets){
+  std::string page;
+  for (size_t i = 0; i < packets; ++i){
+    char hdr[8];
+    memcpy(hdr, "DTP2", 4);
+    Bit::htobl(hdr + 4, 100);
+    page.append(hdr, 8);
+    page.append(100, (char)i);
+  }
+  return page;
+}
+
+/// Writes a source file of the given size.
+void writeFile(const std::string &path, size_t len){
+  std::ofstream f(path.c_str());
+  f << std::string(len, 'x');
+}
+
+/// Sets the modification time of a file to the given amount of seconds in the past.
+void age(const std::string &path, time_t secs){
+  struct utimbuf t;
+  t.actime = t.modtime = time(0) - secs;
+  utime(path.c_str(), &t);
+}
+
+int main(int argc, char **argv){
+  std::stringstream base;
+  base << "/tmp/mist_pagecache_" << getpid();
+  std::string dir = base.str() + "_cache";
+  std::string srcA = base.str() + "_a.mp4", srcB = base.str() + "_b.mp4";
+  writeFile(srcA, 1000);
+  writeFile(srcB, 2000);
+
+  // Packet counting only accepts whole packets
+  std::string page = makePage(10);
+  assert(PageCache::countPackets(page.data(), page.size()) == 10);
+  assert(PageCache::countPackets(page.data(), page.size() - 1) == 0);
+  assert(PageCache::countPackets("DTP1xxxx", 8) == 0);
+
+  // Only local files can be cached
+  std::string layout = "1 H264 0+5/120/65536\n";
+  PageCache::Store store;
+  assert(!store);
+  bool ok;
+  ok = store.open(dir, "http://example.com/file.mp4", layout, 1024 * 1024);
+  assert(!ok);
+  ok = store.open(dir, srcA, layout, 0);
+  assert(!ok);
+  ok = store.open(dir, srcA, layout, 1024 * 1024);
+  assert(ok);
+  assert(store);
+
+  // Stored pages load back identically, missing pages and pages that don't fit do not load
+  char buf[4096];
+  uint64_t len = 0;
+  ok = store.load(0, 0, buf, sizeof(buf), len);
+  assert(!ok);
+  ok = store.store(0, 0, page.data(), page.size());
+  assert(ok);
+  ok = store.load(0, 0, buf, sizeof(buf), len);
+  assert(ok);
+  assert(len == page.size() && !memcmp(buf, page.data(), len));
+  ok = store.load(0, 0, buf, page.size() - 1, len);
+  assert(!ok);
+  ok = store.load(0, 0, buf, sizeof(buf), len);
+  assert(!ok);
+
+  // Pages are invalidated when the source changes
+  ok = store.store(1, 5, page.data(), page.size());
+  assert(ok);
+  writeFile(srcA, 1001);
+  PageCache::Store changed;
+  ok = changed.open(dir, srcA, layout, 1024 * 1024);
+  assert(ok);
+  ok = changed.load(1, 5, buf, sizeof(buf), len);
+  assert(!ok);
+  assert(changed.pagePath(1, 5) != store.pagePath(1, 5));
+  // ...and when the source is divided into pages differently
+  ok = changed.store(1, 5, page.data(), page.size());
+  assert(ok);
+  PageCache::Store repaged;
+  ok = repaged.open(dir, srcA, "1 H264 0+4/100/65536\n", 1024 * 1024);
+  assert(ok);
+  ok = repaged.load(1, 5, buf, sizeof(buf), len);
+  assert(!ok);
+  assert(repaged.pagePath(1, 5) != changed.pagePath(1, 5));
+  changed.remove(1, 5);
+
+  // Trimming never touches anything the cache did not create
+  std::string foreignDir = dir + "/0123456789abcdef0123456789abcdef";
+  std::string otherDir = dir + "/notahash";
+  mkdir(foreignDir.c_str(), 0755);
+  mkdir(otherDir.c_str(), 0755);
+  writeFile(foreignDir + "/1_2", 100000);
+  writeFile(otherDir + "/1_2", 100000);
+  writeFile(dir + "/1_2", 100000);
+  writeFile(store.pagePath(1, 5).substr(0, store.pagePath(1, 5).rfind('/')) + "/notes.txt", 100000);
+
+  // The least recently used pages of all sources are evicted first
+  // The page of the changed source is the oldest, so it goes first and the order below is fixed
+  age(store.pagePath(1, 5), 40);
+  std::string big = makePage(20);
+  PageCache::Store a, b;
+  ok = a.open(dir, srcA, layout, big.size() * 3);
+  assert(ok);
+  ok = b.open(dir, srcB, layout, big.size() * 3);
+  assert(ok);
+  ok = a.store(0, 0, big.data(), big.size());
+  assert(ok);
+  ok = b.store(0, 0, big.data(), big.size());
+  assert(ok);
+  ok = a.store(0, 1, big.data(), big.size());
+  assert(ok);
+  age(a.pagePath(0, 0), 30);
+  age(b.pagePath(0, 0), 20);
+  age(a.pagePath(0, 1), 10);
+  // Loading makes a page the most recently used one
+  ok = a.load(0, 0, buf, sizeof(buf), len);
+  assert(ok);
+  ok = b.store(0, 1, big.data(), big.size());
+  assert(ok);
+  // Each store only knows about its own pages until it trims
+  assert(!access(b.pagePath(0, 0).c_str(), F_OK));
+  uint64_t total = b.trim();
+  assert(total == big.size() * 3);
+  assert(access(b.pagePath(0, 0).c_str(), F_OK));
+  assert(!access(a.pagePath(0, 0).c_str(), F_OK));
+  assert(!access(a.pagePath(0, 1).c_str(), F_OK));
+  assert(!access(b.pagePath(0, 1).c_str(), F_OK));
+  // A store that takes the cache over its size trims right away
+  ok = a.store(0, 2, big.data(), big.size());
+  assert(ok);
+  assert(access(a.pagePath(0, 1).c_str(), F_OK));
+  assert(!access(a.pagePath(0, 0).c_str(), F_OK));
+  assert(!access(a.pagePath(0, 2).c_str(), F_OK));
+  // Stores trim regularly even while below their own limit, to notice pages of other processes
+  PageCache::Store x, y;
+  ok = x.open(dir, srcB, layout, big.size() * 3 + page.size() * PAGECACHE_TRIM_INTERVAL);
+  assert(ok);
+  ok = y.open(dir, srcA, layout, big.size() * 10);
+  assert(ok);
+  ok = y.store(0, 3, big.data(), big.size());
+  assert(ok);
+  age(a.pagePath(0, 0), 50);
+  for (size_t i = 0; i < PAGECACHE_TRIM_INTERVAL; ++i){
+    assert(!access(a.pagePath(0, 0).c_str(), F_OK));
+    ok = x.store(1, i, page.data(), page.size());
+    assert(ok);
+  }
+  assert(access(a.pagePath(0, 0).c_str(), F_OK));
+  assert(!access((foreignDir + "/1_2").c_str(), F_OK));
+  assert(!access((otherDir + "/1_2").c_str(), F_OK));
+  assert(!access((dir + "/1_2").c_str(), F_OK));
+  assert(!access((store.pagePath(1, 5).substr(0, store.pagePath(1, 5).rfind('/')) + "/notes.txt").c_str(), F_OK));
+
+  // Clean up
+  a.remove(0, 2);
+  y.remove(0, 3);
+  b.remove(0, 1);
+  for (size_t i = 0; i < PAGECACHE_TRIM_INTERVAL; ++i){x.remove(1, i);}
+  store.remove(1, 5);
+  std::string cleanup = "rm -rf " + dir;
+  int cleaned = system(cleanup.c_str());
+  assert(!cleaned);
+  unlink(srcA.c_str());
+  unlink(srcB.c_str());
+
+  std::cout << "All page cache tests passed" << std::endl;
+  return 0;
+}
@@ -0,0 +1,154 @@
+/// \file relaccx_fields.cpp
+/// Benchmark for RelAccX field access: by name, through RelAccXFieldData and through
+/// RelAccXTypedField. Also measures the metadata lookups Output::prepareNext does for every
+/// packet that crosses a key boundary, using the cached page ring handles in DTSC::Track, versus
+/// the same lookups done with per-record string lookups.
+
+#include <mist/dtsc.h>
+#include <mist/timing.h>
+#include <iostream>
+#include <stdlib.h>
+
+#define BENCH_KEYS 20000
+#define BENCH_KEYS_PER_PAGE 5
+#define BENCH_KEY_DURATION 2000
+
+class BenchMeta : public DTSC::Meta{
+public:
+  size_t trk;
+  BenchMeta() : DTSC::Meta(){
+    reInit("", true);
+    size_t pageCount = BENCH_KEYS / BENCH_KEYS_PER_PAGE;
+    trk = addTrack(BENCH_KEYS, BENCH_KEYS, BENCH_KEYS, pageCount, true);
+    setType(trk, "video");
+    DTSC::Track &t = tracks.at(trk);
+    for (size_t i = 0; i < BENCH_KEYS; ++i){
+      t.parts.setInt(t.partDurationField, BENCH_KEY_DURATION, i);
+      t.keys.setInt(t.keyFirstPartField, i, i);
+      t.keys.setInt(t.keyDurationField, BENCH_KEY_DURATION, i);
+      t.keys.setInt(t.keyNumberField, i, i);
+      t.keys.setInt(t.keyPartsField, 1, i);
+      t.keys.setInt(t.keyTimeField, i * BENCH_KEY_DURATION, i);
+    }
+    t.parts.addRecords(BENCH_KEYS);
+    t.keys.addRecords(BENCH_KEYS);
+    for (size_t i = 0; i < pageCount; ++i){
+      t.pages.setInt("firstkey", i * BENCH_KEYS_PER_PAGE, i);
+      t.pages.setInt("keycount", BENCH_KEYS_PER_PAGE, i);
+      t.pages.setInt("avail", 1000 + i, i);
+      t.pages.setInt("firsttime", i * BENCH_KEYS_PER_PAGE * BENCH_KEY_DURATION, i);
+    }
+    t.pages.addRecords(pageCount);
+    setLastms(trk, BENCH_KEYS * BENCH_KEY_DURATION);
+  }
+};
+
+/// Reference: next-key page lookup, same search as DTSC::Meta::getPageNumberForKey but with
+/// per-record string lookups for every field access.
+size_t stringPageNumberForKey(const DTSC::Meta &M, size_t idx, uint64_t keyNum){
+  const Util::RelAccX &pages = M.pages(idx);
+  size_t lo = pages.getStartPos(), hi = pages.getEndPos();
+  while (lo < hi){
+    size_t mid = lo + (hi - lo) / 2;
+    if (pages.getInt("firstkey", mid) > keyNum){
+      hi = mid;
+    }else{
+      lo = mid + 1;
+    }
+  }
+  size_t res = lo ? lo - 1 : pages.getStartPos();
+  while (res > pages.getStartPos() && !pages.getInt("avail", res)){--res;}
+  return pages.getInt("firstkey", res);
+}
+
+/// Reference: the page holding a key if it is available, as Output::pageNumForKey used to find it
+/// with a linear scan and string lookups.
+size_t stringAvailablePageForKey(const DTSC::Meta &M, size_t idx, uint64_t keyNum){
+  const Util::RelAccX &pages = M.pages(idx);
+  for (uint64_t i = pages.getDeleted(); i < pages.getEndPos(); i++){
+    uint64_t pageNum = pages.getInt("firstkey", i);
+    if (pageNum > keyNum){continue;}
+    if (keyNum > pageNum + pages.getInt("keycount", i) - 1){continue;}
+    return pages.getInt("avail", i) ? pageNum : INVALID_KEY_NUM;
+  }
+  return INVALID_KEY_NUM;
+}
+
+int main(int argc, char **argv){
+  BenchMeta M;
+  size_t idx = M.trk;
+  const Util::RelAccX &pages = M.pages(idx);
+  size_t pageCount = pages.getEndPos();
+  size_t rounds = 200;
+  if (argc > 1){rounds = atoll(argv[1]);}
+  int failures = 0;
+
+  // Raw field access
+  uint64_t sumName = 0, sumData = 0, sumTyped = 0;
+  uint64_t start = Util::getMicros();
+  for (size_t r = 0; r < rounds; ++r){
+    for (size_t i = 0; i < pageCount; ++i){sumName += pages.getInt("avail", i);}
+  }
+  uint64_t nameTime = Util::getMicros(start);
+
+  Util::RelAccXFieldData availData = pages.getFieldData("avail");
+  start = Util::getMicros();
+  for (size_t r = 0; r < rounds; ++r){
+    for (size_t i = 0; i < pageCount; ++i){sumData += pages.getInt(availData, i);}
+  }
+  uint64_t dataTime = Util::getMicros(start);
+
+  Util::RelAccXTypedField<uint32_t> availTyped = pages.getFieldData("avail");
+  start = Util::getMicros();
+  for (size_t r = 0; r < rounds; ++r){
+    for (size_t i = 0; i < pageCount; ++i){sumTyped += availTyped.get(pages, i);}
+  }
+  uint64_t typedTime = Util::getMicros(start);
+  if (sumName != sumData || sumName != sumTyped){
+    std::cerr << "Field access mismatch: " << sumName << " / " << sumData << " / " << sumTyped << std::endl;
+    ++failures;
+  }
+
+  size_t reads = rounds * pageCount;
+  std::cout << reads << " field reads:" << std::endl;
+  std::cout << "  By name:          " << nameTime << "us (" << (nameTime * 1000 / reads) << "ns/read)" << std::endl;
+  std::cout << "  RelAccXFieldData: " << dataTime << "us (" << (dataTime * 1000 / reads) << "ns/read)" << std::endl;
+  std::cout << "  Typed:            " << typedTime << "us (" << (typedTime * 1000 / reads) << "ns/read)" << std::endl;
+
+  // Output::prepareNext key boundary handling: find the key for the current packet, then the page
+  // for the next key, then the time of the next key.
+  size_t packets = rounds * 100;
+  uint64_t sumMeta = 0, sumString = 0;
+  start = Util::getMicros();
+  for (size_t p = 0; p < packets; ++p){
+    uint64_t time = (p * 7919 * BENCH_KEY_DURATION / 3) % (BENCH_KEYS * BENCH_KEY_DURATION);
+    uint32_t thisKey = M.getKeyNumForTime(idx, time);
+    DTSC::Keys keys(M.getKeys(idx));
+    sumMeta += M.getPageNumberForKey(idx, thisKey + 1);
+    sumMeta += M.getAvailablePageForKey(idx, thisKey + 1);
+    if (keys.getEndValid() > thisKey + 1){sumMeta += keys.getTime(thisKey + 1);}
+    sumMeta += M.nextPageAvailable(idx, M.getPageNumberForTime(idx, time));
+  }
+  uint64_t metaTime = Util::getMicros(start);
+
+  start = Util::getMicros();
+  for (size_t p = 0; p < packets; ++p){
+    uint64_t time = (p * 7919 * BENCH_KEY_DURATION / 3) % (BENCH_KEYS * BENCH_KEY_DURATION);
+    uint32_t thisKey = M.getKeyNumForTime(idx, time);
+    DTSC::Keys keys(M.keys(idx));
+    sumString += stringPageNumberForKey(M, idx, thisKey + 1);
+    sumString += stringAvailablePageForKey(M, idx, thisKey + 1);
+    if (keys.getEndValid() > thisKey + 1){sumString += keys.getTime(thisKey + 1);}
+    sumString += M.nextPageAvailable(idx, M.getPageNumberForTime(idx, time));
+  }
+  uint64_t stringTime = Util::getMicros(start);
+  if (sumMeta != sumString){
+    std::cerr << "Page lookup mismatch: " << sumMeta << " / " << sumString << std::endl;
+    ++failures;
+  }
+
+  std::cout << packets << " prepareNext key boundaries over " << BENCH_KEYS << " keys:" << std::endl;
+  std::cout << "  Cached handles: " << metaTime << "us (" << (metaTime ? packets * 1000000 / metaTime : 0) << " packets/s)" << std::endl;
+  std::cout << "  String lookups: " << stringTime << "us (" << (stringTime ? packets * 1000000 / stringTime : 0) << " packets/s)" << std::endl;
+  return failures ? 1 : 0;
+}
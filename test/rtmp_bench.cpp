@@ -0,0 +1,132 @@
+/// \file rtmp_bench.cpp
+/// Benchmark for RTMP chunking: packs interleaved audio and video messages into chunks through
+/// RTMPStream::SendMedia (one std::string per message) and through RTMPStream::ChunkWriter
+/// (headers only, payload referenced in place), then parses the chunks again with
+/// RTMPStream::Chunk::Parse. Reports packets per second on a single core, and checks that the
+/// parsed messages match the packed ones.
+/// Arguments: amount of packets (default 200000) and chunk size (default 4096).
+
+#include <mist/rtmpchunks.h>
+#include <mist/timing.h>
+#include <iostream>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+
+/// A single media message to pack.
+struct message{
+  unsigned char type;
+  uint64_t time;
+  size_t len;
+};
+
+/// Resets all chunk stream state and counters, as a new connection would.
+void resetState(size_t chunkSize){
+  RTMPStream::lastsend.clear();
+  RTMPStream::lastrecv.clear();
+  RTMPStream::chunk_snd_max = chunkSize;
+  RTMPStream::chunk_rec_max = chunkSize;
+  RTMPStream::snd_cnt = 0;
+  RTMPStream::rec_cnt = 0;
+}
+
+int main(int argc, char **argv){
+  Util::printDebugLevel = DLVL_WARN;
+  size_t packets = 200000;
+  size_t chunkSize = 4096;
+  if (argc > 1){packets = atoll(argv[1]);}
+  if (argc > 2){chunkSize = atoll(argv[2]);}
+
+  // 25 fps video with a large frame every 50 frames, and 1024-sample AAC audio at 48 kHz
+  std::vector<message> msgs;
+  uint64_t vTime = 0, aTime = 0;
+  size_t vCount = 0, aCount = 0;
+  size_t maxLen = 0;
+  srand(42);
+  while (msgs.size() < packets){
+    message m;
+    if (vTime <= aTime){
+      m.type = 9;
+      m.time = vTime;
+      m.len = (vCount % 50) ? 8000 + rand() % 8000 : 120000;
+      vTime = (++vCount) * 40;
+    }else{
+      m.type = 8;
+      m.time = aTime;
+      m.len = 300 + rand() % 100;
+      aTime = (++aCount) * 1024000 / 48000;
+    }
+    if (m.len > maxLen){maxLen = m.len;}
+    msgs.push_back(m);
+  }
+  std::string payload;
+  for (size_t i = 0; i < maxLen; ++i){payload += (char)rand();}
+  uint64_t bytes = 0;
+  for (size_t i = 0; i < msgs.size(); ++i){bytes += msgs[i].len;}
+  std::cout << packets << " packets of " << bytes / packets << " bytes on average, chunk size " << chunkSize << ":" << std::endl;
+
+  // Packing through SendMedia
+  resetState(chunkSize);
+  uint64_t strBytes = 0;
+  uint64_t start = Util::getMicros();
+  for (size_t i = 0; i < msgs.size(); ++i){
+    strBytes += RTMPStream::SendMedia(msgs[i].type, (unsigned char *)payload.data(), msgs[i].len, msgs[i].time).size();
+  }
+  uint64_t strTime = Util::getMicros(start);
+
+  // Packing through ChunkWriter, with the 1-byte FLV data header as a separate prefix
+  resetState(chunkSize);
+  RTMPStream::ChunkWriter writer;
+  uint64_t vecBytes = 0;
+  start = Util::getMicros();
+  for (size_t i = 0; i < msgs.size(); ++i){
+    vecBytes += writer.pack(msgs[i].type + 42, msgs[i].type, 1, msgs[i].time, payload.data(), 1,
+                            payload.data() + 1, msgs[i].len - 1);
+  }
+  uint64_t vecTime = Util::getMicros(start);
+
+  // Keep the packed stream so it can be parsed back; not timed
+  resetState(chunkSize);
+  std::string stream;
+  for (size_t i = 0; i < msgs.size(); ++i){
+    writer.pack(msgs[i].type + 42, msgs[i].type, 1, msgs[i].time, payload.data(), msgs[i].len);
+    for (size_t v = 0; v < writer.count; ++v){
+      stream.append((const char *)writer.vec[v].iov_base, writer.vec[v].iov_len);
+    }
+  }
+
+  // Parsing, fed to the buffer in blocks like a socket would
+  resetState(chunkSize);
+  Socket::Buffer buf;
+  buf.splitter.clear();
+  RTMPStream::Chunk next;
+  size_t parsed = 0, mismatches = 0;
+  start = Util::getMicros();
+  for (size_t pos = 0; pos < stream.size(); pos += 16384){
+    buf.append(stream.data() + pos, std::min((size_t)16384, stream.size() - pos));
+    while (next.Parse(buf)){
+      const message &m = msgs[parsed];
+      if (next.msg_type_id != m.type || next.timestamp != m.time || next.data.size() != m.len ||
+          next.data.compare(0, m.len, payload, 0, m.len)){
+        ++mismatches;
+      }
+      ++parsed;
+    }
+  }
+  uint64_t parseTime = Util::getMicros(start);
+
+  std::cout << "  SendMedia:   " << strTime << "us, " << (strTime ? packets * 1000000 / strTime : 0) << " packets/s" << std::endl;
+  std::cout << "  ChunkWriter: " << vecTime << "us, " << (vecTime ? packets * 1000000 / vecTime : 0) << " packets/s" << std::endl;
+  std::cout << "  Parse:       " << parseTime << "us, " << (parseTime ? packets * 1000000 / parseTime : 0) << " packets/s" << std::endl;
+
+  int failures = 0;
+  if (strBytes != vecBytes){
+    std::cerr << "SendMedia produced " << strBytes << " bytes, ChunkWriter " << vecBytes << std::endl;
+    ++failures;
+  }
+  if (parsed != packets || mismatches){
+    std::cerr << "Parsed " << parsed << " of " << packets << " packets, " << mismatches << " did not match" << std::endl;
+    ++failures;
+  }
+  return failures ? 1 : 0;
+}
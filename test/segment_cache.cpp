@@ -0,0 +1,130 @@
+/// \file segment_cache.cpp
+/// Tests for the shared memory segment cache: producing, hitting, waiting for another producer,
+/// size-based eviction, eviction of data no longer in the buffer and removal of the whole cache.
+
+#include <mist/dtsc.h>
+#include <mist/segment_cache.h>
+#include <mist/timing.h>
+#include <cassert>
+#include <iostream>
+#include <sstream>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+std::string segData(size_t len, char c){return std::string(len, c);}
+
+int main(int argc, char **argv){
+  std::stringstream sn;
+  sn << "segcachetest" << getpid();
+  std::string streamName = sn.str();
+  uint64_t maxBytes = 1024 * 1024;
+  bool cached;
+
+  // First request produces the segment, second one is served from the cache
+  {
+    SegmentCache::Segment prod;
+    cached = prod.get(streamName, "HLS_1_2/0_2000", 1, 0, maxBytes);
+    assert(!cached);
+    assert(prod.isProducing());
+    prod.append(segData(1000, 'a'));
+    prod.append(segData(880, 'b'));
+    prod.finish();
+    assert(!prod.isProducing());
+
+    SegmentCache::Segment hit;
+    cached = hit.get(streamName, "HLS_1_2/0_2000", 1, 0, maxBytes);
+    assert(cached);
+    assert(hit.size() == 1880);
+    assert(!memcmp(hit.data(), segData(1000, 'a').data(), 1000));
+    assert(!memcmp(hit.data() + 1000, segData(880, 'b').data(), 880));
+  }
+
+  SegmentCache::Index idx;
+  cached = idx.open(streamName, false);
+  assert(cached);
+  assert(idx.getHits() == 1);
+  assert(idx.getMisses() == 1);
+  assert(idx.getStored() == 1880);
+  assert(idx.getCount() == 1);
+
+  // Segments that are released before being finished are not cached
+  {
+    SegmentCache::Segment prod;
+    cached = prod.get(streamName, "HLS_1_2/2000_4000", 1, 2000, maxBytes);
+    assert(!cached);
+    prod.append(segData(100, 'c'));
+  }
+  assert(idx.getCount() == 1);
+
+  // Concurrent requests wait for the producing process instead of producing it themselves
+  {
+    SegmentCache::Segment prod;
+    cached = prod.get(streamName, "HLS_1_2/4000_6000", 1, 4000, maxBytes);
+    assert(!cached);
+    pid_t child = fork();
+    if (!child){
+      SegmentCache::Segment waiter;
+      uint64_t start = Util::bootMS();
+      bool res = waiter.get(streamName, "HLS_1_2/4000_6000", 1, 4000, maxBytes);
+      _exit((res && waiter.size() == 500 && Util::bootMS() - start >= 100) ? 0 : 1);
+    }
+    Util::sleep(200);
+    prod.append(segData(500, 'd'));
+    prod.finish();
+    int status = 1;
+    waitpid(child, &status, 0);
+    assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+  }
+  assert(idx.getCount() == 2);
+  assert(idx.getStored() == 2380);
+
+  // Oldest segments are evicted to stay below the size limit
+  {
+    SegmentCache::Segment prod;
+    cached = prod.get(streamName, "CMAF_3/0_0_2000", 3, 0, 3000);
+    assert(!cached);
+    prod.append(segData(1000, 'e'));
+    prod.finish();
+    assert(idx.getStored() == 1500);
+    assert(idx.getEvictions() == 1);
+    SegmentCache::Segment hit;
+    cached = hit.get(streamName, "HLS_1_2/0_2000", 1, 0, maxBytes);
+    assert(!cached);
+    hit.release();
+    cached = hit.get(streamName, "CMAF_3/0_0_2000", 3, 0, maxBytes);
+    assert(cached);
+  }
+
+  // Segments are evicted when their track or start time leave the buffer
+  {
+    DTSC::Meta M;
+    M.reInit("", true);
+    size_t trk = M.addTrack(10, 10, 10, 10, true);
+    M.setType(trk, "video");
+    M.setFirstms(trk, 3000);
+    M.setLastms(trk, 10000);
+    SegmentCache::Segment prod;
+    cached = prod.get(streamName, "TEST/3000", trk, 3000, maxBytes);
+    assert(!cached);
+    prod.append(segData(10, 'f'));
+    prod.finish();
+    cached = prod.get(streamName, "TEST/1000", trk, 1000, maxBytes);
+    assert(!cached);
+    prod.append(segData(10, 'g'));
+    prod.finish();
+    size_t before = idx.getCount();
+    idx.evictStale(M);
+    assert(idx.getCount() == 1);
+    assert(before == 4);
+    SegmentCache::Segment hit;
+    cached = hit.get(streamName, "TEST/3000", trk, 3000, maxBytes);
+    assert(cached);
+  }
+
+  idx.clear();
+  cached = idx.open(streamName, false);
+  assert(!cached);
+  std::cout << "All segment cache tests passed" << std::endl;
+  return 0;
+}
@@ -0,0 +1,97 @@
+/// \file socket_buffer.cpp
+/// Tests for Socket::Buffer: splitting into parts, reading in place through peek() and skip(),
+/// prepending, and keeping data intact while the buffer moves and grows its memory.
+
+#include <mist/socket.h>
+#include <cassert>
+#include <iostream>
+#include <string.h>
+
+int main(int argc, char **argv){
+  // get(), peek() and copy() move data between the current part and the memory block, so they
+  // are called outside of assert() and their results checked afterwards
+  Socket::Buffer B;
+  assert(!B.size());
+  std::string got = B.get();
+  assert(got.empty());
+  const char *p = B.peek(1);
+  assert(!p);
+
+  // Parts end with the splitter, data erased from a part is removed from the buffer
+  B.append("GET / HTTP/1.1\r\nHost: x");
+  assert(B.size() == 2);
+  got = B.get();
+  assert(got == "GET / HTTP/1.1\r\n");
+  assert(B.bytes(100) == 23);
+  B.get().clear();
+  assert(B.size() == 1);
+  got = B.get();
+  assert(got == "Host: x");
+  B.append("\r\n\r\n");
+  assert(B.size() == 2);
+  B.get().erase(0, 2);
+  got = B.copy(5);
+  assert(got == "st: x");
+  got = B.get();
+  assert(got == "st: x\r\n");
+  B.get().clear();
+  got = B.get();
+  assert(got == "\r\n");
+  B.get().clear();
+  assert(!B.size());
+
+  // Peeking does not copy or remove anything, also when a part was handed out before
+  B.append("abc\ndef");
+  B.get().erase(0, 1);
+  p = B.peek(6);
+  assert(p && !memcmp(p, "bc\ndef", 6));
+  p = B.peek(7);
+  assert(!p);
+  unsigned int toSplit = B.bytesToSplit();
+  assert(toSplit == 3);
+  B.skip(3);
+  got = B.remove(3);
+  assert(got == "def");
+  assert(!B.available(1));
+
+  // Prepended data comes before everything else
+  B.append("world");
+  B.get();
+  B.prepend("hello ");
+  got = B.copy(11);
+  assert(got == "hello world");
+  B.clear();
+
+  // Binary data without a splitter, through moves and growth of the memory block
+  B.splitter.clear();
+  std::string all;
+  size_t removed = 0;
+  for (size_t i = 0; i < 2000; ++i){
+    std::string chunk(1 + (i * 7919) % 3000, (char)i);
+    char *dest = B.appendSpace(chunk.size());
+    assert(dest);
+    memcpy(dest, chunk.data(), chunk.size());
+    B.appended(chunk.size());
+    all += chunk;
+    size_t take = (i * 104729) % 2500;
+    if (!B.available(take)){continue;}
+    const char *d = B.peek(take);
+    assert(d && !memcmp(d, all.data() + removed, take));
+    B.skip(take);
+    removed += take;
+  }
+  assert(B.bytes(0xFFFFFFFFul) == all.size() - removed);
+  got = B.get();
+  assert(got.size() == 4096);
+  assert(!memcmp(got.data(), all.data() + removed, 4096));
+
+  // Copies are independent
+  Socket::Buffer C(B);
+  got = C.copy(all.size() - removed);
+  assert(got == all.substr(removed));
+  B.clear();
+  assert(C.bytes(0xFFFFFFFFul) == all.size() - removed);
+
+  std::cout << "All socket buffer tests passed" << std::endl;
+  return 0;
+}
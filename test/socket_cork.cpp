@@ -0,0 +1,95 @@
+/// \file socket_cork.cpp
+/// Benchmark for corked Socket::Connection output: sends HTTP-chunked 188-byte TS packets the way
+/// OutHTTPTS does, once with every packet sent right away and once with every media packet worth
+/// of TS packets corked, and reports the write system calls and throughput for both.
+
+#include <mist/http_parser.h>
+#include <mist/socket.h>
+#include <mist/timing.h>
+#include <fstream>
+#include <iostream>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+/// Returns the amount of write system calls done by this process so far, or 0 if unknown.
+uint64_t writeCalls(){
+  std::ifstream io("/proc/self/io");
+  std::string name;
+  uint64_t val;
+  while (io >> name >> val){
+    if (name == "syscw:"){return val;}
+  }
+  return 0;
+}
+
+/// Sends the given amount of media packets, each consisting of tsPerPacket TS packets.
+void sendPackets(Socket::Connection &conn, size_t packets, size_t tsPerPacket, bool corked){
+  HTTP::Parser H;
+  H.sendingChunks = true;
+  char ts[188];
+  memset(ts, 0xFF, 188);
+  ts[0] = 0x47;
+  for (size_t p = 0; p < packets; ++p){
+    if (corked){conn.cork();}
+    for (size_t i = 0; i < tsPerPacket; ++i){H.Chunkify(ts, 188, conn);}
+    if (corked){conn.uncork();}
+  }
+}
+
+/// Runs a single benchmark round through a socket pair, drained by a child process.
+/// Returns false if the child did not receive the expected amount of data.
+bool runRound(const char *name, size_t packets, size_t tsPerPacket, bool corked){
+  int sv[2];
+  if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv)){
+    std::cerr << "Could not create socket pair" << std::endl;
+    return false;
+  }
+  // Every chunk is "bc\r\n" + 188 bytes + "\r\n"
+  uint64_t expected = (uint64_t)packets * tsPerPacket * 194;
+  pid_t child = fork();
+  if (!child){
+    close(sv[0]);
+    char buf[65536];
+    uint64_t total = 0;
+    ssize_t r;
+    while ((r = read(sv[1], buf, sizeof(buf))) > 0){total += r;}
+    _exit(total == expected ? 0 : 1);
+  }
+  close(sv[1]);
+  Socket::Connection conn(sv[0], sv[0]);
+  uint64_t calls = writeCalls();
+  uint64_t start = Util::getMicros();
+  sendPackets(conn, packets, tsPerPacket, corked);
+  uint64_t time = Util::getMicros(start);
+  calls = writeCalls() - calls;
+  conn.close();
+  int status = 1;
+  waitpid(child, &status, 0);
+  std::cout << "  " << name << calls << " write calls in " << time << "us ("
+            << (time ? calls * 1000000 / time : 0) << " calls/s, "
+            << (time ? expected / time : 0) << " MB/s)" << std::endl;
+  return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+int main(int argc, char **argv){
+  size_t packets = 5000;
+  size_t tsPerPacket = 40;
+  if (argc > 1){packets = atoll(argv[1]);}
+  if (argc > 2){tsPerPacket = atoll(argv[2]);}
+  int failures = 0;
+
+  std::cout << packets << " media packets of " << tsPerPacket << " chunked TS packets each:" << std::endl;
+  if (!runRound("Uncorked: ", packets, tsPerPacket, false)){
+    std::cerr << "Uncorked data was not received correctly" << std::endl;
+    ++failures;
+  }
+  if (!runRound("Corked:   ", packets, tsPerPacket, true)){
+    std::cerr << "Corked data was not received correctly" << std::endl;
+    ++failures;
+  }
+  return failures ? 1 : 0;
+}
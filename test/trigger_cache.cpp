@@ -0,0 +1,175 @@
+/// \file trigger_cache.cpp
+/// Tests for the blocking trigger response cache: caching, expiry, payload line keys, waiting for
+/// another process handling an identical trigger, claims of exited processes and handling of
+/// triggers through the cache by Triggers::doTrigger.
+
+#include <mist/defines.h>
+#include <mist/shared_memory.h>
+#include <mist/timing.h>
+#include <mist/triggers.h>
+#include <cassert>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+int main(int argc, char **argv){
+  std::stringstream tn;
+  tn << "TESTTRIG" << getpid();
+  std::string type = tn.str();
+
+  // Only the configured payload lines are part of the key, next to the handler
+  uint64_t keyA = Triggers::ResponseCache::makeKey("http://a/", "strm\n1.2.3.4\nHLS", "1,3");
+  assert(keyA == Triggers::ResponseCache::makeKey("http://a/", "strm\n5.6.7.8\nHLS", "1,3"));
+  assert(keyA != Triggers::ResponseCache::makeKey("http://a/", "strm\n1.2.3.4\nRTMP", "1,3"));
+  assert(keyA != Triggers::ResponseCache::makeKey("http://b/", "strm\n1.2.3.4\nHLS", "1,3"));
+  assert(Triggers::ResponseCache::makeKey("http://a/", "strm\n1.2.3.4\nHLS", "") !=
+         Triggers::ResponseCache::makeKey("http://a/", "strm\n5.6.7.8\nHLS", ""));
+
+  Triggers::ResponseCache cache;
+  bool opened = cache.open(type, false);
+  assert(!opened);
+  opened = cache.open(type, true);
+  assert(opened);
+
+  // First call handles the trigger, second one is served from the cache
+  std::string response;
+  uint8_t claimed = cache.claim(keyA, response, false);
+  assert(claimed == CLAIMIDX_CLAIMED);
+  cache.publish(keyA, "false", 60);
+  claimed = cache.claim(keyA, response, false);
+  assert(claimed == CLAIMIDX_READY);
+  assert(response == "false");
+  assert(cache.getHits() == 1);
+  assert(cache.getMisses() == 1);
+  assert(cache.getCount() == 1);
+
+  // Responses expire after their TTL
+  uint64_t keyB = Triggers::ResponseCache::makeKey("http://a/", "other", "");
+  claimed = cache.claim(keyB, response, false);
+  assert(claimed == CLAIMIDX_CLAIMED);
+  cache.publish(keyB, "true", 1);
+  claimed = cache.claim(keyB, response, false);
+  assert(claimed == CLAIMIDX_READY);
+  Util::sleep(1100);
+  claimed = cache.claim(keyB, response, false);
+  assert(claimed == CLAIMIDX_CLAIMED);
+
+  // Responses that are too long are not cached
+  cache.publish(keyB, std::string(TRIGCACHE_RESPONSE + 1, 'x'), 60);
+  claimed = cache.claim(keyB, response, false);
+  assert(claimed == CLAIMIDX_CLAIMED);
+  cache.abandon(keyB);
+
+  // Identical calls wait for the process handling the trigger instead of handling it themselves
+  {
+    uint64_t keyC = Triggers::ResponseCache::makeKey("http://a/", "coalesce", "");
+    claimed = cache.claim(keyC, response, false);
+    assert(claimed == CLAIMIDX_CLAIMED);
+    pid_t child = fork();
+    if (!child){
+      Triggers::ResponseCache waiter;
+      if (!waiter.open(type, false)){_exit(1);}
+      std::string res;
+      uint8_t status = waiter.claim(keyC, res, false);
+      bool waited = false;
+      uint64_t waitUntil = Util::bootMS() + 5000;
+      while (status == CLAIMIDX_BUSY && waiter.await(waitUntil)){
+        waited = true;
+        status = waiter.claim(keyC, res, waited);
+      }
+      // Publishing wakes the waiter right away, not after polling or timing out
+      bool prompt = Util::bootMS() < waitUntil - 4500;
+      _exit((waited && prompt && status == CLAIMIDX_READY && res == "shared") ? 0 : 1);
+    }
+    Util::sleep(200);
+    cache.publish(keyC, "shared", 60);
+    int status = 1;
+    waitpid(child, &status, 0);
+    assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    assert(cache.getCoalesced() == 1);
+  }
+
+  // Claims of processes that exited without publishing are taken over
+  {
+    uint64_t keyD = Triggers::ResponseCache::makeKey("http://a/", "crashed", "");
+    pid_t child = fork();
+    if (!child){
+      Triggers::ResponseCache claimer;
+      std::string res;
+      _exit((claimer.open(type, false) && claimer.claim(keyD, res, false) == CLAIMIDX_CLAIMED) ? 0 : 1);
+    }
+    int status = 1;
+    waitpid(child, &status, 0);
+    assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    claimed = cache.claim(keyD, response, false);
+    assert(claimed == CLAIMIDX_CLAIMED);
+    cache.abandon(keyD);
+  }
+  cache.clear();
+  opened = cache.open(type, false);
+  assert(!opened);
+
+  // Blocking triggers with a cache TTL only run their handler once for identical payloads
+  {
+    std::stringstream sn, cn;
+    sn << "/tmp/mist_trigcache_" << getpid() << ".sh";
+    cn << "/tmp/mist_trigcache_" << getpid() << ".cnt";
+    std::string script = sn.str(), counter = cn.str();
+    {
+      std::ofstream sh(script.c_str());
+      sh << "#!/bin/sh\ncat > /dev/null\necho x >> " << counter << "\necho false\n";
+    }
+    chmod(script.c_str(), 0755);
+
+    char pageName[NAME_BUFFER_SIZE];
+    snprintf(pageName, NAME_BUFFER_SIZE, SHM_TRIGGER, type.c_str());
+    IPC::sharedPage trigPage(pageName, 32 * 1024, true, false);
+    Util::RelAccX tPage(trigPage.mapped, false);
+    tPage.addField("url", RAX_128STRING);
+    tPage.addField("sync", RAX_UINT);
+    tPage.addField("streams", RAX_256RAW);
+    tPage.addField("params", RAX_128STRING);
+    tPage.addField("default", RAX_128STRING);
+    tPage.addField("cachettl", RAX_32UINT);
+    tPage.addField("cachekey", RAX_64STRING);
+    tPage.setReady();
+    tPage.setString("url", script, 0);
+    tPage.setInt("sync", 1, 0);
+    memset(tPage.getPointer("streams", 0), 0, 4);
+    tPage.setString("params", "", 0);
+    tPage.setString("default", "", 0);
+    tPage.setInt("cachettl", 60, 0);
+    tPage.setString("cachekey", "1", 0);
+    tPage.setRCount(1);
+    tPage.setEndPos(1);
+
+    std::string res;
+    bool allowed = Triggers::doTrigger(type, "strm\nviewer1", "strm", false, res);
+    assert(!allowed);
+    allowed = Triggers::doTrigger(type, "strm\nviewer2", "strm", false, res);
+    assert(!allowed);
+    assert(res == "false\n");
+    size_t runs = 0;
+    std::ifstream cnt(counter.c_str());
+    std::string line;
+    while (std::getline(cnt, line)){++runs;}
+    assert(runs == 1);
+
+    Triggers::ResponseCache check;
+    opened = check.open(type, false);
+    assert(opened);
+    assert(check.getHits() == 1);
+    assert(check.getMisses() == 1);
+    check.clear();
+    unlink(script.c_str());
+    unlink(counter.c_str());
+  }
+
+  std::cout << "All trigger cache tests passed" << std::endl;
+  return 0;
+}
@@ -0,0 +1,200 @@
+/// \file ts_demux.cpp
+/// Benchmark for TS demuxing: generates a multi-program TS stream with an H264 and an AAC track per
+/// program, demuxes it through TS::Stream the way the TS input does and reports the throughput.
+/// Also checks that every generated frame comes out of the demuxer exactly once.
+
+#include <mist/bitfields.h>
+#include <mist/defines.h>
+#include <mist/timing.h>
+#include <mist/ts_packet.h>
+#include <mist/ts_stream.h>
+#include <mist/util.h>
+#include <deque>
+#include <iostream>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+
+/// Appends a PSI section as a single TS packet on the given PID, calculating its CRC32.
+void writeSection(std::string &out, size_t pid, size_t cc, const std::string &section){
+  char pkt[188];
+  memset(pkt, 0xFF, 188);
+  pkt[0] = 0x47;
+  pkt[1] = 0x40 | ((pid >> 8) & 0x1F);
+  pkt[2] = pid & 0xFF;
+  pkt[3] = 0x10 | (cc & 0x0F);
+  pkt[4] = 0; // pointer field
+  memcpy(pkt + 5, section.data(), section.size());
+  uint32_t crc = checksum::crc32(-1, section.data(), section.size());
+  Bit::htobl(pkt + 5 + section.size(), crc);
+  out.append(pkt, 188);
+}
+
+/// Appends a PAT listing a PMT on PID 0x1000 + i for every program i.
+void writePAT(std::string &out, size_t programs, size_t cc){
+  std::string s;
+  size_t len = 5 + 4 * programs + 4;
+  s += (char)0x00;
+  s += (char)(0xB0 | (len >> 8));
+  s += (char)(len & 0xFF);
+  s.append("\000\001\301\000\000", 5);
+  for (size_t i = 0; i < programs; ++i){
+    s += (char)0;
+    s += (char)(i + 1);
+    s += (char)(0xE0 | ((0x1000 + i) >> 8));
+    s += (char)((0x1000 + i) & 0xFF);
+  }
+  writeSection(out, 0, cc, s);
+}
+
+/// Appends a PMT for program i, holding an H264 track on PID 0x100 + 2i and an AAC track on
+/// PID 0x101 + 2i.
+void writePMT(std::string &out, size_t i, size_t cc){
+  std::string s;
+  size_t len = 9 + 2 * 5 + 4;
+  size_t vPid = 0x100 + 2 * i;
+  s += (char)0x02;
+  s += (char)(0xB0 | (len >> 8));
+  s += (char)(len & 0xFF);
+  s += (char)0;
+  s += (char)(i + 1);
+  s.append("\301\000\000", 3);
+  s += (char)(0xE0 | (vPid >> 8));
+  s += (char)(vPid & 0xFF);
+  s.append("\360\000", 2);
+  for (size_t t = 0; t < 2; ++t){
+    s += (char)(t ? TS::AAC : TS::H264);
+    s += (char)(0xE0 | ((vPid + t) >> 8));
+    s += (char)((vPid + t) & 0xFF);
+    s.append("\360\000", 2);
+  }
+  writeSection(out, 0x1000 + i, cc, s);
+}
+
+/// Splits a PES packet over TS packets on the given PID, stuffing the last one.
+void writePES(std::string &out, size_t pid, size_t &cc, const std::string &pes){
+  TS::Packet pack;
+  const char *data = pes.data();
+  size_t dataLen = pes.size();
+  bool first = true;
+  while (dataLen){
+    pack.clear();
+    pack.setPID(pid);
+    pack.setContinuityCounter(++cc);
+    if (first){
+      pack.setUnitStart(1);
+      first = false;
+    }
+    size_t tmp = pack.fillFree(data, dataLen);
+    data += tmp;
+    dataLen -= tmp;
+    if (pack.getBytesFree()){pack.addStuffing();}
+    out.append(pack.checkAndGetBuffer(), 188);
+  }
+}
+
+/// Returns random payload bytes that never form an Annex B start code.
+std::string payload(size_t len){
+  std::string ret(len, 0);
+  for (size_t i = 0; i < len; ++i){ret[i] = (char)(0x10 | (rand() % 0xF0));}
+  return ret;
+}
+
+/// Generates the given amount of frames per program: one H264 frame (with SPS/PPS and an IDR slice
+/// every 50 frames) and one ADTS AAC frame, interleaved across programs, with a PAT and PMTs every
+/// 10 frames.
+std::string generateStream(size_t programs, size_t frames){
+  std::string out;
+  size_t patCC = 0;
+  std::deque<size_t> ccs(programs * 3, 0);
+  for (size_t f = 0; f < frames; ++f){
+    if (f % 10 == 0){
+      writePAT(out, programs, patCC++);
+      for (size_t i = 0; i < programs; ++i){writePMT(out, i, ccs[3 * i + 2]++);}
+    }
+    uint64_t pts = 90000 + f * 3600;
+    for (size_t i = 0; i < programs; ++i){
+      std::string es;
+      es.append("\000\000\000\001\011\360", 6);
+      if (f % 50 == 0){
+        es.append("\000\000\000\001\147\144\000\037\254\331\100\120\005\273\001\020", 16);
+        es.append("\000\000\000\001\150\353\343\313\042\300", 10);
+        es.append("\000\000\001\145", 4);
+        es += payload(20000);
+      }else{
+        es.append("\000\000\001\101", 4);
+        es += payload(2000 + rand() % 4000);
+      }
+      std::string pes;
+      TS::Packet::getPESVideoLeadIn(pes, es.size(), pts, 0, true);
+      writePES(out, 0x100 + 2 * i, ccs[3 * i], pes + es);
+
+      size_t aLen = 7 + 300;
+      char adts[7] ={(char)0xFF, (char)0xF1, (char)0x50, (char)(0x80 | (aLen >> 11)),
+                     (char)((aLen >> 3) & 0xFF), (char)(((aLen & 7) << 5) | 0x1F), (char)0xFC};
+      es = std::string(adts, 7) + payload(300);
+      pes.clear();
+      TS::Packet::getPESAudioLeadIn(pes, es.size(), pts, 0);
+      writePES(out, 0x101 + 2 * i, ccs[3 * i + 1], pes + es);
+    }
+  }
+  return out;
+}
+
+/// Demuxes the whole stream the way the TS input does, returning the amount of frames received.
+size_t demux(const std::string &data){
+  TS::Stream strm;
+  TS::Packet pkt;
+  DTSC::Packet out;
+  size_t frames = 0;
+  for (size_t pos = 0; pos + 188 <= data.size(); pos += 188){
+    pkt.FromPointer(data.data() + pos);
+    strm.parse(pkt, pos);
+    while (strm.hasPacket()){
+      strm.getEarliestPacket(out);
+      if (!out){break;}
+      ++frames;
+    }
+  }
+  strm.finish();
+  while (strm.hasPacket()){
+    strm.getEarliestPacket(out);
+    if (!out){break;}
+    ++frames;
+  }
+  return frames;
+}
+
+int main(int argc, char **argv){
+  Util::printDebugLevel = DLVL_WARN;
+  size_t programs = 8;
+  size_t frames = 500;
+  size_t rounds = 5;
+  if (argc > 1){programs = atoll(argv[1]);}
+  if (argc > 2){frames = atoll(argv[2]);}
+  if (argc > 3){rounds = atoll(argv[3]);}
+  // The PAT has to fit in a single TS packet
+  if (programs > 40){programs = 40;}
+  srand(42);
+
+  std::string data = generateStream(programs, frames);
+  std::cout << programs << " programs, " << frames << " frames each, " << data.size() / 188
+            << " TS packets:" << std::endl;
+
+  size_t expected = programs * frames * 2;
+  int failures = 0;
+  uint64_t start = Util::getMicros();
+  for (size_t r = 0; r < rounds; ++r){
+    size_t got = demux(data);
+    if (got != expected){
+      std::cerr << "Demuxed " << got << " frames, expected " << expected << std::endl;
+      ++failures;
+    }
+  }
+  uint64_t time = Util::getMicros(start);
+  uint64_t bytes = (uint64_t)data.size() * rounds;
+  std::cout << "  Demuxed " << bytes << " bytes in " << time << "us (" << (time ? bytes / time : 0)
+            << " MB/s, " << (time ? (uint64_t)data.size() / 188 * rounds * 1000000 / time : 0)
+            << " packets/s)" << std::endl;
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,120 @@
+/// \file ts_resync.cpp
+/// Benchmark for reading live TS data: feeds a generated TS stream with occasional junk bytes to a
+/// TS::Stream the way the TS input used to (188 bytes per read, resyncing one byte at a time) and
+/// the way it does now (large reads through TS::Assembler, resyncing with TS::findSync), and
+/// reports the throughput of both. Also checks TS::findSync against a plain byte-by-byte search.
+
+#include <mist/defines.h>
+#include <mist/timing.h>
+#include <mist/ts_packet.h>
+#include <mist/ts_stream.h>
+#include <mist/util.h>
+#include <iostream>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+
+/// Generates a TS stream of the given amount of packets, inserting a run of junk bytes after one in
+/// every junkEvery packets, if set.
+std::string generateStream(size_t packets, size_t junkEvery){
+  std::string stream;
+  char pkt[188];
+  for (size_t i = 0; i < packets; ++i){
+    pkt[0] = 0x47;
+    pkt[1] = 0x01; // PID 0x100, not in any PMT
+    pkt[2] = 0x00;
+    pkt[3] = 0x10 | (i & 0x0F);
+    for (size_t j = 4; j < 188; ++j){pkt[j] = rand() % 256;}
+    stream.append(pkt, 188);
+    if (junkEvery && i % junkEvery == junkEvery - 1){
+      size_t junk = 1 + rand() % 150;
+      for (size_t j = 0; j < junk; ++j){stream += (char)(rand() % 256);}
+    }
+  }
+  return stream;
+}
+
+/// Previous way of reading: every read is copied into a temporary buffer as URIReader does for
+/// sockets and pipes, then appended to the read buffer, which is shifted per byte to resync.
+void readOld(TS::Stream &strm, const std::string &data, size_t readSize){
+  Util::ResizeablePointer liveReadBuffer;
+  TS::Packet tsBuf;
+  for (size_t pos = 0; pos < data.size(); pos += readSize){
+    Util::ResizeablePointer buf;
+    buf.append(data.data() + pos, data.size() - pos < readSize ? data.size() - pos : readSize);
+    liveReadBuffer.append(buf, buf.size());
+    while (liveReadBuffer.size() >= 188){
+      while (liveReadBuffer[0] != 0x47 && liveReadBuffer.size() >= 188){liveReadBuffer.shift(1);}
+      if (liveReadBuffer.size() >= 188 && liveReadBuffer[0] == 0x47){
+        size_t shiftAmount = 0;
+        for (size_t offset = 0; liveReadBuffer.size() >= offset + 188; offset += 188){
+          tsBuf.FromPointer(liveReadBuffer + offset);
+          strm.add(tsBuf);
+          if (!strm.isDataTrack(tsBuf.getPID())){strm.parse(tsBuf.getPID());}
+          shiftAmount += 188;
+        }
+        liveReadBuffer.shift(shiftAmount);
+      }
+    }
+  }
+}
+
+/// Current way of reading: large reads straight into the assembler.
+void readNew(TS::Stream &strm, const std::string &data, size_t blockSize){
+  TS::Assembler assembler;
+  for (size_t pos = 0; pos < data.size(); pos += blockSize){
+    assembler.assemble(strm, data.data() + pos, data.size() - pos < blockSize ? data.size() - pos : blockSize);
+  }
+}
+
+/// Runs a single benchmark round on the given stream, printing the throughput of both methods.
+void runRound(const char *name, const std::string &data, size_t rounds){
+  uint64_t bits = (uint64_t)data.size() * 8 * rounds;
+  TS::Stream strm;
+  uint64_t start = Util::getMicros();
+  for (size_t r = 0; r < rounds; ++r){readOld(strm, data, 188);}
+  uint64_t oldTime = Util::getMicros(start);
+  start = Util::getMicros();
+  for (size_t r = 0; r < rounds; ++r){readOld(strm, data, 65536);}
+  uint64_t oldBlockTime = Util::getMicros(start);
+  start = Util::getMicros();
+  for (size_t r = 0; r < rounds; ++r){readNew(strm, data, 188 * 348);}
+  uint64_t newTime = Util::getMicros(start);
+  std::cout << "  " << name << ": " << (oldTime ? bits / oldTime : 0) << " Mbit/s before with 188 byte reads, "
+            << (oldBlockTime ? bits / oldBlockTime : 0) << " Mbit/s before with 64KiB reads, "
+            << (newTime ? bits / newTime : 0) << " Mbit/s now" << std::endl;
+}
+
+/// Compares TS::findSync with a plain search on random data with many sync bytes.
+/// Returns the amount of mismatches found.
+int checkFindSync(){
+  int failures = 0;
+  char data[1024];
+  for (size_t iter = 0; iter < 20000; ++iter){
+    size_t len = rand() % sizeof(data);
+    for (size_t i = 0; i < len; ++i){data[i] = (rand() % 4) ? 0x47 : (rand() % 256);}
+    size_t expect = len;
+    for (size_t i = 0; i < len; ++i){
+      if (data[i] == 0x47 && (i + 188 >= len || data[i + 188] == 0x47)){
+        expect = i;
+        break;
+      }
+    }
+    if (TS::findSync(data, len) != expect){++failures;}
+  }
+  if (failures){std::cerr << failures << " TS::findSync mismatches" << std::endl;}
+  return failures;
+}
+
+int main(int argc, char **argv){
+  size_t packets = 100000;
+  if (argc > 1){packets = atoll(argv[1]);}
+  srand(1);
+  Util::printDebugLevel = DLVL_WARN; // Junk data is reported at INFO level
+  int failures = checkFindSync();
+  std::cout << packets << " TS packets per round:" << std::endl;
+  runRound("Clean stream", generateStream(packets, 0), 5);
+  runRound("Junk after 1 in 1000 packets", generateStream(packets, 1000), 5);
+  runRound("Junk after 1 in 50 packets", generateStream(packets, 50), 5);
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,80 @@
+/// \file udp_batch.cpp
+/// Tests for batched UDP I/O: corked sending with and without segmentation offload, and receiving
+/// several datagrams per system call, checking that every datagram arrives intact and in order.
+
+#include <mist/socket.h>
+#include <cassert>
+#include <iostream>
+#include <string>
+
+/// Sends count datagrams of the given size through a corked socket, the last one lastSize bytes.
+void sendCorked(Socket::UDPConnection &out, size_t count, size_t size, size_t lastSize){
+  out.cork();
+  for (size_t i = 0; i < count; ++i){
+    std::string dgram((i + 1 == count) ? lastSize : size, (char)('a' + i % 26));
+    out.SendNow(dgram);
+  }
+  out.uncork();
+}
+
+/// Receives count datagrams of the given size as sent by sendCorked.
+void checkReceived(Socket::UDPConnection &in, size_t count, size_t size, size_t lastSize){
+  bool received;
+  for (size_t i = 0; i < count; ++i){
+    received = in.Receive();
+    assert(received);
+    size_t expect = (i + 1 == count) ? lastSize : size;
+    assert(in.data.size() == expect);
+    assert(std::string(in.data, in.data.size()) == std::string(expect, (char)('a' + i % 26)));
+  }
+  received = in.Receive();
+  assert(!received);
+}
+
+int main(int argc, char **argv){
+  Socket::UDPConnection in(true);
+  uint16_t port = in.bind(0, "127.0.0.1");
+  assert(port);
+  bool received;
+  in.allocateDestination();
+
+  Socket::UDPConnection out;
+  out.SetDestination("127.0.0.1", port);
+
+  // Uncorked datagrams are sent right away
+  out.SendNow("single");
+  received = in.Receive();
+  assert(received);
+  assert(std::string(in.data, in.data.size()) == "single");
+  received = in.Receive();
+  assert(!received);
+
+  // More datagrams than fit in a single batch, in both directions
+  sendCorked(out, UDP_BATCH * 2 + 5, 1316, 1316);
+  checkReceived(in, UDP_BATCH * 2 + 5, 1316, 1316);
+
+  // Differently sized datagrams
+  sendCorked(out, 10, 1200, 300);
+  checkReceived(in, 10, 1200, 300);
+
+  // Segmentation offload, if supported, must not change what arrives
+  out.setSegmentOffload(true);
+  sendCorked(out, 20, 1316, 1316);
+  checkReceived(in, 20, 1316, 1316);
+  sendCorked(out, 20, 1316, 500);
+  checkReceived(in, 20, 1316, 500);
+
+  // Replies go to the source of the datagram that was received last
+  out.bind(0, "127.0.0.1");
+  out.SetDestination("127.0.0.1", port);
+  out.SendNow("ping");
+  received = in.Receive();
+  assert(received);
+  in.SendNow("pong");
+  received = out.Receive();
+  assert(received);
+  assert(std::string(out.data, out.data.size()) == "pong");
+
+  std::cout << "All UDP batch tests passed" << std::endl;
+  return 0;
+}